@@ -0,0 +1,102 @@
+#include "ambientOcclusion.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    // how closely a sample has to agree with a pixel to be shared with it. normals within about 25 degrees, and a point
+    // within a tenth of the ray length of the pixel's tangent plane and within the ray length of the pixel itself,
+    // beyond which the occluders each sees could differ
+    const float MIN_NORMAL_AGREEMENT = 0.9;
+    const float MAX_PLANE_DISTANCE = 0.1;
+    const float MAX_SAMPLE_DISTANCE = 1;
+    // keeps a sample right on top of a pixel from shutting out the others when it is the one that does not agree
+    const float MIN_BILINEAR_WEIGHT = 0.01;
+}
+
+AmbientOcclusionBuffer::AmbientOcclusionBuffer(Util::PixelRect const& region, int divisor)
+{
+    this->region = region;
+    this->divisor = std::max(1, divisor);
+    this->width = (region.width() + this->divisor - 1) / this->divisor;
+    this->height = (region.height() + this->divisor - 1) / this->divisor;
+    this->samples.resize((size_t) std::max(0, this->width) * std::max(0, this->height));
+}
+
+int AmbientOcclusionBuffer::getDivisor() const
+{
+    return this->divisor;
+}
+
+ShadowRayStatistics AmbientOcclusionBuffer::compute(const Camera & camera, const Renderable & surface, const RenderContext & context, int threadCount)
+{
+    this->maxDistance = context.ambientOcclusionDistance;
+    std::vector<ShadowRayStatistics> threadStatistics(threadCount);
+    Util::parallelFor(this->samples.size(), 64, threadCount, [&](size_t begin, size_t end, int threadIndex)
+    {
+        RenderContext sampleContext = context;
+        sampleContext.shadowRayStatistics = &threadStatistics[threadIndex];
+        sampleContext.dependencies = NULL;
+        std::shared_ptr<Util::HitRecord> hitRecord(new Util::HitRecord);
+        for (size_t s = begin; s < end; s++)
+        {
+            const int x = std::min(this->region.x0 + (int) (s % this->width) * this->divisor + this->divisor / 2, this->region.x1 - 1);
+            const int y = std::min(this->region.y0 + (int) (s / this->width) * this->divisor + this->divisor / 2, this->region.y1 - 1);
+            const Math::Ray viewRay = camera.computeViewingRay(x, y);
+            Sample & sample = this->samples[s];
+            sample.hit = surface.hit(viewRay, 0, std::numeric_limits<float>::max(), hitRecord);
+            if (!sample.hit) { continue; }
+
+            // keyed like the pixel itself, so a pixel that lands right on its sample gets the same rays either way
+            sampleContext.pixelIndex = y * context.resolutionX + x;
+            sampleContext.bounce = 0;
+            sample.point = hitRecord->intersectionPoint;
+            sample.unitNormal = Math::dot(hitRecord->unitNormal, viewRay.direction) > 0 ? -hitRecord->unitNormal : hitRecord->unitNormal;
+            sample.visibility = sampleContext.traceAmbientOcclusion(surface, sample.point, sample.unitNormal);
+        }
+    });
+
+    ShadowRayStatistics statistics;
+    for (auto & threadStatistic : threadStatistics)
+    {
+        statistics.add(threadStatistic);
+    }
+    return statistics;
+}
+
+float AmbientOcclusionBuffer::lookup(int x, int y, Math::Vector3 point, Math::Vector3 unitNormal) const
+{
+    if (this->samples.empty() || !this->region.contains(x, y)) { return -1; }
+
+    // where the pixel falls between the block centers
+    const float blockX = (float) (x - this->region.x0 - this->divisor / 2) / this->divisor;
+    const float blockY = (float) (y - this->region.y0 - this->divisor / 2) / this->divisor;
+    const int blockX0 = std::min(std::max((int) std::floor(blockX), 0), this->width - 1);
+    const int blockY0 = std::min(std::max((int) std::floor(blockY), 0), this->height - 1);
+    const float fractionX = std::min(std::max(blockX - blockX0, 0.0f), 1.0f);
+    const float fractionY = std::min(std::max(blockY - blockY0, 0.0f), 1.0f);
+
+    float weightedVisibility = 0, totalWeight = 0;
+    for (int k = 0; k < 4; k++)
+    {
+        const int sampleX = std::min(blockX0 + (k & 1), this->width - 1);
+        const int sampleY = std::min(blockY0 + (k >> 1), this->height - 1);
+        const Sample & sample = this->samples[sampleY * this->width + sampleX];
+        if (!sample.hit) { continue; }
+
+        const float normalAgreement = Math::dot(unitNormal, sample.unitNormal);
+        if (normalAgreement < MIN_NORMAL_AGREEMENT) { continue; }
+        const Math::Vector3 offset = sample.point - point;
+        const float planeDistance = std::abs(Math::dot(unitNormal, offset)) / (MAX_PLANE_DISTANCE * this->maxDistance);
+        if (planeDistance >= 1 || offset.norm() > MAX_SAMPLE_DISTANCE * this->maxDistance) { continue; }
+
+        const float bilinearWeight = ((k & 1) ? fractionX : 1 - fractionX) * ((k >> 1) ? fractionY : 1 - fractionY);
+        const float weight = (bilinearWeight + MIN_BILINEAR_WEIGHT) * normalAgreement * (1 - planeDistance);
+        weightedVisibility += weight * sample.visibility;
+        totalWeight += weight;
+    }
+    if (totalWeight <= 0) { return -1; }
+    return weightedVisibility / totalWeight;
+}
@@ -0,0 +1,46 @@
+#ifndef AMBIENT_OCCLUSION_HEADER
+#define AMBIENT_OCCLUSION_HEADER
+
+#include <vector>
+#include "math.h"
+#include "camera.h"
+#include "hittable.h"
+#include "renderContext.h"
+#include "tiling.h"
+
+// ambient occlusion traced at reduced resolution: once at the center pixel of every divisor x divisor block of a
+// region, then shared with the pixels around it. a pixel takes the samples of the four blocks nearest to it, weighted
+// by distance and by how well each sample lies on the pixel's own surface, so occlusion does not bleed across
+// silhouettes and creases. a pixel with no such sample traces its own rays
+class AmbientOcclusionBuffer
+{
+public:
+    AmbientOcclusionBuffer(Util::PixelRect const& region, int divisor);
+
+    int getDivisor() const;
+
+    // traces the view ray of every block center through camera and the ambient occlusion rays of its hit, as set in
+    // context. returns the rays traced
+    ShadowRayStatistics compute(const Camera & camera, const Renderable & surface, const RenderContext & context, int threadCount);
+
+    // the occlusion at pixel (x, y), whose view ray hit point with unitNormal facing the camera. -1 when none of the
+    // nearest samples lies on the same surface
+    float lookup(int x, int y, Math::Vector3 point, Math::Vector3 unitNormal) const;
+
+private:
+    struct Sample
+    {
+        Math::Vector3 point;
+        Math::Vector3 unitNormal; // facing the camera
+        float visibility;
+        bool hit = false;
+    };
+
+    Util::PixelRect region;
+    int divisor;
+    int width, height; // in blocks
+    float maxDistance = 1;
+    std::vector<Sample> samples;
+};
+
+#endif
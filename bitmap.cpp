@@ -0,0 +1,65 @@
+#include "bitmap.h"
+#include <fstream>
+
+// https://stackoverflow.com/a/47785639/21190150
+
+std::string Bitmap::computeHeaders(int width, int height)
+{
+    int fileSize = FILE_HEADER_SIZE + INFO_HEADER_SIZE + (computeScanLineSize(width) * height);
+
+    // create file header
+    std::string fileHeader = std::string(FILE_HEADER_SIZE, (char) 0);
+    fileHeader.replace(0, 1, 1, 'B');
+    fileHeader.replace(1, 1, 1, 'M');
+    fileHeader.replace(2, 1, 1, (char) fileSize);
+    fileHeader.replace(3, 1, 1, (char) (fileSize >> 8));
+    fileHeader.replace(4, 1, 1, (char) (fileSize >> 16));
+    fileHeader.replace(5, 1, 1, (char) (fileSize >> 24));
+    fileHeader.replace(10, 1, 1, (char) (FILE_HEADER_SIZE + INFO_HEADER_SIZE));
+
+    // create info header
+    std::string infoHeader = std::string(INFO_HEADER_SIZE, 0);
+    infoHeader.replace(0, 1, 1, INFO_HEADER_SIZE);
+    infoHeader.replace(4, 1, 1, (char) width);
+    infoHeader.replace(5, 1, 1, (char) (width >> 8));
+    infoHeader.replace(6, 1, 1, (char) (width >> 16));
+    infoHeader.replace(7, 1, 1, (char) (width >> 24));
+    infoHeader.replace(8, 1, 1, (char) height);
+    infoHeader.replace(9, 1, 1, (char) (height >> 8));
+    infoHeader.replace(10, 1, 1, (char) (height >> 16));
+    infoHeader.replace(11, 1, 1, (char) (height >> 24));
+    infoHeader.replace(12, 1, 1, (char) 1);
+    infoHeader.replace(14, 1, 1, (char) (BYTES_PER_PIXEL * 8));
+
+    return fileHeader + infoHeader;
+}
+
+int Bitmap::computeScanLineSize(int width)
+{
+    int widthInBytes = width * BYTES_PER_PIXEL;
+    return widthInBytes + (4 - (widthInBytes % 4)) % 4;
+}
+
+std::string Bitmap::encode(int width, int height, std::string const& pixelArray)
+{
+    const int widthInBytes = width * BYTES_PER_PIXEL;
+    const int scanLineSize = computeScanLineSize(width);
+    std::string file = computeHeaders(width, height);
+    const size_t pixelArrayOffset = file.size();
+    file.resize(pixelArrayOffset + (size_t) scanLineSize * height, 0);
+    for (int i = 0; i < height; i++)
+    {
+        file.replace(pixelArrayOffset + (size_t) i * scanLineSize, widthInBytes, pixelArray, (size_t) i * widthInBytes, widthInBytes);
+    }
+    return file;
+}
+
+bool Bitmap::write(std::string const& filename, int width, int height, std::string const& pixelArray)
+{
+    const std::string contents = encode(width, height, pixelArray);
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) { return false; }
+    file.write(contents.c_str(), contents.size());
+    file.close();
+    return !file.fail();
+}
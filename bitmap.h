@@ -0,0 +1,23 @@
+#ifndef BITMAP_HEADER
+#define BITMAP_HEADER
+
+#include <string>
+
+// uncompressed 24 bit bmp files. a pixel array is what Scene::computePixelArray returns: bottom up rows of blue, green
+// and red bytes without padding
+namespace Bitmap
+{
+    const int BYTES_PER_PIXEL = 3;
+    const int FILE_HEADER_SIZE = 14;
+    const int INFO_HEADER_SIZE = 40;
+
+    std::string computeHeaders(int width, int height); // the file and info headers
+    int computeScanLineSize(int width); // the bytes of a row in the file, padded to a multiple of 4
+
+    // the whole file: headers followed by the padded rows
+    std::string encode(int width, int height, std::string const& pixelArray);
+    // false if the file cannot be written
+    bool write(std::string const& filename, int width, int height, std::string const& pixelArray);
+}
+
+#endif
@@ -2,9 +2,36 @@
 #include "math.h"
 #include <iostream>
 #include <assert.h>
+#include <algorithm>
 
 using namespace Math;
 
+namespace
+{
+    // type tags of the serialized cameras
+    const uint8_t PARALLEL_ORTHOGRAPHIC_CAMERA = 1;
+    const uint8_t PERSPECTIVE_CAMERA = 2;
+    // the keywords of the text format, indexed by type tag
+    const char * const CAMERA_TYPE_NAMES[] = { "", "orthographicCamera", "perspectiveCamera" };
+    const size_t CAMERA_TYPE_COUNT = sizeof(CAMERA_TYPE_NAMES) / sizeof(CAMERA_TYPE_NAMES[0]);
+
+    // the tile loop shared by the cameras. it is instantiated once per camera type so the per pixel ray is inlined
+    template <typename CameraType>
+    void fillViewingRays(const CameraType & camera, int x0, int y0, int x1, int y1, Ray * rays)
+    {
+        assert ((x0 >= 0) && (x1 <= camera.getResolutionX()) && (x0 <= x1));
+        assert ((y0 >= 0) && (y1 <= camera.getResolutionY()) && (y0 <= y1));
+
+        for (int j = y0; j < y1; j++)
+        {
+            for (int i = x0; i < x1; i++)
+            {
+                *rays++ = camera.viewingRay(i, j);
+            }
+        }
+    }
+}
+
 Camera::Camera()
 {
     this->resolutionX = 64;
@@ -17,6 +44,7 @@ Camera::Camera()
     this->rightBound = 1;
     this->topBound = 1;
     this->bottomBound = -1;
+    this->updateOffsetTables();
 };
 
 Camera::Camera(Vector3 viewPoint, Vector3 u, Vector3 v, Vector3 w, int resolutionX, int resolutionY, float leftBound, float rightBound, float topBound, float bottomBound)
@@ -33,6 +61,7 @@ Camera::Camera(Vector3 viewPoint, Vector3 u, Vector3 v, Vector3 w, int resolutio
     this->rightBound = rightBound;
     this->topBound = topBound;
     this->bottomBound = bottomBound;
+    this->updateOffsetTables();
 };
 
 Camera::Camera(Vector3 viewPoint, Vector3 viewingDirection, int resolutionX, int resolutionY, float leftBound, float rightBound, float topBound, float bottomBound)
@@ -42,11 +71,11 @@ Camera::Camera(Vector3 viewPoint, Vector3 viewingDirection, int resolutionX, int
     this->resolutionX = resolutionX;
     this->resolutionY = resolutionY;
     this->viewPoint = viewPoint;
-    this->setOrientation(viewingDirection);
     this->leftBound = leftBound;
     this->rightBound = rightBound;
     this->topBound = topBound;
     this->bottomBound = bottomBound;
+    this->setOrientation(viewingDirection); // also fills the offset tables, so it goes after the bounds
 };
 
 int Camera::getResolutionX() const
@@ -68,6 +97,7 @@ void Camera::setResolution(int resolutionX, int resolutionY)
 {
     this->resolutionX = resolutionX;
     this->resolutionY = resolutionY;
+    this->updateOffsetTables();
 };
 
 void Camera::setOrientation(Math::Vector3 u, Math::Vector3 v, Math::Vector3 w)
@@ -75,6 +105,7 @@ void Camera::setOrientation(Math::Vector3 u, Math::Vector3 v, Math::Vector3 w)
     this->u = Math::Vector3(u);
     this->v = Math::Vector3(v);
     this->w = Math::Vector3(w);
+    this->updateOffsetTables();
 };
 
 void Camera::setOrientation(Math::Vector3 viewingDirection)
@@ -88,6 +119,7 @@ void Camera::setOrientation(Math::Vector3 viewingDirection)
     this->u = u;
     this->v = v;
     this->w = w;
+    this->updateOffsetTables();
 };
 
 void Camera::setBounds(float leftBound, float rightBound, float topBound, float bottomBound)
@@ -98,6 +130,104 @@ void Camera::setBounds(float leftBound, float rightBound, float topBound, float
     this->rightBound = rightBound;
     this->topBound = topBound;
     this->bottomBound = bottomBound;
+    this->updateOffsetTables();
+};
+
+void Camera::updateOffsetTables()
+{
+    this->columnOffsets.resize(std::max(0, this->resolutionX));
+    for (int i = 0; i < this->resolutionX; i++)
+    {
+        const float uCoordinate = this->leftBound + (this->rightBound - this->leftBound) * (i + 0.5) / this->resolutionX;
+        this->columnOffsets[i] = uCoordinate * this->u;
+    }
+
+    this->rowOffsets.resize(std::max(0, this->resolutionY));
+    for (int j = 0; j < this->resolutionY; j++)
+    {
+        const float vCoordinate = this->bottomBound + (this->topBound - this->bottomBound) * (j + 0.5) / this->resolutionY;
+        this->rowOffsets[j] = vCoordinate * this->v;
+    }
+};
+
+Math::Vector3 Camera::computeSubpixelOffset(float offsetX, float offsetY) const
+{
+    return (offsetX * (this->rightBound - this->leftBound) / this->resolutionX) * this->u
+        + (offsetY * (this->topBound - this->bottomBound) / this->resolutionY) * this->v;
+}
+
+Ray Camera::computeViewingRay(int pixelIndexX, int pixelIndexY, Util::RayDifferential & differential) const
+{
+    differential = this->computeRayDifferential();
+    return this->computeViewingRay(pixelIndexX, pixelIndexY);
+}
+
+std::unique_ptr<Camera> Camera::deserialize(Serialization::Reader & reader)
+{
+    std::unique_ptr<Camera> camera;
+    const uint8_t type = reader.readType(CAMERA_TYPE_NAMES, CAMERA_TYPE_COUNT);
+    if (type == PARALLEL_ORTHOGRAPHIC_CAMERA)
+    {
+        camera = std::unique_ptr<Camera>(new ParallelOrthographicCamera());
+        camera->deserializeFrame(reader);
+    }
+    else if (type == PERSPECTIVE_CAMERA)
+    {
+        PerspectiveCamera * perspectiveCamera = new PerspectiveCamera();
+        camera = std::unique_ptr<Camera>(perspectiveCamera);
+        perspectiveCamera->deserializeFrame(reader);
+        perspectiveCamera->setFocalLength(reader.readFloat("focalLength"));
+    }
+
+    if (camera == NULL) { reader.fail(); }
+    if (!reader.isOk()) { return NULL; }
+    return camera;
+};
+
+void Camera::serializeFrame(Serialization::Writer & writer) const
+{
+    writer.writeVector3("viewPoint", this->viewPoint);
+    writer.writeVector3("u", this->u);
+    writer.writeVector3("v", this->v);
+    writer.writeVector3("w", this->w);
+    writer.writeInt32("resolutionX", this->resolutionX);
+    writer.writeInt32("resolutionY", this->resolutionY);
+    writer.writeFloat("leftBound", this->leftBound);
+    writer.writeFloat("rightBound", this->rightBound);
+    writer.writeFloat("topBound", this->topBound);
+    writer.writeFloat("bottomBound", this->bottomBound);
+};
+
+void Camera::deserializeFrame(Serialization::Reader & reader)
+{
+    const Vector3 viewPoint = reader.readVector3("viewPoint");
+    const Vector3 u = reader.readVector3("u");
+    const Vector3 v = reader.readVector3("v");
+    const Vector3 w = reader.readVector3("w");
+    const int resolutionX = reader.readInt32("resolutionX");
+    const int resolutionY = reader.readInt32("resolutionY");
+    const float leftBound = reader.readFloat("leftBound");
+    const float rightBound = reader.readFloat("rightBound");
+    const float topBound = reader.readFloat("topBound");
+    const float bottomBound = reader.readFloat("bottomBound");
+
+    // the setters assert on bad bounds, and a huge resolution would allocate huge offset tables
+    const int maxResolution = 1 << 16;
+    if (!(leftBound < 0 && rightBound > 0 && bottomBound < 0 && topBound > 0)
+        || resolutionX <= 0 || resolutionY <= 0 || resolutionX > maxResolution || resolutionY > maxResolution)
+    {
+        reader.fail();
+    }
+    if (!reader.isOk()) { return; }
+
+    this->viewPoint = viewPoint;
+    this->resolutionX = resolutionX;
+    this->resolutionY = resolutionY;
+    this->leftBound = leftBound;
+    this->rightBound = rightBound;
+    this->topBound = topBound;
+    this->bottomBound = bottomBound;
+    this->setOrientation(u, v, w);
 };
 
 Ray ParallelOrthographicCamera::computeViewingRay(int pixelIndexX, int pixelIndexY) const
@@ -105,18 +235,38 @@ Ray ParallelOrthographicCamera::computeViewingRay(int pixelIndexX, int pixelInde
     assert ((pixelIndexX >= 0) && (pixelIndexX < this->resolutionX));
     assert ((pixelIndexY >= 0) && (pixelIndexY < this->resolutionY));
 
-    const float uCoordinate = this->leftBound + (this->rightBound - this->leftBound) * (pixelIndexX + 0.5) / this->resolutionX;
-    const float vCoordinate = this->bottomBound + (this->topBound - this->bottomBound) * (pixelIndexY + 0.5) / this->resolutionY;
-
-    Ray ray;
-    ray.direction = -this->w;
-    ray.origin = this->viewPoint + (uCoordinate * this->u) + (vCoordinate * this->v);
+    return this->viewingRay(pixelIndexX, pixelIndexY);
+};
 
+Ray ParallelOrthographicCamera::computeJitteredViewingRay(int pixelIndexX, int pixelIndexY, float offsetX, float offsetY) const
+{
+    Ray ray = this->computeViewingRay(pixelIndexX, pixelIndexY);
+    ray.origin = ray.origin + this->computeSubpixelOffset(offsetX, offsetY);
     return ray;
+}
+
+Util::RayDifferential ParallelOrthographicCamera::computeRayDifferential() const
+{
+    return { this->computeSubpixelOffset(1, 0), this->computeSubpixelOffset(0, 1), { 0, 0, 0 }, { 0, 0, 0 } };
+}
+
+float ParallelOrthographicCamera::computePixelWidth(Math::Box const&) const
+{
+    return std::min(this->computeSubpixelOffset(1, 0).norm(), this->computeSubpixelOffset(0, 1).norm());
+}
+
+void ParallelOrthographicCamera::computeViewingRays(int x0, int y0, int x1, int y1, Ray * rays) const
+{
+    fillViewingRays(*this, x0, y0, x1, y1, rays);
 };
 
-PerspectiveCamera::PerspectiveCamera(){};
+void ParallelOrthographicCamera::serialize(Serialization::Writer & writer) const
+{
+    writer.writeType(PARALLEL_ORTHOGRAPHIC_CAMERA, CAMERA_TYPE_NAMES);
+    this->serializeFrame(writer);
+};
 
+PerspectiveCamera::PerspectiveCamera(){};
 PerspectiveCamera::PerspectiveCamera(Vector3 viewPoint, Vector3 u, Vector3 v, Vector3 w, int resolutionX, int resolutionY, float leftBound, float rightBound, float topBound, float bottomBound, float focalLength)
     : Camera(viewPoint, u, v, w, resolutionX, resolutionY, leftBound, rightBound, topBound, bottomBound)
 {
@@ -129,6 +279,11 @@ PerspectiveCamera::PerspectiveCamera(Vector3 viewPoint, Vector3 viewingDirection
     this->focalLength = focalLength;
 };
 
+float PerspectiveCamera::getFocalLength() const
+{
+    return this->focalLength;
+};
+
 void PerspectiveCamera::setFocalLength(float focalLength)
 {
     this->focalLength = focalLength;
@@ -139,12 +294,41 @@ Ray PerspectiveCamera::computeViewingRay(int pixelIndexX, int pixelIndexY) const
     assert ((pixelIndexX >= 0) && (pixelIndexX < this->resolutionX));
     assert ((pixelIndexY >= 0) && (pixelIndexY < this->resolutionY));
 
-    const float uCoordinate = this->leftBound + (this->rightBound - this->leftBound) * (pixelIndexX + 0.5) / this->resolutionX;
-    const float vCoordinate = this->bottomBound + (this->topBound - this->bottomBound) * (pixelIndexY + 0.5) / this->resolutionY;
-
-    Ray ray;
-    ray.origin = this->viewPoint;
-    ray.direction = -(this->focalLength * this->w) + (uCoordinate * this->u) + (vCoordinate * this->v);
+    return this->viewingRay(pixelIndexX, pixelIndexY);
+}
 
+Ray PerspectiveCamera::computeJitteredViewingRay(int pixelIndexX, int pixelIndexY, float offsetX, float offsetY) const
+{
+    Ray ray = this->computeViewingRay(pixelIndexX, pixelIndexY);
+    ray.direction = ray.direction + this->computeSubpixelOffset(offsetX, offsetY);
     return ray;
 }
+
+Util::RayDifferential PerspectiveCamera::computeRayDifferential() const
+{
+    return { { 0, 0, 0 }, { 0, 0, 0 }, this->computeSubpixelOffset(1, 0), this->computeSubpixelOffset(0, 1) };
+}
+
+float PerspectiveCamera::computePixelWidth(Math::Box const& bounds) const
+{
+    // the pixel is the narrower of its sides, which lie focalLength away from the view point
+    const float pixelWidth = std::min(this->computeSubpixelOffset(1, 0).norm(), this->computeSubpixelOffset(0, 1).norm());
+    const Vector3 closest = {
+        std::min(std::max(this->viewPoint.getX(), bounds.min.getX()), bounds.max.getX()),
+        std::min(std::max(this->viewPoint.getY(), bounds.min.getY()), bounds.max.getY()),
+        std::min(std::max(this->viewPoint.getZ(), bounds.min.getZ()), bounds.max.getZ())
+    };
+    return pixelWidth * (closest - this->viewPoint).norm() / this->focalLength;
+}
+
+void PerspectiveCamera::computeViewingRays(int x0, int y0, int x1, int y1, Ray * rays) const
+{
+    fillViewingRays(*this, x0, y0, x1, y1, rays);
+}
+
+void PerspectiveCamera::serialize(Serialization::Writer & writer) const
+{
+    writer.writeType(PERSPECTIVE_CAMERA, CAMERA_TYPE_NAMES);
+    this->serializeFrame(writer);
+    writer.writeFloat("focalLength", this->focalLength);
+}
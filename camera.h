@@ -2,6 +2,10 @@
 #define CAMERA_HEADER
 
 #include "math.h"
+#include "rayDifferential.h"
+#include "serialization.h"
+#include <memory>
+#include <vector>
 
 class Camera
 {
@@ -22,8 +26,31 @@ public:
     void setBounds(float leftBound, float rightBound, float topBound, float bottomBound);
 
     virtual Math::Ray computeViewingRay(int pixelIndexX, int pixelIndexY) const = 0;
+    // writes the view rays of the pixels in [x0, x1) x [y0, y1) to rays row by row, one virtual call per tile
+    virtual void computeViewingRays(int x0, int y0, int x1, int y1, Math::Ray * rays) const = 0;
+    // the view ray through the point offsetX and offsetY pixel widths off the center of the pixel, for antialiasing
+    virtual Math::Ray computeJitteredViewingRay(int pixelIndexX, int pixelIndexY, float offsetX, float offsetY) const = 0;
+    // how the view ray changes from one pixel to the next. the same for every pixel of these cameras
+    virtual Util::RayDifferential computeRayDifferential() const = 0;
+    // the width one pixel covers at the point of bounds closest to the view point, for picking a level of detail
+    virtual float computePixelWidth(Math::Box const& bounds) const = 0;
+    // the view ray of the pixel along with its differential
+    Math::Ray computeViewingRay(int pixelIndexX, int pixelIndexY, Util::RayDifferential & differential) const;
+
+    virtual void serialize(Serialization::Writer & writer) const = 0;
+    static std::unique_ptr<Camera> deserialize(Serialization::Reader & reader); // NULL if the reader does not hold a camera
 
 protected:
+    void serializeFrame(Serialization::Writer & writer) const; // everything but the projection
+    void deserializeFrame(Serialization::Reader & reader);
+
+    void updateOffsetTables(); // must run whenever the resolution, orientation or bounds change
+    Math::Vector3 computeSubpixelOffset(float offsetX, float offsetY) const; // offsetX and offsetY pixels along u and v
+
+    // the u and v parts of the offset from the view point to each pixel, so ray generation needs no division
+    std::vector<Math::Vector3> columnOffsets; // uCoordinate * u for every pixel column
+    std::vector<Math::Vector3> rowOffsets; // vCoordinate * v for every pixel row
+
     int resolutionX, resolutionY;
     Math::Vector3 viewPoint; // labeled e in the text
     // orthonormal basis of the camera
@@ -35,7 +62,19 @@ protected:
 class ParallelOrthographicCamera: public Camera
 {
 public:
+    using Camera::computeViewingRay;
     Math::Ray computeViewingRay(int pixelIndexX, int pixelIndexY) const;
+    void computeViewingRays(int x0, int y0, int x1, int y1, Math::Ray * rays) const;
+    Math::Ray computeJitteredViewingRay(int pixelIndexX, int pixelIndexY, float offsetX, float offsetY) const;
+    Util::RayDifferential computeRayDifferential() const; // the origin moves, the direction stays
+    float computePixelWidth(Math::Box const& bounds) const; // the same at any distance
+    void serialize(Serialization::Writer & writer) const;
+
+    // unchecked and non virtual so that the batch loop can inline it
+    Math::Ray viewingRay(int pixelIndexX, int pixelIndexY) const
+    {
+        return { this->viewPoint + this->columnOffsets[pixelIndexX] + this->rowOffsets[pixelIndexY], -this->w };
+    }
 };
 
 class PerspectiveCamera: public Camera
@@ -45,9 +84,23 @@ public:
     PerspectiveCamera(Math::Vector3 viewPoint, Math::Vector3 u, Math::Vector3 v, Math::Vector3 w, int resolutionX, int resolutionY, float leftBound, float rightBound, float topBound, float bottomBound, float focalLength);
     PerspectiveCamera(Math::Vector3 viewPoint, Math::Vector3 viewingDirection, int resolutionX, int resolutionY, float leftBound, float rightBound, float topBound, float bottomBound, float focalLength);
 
+    float getFocalLength() const;
+
     void setFocalLength(float focalLength);
 
+    using Camera::computeViewingRay;
     Math::Ray computeViewingRay(int pixelIndexX, int pixelIndexY) const;
+    void computeViewingRays(int x0, int y0, int x1, int y1, Math::Ray * rays) const;
+    Math::Ray computeJitteredViewingRay(int pixelIndexX, int pixelIndexY, float offsetX, float offsetY) const;
+    Util::RayDifferential computeRayDifferential() const; // the direction turns, the origin stays
+    float computePixelWidth(Math::Box const& bounds) const; // grows with the distance, zero inside bounds
+    void serialize(Serialization::Writer & writer) const;
+
+    // unchecked and non virtual so that the batch loop can inline it
+    Math::Ray viewingRay(int pixelIndexX, int pixelIndexY) const
+    {
+        return { this->viewPoint, -(this->focalLength * this->w) + this->columnOffsets[pixelIndexX] + this->rowOffsets[pixelIndexY] };
+    }
 
 protected:
     float focalLength = 0;
@@ -0,0 +1,532 @@
+#include "deflate.h"
+#include "parallel.h"
+#include <algorithm>
+#include <queue>
+#include <utility>
+
+namespace
+{
+    const int WINDOW_SIZE = 32768;
+    const int MIN_MATCH = 3;
+    const int MAX_MATCH = 258;
+    const int HASH_BITS = 15;
+    const size_t SYMBOLS_PER_BLOCK = 1 << 15;
+    const size_t MAX_STORED_BLOCK_SIZE = 65535;
+    const uint32_t ADLER_BASE = 65521;
+
+    const int LITERAL_LENGTH_CODE_COUNT = 286;
+    const int DISTANCE_CODE_COUNT = 30;
+    const int CODE_LENGTH_CODE_COUNT = 19;
+    const int END_OF_BLOCK = 256;
+
+    const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const uint8_t LENGTH_EXTRA_BITS[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const uint8_t DISTANCE_EXTRA_BITS[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    const uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    // a literal byte when distance is 0, a match of length value otherwise
+    struct Symbol
+    {
+        uint16_t value;
+        uint16_t distance;
+    };
+
+    // packs bits least significant first, as deflate wants them
+    class BitWriter
+    {
+    public:
+        BitWriter(std::string & output)
+            : output(output) {}
+
+        void write(uint32_t bits, int count)
+        {
+            this->buffer |= (uint64_t) bits << this->bitCount;
+            this->bitCount += count;
+            while (this->bitCount >= 8)
+            {
+                this->output.push_back((char) this->buffer);
+                this->buffer >>= 8;
+                this->bitCount -= 8;
+            }
+        }
+
+        void align()
+        {
+            if (this->bitCount > 0) { this->write(0, 8 - this->bitCount); }
+        }
+
+    private:
+        std::string & output;
+        uint64_t buffer = 0;
+        int bitCount = 0;
+    };
+
+    int findLengthCode(int length)
+    {
+        return (int) (std::upper_bound(LENGTH_BASE, LENGTH_BASE + 29, length) - LENGTH_BASE) - 1;
+    }
+
+    int findDistanceCode(int distance)
+    {
+        return (int) (std::upper_bound(DISTANCE_BASE, DISTANCE_BASE + 30, distance) - DISTANCE_BASE) - 1;
+    }
+
+    uint32_t hash(const uint8_t *bytes)
+    {
+        const uint32_t key = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+        return (key * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // inflaters reject a tree with a single code, so every tree gets at least two
+    void ensureTwoCodes(std::vector<uint32_t> & frequencies)
+    {
+        int usedCount = (int) std::count_if(frequencies.begin(), frequencies.end(), [](uint32_t frequency) { return frequency > 0; });
+        for (size_t i = 0; usedCount < 2; i++)
+        {
+            if (frequencies[i] == 0)
+            {
+                frequencies[i] = 1;
+                usedCount++;
+            }
+        }
+    }
+
+    // huffman code lengths for frequencies, none longer than maxLength
+    std::vector<uint8_t> computeCodeLengths(std::vector<uint32_t> const& frequencies, int maxLength)
+    {
+        std::vector<uint8_t> lengths(frequencies.size(), 0);
+        std::vector<int> usedSymbols;
+        for (size_t symbol = 0; symbol < frequencies.size(); symbol++)
+        {
+            if (frequencies[symbol] > 0) { usedSymbols.push_back((int) symbol); }
+        }
+        const int leafCount = (int) usedSymbols.size();
+        if (leafCount == 0) { return lengths; }
+        if (leafCount == 1)
+        {
+            lengths[usedSymbols[0]] = 1;
+            return lengths;
+        }
+
+        // the leaves are nodes [0, leafCount) and every merge adds a node past them, so parents come after children
+        std::vector<int> parents(2 * leafCount - 1, -1);
+        std::priority_queue<std::pair<uint64_t, int>, std::vector<std::pair<uint64_t, int>>, std::greater<std::pair<uint64_t, int>>> queue;
+        for (int leaf = 0; leaf < leafCount; leaf++)
+        {
+            queue.push({ frequencies[usedSymbols[leaf]], leaf });
+        }
+        int nextNode = leafCount;
+        while (queue.size() > 1)
+        {
+            const std::pair<uint64_t, int> first = queue.top();
+            queue.pop();
+            const std::pair<uint64_t, int> second = queue.top();
+            queue.pop();
+            parents[first.second] = nextNode;
+            parents[second.second] = nextNode;
+            queue.push({ first.first + second.first, nextNode++ });
+        }
+
+        std::vector<int> depths(2 * leafCount - 1, 0);
+        std::vector<int> lengthCounts(leafCount + 1, 0);
+        for (int node = 2 * leafCount - 3; node >= 0; node--)
+        {
+            depths[node] = depths[parents[node]] + 1;
+            if (node < leafCount) { lengthCounts[depths[node]]++; }
+        }
+
+        // codes too long move up to maxLength, then the shortest codes that can lengthen do until the code fits again
+        std::vector<int> limitedCounts(maxLength + 1, 0);
+        for (int length = 1; length <= leafCount; length++)
+        {
+            limitedCounts[std::min(length, maxLength)] += lengthCounts[length];
+        }
+        uint32_t kraftSum = 0;
+        for (int length = 1; length <= maxLength; length++)
+        {
+            kraftSum += (uint32_t) limitedCounts[length] << (maxLength - length);
+        }
+        while (kraftSum > (1u << maxLength))
+        {
+            limitedCounts[maxLength]--;
+            for (int length = maxLength - 1; length > 0; length--)
+            {
+                if (limitedCounts[length] > 0)
+                {
+                    limitedCounts[length]--;
+                    limitedCounts[length + 1] += 2;
+                    break;
+                }
+            }
+            kraftSum--;
+        }
+
+        // the most frequent symbols take the shortest codes
+        std::stable_sort(usedSymbols.begin(), usedSymbols.end(), [&](int a, int b) { return frequencies[a] > frequencies[b]; });
+        int length = 1;
+        for (int symbol : usedSymbols)
+        {
+            while (limitedCounts[length] == 0) { length++; }
+            lengths[symbol] = length;
+            limitedCounts[length]--;
+        }
+        return lengths;
+    }
+
+    // the canonical codes for lengths, bit reversed for BitWriter
+    std::vector<uint16_t> computeCodes(std::vector<uint8_t> const& lengths)
+    {
+        int lengthCounts[16] = { 0 };
+        for (uint8_t length : lengths) { lengthCounts[length]++; }
+        lengthCounts[0] = 0;
+        uint32_t nextCodes[16] = { 0 };
+        uint32_t code = 0;
+        for (int length = 1; length < 16; length++)
+        {
+            code = (code + lengthCounts[length - 1]) << 1;
+            nextCodes[length] = code;
+        }
+
+        std::vector<uint16_t> codes(lengths.size(), 0);
+        for (size_t symbol = 0; symbol < lengths.size(); symbol++)
+        {
+            const int length = lengths[symbol];
+            if (length == 0) { continue; }
+            uint32_t bits = nextCodes[length]++, reversed = 0;
+            for (int i = 0; i < length; i++, bits >>= 1)
+            {
+                reversed = (reversed << 1) | (bits & 1);
+            }
+            codes[symbol] = (uint16_t) reversed;
+        }
+        return codes;
+    }
+
+    void writeStoredBlocks(BitWriter & writer, const char *data, size_t size, bool final)
+    {
+        size_t offset = 0;
+        do
+        {
+            const size_t blockSize = std::min(size - offset, MAX_STORED_BLOCK_SIZE);
+            writer.write(final && offset + blockSize == size ? 1 : 0, 1);
+            writer.write(0, 2);
+            writer.align();
+            writer.write((uint32_t) blockSize, 16);
+            writer.write((uint32_t) ~blockSize & 0xFFFF, 16);
+            for (size_t i = 0; i < blockSize; i++)
+            {
+                writer.write((uint8_t) data[offset + i], 8);
+            }
+            offset += blockSize;
+        } while (offset < size);
+    }
+
+    // one block of symbols with its own dynamic huffman trees, or stored if that comes out smaller. data holds the
+    // bytes the symbols stand for
+    void writeBlock(BitWriter & writer, std::vector<Symbol> const& symbols, const char *data, size_t size, bool final)
+    {
+        std::vector<uint32_t> literalFrequencies(LITERAL_LENGTH_CODE_COUNT, 0), distanceFrequencies(DISTANCE_CODE_COUNT, 0);
+        for (Symbol const& symbol : symbols)
+        {
+            if (symbol.distance == 0)
+            {
+                literalFrequencies[symbol.value]++;
+                continue;
+            }
+            literalFrequencies[257 + findLengthCode(symbol.value)]++;
+            distanceFrequencies[findDistanceCode(symbol.distance)]++;
+        }
+        literalFrequencies[END_OF_BLOCK] = 1;
+        ensureTwoCodes(literalFrequencies);
+        ensureTwoCodes(distanceFrequencies);
+
+        const std::vector<uint8_t> literalLengths = computeCodeLengths(literalFrequencies, 15);
+        const std::vector<uint8_t> distanceLengths = computeCodeLengths(distanceFrequencies, 15);
+        int literalCodeCount = LITERAL_LENGTH_CODE_COUNT, distanceCodeCount = DISTANCE_CODE_COUNT;
+        while (literalLengths[literalCodeCount - 1] == 0) { literalCodeCount--; }
+        while (distanceLengths[distanceCodeCount - 1] == 0) { distanceCodeCount--; }
+
+        // both trees' lengths back to back, run length coded with 16 (repeat the last), 17 and 18 (runs of zeros)
+        std::vector<uint8_t> lengths(literalLengths.begin(), literalLengths.begin() + literalCodeCount);
+        lengths.insert(lengths.end(), distanceLengths.begin(), distanceLengths.begin() + distanceCodeCount);
+        std::vector<std::pair<uint8_t, uint8_t>> lengthSymbols; // the code length code and its extra bits
+        for (size_t i = 0; i < lengths.size();)
+        {
+            const uint8_t length = lengths[i];
+            size_t runLength = 1;
+            while (i + runLength < lengths.size() && lengths[i + runLength] == length) { runLength++; }
+            i += runLength;
+            if (length == 0)
+            {
+                while (runLength >= 11)
+                {
+                    const size_t count = std::min(runLength, (size_t) 138);
+                    lengthSymbols.push_back({ 18, (uint8_t) (count - 11) });
+                    runLength -= count;
+                }
+                if (runLength >= 3)
+                {
+                    lengthSymbols.push_back({ 17, (uint8_t) (runLength - 3) });
+                    runLength = 0;
+                }
+            }
+            else
+            {
+                lengthSymbols.push_back({ length, 0 });
+                runLength--;
+                while (runLength >= 3)
+                {
+                    const size_t count = std::min(runLength, (size_t) 6);
+                    lengthSymbols.push_back({ 16, (uint8_t) (count - 3) });
+                    runLength -= count;
+                }
+            }
+            for (; runLength > 0; runLength--) { lengthSymbols.push_back({ length, 0 }); }
+        }
+
+        std::vector<uint32_t> codeLengthFrequencies(CODE_LENGTH_CODE_COUNT, 0);
+        for (auto & lengthSymbol : lengthSymbols) { codeLengthFrequencies[lengthSymbol.first]++; }
+        ensureTwoCodes(codeLengthFrequencies);
+        const std::vector<uint8_t> codeLengthLengths = computeCodeLengths(codeLengthFrequencies, 7);
+        int codeLengthCodeCount = CODE_LENGTH_CODE_COUNT;
+        while (codeLengthCodeCount > 4 && codeLengthLengths[CODE_LENGTH_ORDER[codeLengthCodeCount - 1]] == 0) { codeLengthCodeCount--; }
+
+        // compare the sizes before writing anything
+        uint64_t dynamicBits = 3 + 5 + 5 + 4 + 3 * codeLengthCodeCount;
+        for (auto & lengthSymbol : lengthSymbols)
+        {
+            const int code = lengthSymbol.first;
+            dynamicBits += codeLengthLengths[code] + (code == 16 ? 2 : code == 17 ? 3 : code == 18 ? 7 : 0);
+        }
+        for (int code = 0; code < LITERAL_LENGTH_CODE_COUNT; code++)
+        {
+            const int extraBits = code > 256 ? LENGTH_EXTRA_BITS[code - 257] : 0;
+            dynamicBits += (uint64_t) literalFrequencies[code] * (literalLengths[code] + extraBits);
+        }
+        for (int code = 0; code < DISTANCE_CODE_COUNT; code++)
+        {
+            dynamicBits += (uint64_t) distanceFrequencies[code] * (distanceLengths[code] + DISTANCE_EXTRA_BITS[code]);
+        }
+        const uint64_t storedBits = (size / MAX_STORED_BLOCK_SIZE + 1) * (3 + 7 + 32) + 8 * (uint64_t) size;
+        if (storedBits < dynamicBits)
+        {
+            writeStoredBlocks(writer, data, size, final);
+            return;
+        }
+
+        const std::vector<uint16_t> literalCodes = computeCodes(literalLengths);
+        const std::vector<uint16_t> distanceCodes = computeCodes(distanceLengths);
+        const std::vector<uint16_t> codeLengthCodes = computeCodes(codeLengthLengths);
+
+        writer.write(final ? 1 : 0, 1);
+        writer.write(2, 2);
+        writer.write(literalCodeCount - 257, 5);
+        writer.write(distanceCodeCount - 1, 5);
+        writer.write(codeLengthCodeCount - 4, 4);
+        for (int i = 0; i < codeLengthCodeCount; i++)
+        {
+            writer.write(codeLengthLengths[CODE_LENGTH_ORDER[i]], 3);
+        }
+        for (auto & lengthSymbol : lengthSymbols)
+        {
+            const int code = lengthSymbol.first;
+            writer.write(codeLengthCodes[code], codeLengthLengths[code]);
+            if (code >= 16) { writer.write(lengthSymbol.second, code == 16 ? 2 : code == 17 ? 3 : 7); }
+        }
+
+        for (Symbol const& symbol : symbols)
+        {
+            if (symbol.distance == 0)
+            {
+                writer.write(literalCodes[symbol.value], literalLengths[symbol.value]);
+                continue;
+            }
+            const int lengthCode = findLengthCode(symbol.value);
+            writer.write(literalCodes[257 + lengthCode], literalLengths[257 + lengthCode]);
+            writer.write(symbol.value - LENGTH_BASE[lengthCode], LENGTH_EXTRA_BITS[lengthCode]);
+            const int distanceCode = findDistanceCode(symbol.distance);
+            writer.write(distanceCodes[distanceCode], distanceLengths[distanceCode]);
+            writer.write(symbol.distance - DISTANCE_BASE[distanceCode], DISTANCE_EXTRA_BITS[distanceCode]);
+        }
+        writer.write(literalCodes[END_OF_BLOCK], literalLengths[END_OF_BLOCK]);
+    }
+}
+
+uint32_t Deflate::crc32(const char *data, size_t size, uint32_t crc)
+{
+    static const std::vector<uint32_t> table = []()
+    {
+        std::vector<uint32_t> table(256);
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                value = (value & 1) ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+            }
+            table[i] = value;
+        }
+        return table;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = table[(crc ^ (uint8_t) data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint32_t Deflate::adler32(const char *data, size_t size, uint32_t adler)
+{
+    // 5552 bytes is the most that can be summed before the second sum could overflow
+    uint32_t sum1 = adler & 0xFFFF, sum2 = adler >> 16;
+    for (size_t offset = 0; offset < size; offset += 5552)
+    {
+        const size_t end = std::min(size, offset + 5552);
+        for (size_t i = offset; i < end; i++)
+        {
+            sum1 += (uint8_t) data[i];
+            sum2 += sum1;
+        }
+        sum1 %= ADLER_BASE;
+        sum2 %= ADLER_BASE;
+    }
+    return sum1 | (sum2 << 16);
+}
+
+uint32_t Deflate::combineAdler32(uint32_t adler1, uint32_t adler2, size_t size2)
+{
+    // the second sum of the first piece grows by its first sum once per byte of the second piece
+    const uint32_t remainder = (uint32_t) (size2 % ADLER_BASE);
+    uint32_t sum1 = adler1 & 0xFFFF;
+    uint32_t sum2 = (uint32_t) (((uint64_t) remainder * sum1) % ADLER_BASE);
+    sum1 += (adler2 & 0xFFFF) + ADLER_BASE - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + ADLER_BASE - remainder;
+    if (sum1 >= ADLER_BASE) { sum1 -= ADLER_BASE; }
+    if (sum1 >= ADLER_BASE) { sum1 -= ADLER_BASE; }
+    if (sum2 >= 2 * ADLER_BASE) { sum2 -= 2 * ADLER_BASE; }
+    if (sum2 >= ADLER_BASE) { sum2 -= ADLER_BASE; }
+    return sum1 | (sum2 << 16);
+}
+
+std::string Deflate::compress(std::string const& data, size_t begin, size_t end, bool final, int level)
+{
+    std::string output;
+    BitWriter writer(output);
+    const uint8_t *bytes = (const uint8_t *) data.data();
+
+    if (level <= 0 || begin == end)
+    {
+        writeStoredBlocks(writer, data.data() + begin, end - begin, final);
+    }
+    else
+    {
+        // positions are kept relative to the start of the window, which reaches back before begin
+        const size_t windowStart = begin > (size_t) WINDOW_SIZE ? begin - WINDOW_SIZE : 0;
+        const int maxChainLength = 1 << std::min(level, 12);
+        std::vector<int32_t> heads(1 << HASH_BITS, -1);
+        std::vector<int32_t> previous(end - windowStart, -1);
+        auto insert = [&](size_t position)
+        {
+            if (position + MIN_MATCH > end) { return; }
+            const uint32_t key = hash(bytes + position);
+            previous[position - windowStart] = heads[key];
+            heads[key] = (int32_t) (position - windowStart);
+        };
+        for (size_t position = windowStart; position < begin; position++) { insert(position); }
+
+        std::vector<Symbol> symbols;
+        symbols.reserve(std::min(SYMBOLS_PER_BLOCK, end - begin));
+        size_t blockBegin = begin;
+        size_t position = begin;
+        while (position < end)
+        {
+            int bestLength = 0, bestDistance = 0;
+            if (position + MIN_MATCH <= end)
+            {
+                const int maxLength = (int) std::min((size_t) MAX_MATCH, end - position);
+                int32_t candidate = heads[hash(bytes + position)];
+                for (int chainLength = 0; candidate >= 0 && chainLength < maxChainLength; chainLength++)
+                {
+                    const size_t candidatePosition = windowStart + candidate;
+                    const int distance = (int) (position - candidatePosition);
+                    if (distance > WINDOW_SIZE) { break; }
+                    if (bytes[candidatePosition + bestLength] == bytes[position + bestLength])
+                    {
+                        int length = 0;
+                        while (length < maxLength && bytes[candidatePosition + length] == bytes[position + length]) { length++; }
+                        if (length > bestLength)
+                        {
+                            bestLength = length;
+                            bestDistance = distance;
+                            if (length == maxLength) { break; }
+                        }
+                    }
+                    candidate = previous[candidate];
+                }
+            }
+
+            if (bestLength >= MIN_MATCH)
+            {
+                symbols.push_back({ (uint16_t) bestLength, (uint16_t) bestDistance });
+                for (int i = 0; i < bestLength; i++) { insert(position + i); }
+                position += bestLength;
+            }
+            else
+            {
+                symbols.push_back({ bytes[position], 0 });
+                insert(position);
+                position++;
+            }
+
+            if (symbols.size() >= SYMBOLS_PER_BLOCK && position < end)
+            {
+                writeBlock(writer, symbols, data.data() + blockBegin, position - blockBegin, false);
+                symbols.clear();
+                blockBegin = position;
+            }
+        }
+        writeBlock(writer, symbols, data.data() + blockBegin, end - blockBegin, final);
+    }
+
+    if (!final)
+    {
+        // an empty stored block brings the chunk to a byte boundary so that the next one can follow it directly
+        writeStoredBlocks(writer, NULL, 0, false);
+    }
+    writer.align();
+    return output;
+}
+
+std::vector<std::string> Deflate::compressZlib(std::string const& data, int level, int threadCount, size_t chunkSize)
+{
+    const size_t chunkCount = std::max((size_t) 1, (data.size() + chunkSize - 1) / chunkSize);
+    std::vector<std::string> pieces(chunkCount);
+    std::vector<uint32_t> adlers(chunkCount);
+    Util::parallelFor(chunkCount, 1, threadCount, [&](size_t firstChunk, size_t lastChunk, int)
+    {
+        for (size_t chunk = firstChunk; chunk < lastChunk; chunk++)
+        {
+            const size_t begin = std::min(data.size(), chunk * chunkSize);
+            const size_t end = std::min(data.size(), begin + chunkSize);
+            pieces[chunk] = compress(data, begin, end, chunk + 1 == chunkCount, level);
+            adlers[chunk] = adler32(data.data() + begin, end - begin);
+        }
+    });
+
+    // deflate with a 32K window, then the adler32 of everything, most significant byte first
+    pieces.front().insert(0, "\x78\x9C", 2);
+    uint32_t adler = adlers[0];
+    for (size_t chunk = 1; chunk < chunkCount; chunk++)
+    {
+        const size_t begin = chunk * chunkSize;
+        adler = combineAdler32(adler, adlers[chunk], std::min(data.size(), begin + chunkSize) - begin);
+    }
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        pieces.back().push_back((char) (adler >> shift));
+    }
+    return pieces;
+}
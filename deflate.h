@@ -0,0 +1,27 @@
+#ifndef DEFLATE_HEADER
+#define DEFLATE_HEADER
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// the deflate and zlib formats of rfc 1950 and 1951, with the checksums png needs. the input is cut into chunks that
+// compress on separate threads: each chunk may still refer back into the 32K before it, and every chunk but the last
+// ends on a byte boundary with an empty stored block, so the compressed chunks simply concatenate
+namespace Deflate
+{
+    uint32_t crc32(const char *data, size_t size, uint32_t crc = 0);
+    uint32_t adler32(const char *data, size_t size, uint32_t adler = 1);
+    // the adler32 of two pieces of data back to back, from the adler32 of each and the size of the second
+    uint32_t combineAdler32(uint32_t adler1, uint32_t adler2, size_t size2);
+
+    // raw deflate of data[begin, end). level is 0 for stored blocks only, up to 9 for the longest match search. the
+    // last block is marked final only if final is set
+    std::string compress(std::string const& data, size_t begin, size_t end, bool final, int level);
+
+    // a zlib stream of data compressed chunkSize bytes at a time on threadCount threads. the pieces, one per chunk,
+    // concatenated in order are the stream
+    std::vector<std::string> compressZlib(std::string const& data, int level, int threadCount, size_t chunkSize = 1 << 18);
+}
+
+#endif
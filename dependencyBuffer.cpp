@@ -0,0 +1,116 @@
+#include "dependencyBuffer.h"
+#include <algorithm>
+
+namespace
+{
+    const int MAX_SURFACE_BIT = 63;
+}
+
+void DependencyRecorder::beginPixel(int pixelIndex)
+{
+    this->pixels.push_back({ pixelIndex, 0, this->segments.size(), 0 });
+}
+
+void DependencyRecorder::recordSurface(int topLevelSurfaceIndex)
+{
+    if (this->pixels.empty() || topLevelSurfaceIndex < 0) { return; }
+    this->pixels.back().surfaceMask |= ((uint64_t) 1) << std::min(topLevelSurfaceIndex, MAX_SURFACE_BIT);
+}
+
+void DependencyRecorder::recordRay(Math::Ray const& ray, float t0, float t1)
+{
+    if (this->pixels.empty()) { return; }
+    this->segments.push_back({ ray, t0, t1 });
+    this->pixels.back().segmentCount++;
+}
+
+void DependencyBuffer::reset(int pixelCount)
+{
+    this->pixels.assign(pixelCount, PixelDependencies());
+    this->segments.clear();
+    this->dirtyPixels.assign(pixelCount, 1);
+    this->liveSegmentCount = 0;
+}
+
+int DependencyBuffer::getPixelCount() const
+{
+    return (int) this->pixels.size();
+}
+
+void DependencyBuffer::commit(DependencyRecorder & recorder)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    const size_t segmentOffset = this->segments.size();
+    this->segments.insert(this->segments.end(), recorder.segments.begin(), recorder.segments.end());
+    for (auto & record : recorder.pixels)
+    {
+        PixelDependencies & pixel = this->pixels.at(record.pixelIndex);
+        this->liveSegmentCount += record.segmentCount - pixel.segmentCount;
+        pixel.surfaceMask = record.surfaceMask;
+        pixel.firstSegment = segmentOffset + record.firstSegment;
+        pixel.segmentCount = record.segmentCount;
+        this->dirtyPixels[record.pixelIndex] = 0;
+    }
+    recorder.pixels.clear();
+    recorder.segments.clear();
+}
+
+void DependencyBuffer::markSurfaceChanged(int topLevelSurfaceIndex)
+{
+    const uint64_t bit = ((uint64_t) 1) << std::min(std::max(topLevelSurfaceIndex, 0), MAX_SURFACE_BIT);
+    for (size_t p = 0; p < this->pixels.size(); p++)
+    {
+        if (this->pixels[p].surfaceMask & bit) { this->dirtyPixels[p] = 1; }
+    }
+}
+
+void DependencyBuffer::markBoundsChanged(Math::Box const& bounds)
+{
+    if (bounds.isEmpty()) { return; }
+    for (size_t p = 0; p < this->pixels.size(); p++)
+    {
+        if (this->dirtyPixels[p]) { continue; }
+        const PixelDependencies & pixel = this->pixels[p];
+        for (size_t s = pixel.firstSegment; s < pixel.firstSegment + pixel.segmentCount; s++)
+        {
+            const DependencyRecorder::Segment & segment = this->segments[s];
+            float tEnter, tExit;
+            if (bounds.hit(segment.ray, Math::inverse(segment.ray.direction), segment.t0, segment.t1, tEnter, tExit))
+            {
+                this->dirtyPixels[p] = 1;
+                break;
+            }
+        }
+    }
+}
+
+void DependencyBuffer::markAllDirty()
+{
+    std::fill(this->dirtyPixels.begin(), this->dirtyPixels.end(), 1);
+}
+
+const std::vector<uint8_t> & DependencyBuffer::getDirtyPixels() const
+{
+    return this->dirtyPixels;
+}
+
+int DependencyBuffer::getDirtyPixelCount() const
+{
+    return (int) std::count(this->dirtyPixels.begin(), this->dirtyPixels.end(), 1);
+}
+
+void DependencyBuffer::compact()
+{
+    // pixels recorded again leave their old segments behind. once those are most of the array, copy out the live ones
+    if (this->segments.size() < 2 * this->liveSegmentCount + 1024) { return; }
+
+    std::vector<DependencyRecorder::Segment> liveSegments;
+    liveSegments.reserve(this->liveSegmentCount);
+    for (auto & pixel : this->pixels)
+    {
+        const size_t firstSegment = liveSegments.size();
+        liveSegments.insert(liveSegments.end(), this->segments.begin() + pixel.firstSegment, this->segments.begin() + pixel.firstSegment + pixel.segmentCount);
+        pixel.firstSegment = firstSegment;
+    }
+    this->segments.swap(liveSegments);
+}
@@ -0,0 +1,79 @@
+#ifndef DEPENDENCY_BUFFER_HEADER
+#define DEPENDENCY_BUFFER_HEADER
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+#include "math.h"
+
+// what the rays of one thread touched, pixel by pixel. the renderer starts every pixel with beginPixel, and the
+// surfaces and shaders record into it through RenderContext::dependencies
+class DependencyRecorder
+{
+public:
+    struct Segment
+    {
+        Math::Ray ray;
+        float t0, t1;
+    };
+
+    void beginPixel(int pixelIndex);
+    // the top level surface that shaded a hit: its index in the root group, or 0 when the root is not a group.
+    // surfaces past the 63rd share the last bit
+    void recordSurface(int topLevelSurfaceIndex);
+    // the part of a view, reflection or shadow ray that was traced
+    void recordRay(Math::Ray const& ray, float t0, float t1);
+
+private:
+    friend class DependencyBuffer;
+
+    struct PixelRecord
+    {
+        int pixelIndex;
+        uint64_t surfaceMask;
+        size_t firstSegment, segmentCount;
+    };
+
+    std::vector<PixelRecord> pixels;
+    std::vector<Segment> segments;
+};
+
+// for every pixel of a frame, the top level surfaces its rays were shaded by and every ray segment it traced. after an
+// edit, marking what changed dirties exactly the pixels whose rays could see the change, so only those are traced again
+class DependencyBuffer
+{
+public:
+    // forgets every pixel, leaving all of them dirty
+    void reset(int pixelCount);
+    int getPixelCount() const;
+
+    // stores the pixels recorded since the last commit, which become clean, and empties the recorder. thread safe
+    void commit(DependencyRecorder & recorder);
+
+    // a change to how the surface shades, such as a new shader color
+    void markSurfaceChanged(int topLevelSurfaceIndex);
+    // a change to the geometry inside bounds. a moved surface needs both its old and its new bounds marked
+    void markBoundsChanged(Math::Box const& bounds);
+    void markAllDirty();
+
+    const std::vector<uint8_t> & getDirtyPixels() const; // nonzero for every dirty pixel
+    int getDirtyPixelCount() const;
+
+    // drops the segments of pixels that have been recorded again since. not thread safe
+    void compact();
+
+private:
+    struct PixelDependencies
+    {
+        uint64_t surfaceMask = 0;
+        size_t firstSegment = 0, segmentCount = 0;
+    };
+
+    std::vector<PixelDependencies> pixels;
+    std::vector<DependencyRecorder::Segment> segments;
+    std::vector<uint8_t> dirtyPixels;
+    size_t liveSegmentCount = 0;
+    std::mutex mutex;
+};
+
+#endif
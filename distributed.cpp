@@ -0,0 +1,445 @@
+#include "distributed.h"
+#include "serialization.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+    // every message is a 4 byte little endian length followed by that many bytes, the first of which is the type
+    const uint8_t MESSAGE_SCENE = 1; // thread count, acceleration cache directory, then a serialized scene
+    const uint8_t MESSAGE_TILE = 2; // x0, y0, x1, y1 of a tile to render
+    const uint8_t MESSAGE_TILE_RESULT = 3; // the tile, then red, green, blue and hit for each of its pixels row by row
+
+    const uint32_t MAX_MESSAGE_SIZE = 1 << 30;
+
+    bool sendAll(int socket, const char * data, size_t size)
+    {
+        while (size > 0)
+        {
+            const ssize_t sent = send(socket, data, size, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) { continue; }
+            if (sent <= 0) { return false; }
+            data += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    bool receiveAll(int socket, char * data, size_t size)
+    {
+        while (size > 0)
+        {
+            const ssize_t received = recv(socket, data, size, 0);
+            if (received < 0 && errno == EINTR) { continue; }
+            if (received <= 0) { return false; }
+            data += received;
+            size -= received;
+        }
+        return true;
+    }
+
+    bool sendMessage(int socket, std::string const& message)
+    {
+        Serialization::BinaryWriter header;
+        header.writeUint32("size", message.size());
+        return sendAll(socket, header.getBuffer().data(), 4) && sendAll(socket, message.data(), message.size());
+    }
+
+    bool receiveMessage(int socket, std::string & message)
+    {
+        char header[4];
+        if (!receiveAll(socket, header, 4)) { return false; }
+        const uint32_t size = Serialization::BinaryReader(header, 4).readUint32("size");
+        if (size == 0 || size > MAX_MESSAGE_SIZE) { return false; }
+        message.resize(size);
+        return receiveAll(socket, &message[0], size);
+    }
+
+    void writeRect(Serialization::BinaryWriter & writer, Util::PixelRect const& rect)
+    {
+        writer.writeInt32("x0", rect.x0);
+        writer.writeInt32("y0", rect.y0);
+        writer.writeInt32("x1", rect.x1);
+        writer.writeInt32("y1", rect.y1);
+    }
+
+    Util::PixelRect readRect(Serialization::BinaryReader & reader)
+    {
+        const int x0 = reader.readInt32("x0");
+        const int y0 = reader.readInt32("y0");
+        const int x1 = reader.readInt32("x1");
+        const int y1 = reader.readInt32("y1");
+        return { x0, y0, x1, y1 };
+    }
+
+    bool sameRect(Util::PixelRect const& lhs, Util::PixelRect const& rhs)
+    {
+        return lhs.x0 == rhs.x0 && lhs.y0 == rhs.y0 && lhs.x1 == rhs.x1 && lhs.y1 == rhs.y1;
+    }
+
+    // bounds every send and receive on socket, so that a worker that stops reading or stops halfway through an answer
+    // cannot stall the coordinator
+    void setSocketTimeout(int socket, int milliseconds)
+    {
+        struct timeval timeout;
+        timeout.tv_sec = milliseconds / 1000;
+        timeout.tv_usec = (milliseconds % 1000) * 1000;
+        setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+}
+
+TileCoordinator::TileCoordinator()
+{
+    this->workerCount = Util::defaultThreadCount();
+}
+
+TileCoordinator::TileCoordinator(int workerCount)
+{
+    this->setWorkerCount(workerCount);
+}
+
+TileCoordinator::~TileCoordinator()
+{
+    // the workers are all idle by now, and the forked ones exit once their socket closes
+    for (auto & worker : this->workers)
+    {
+        if (worker.socket >= 0) { close(worker.socket); }
+    }
+    for (auto & worker : this->workers)
+    {
+        if (worker.pid > 0) { waitpid(worker.pid, NULL, 0); }
+    }
+}
+
+int TileCoordinator::getWorkerCount() const
+{
+    return this->workerCount;
+}
+
+int TileCoordinator::getTileSize() const
+{
+    return this->tileSize;
+}
+
+int TileCoordinator::getMaxAttempts() const
+{
+    return this->maxAttempts;
+}
+
+int TileCoordinator::getTileTimeout() const
+{
+    return this->tileTimeout;
+}
+
+void TileCoordinator::setWorkerCount(int workerCount)
+{
+    this->workerCount = std::max(0, workerCount);
+}
+
+void TileCoordinator::setTileSize(int tileSize)
+{
+    this->tileSize = std::max(1, tileSize);
+}
+
+void TileCoordinator::setMaxAttempts(int maxAttempts)
+{
+    this->maxAttempts = std::max(1, maxAttempts);
+}
+
+void TileCoordinator::setTileTimeout(int tileTimeout)
+{
+    this->tileTimeout = std::max(1, tileTimeout);
+}
+
+void TileCoordinator::addWorkerConnection(int socket)
+{
+    this->addWorker(socket, -1);
+}
+
+void TileCoordinator::startWorkers()
+{
+    int localWorkerCount = 0;
+    for (auto & worker : this->workers)
+    {
+        if (worker.socket < 0 || worker.pid < 0) { continue; }
+        if (localWorkerCount < this->workerCount) { localWorkerCount++; }
+        else { this->dropWorker(worker); }
+    }
+    for (; localWorkerCount < this->workerCount; localWorkerCount++)
+    {
+        if (!this->spawnWorker()) { break; }
+    }
+}
+
+bool TileCoordinator::render(Scene & scene)
+{
+    const int resolutionX = scene.camera->getResolutionX();
+    const int resolutionY = scene.camera->getResolutionY();
+    const std::vector<Util::PixelRect> tiles = Util::computeTiles(resolutionX, resolutionY, this->tileSize, scene.tileOrder);
+
+    // local workers split the threads of this machine between them, remote workers use all of theirs
+    Serialization::BinaryWriter sceneWriter;
+    scene.serialize(sceneWriter);
+    auto sceneMessage = [&](bool local)
+    {
+        Serialization::BinaryWriter writer;
+        writer.writeUint8("message", MESSAGE_SCENE);
+        writer.writeInt32("threadCount", local ? std::max(1, scene.threadCount / std::max(1, this->workerCount)) : 0);
+        // forked workers share the cache of this machine, remote ones have their own
+        const std::string cacheDirectory = local ? scene.accelerationCacheDirectory : "";
+        writer.writeUint32("cacheDirectorySize", cacheDirectory.size());
+        writer.writeBytes(cacheDirectory.data(), cacheDirectory.size());
+        writer.writeBytes(sceneWriter.getBuffer().data(), sceneWriter.getBuffer().size());
+        return writer.getBuffer();
+    };
+
+    std::vector<Worker> & workers = this->workers;
+    this->startWorkers();
+    for (auto & worker : workers)
+    {
+        if (worker.socket < 0) { continue; }
+        setSocketTimeout(worker.socket, this->tileTimeout);
+        if (!sendMessage(worker.socket, sceneMessage(worker.pid >= 0))) { this->dropWorker(worker); }
+    }
+
+    std::deque<int> pendingTiles;
+    for (size_t t = 0; t < tiles.size(); t++) { pendingTiles.push_back(t); }
+    std::vector<int> attempts(tiles.size(), 0);
+    size_t settledTileCount = 0; // rendered or given up on
+    size_t failedTileCount = 0;
+    int respawnsLeft = this->workerCount * this->maxAttempts;
+
+    // gives the tile of a worker that died or hung back to the queue, and replaces the worker if it was forked here
+    auto loseWorker = [&](size_t w)
+    {
+        const int tileIndex = workers[w].tileIndex;
+        const bool local = workers[w].pid >= 0;
+        this->dropWorker(workers[w]);
+        if (tileIndex >= 0)
+        {
+            attempts[tileIndex]++;
+            if (attempts[tileIndex] < this->maxAttempts) { pendingTiles.push_front(tileIndex); }
+            else
+            {
+                std::cerr << "Giving up on tile (" << tiles[tileIndex].x0 << ", " << tiles[tileIndex].y0 << ") after " << attempts[tileIndex] << " attempts." << std::endl;
+                failedTileCount++;
+                settledTileCount++;
+            }
+        }
+        if (local && respawnsLeft > 0 && !pendingTiles.empty() && this->spawnWorker())
+        {
+            respawnsLeft--;
+            setSocketTimeout(workers.back().socket, this->tileTimeout);
+            if (!sendMessage(workers.back().socket, sceneMessage(true))) { this->dropWorker(workers.back()); }
+        }
+    };
+
+    std::string message;
+    std::vector<struct pollfd> pollSockets;
+    std::vector<size_t> pollWorkers;
+    while (settledTileCount < tiles.size())
+    {
+        for (size_t w = 0; w < workers.size() && !pendingTiles.empty(); w++)
+        {
+            if (workers[w].socket < 0 || workers[w].tileIndex >= 0) { continue; }
+            workers[w].tileIndex = pendingTiles.front();
+            workers[w].deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(this->tileTimeout);
+            pendingTiles.pop_front();
+
+            Serialization::BinaryWriter writer;
+            writer.writeUint8("message", MESSAGE_TILE);
+            writeRect(writer, tiles[workers[w].tileIndex]);
+            if (!sendMessage(workers[w].socket, writer.getBuffer())) { loseWorker(w); }
+        }
+
+        pollSockets.clear();
+        pollWorkers.clear();
+        auto firstDeadline = std::chrono::steady_clock::time_point::max();
+        for (size_t w = 0; w < workers.size(); w++)
+        {
+            if (workers[w].socket < 0 || workers[w].tileIndex < 0) { continue; }
+            pollSockets.push_back({ workers[w].socket, POLLIN, 0 });
+            pollWorkers.push_back(w);
+            firstDeadline = std::min(firstDeadline, workers[w].deadline);
+        }
+        if (pollSockets.empty())
+        {
+            if (!pendingTiles.empty() && respawnsLeft > 0 && this->workerCount > 0 && this->spawnWorker())
+            {
+                respawnsLeft--;
+                setSocketTimeout(workers.back().socket, this->tileTimeout);
+                if (!sendMessage(workers.back().socket, sceneMessage(true))) { this->dropWorker(workers.back()); }
+                continue;
+            }
+            std::cerr << "No workers left with " << pendingTiles.size() << " tiles to render." << std::endl;
+            failedTileCount += pendingTiles.size();
+            break;
+        }
+
+        // waits no longer than the first deadline, and a millisecond past it so that the wait does not end just short
+        const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(firstDeadline - std::chrono::steady_clock::now());
+        if (poll(pollSockets.data(), pollSockets.size(), std::max(0, (int) wait.count() + 1)) < 0)
+        {
+            if (errno == EINTR) { continue; }
+            const int pollError = errno;
+            // the tiles still out are lost along with the ones waiting, or the frame would pass for complete
+            size_t inFlightTileCount = 0;
+            for (auto & worker : workers)
+            {
+                if (worker.socket >= 0 && worker.tileIndex >= 0) { inFlightTileCount++; }
+            }
+            std::cerr << "Polling the workers failed with " << inFlightTileCount + pendingTiles.size() << " tiles to render: " << std::strerror(pollError) << std::endl;
+            failedTileCount += inFlightTileCount + pendingTiles.size();
+            break;
+        }
+        for (size_t p = 0; p < pollSockets.size(); p++)
+        {
+            if (pollSockets[p].revents == 0) { continue; }
+            const size_t w = pollWorkers[p];
+            if (!receiveMessage(workers[w].socket, message))
+            {
+                loseWorker(w);
+                continue;
+            }
+
+            const Util::PixelRect & tile = tiles[workers[w].tileIndex];
+            Serialization::BinaryReader reader(message);
+            const bool isResult = reader.readUint8("message") == MESSAGE_TILE_RESULT && sameRect(readRect(reader), tile);
+            const char * pixels = isResult ? reader.readBytes(4 * (size_t) tile.pixelCount()) : NULL;
+            if (pixels == NULL || !reader.isAtEnd())
+            {
+                loseWorker(w); // a worker that answers with something else cannot be trusted with more tiles
+                continue;
+            }
+
+            for (int j = tile.y0; j < tile.y1; j++)
+            {
+                for (int i = tile.x0; i < tile.x1; i++, pixels += 4)
+                {
+                    scene.setPixel(i, j, { (uint8_t) pixels[0], (uint8_t) pixels[1], (uint8_t) pixels[2] }, pixels[3] != 0);
+                }
+            }
+            workers[w].tileIndex = -1;
+            settledTileCount++;
+        }
+
+        // a hung worker would otherwise keep its tile forever. a forked one is killed and replaced by loseWorker
+        const auto now = std::chrono::steady_clock::now();
+        for (size_t w = 0; w < workers.size(); w++)
+        {
+            if (workers[w].socket < 0 || workers[w].tileIndex < 0 || workers[w].deadline > now) { continue; }
+            std::cerr << "A worker missed the deadline of tile (" << tiles[workers[w].tileIndex].x0 << ", " << tiles[workers[w].tileIndex].y0 << ")." << std::endl;
+            loseWorker(w);
+        }
+    }
+
+    // idle workers, forked or remote, stay for the next frame. the ones still busy after a failure are dropped, since
+    // their late answers would be read as the tiles of the next one
+    for (auto & worker : workers)
+    {
+        if (worker.tileIndex >= 0) { this->dropWorker(worker); }
+    }
+    workers.erase(std::remove_if(workers.begin(), workers.end(), [](Worker const& worker) { return worker.socket < 0; }), workers.end());
+    return settledTileCount == tiles.size() && failedTileCount == 0;
+}
+
+int TileCoordinator::serveWorker(int socket)
+{
+    std::unique_ptr<Scene> scene;
+    std::string message;
+    std::vector<Util::Color> colors;
+    std::vector<bool> hits;
+    while (receiveMessage(socket, message))
+    {
+        Serialization::BinaryReader reader(message);
+        const uint8_t type = reader.readUint8("message");
+        if (type == MESSAGE_SCENE)
+        {
+            const int threadCount = reader.readInt32("threadCount");
+            const uint32_t cacheDirectorySize = reader.readUint32("cacheDirectorySize");
+            const char * cacheDirectory = reader.readBytes(cacheDirectorySize);
+            scene = cacheDirectory != NULL ? Scene::deserialize(reader) : NULL;
+            if (scene == NULL || !reader.isAtEnd()) { return 1; }
+            if (threadCount > 0) { scene->setThreadCount(threadCount); }
+            scene->setAccelerationCacheDirectory(std::string(cacheDirectory, cacheDirectorySize));
+            continue;
+        }
+
+        const Util::PixelRect tile = readRect(reader);
+        if (type != MESSAGE_TILE || scene == NULL || !reader.isAtEnd()) { return 1; }
+        if (tile.x0 < 0 || tile.y0 < 0 || tile.x1 > scene->camera->getResolutionX() || tile.y1 > scene->camera->getResolutionY()
+            || tile.x0 >= tile.x1 || tile.y0 >= tile.y1)
+        {
+            return 1;
+        }
+
+        scene->computeRegion(tile, colors, hits);
+        Serialization::BinaryWriter writer;
+        writer.writeUint8("message", MESSAGE_TILE_RESULT);
+        writeRect(writer, tile);
+        for (int k = 0; k < tile.pixelCount(); k++)
+        {
+            writer.writeColor("color", colors[k]);
+            writer.writeUint8("hit", hits[k] ? 1 : 0);
+        }
+        if (!sendMessage(socket, writer.getBuffer())) { return 0; }
+    }
+    return 0;
+}
+
+bool TileCoordinator::spawnWorker()
+{
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) { return false; }
+
+    const pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(sockets[0]);
+        close(sockets[1]);
+        return false;
+    }
+    if (pid == 0)
+    {
+        // the child keeps only its own end, otherwise the other workers would never see their sockets close
+        close(sockets[0]);
+        for (auto & worker : this->workers)
+        {
+            if (worker.socket >= 0) { close(worker.socket); }
+        }
+        _exit(TileCoordinator::serveWorker(sockets[1]));
+    }
+
+    close(sockets[1]);
+    this->addWorker(sockets[0], pid);
+    return true;
+}
+
+void TileCoordinator::addWorker(int socket, pid_t pid)
+{
+    this->workers.push_back({ socket, pid, -1, std::chrono::steady_clock::time_point() });
+}
+
+void TileCoordinator::dropWorker(Worker & worker) const
+{
+    if (worker.socket >= 0) { close(worker.socket); }
+    // a worker dropped for failing may be hung rather than dead, and would never notice its socket closing
+    if (worker.pid > 0)
+    {
+        kill(worker.pid, SIGKILL);
+        waitpid(worker.pid, NULL, 0);
+    }
+    worker.socket = -1;
+    worker.pid = -1;
+    worker.tileIndex = -1;
+}
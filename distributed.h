@@ -0,0 +1,74 @@
+#ifndef DISTRIBUTED_HEADER
+#define DISTRIBUTED_HEADER
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "scene.h"
+#include "tiling.h"
+
+// renders a frame across worker processes. the coordinator serializes the scene once, sends it to every worker, then
+// hands out tiles one at a time and writes each finished tile into the scene's bitmap, so the result goes out through
+// Scene::exportToFile as usual. a worker that dies, hangs up or misses the deadline of its tile gives the tile back to
+// the queue. a local worker that missed it is killed and forked again.
+//
+// workers talk over connected stream sockets. setWorkerCount() local workers are forked on socket pairs and kept from
+// one render to the next, and addWorkerConnection() takes sockets to workers running serveWorker() anywhere else, such
+// as on other hosts.
+//
+// a forked child only has the thread that forked it, and any lock another thread held at that moment stays locked in
+// the child for good. so call startWorkers() before this process starts any thread of its own. render() only forks
+// the workers that are missing and the replacements for the ones it lost, at points where no thread of the renderer
+// runs, which is only safe if no other thread does either
+class TileCoordinator
+{
+public:
+    TileCoordinator();
+    TileCoordinator(int workerCount);
+    ~TileCoordinator();
+
+    int getWorkerCount() const;
+    int getTileSize() const;
+    int getMaxAttempts() const;
+    int getTileTimeout() const;
+
+    void setWorkerCount(int workerCount); // local worker processes. may be 0 with remote workers
+    void setTileSize(int tileSize);
+    void setMaxAttempts(int maxAttempts); // a tile whose worker died this many times is given up on
+    // milliseconds a worker has for a tile, and for every message, before it is taken for hung. a worker builds what the
+    // scene needs on its first tile, so this has to allow for that
+    void setTileTimeout(int tileTimeout);
+    void addWorkerConnection(int socket); // the coordinator owns the socket from now on and closes it when done
+    // forks the local workers that are missing. see the class comment for when to call it
+    void startWorkers();
+
+    // renders the whole frame into the bitmap of scene. returns false if some tile could not be rendered, in which case
+    // its pixels keep whatever the bitmap held before
+    bool render(Scene & scene);
+
+    // the worker side. reads scenes and renders tiles until the coordinator hangs up. returns 0 when it hung up
+    // cleanly and 1 on a malformed message
+    static int serveWorker(int socket);
+
+private:
+    struct Worker
+    {
+        int socket;
+        pid_t pid; // -1 for workers this coordinator did not fork
+        int tileIndex; // the tile being rendered, -1 when idle
+        std::chrono::steady_clock::time_point deadline; // when the tile is given up on, if tileIndex is not -1
+    };
+
+    int workerCount;
+    int tileSize = 64;
+    int maxAttempts = 3;
+    int tileTimeout = 120000;
+    std::vector<Worker> workers; // local and remote, kept from one render to the next
+
+    bool spawnWorker();
+    void addWorker(int socket, pid_t pid);
+    void dropWorker(Worker & worker) const; // closes its socket, and kills a forked worker
+};
+
+#endif
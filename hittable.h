@@ -4,14 +4,22 @@
 #include <memory>
 #include "math.h"
 #include "util.h"
+#include "renderContext.h"
 #include <vector>
 
 class Renderable
 {
 public:
     virtual bool hit(Math::Ray ray, float t0, float t1, std::shared_ptr<Util::HitRecord> & hitRecord) const = 0;
+    // true if anything lies along the ray in [t0, t1]. unlike hit it can stop at the first hit found instead of
+    // looking for the closest, which is all an occlusion ray needs
+    virtual bool hitAny(Math::Ray ray, float t0, float t1) const
+    {
+        std::shared_ptr<Util::HitRecord> hitRecord(new Util::HitRecord);
+        return this->hit(ray, t0, t1, hitRecord);
+    }
     virtual Util::Color computeColor(
-        const std::vector<std::unique_ptr<LightSource>> & lightSources,
+        const RenderContext & context,
         Math::Ray viewRay,
         std::shared_ptr<Renderable> surface,
         std::shared_ptr<Util::HitRecord> hitRecord
@@ -0,0 +1,210 @@
+#include "imageEncoder.h"
+#include "bitmap.h"
+#include "deflate.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    const int BYTES_PER_PIXEL = Bitmap::BYTES_PER_PIXEL;
+    const size_t PNG_ROWS_PER_BATCH = 16;
+
+    // the blue, green and red bytes of the pixel array row that is row y from the top, as red, green and blue
+    void copyRowTopDown(int width, int height, std::string const& pixelArray, int y, char *row)
+    {
+        const char *source = pixelArray.data() + (size_t) (height - 1 - y) * width * BYTES_PER_PIXEL;
+        for (int x = 0; x < width; x++)
+        {
+            row[x * BYTES_PER_PIXEL] = source[x * BYTES_PER_PIXEL + 2];
+            row[x * BYTES_PER_PIXEL + 1] = source[x * BYTES_PER_PIXEL + 1];
+            row[x * BYTES_PER_PIXEL + 2] = source[x * BYTES_PER_PIXEL];
+        }
+    }
+
+    void appendUint32BigEndian(std::string & output, uint32_t value)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+        {
+            output.push_back((char) (value >> shift));
+        }
+    }
+
+    void appendPngChunk(std::string & output, const char *type, std::string const& data)
+    {
+        appendUint32BigEndian(output, (uint32_t) data.size());
+        const size_t typeOffset = output.size();
+        output.append(type, 4);
+        output.append(data);
+        appendUint32BigEndian(output, Deflate::crc32(output.data() + typeOffset, 4 + data.size()));
+    }
+
+    uint8_t paeth(int left, int up, int upLeft)
+    {
+        const int estimate = left + up - upLeft;
+        const int leftDistance = std::abs(estimate - left);
+        const int upDistance = std::abs(estimate - up);
+        const int upLeftDistance = std::abs(estimate - upLeft);
+        if (leftDistance <= upDistance && leftDistance <= upLeftDistance) { return left; }
+        return upDistance <= upLeftDistance ? up : upLeft;
+    }
+
+    // filters row, given the row above (zeros for the first), with whichever of the five png filters leaves the
+    // smallest sum of absolute differences, the usual guess at what deflates best. output starts with the filter type
+    void filterRow(const uint8_t *row, const uint8_t *previousRow, size_t rowSize, uint8_t *output, std::vector<uint8_t> & candidate)
+    {
+        uint64_t bestSum = UINT64_MAX;
+        for (int filter = 0; filter < 5; filter++)
+        {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < rowSize; i++)
+            {
+                const int left = i >= (size_t) BYTES_PER_PIXEL ? row[i - BYTES_PER_PIXEL] : 0;
+                const int up = previousRow[i];
+                const int upLeft = i >= (size_t) BYTES_PER_PIXEL ? previousRow[i - BYTES_PER_PIXEL] : 0;
+                int prediction = 0;
+                if (filter == 1) { prediction = left; }
+                else if (filter == 2) { prediction = up; }
+                else if (filter == 3) { prediction = (left + up) / 2; }
+                else if (filter == 4) { prediction = paeth(left, up, upLeft); }
+                candidate[i] = (uint8_t) (row[i] - prediction);
+                sum += std::abs((int8_t) candidate[i]);
+            }
+            if (sum < bestSum)
+            {
+                bestSum = sum;
+                output[0] = (uint8_t) filter;
+                std::memcpy(output + 1, candidate.data(), rowSize);
+            }
+        }
+    }
+}
+
+std::unique_ptr<ImageEncoder> ImageEncoder::createForFilename(std::string const& filename)
+{
+    const size_t dot = filename.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : filename.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (extension == "ppm") { return std::unique_ptr<ImageEncoder>(new PpmEncoder()); }
+    if (extension == "pfm") { return std::unique_ptr<ImageEncoder>(new PfmEncoder()); }
+    if (extension == "png") { return std::unique_ptr<ImageEncoder>(new PngEncoder()); }
+    return std::unique_ptr<ImageEncoder>(new BmpEncoder());
+}
+
+std::string BmpEncoder::getExtension() const
+{
+    return "bmp";
+}
+
+std::string BmpEncoder::encode(int width, int height, std::string const& pixelArray) const
+{
+    return Bitmap::encode(width, height, pixelArray);
+}
+
+std::string PpmEncoder::getExtension() const
+{
+    return "ppm";
+}
+
+std::string PpmEncoder::encode(int width, int height, std::string const& pixelArray) const
+{
+    std::string file = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+    const size_t headerSize = file.size();
+    const size_t rowSize = (size_t) width * BYTES_PER_PIXEL;
+    file.resize(headerSize + rowSize * height);
+    for (int y = 0; y < height; y++)
+    {
+        copyRowTopDown(width, height, pixelArray, y, &file[headerSize + y * rowSize]);
+    }
+    return file;
+}
+
+std::string PfmEncoder::getExtension() const
+{
+    return "pfm";
+}
+
+std::string PfmEncoder::encode(int width, int height, std::string const& pixelArray) const
+{
+    // a negative scale means little endian
+    std::string file = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+    const size_t headerSize = file.size();
+    const size_t pixelCount = (size_t) width * height;
+    file.resize(headerSize + pixelCount * BYTES_PER_PIXEL * sizeof(float));
+    for (size_t p = 0; p < pixelCount; p++)
+    {
+        for (int channel = 0; channel < BYTES_PER_PIXEL; channel++)
+        {
+            const float value = (uint8_t) pixelArray[p * BYTES_PER_PIXEL + (BYTES_PER_PIXEL - 1 - channel)] / 255.0f;
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            char *destination = &file[headerSize + (p * BYTES_PER_PIXEL + channel) * sizeof(float)];
+            for (int i = 0; i < 4; i++) { destination[i] = (char) (bits >> (8 * i)); }
+        }
+    }
+    return file;
+}
+
+int PngEncoder::getCompressionLevel() const
+{
+    return this->compressionLevel;
+}
+
+int PngEncoder::getThreadCount() const
+{
+    return this->threadCount;
+}
+
+void PngEncoder::setCompressionLevel(int compressionLevel)
+{
+    this->compressionLevel = std::min(std::max(compressionLevel, 0), 9);
+}
+
+void PngEncoder::setThreadCount(int threadCount)
+{
+    this->threadCount = std::max(1, threadCount);
+}
+
+std::string PngEncoder::getExtension() const
+{
+    return "png";
+}
+
+std::string PngEncoder::encode(int width, int height, std::string const& pixelArray) const
+{
+    // every row is filtered against the unfiltered row above, so rows filter independently
+    const size_t rowSize = (size_t) width * BYTES_PER_PIXEL;
+    std::string filtered((rowSize + 1) * height, 0);
+    Util::parallelFor(height, PNG_ROWS_PER_BATCH, this->threadCount, [&](size_t begin, size_t end, int)
+    {
+        std::vector<uint8_t> row(rowSize), previousRow(rowSize, 0), candidate(rowSize);
+        if (begin > 0) { copyRowTopDown(width, height, pixelArray, begin - 1, (char *) previousRow.data()); }
+        for (size_t y = begin; y < end; y++)
+        {
+            copyRowTopDown(width, height, pixelArray, y, (char *) row.data());
+            filterRow(row.data(), previousRow.data(), rowSize, (uint8_t *) &filtered[y * (rowSize + 1)], candidate);
+            row.swap(previousRow);
+        }
+    });
+
+    std::string header;
+    appendUint32BigEndian(header, width);
+    appendUint32BigEndian(header, height);
+    header.push_back(8); // bits per channel
+    header.push_back(2); // rgb
+    header.push_back(0); // deflate
+    header.push_back(0); // adaptive filtering
+    header.push_back(0); // not interlaced
+
+    // each compressed chunk becomes an IDAT chunk of its own, which readers join back together
+    const std::vector<std::string> pieces = Deflate::compressZlib(filtered, this->compressionLevel, this->threadCount);
+    std::string file("\x89PNG\r\n\x1A\n", 8);
+    appendPngChunk(file, "IHDR", header);
+    for (auto & piece : pieces)
+    {
+        appendPngChunk(file, "IDAT", piece);
+    }
+    appendPngChunk(file, "IEND", "");
+    return file;
+}
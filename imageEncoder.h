@@ -0,0 +1,64 @@
+#ifndef IMAGE_ENCODER_HEADER
+#define IMAGE_ENCODER_HEADER
+
+#include <memory>
+#include <string>
+#include "parallel.h"
+
+// turns a pixel array, as Scene::computePixelArray returns it, into the bytes of an image file
+class ImageEncoder
+{
+public:
+    virtual ~ImageEncoder() {}
+
+    virtual std::string getExtension() const = 0; // without the dot
+    virtual std::string encode(int width, int height, std::string const& pixelArray) const = 0;
+
+    // the encoder for the extension of filename, ignoring case. a BmpEncoder for extensions it does not know
+    static std::unique_ptr<ImageEncoder> createForFilename(std::string const& filename);
+};
+
+// uncompressed 24 bit bmp. see Bitmap
+class BmpEncoder : public ImageEncoder
+{
+public:
+    std::string getExtension() const;
+    std::string encode(int width, int height, std::string const& pixelArray) const;
+};
+
+// binary ppm (P6): a short text header and the raw rows top down. the cheapest to write
+class PpmEncoder : public ImageEncoder
+{
+public:
+    std::string getExtension() const;
+    std::string encode(int width, int height, std::string const& pixelArray) const;
+};
+
+// pfm: little endian 32 bit floats per channel, rows bottom up. the renderer clamps colors to bytes before they reach
+// the bitmap, so the floats are those bytes over 255
+class PfmEncoder : public ImageEncoder
+{
+public:
+    std::string getExtension() const;
+    std::string encode(int width, int height, std::string const& pixelArray) const;
+};
+
+// 8 bit rgb png. rows are filtered and deflated in chunks on threadCount threads, see Deflate
+class PngEncoder : public ImageEncoder
+{
+public:
+    int getCompressionLevel() const;
+    int getThreadCount() const;
+
+    void setCompressionLevel(int compressionLevel); // 0 stores the rows uncompressed, up to 9 for the smallest files. 4 by default
+    void setThreadCount(int threadCount);
+
+    std::string getExtension() const;
+    std::string encode(int width, int height, std::string const& pixelArray) const;
+
+private:
+    int compressionLevel = 4;
+    int threadCount = Util::defaultThreadCount();
+};
+
+#endif
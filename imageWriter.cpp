@@ -0,0 +1,199 @@
+#include "imageWriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <memory>
+#include <unistd.h>
+
+namespace
+{
+    // O_DIRECT wants the buffer, offsets and sizes aligned to the logical block size, which this covers on common disks
+    const size_t DIRECT_IO_ALIGNMENT = 4096;
+
+    AsyncImageWriter::Result failure(std::string const& filename, std::string const& what)
+    {
+        AsyncImageWriter::Result result;
+        result.error = filename + ": " + what;
+        return result;
+    }
+
+    // pwrite until all of size is written, through interruptions and short writes. false with errno set on failure
+    bool writeAll(int file, const char *data, size_t size)
+    {
+        size_t written = 0;
+        while (written < size)
+        {
+            const ssize_t count = pwrite(file, data + written, size - written, (off_t) written);
+            if (count < 0)
+            {
+                if (errno == EINTR) { continue; }
+                return false;
+            }
+            written += count;
+        }
+        return true;
+    }
+
+#ifdef O_DIRECT
+    // the file rounded up to whole blocks from an aligned copy, then cut back to its size. false with errno set on
+    // failure
+    bool writeAllDirect(int file, std::string const& contents)
+    {
+        const size_t paddedSize = (contents.size() + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+        void *buffer = NULL;
+        if (paddedSize == 0) { return true; }
+        if (posix_memalign(&buffer, DIRECT_IO_ALIGNMENT, paddedSize) != 0)
+        {
+            errno = ENOMEM;
+            return false;
+        }
+        std::memcpy(buffer, contents.data(), contents.size());
+        std::memset((char *) buffer + contents.size(), 0, paddedSize - contents.size());
+        const bool success = writeAll(file, (const char *) buffer, paddedSize) && ftruncate(file, contents.size()) == 0;
+        const int error = errno;
+        std::free(buffer);
+        errno = error;
+        return success;
+    }
+#endif
+}
+
+AsyncImageWriter::AsyncImageWriter(int maxPendingWrites)
+    : maxPendingWrites(std::max(1, maxPendingWrites))
+{
+    this->thread = std::thread(&AsyncImageWriter::run, this);
+}
+
+AsyncImageWriter::~AsyncImageWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->jobQueued.notify_one();
+    this->thread.join();
+}
+
+int AsyncImageWriter::getMaxPendingWrites() const
+{
+    return this->maxPendingWrites;
+}
+
+bool AsyncImageWriter::getDirectIo() const
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->directIo;
+}
+
+void AsyncImageWriter::setDirectIo(bool directIo)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->directIo = directIo;
+}
+
+std::future<AsyncImageWriter::Result> AsyncImageWriter::write(std::string filename, std::string contents)
+{
+    // shared so that the encoder stays copyable, which std::function requires, without copying the bytes
+    auto bytes = std::make_shared<std::string>(std::move(contents));
+    return this->write(std::move(filename), [bytes]() { return std::move(*bytes); });
+}
+
+std::future<AsyncImageWriter::Result> AsyncImageWriter::write(std::string filename, Encoder encode)
+{
+    Job job;
+    job.filename = std::move(filename);
+    job.encode = std::move(encode);
+    std::future<Result> future = job.promise.get_future();
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->jobTaken.wait(lock, [this]() { return (int) this->jobs.size() < this->maxPendingWrites; });
+    job.directIo = this->directIo;
+    this->jobs.push_back(std::move(job));
+    lock.unlock();
+    this->jobQueued.notify_one();
+    return future;
+}
+
+void AsyncImageWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->jobFinished.wait(lock, [this]() { return this->jobs.empty() && !this->writing; });
+}
+
+AsyncImageWriter::Result AsyncImageWriter::writeFile(std::string const& filename, std::string const& contents, bool directIo)
+{
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    int file = -1;
+#ifdef O_DIRECT
+    if (directIo)
+    {
+        file = open(filename.c_str(), flags | O_DIRECT, 0644);
+        // file systems such as tmpfs refuse O_DIRECT outright
+        if (file < 0 && errno == EINVAL) { directIo = false; }
+        else if (file < 0) { return failure(filename, std::strerror(errno)); }
+    }
+#else
+    directIo = false;
+#endif
+    if (file < 0) { file = open(filename.c_str(), flags, 0644); }
+    if (file < 0) { return failure(filename, std::strerror(errno)); }
+
+    bool success = false;
+#ifdef O_DIRECT
+    if (directIo)
+    {
+        success = writeAllDirect(file, contents);
+        // and some only refuse it once written to. start over through the page cache
+        if (!success && errno == EINVAL && fcntl(file, F_SETFL, fcntl(file, F_GETFL) & ~O_DIRECT) == 0 && ftruncate(file, 0) == 0)
+        {
+            directIo = false;
+        }
+    }
+#endif
+    if (!directIo) { success = writeAll(file, contents.data(), contents.size()); }
+
+    const int error = errno;
+    if (close(file) != 0 && success) { return failure(filename, std::strerror(errno)); }
+    if (!success) { return failure(filename, std::strerror(error)); }
+
+    Result result;
+    result.success = true;
+    return result;
+}
+
+void AsyncImageWriter::run()
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->jobQueued.wait(lock, [this]() { return !this->jobs.empty() || this->stopping; });
+            if (this->jobs.empty()) { return; }
+            job = std::move(this->jobs.front());
+            this->jobs.pop_front();
+            this->writing = true;
+        }
+        this->jobTaken.notify_one();
+
+        Result result;
+        try
+        {
+            result = writeFile(job.filename, job.encode(), job.directIo);
+        }
+        catch (std::exception const& exception)
+        {
+            result = failure(job.filename, exception.what());
+        }
+        job.promise.set_value(result);
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->writing = false;
+        }
+        this->jobFinished.notify_all();
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef IMAGE_WRITER_HEADER
+#define IMAGE_WRITER_HEADER
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// writes files on a background thread. a write takes the bytes, or a function that encodes them on the writer thread,
+// and returns at once with a future for the outcome, so the render thread can go on to the next frame. at most
+// maxPendingWrites writes wait behind the one being written, two by default for a double buffer: one frame on its way
+// to the disk while the next is rendered. past that, write blocks until the writer catches up
+class AsyncImageWriter
+{
+public:
+    struct Result
+    {
+        bool success = false;
+        std::string error; // what went wrong, empty on success
+    };
+
+    // produces the bytes of a file on the writer thread. throwing fails the write with the exception message
+    typedef std::function<std::string()> Encoder;
+
+    AsyncImageWriter(int maxPendingWrites = 2);
+    // finishes every write already handed over
+    ~AsyncImageWriter();
+
+    AsyncImageWriter(AsyncImageWriter const&) = delete;
+    AsyncImageWriter & operator=(AsyncImageWriter const&) = delete;
+
+    int getMaxPendingWrites() const;
+    bool getDirectIo() const;
+
+    // bypasses the page cache with O_DIRECT where the file system supports it, falling back to plain writes where
+    // it does not. off by default
+    void setDirectIo(bool directIo);
+
+    std::future<Result> write(std::string filename, std::string contents);
+    std::future<Result> write(std::string filename, Encoder encode);
+    // blocks until every write handed over so far is done
+    void flush();
+
+    // writes contents to filename with pwrite on the calling thread
+    static Result writeFile(std::string const& filename, std::string const& contents, bool directIo);
+
+private:
+    struct Job
+    {
+        std::string filename;
+        Encoder encode;
+        bool directIo;
+        std::promise<Result> promise;
+    };
+
+    void run();
+
+    const int maxPendingWrites;
+    bool directIo = false;
+    mutable std::mutex mutex; // guards directIo, jobs and the flags below
+    std::condition_variable jobQueued, jobTaken, jobFinished;
+    std::deque<Job> jobs;
+    bool writing = false;
+    bool stopping = false;
+    std::thread thread;
+};
+
+#endif
@@ -0,0 +1,321 @@
+#include "irradianceCache.h"
+#include "sampling.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <mutex>
+
+namespace
+{
+    // how far a gather ray starts from its point, so that it does not find the surface it left
+    const float GATHER_EPSILON = 0.001;
+    // a record whose point lies in front of the point looked up, by more than this part of its radius, may see light
+    // that the point does not, as in a corner
+    const float FRONT_TOLERANCE = 0.05;
+
+    // the largest componentwise distance between a and b, which is how far apart they are in a cube's terms
+    float chebyshevDistance(Math::Vector3 const& a, Math::Vector3 const& b)
+    {
+        const Math::Vector3 offset = a - b;
+        return std::max(std::abs(offset.getX()), std::max(std::abs(offset.getY()), std::abs(offset.getZ())));
+    }
+
+    // which of the eight children of a cube centered at center the point falls in. bit 0 is x, bit 1 y and bit 2 z
+    int findOctant(Math::Vector3 const& center, Math::Vector3 const& point)
+    {
+        return (point.getX() >= center.getX() ? 1 : 0) | (point.getY() >= center.getY() ? 2 : 0) | (point.getZ() >= center.getZ() ? 4 : 0);
+    }
+
+    Math::Vector3 octantOffset(int octant, float distance)
+    {
+        return { (octant & 1) ? distance : -distance, (octant & 2) ? distance : -distance, (octant & 4) ? distance : -distance };
+    }
+
+    std::tuple<long, long, long> gridCell(Math::Vector3 const& point, float cellSize)
+    {
+        return std::make_tuple((long) std::floor(point.getX() / cellSize), (long) std::floor(point.getY() / cellSize), (long) std::floor(point.getZ() / cellSize));
+    }
+}
+
+IrradianceCache::IrradianceCache(int sampleCount, float accuracy, float minRadius, float maxRadius)
+    : lookupCount(0), interpolatedCount(0), recordCount(0), gatherRayCount(0)
+{
+    this->sampleCount = std::max(1, sampleCount);
+    this->accuracy = accuracy > 0 ? accuracy : 0.2f;
+    this->minRadius = std::max(minRadius, 1e-4f);
+    this->maxRadius = std::max(maxRadius, this->minRadius);
+}
+
+int IrradianceCache::getSampleCount() const
+{
+    return this->sampleCount;
+}
+
+float IrradianceCache::getAccuracy() const
+{
+    return this->accuracy;
+}
+
+float IrradianceCache::getMinRadius() const
+{
+    return this->minRadius;
+}
+
+float IrradianceCache::getMaxRadius() const
+{
+    return this->maxRadius;
+}
+
+IrradianceCache::Statistics IrradianceCache::getStatistics() const
+{
+    Statistics statistics;
+    statistics.lookupCount = this->lookupCount;
+    statistics.interpolatedCount = this->interpolatedCount;
+    statistics.recordCount = this->recordCount;
+    statistics.gatherRayCount = this->gatherRayCount;
+    return statistics;
+}
+
+IrradianceCache::MissMode IrradianceCache::getMissMode() const
+{
+    return this->missMode;
+}
+
+void IrradianceCache::setMissMode(MissMode missMode)
+{
+    this->missMode = missMode;
+}
+
+void IrradianceCache::clear()
+{
+    std::unique_lock<std::shared_mutex> lock(this->mutex);
+    this->root = NULL;
+    this->pendingPoints.clear();
+    this->lookupCount = 0;
+    this->interpolatedCount = 0;
+    this->recordCount = 0;
+    this->gatherRayCount = 0;
+}
+
+void IrradianceCache::computeIrradiance(const RenderContext & context, std::shared_ptr<Renderable> surface, Math::Vector3 point,
+    Math::Vector3 unitNormal, Math::Vector3 viewDirection, float irradiance[3])
+{
+    if (Math::dot(unitNormal, viewDirection) > 0) { unitNormal = -unitNormal; }
+    this->lookupCount++;
+    if (this->lookup(point, unitNormal, irradiance))
+    {
+        this->interpolatedCount++;
+        return;
+    }
+
+    if (this->missMode == MissMode::Defer)
+    {
+        irradiance[0] = irradiance[1] = irradiance[2] = 0;
+        std::lock_guard<std::mutex> lock(this->pendingMutex);
+        this->pendingPoints.push_back({ context.pixelIndex, context.sampleIndex, point, unitNormal });
+        return;
+    }
+
+    const Record record = this->gather(context, surface, point, unitNormal);
+    for (int channel = 0; channel < 3; channel++) { irradiance[channel] = record.irradiance[channel]; }
+    if (this->missMode == MissMode::Insert) { this->insert(record); }
+}
+
+void IrradianceCache::insertPending(const RenderContext & context, std::shared_ptr<Renderable> surface, int threadCount)
+{
+    // the order the threads queued in is not the order of the frame. ties only come from one sample seeing several
+    // points, which the points themselves then order
+    std::vector<PendingPoint> pendingPoints;
+    pendingPoints.swap(this->pendingPoints);
+    std::sort(pendingPoints.begin(), pendingPoints.end(), [](PendingPoint const& lhs, PendingPoint const& rhs)
+    {
+        if (lhs.pixelIndex != rhs.pixelIndex) { return lhs.pixelIndex < rhs.pixelIndex; }
+        if (lhs.sampleIndex != rhs.sampleIndex) { return lhs.sampleIndex < rhs.sampleIndex; }
+        if (lhs.point.getX() != rhs.point.getX()) { return lhs.point.getX() < rhs.point.getX(); }
+        if (lhs.point.getY() != rhs.point.getY()) { return lhs.point.getY() < rhs.point.getY(); }
+        return lhs.point.getZ() < rhs.point.getZ();
+    });
+
+    // gathering every point at once would crowd records where one would have covered its neighbours. so each round only
+    // gathers points further apart than reach, the points it passes over look up the records it made, and the ones
+    // still missed go to the next round with half the reach. below what the smallest record covers, every point goes
+    float reach = this->accuracy * this->maxRadius;
+    while (!pendingPoints.empty())
+    {
+        std::vector<PendingPoint> roundPoints, passedPoints;
+        std::map<std::tuple<long, long, long>, std::vector<Math::Vector3>> roundCells;
+        for (auto & pendingPoint : pendingPoints)
+        {
+            bool near = false;
+            if (reach >= this->accuracy * this->minRadius)
+            {
+                const std::tuple<long, long, long> cell = gridCell(pendingPoint.point, reach);
+                for (int neighbour = 0; neighbour < 27 && !near; neighbour++)
+                {
+                    const auto found = roundCells.find(std::make_tuple(std::get<0>(cell) + neighbour % 3 - 1,
+                        std::get<1>(cell) + neighbour / 3 % 3 - 1, std::get<2>(cell) + neighbour / 9 - 1));
+                    if (found == roundCells.end()) { continue; }
+                    for (auto & point : found->second)
+                    {
+                        if ((point - pendingPoint.point).norm() < reach) { near = true; }
+                    }
+                }
+                if (!near) { roundCells[cell].push_back(pendingPoint.point); }
+            }
+            if (near) { passedPoints.push_back(pendingPoint); }
+            else { roundPoints.push_back(pendingPoint); }
+        }
+
+        std::vector<Record> records(roundPoints.size());
+        Util::parallelFor(roundPoints.size(), 16, threadCount, [&](size_t begin, size_t end, int)
+        {
+            RenderContext pointContext = context;
+            for (size_t k = begin; k < end; k++)
+            {
+                pointContext.pixelIndex = roundPoints[k].pixelIndex;
+                pointContext.sampleIndex = roundPoints[k].sampleIndex;
+                pointContext.bounce = 0;
+                records[k] = this->gather(pointContext, surface, roundPoints[k].point, roundPoints[k].unitNormal);
+            }
+        });
+        for (auto & record : records) { this->insert(record); }
+
+        std::vector<uint8_t> missed(passedPoints.size(), 0);
+        Util::parallelFor(passedPoints.size(), 256, threadCount, [&](size_t begin, size_t end, int)
+        {
+            float irradiance[3];
+            for (size_t k = begin; k < end; k++)
+            {
+                missed[k] = this->lookup(passedPoints[k].point, passedPoints[k].unitNormal, irradiance) ? 0 : 1;
+            }
+        });
+        pendingPoints.clear();
+        for (size_t k = 0; k < passedPoints.size(); k++)
+        {
+            if (missed[k]) { pendingPoints.push_back(passedPoints[k]); }
+        }
+        reach /= 2;
+    }
+}
+
+IrradianceCache::Record IrradianceCache::gather(const RenderContext & context, std::shared_ptr<Renderable> surface, Math::Vector3 point, Math::Vector3 unitNormal)
+{
+    // r2 points under a random shift per record, mapped to cosine weighted directions so that the plain average of
+    // what the rays see is the irradiance over pi
+    Util::Sampler sampler = context.sampler(Util::INDIRECT_STREAM);
+    const float offsetU = sampler.nextFloat(), offsetV = sampler.nextFloat();
+    RenderContext gatherContext = context;
+    gatherContext.bounce++;
+    // a gather ray stands for its share of the hemisphere, so whatever it sees is filtered over that width
+    const float spread = std::sqrt(2 * (float) M_PI / this->sampleCount);
+    Math::Vector3 tangent, bitangent;
+    Util::orthonormalBasis(unitNormal, tangent, bitangent);
+    gatherContext.rayDifferential = { { 0, 0, 0 }, { 0, 0, 0 }, spread * tangent, spread * bitangent };
+    std::shared_ptr<Util::HitRecord> hitRecord(new Util::HitRecord);
+    float sums[3] = { 0, 0, 0 };
+    float inverseDistanceSum = 0;
+    for (int k = 0; k < this->sampleCount; k++)
+    {
+        float u, v;
+        Util::r2Point(k, offsetU, offsetV, u, v);
+        const Math::Vector3 direction = Util::cosineDirection(unitNormal, u, v);
+        const Math::Ray ray = { point + GATHER_EPSILON * direction, direction };
+        Util::Color color = surface->computeColor(gatherContext, ray, surface, hitRecord);
+        if (hitRecord->intersectionTime < 0) { color = context.backgroundColor; }
+        else { inverseDistanceSum += 1 / std::max(hitRecord->intersectionTime + GATHER_EPSILON, this->minRadius); }
+        sums[0] += color.red;
+        sums[1] += color.green;
+        sums[2] += color.blue;
+    }
+    this->gatherRayCount += this->sampleCount;
+
+    Record record;
+    record.point = point;
+    record.unitNormal = unitNormal;
+    for (int channel = 0; channel < 3; channel++)
+    {
+        record.irradiance[channel] = sums[channel] / (255.0f * this->sampleCount);
+    }
+    // the harmonic mean distance, which near walls and corners shrinks to keep records where the light changes fast
+    const float radius = inverseDistanceSum > 0 ? this->sampleCount / inverseDistanceSum : this->maxRadius;
+    record.radius = std::min(std::max(radius, this->minRadius), this->maxRadius);
+    return record;
+}
+
+bool IrradianceCache::lookup(Math::Vector3 point, Math::Vector3 unitNormal, float irradiance[3]) const
+{
+    std::shared_lock<std::shared_mutex> lock(this->mutex);
+    if (this->root == NULL) { return false; }
+
+    float totalWeight = 0;
+    irradiance[0] = irradiance[1] = irradiance[2] = 0;
+    this->lookupInNode(*this->root, point, unitNormal, irradiance, totalWeight);
+    if (totalWeight <= 0) { return false; }
+    for (int channel = 0; channel < 3; channel++) { irradiance[channel] /= totalWeight; }
+    return true;
+}
+
+void IrradianceCache::lookupInNode(const Node & node, Math::Vector3 point, Math::Vector3 unitNormal, float irradiance[3], float & totalWeight) const
+{
+    if (chebyshevDistance(point, node.center) > 2 * node.halfSize) { return; }
+
+    for (auto & record : node.records)
+    {
+        const Math::Vector3 offset = point - record.point;
+        const float error = offset.norm() / record.radius + std::sqrt(std::max(0.0f, 1 - Math::dot(unitNormal, record.unitNormal)));
+        if (error >= this->accuracy) { continue; }
+        if (Math::dot(offset, (unitNormal + record.unitNormal) / 2) < -FRONT_TOLERANCE * record.radius) { continue; }
+
+        // ward's weight less its value at the accuracy, so that a record fades out toward the edge of where it is valid
+        // instead of ending at a seam
+        const float weight = 1 / std::max(error, 1e-4f) - 1 / this->accuracy;
+        irradiance[0] += weight * record.irradiance[0];
+        irradiance[1] += weight * record.irradiance[1];
+        irradiance[2] += weight * record.irradiance[2];
+        totalWeight += weight;
+    }
+    for (auto & child : node.children)
+    {
+        if (child != NULL) { this->lookupInNode(*child, point, unitNormal, irradiance, totalWeight); }
+    }
+}
+
+void IrradianceCache::insert(Record const& record)
+{
+    std::unique_lock<std::shared_mutex> lock(this->mutex);
+    const float validRadius = this->accuracy * record.radius;
+    if (this->root == NULL)
+    {
+        this->root = std::unique_ptr<Node>(new Node());
+        this->root->center = record.point;
+        this->root->halfSize = this->accuracy * this->maxRadius;
+    }
+
+    // the octree has no fixed bounds. it grows a parent around the root, toward the record, until the record fits
+    while (chebyshevDistance(record.point, this->root->center) > this->root->halfSize || this->root->halfSize < validRadius)
+    {
+        const int octant = findOctant(this->root->center, record.point);
+        std::unique_ptr<Node> parent(new Node());
+        parent->center = this->root->center + octantOffset(octant, this->root->halfSize);
+        parent->halfSize = 2 * this->root->halfSize;
+        parent->children[findOctant(parent->center, this->root->center)] = std::move(this->root);
+        this->root = std::move(parent);
+    }
+
+    Node * node = this->root.get();
+    while (node->halfSize / 2 >= validRadius)
+    {
+        const int octant = findOctant(node->center, record.point);
+        if (node->children[octant] == NULL)
+        {
+            node->children[octant] = std::unique_ptr<Node>(new Node());
+            node->children[octant]->center = node->center + octantOffset(octant, node->halfSize / 2);
+            node->children[octant]->halfSize = node->halfSize / 2;
+        }
+        node = node->children[octant].get();
+    }
+    node->records.push_back(record);
+    this->recordCount++;
+}
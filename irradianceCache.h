@@ -0,0 +1,108 @@
+#ifndef IRRADIANCE_CACHE_HEADER
+#define IRRADIANCE_CACHE_HEADER
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include "math.h"
+#include "hittable.h"
+#include "renderContext.h"
+
+// indirect diffuse light (ward et al. 1988). gathering the light that reaches a point off other surfaces takes a
+// hemisphere of rays, so it is done only at sparse points and stored in an octree. every other point interpolates the
+// records whose error estimate at that point is below the accuracy, and gathers its own only when none is. lookups
+// share a lock and only inserts take it alone, so threads can fill the cache while they read it. nothing in a record
+// depends on the camera, so one cache serves every frame of a fly through until the scene itself changes. records that
+// threads insert as they race across the frame depend on which thread got where first, so a frame that must not
+// depend on its thread count fills the cache with Defer and insertPending first and renders with Gather
+class IrradianceCache
+{
+public:
+    // what computeIrradiance does at a point no record covers
+    enum class MissMode
+    {
+        Insert, // gathers a record for the point and keeps it
+        Defer, // answers no light and queues the point for insertPending
+        Gather, // gathers for the point alone and keeps nothing, leaving the records as they are
+    };
+
+    struct Statistics
+    {
+        long lookupCount = 0; // points that asked the cache
+        long interpolatedCount = 0; // of those, the ones that were answered from records
+        long recordCount = 0;
+        long gatherRayCount = 0;
+    };
+
+    // sampleCount rays gather each record. accuracy is ward's a: the error a record may have at a point it is used
+    // at, smaller for more records. the radius a record is valid over, the harmonic mean distance to what its rays hit,
+    // is kept in [minRadius, maxRadius] so that records neither crowd corners nor stretch across open space
+    IrradianceCache(int sampleCount, float accuracy, float minRadius, float maxRadius);
+
+    int getSampleCount() const;
+    float getAccuracy() const;
+    float getMinRadius() const;
+    float getMaxRadius() const;
+    Statistics getStatistics() const;
+    MissMode getMissMode() const;
+    void setMissMode(MissMode missMode); // not while a frame is being shaded
+
+    // the light reaching point per channel from other surfaces, cosine weighted and in the units of
+    // LightTable::red and the others, so that it adds straight onto lambert shading. viewDirection is only used to turn
+    // the normal toward the viewer. the rays trace through surface at context.bounce + 1 and take
+    // context.backgroundColor where they leave the scene
+    void computeIrradiance(const RenderContext & context, std::shared_ptr<Renderable> surface, Math::Vector3 point,
+        Math::Vector3 unitNormal, Math::Vector3 viewDirection, float irradiance[3]);
+    // gathers the points Defer queued on threadCount threads and inserts their records in pixel order, so that the
+    // records do not depend on which thread queued what. context gives everything but the pixel and sample of each
+    // point, and must be safe to share between threads
+    void insertPending(const RenderContext & context, std::shared_ptr<Renderable> surface, int threadCount);
+
+    void clear();
+
+private:
+    struct Record
+    {
+        Math::Vector3 point;
+        Math::Vector3 unitNormal;
+        float irradiance[3];
+        float radius;
+    };
+
+    // a point Defer left for insertPending, with the normal already turned toward the viewer
+    struct PendingPoint
+    {
+        uint32_t pixelIndex;
+        uint32_t sampleIndex;
+        Math::Vector3 point;
+        Math::Vector3 unitNormal;
+    };
+
+    // a cube of the octree. a record lives in the smallest cube at least as big as the sphere it is valid in, so a
+    // lookup only has to visit the cubes that, grown by their own half size, contain the point
+    struct Node
+    {
+        Math::Vector3 center;
+        float halfSize;
+        std::vector<Record> records;
+        std::unique_ptr<Node> children[8];
+    };
+
+    Record gather(const RenderContext & context, std::shared_ptr<Renderable> surface, Math::Vector3 point, Math::Vector3 unitNormal);
+    bool lookup(Math::Vector3 point, Math::Vector3 unitNormal, float irradiance[3]) const;
+    void insert(Record const& record);
+    void lookupInNode(const Node & node, Math::Vector3 point, Math::Vector3 unitNormal, float irradiance[3], float & totalWeight) const;
+
+    int sampleCount;
+    float accuracy, minRadius, maxRadius;
+    MissMode missMode = MissMode::Insert;
+    std::unique_ptr<Node> root;
+    mutable std::shared_mutex mutex;
+    std::vector<PendingPoint> pendingPoints;
+    std::mutex pendingMutex;
+    mutable std::atomic<long> lookupCount, interpolatedCount, recordCount, gatherRayCount;
+};
+
+#endif
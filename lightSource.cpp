@@ -1,17 +1,30 @@
 #include "lightSource.h"
 #include "math.h"
 #include "util.h"
+#include "lightTable.h"
+
+namespace
+{
+    // type tags of the serialized lights
+    const uint8_t UNIDIRECTIONAL_LIGHT_SOURCE = 1;
+    const uint8_t POINT_LIGHT_SOURCE = 2;
+    const uint8_t RECTANGLE_LIGHT_SOURCE = 3;
+    const uint8_t SPHERE_LIGHT_SOURCE = 4;
+    // the keywords of the text format, indexed by type tag
+    const char * const LIGHT_SOURCE_TYPE_NAMES[] = { "", "unidirectionalLight", "pointLight", "rectangleLight", "sphereLight" };
+    const size_t LIGHT_SOURCE_TYPE_COUNT = sizeof(LIGHT_SOURCE_TYPE_NAMES) / sizeof(LIGHT_SOURCE_TYPE_NAMES[0]);
+}
 
 LightSource::LightSource()
 {
     this->intensity = 0;
-    this->color = { 0, 0, 0 };
+    this->color = { 255, 255, 255 };
 }
 
 LightSource::LightSource(float intensity)
 {
     this->intensity = intensity;
-    this->color = { 0, 0, 0 };
+    this->color = { 255, 255, 255 };
 }
 
 LightSource::LightSource(float intensity, Util::Color color)
@@ -25,31 +38,83 @@ float LightSource::getIntensity() const
     return this->intensity;
 }
 
+Util::Color LightSource::getColor() const
+{
+    return this->color;
+}
+
 void LightSource::setIntensity(float intensity)
 {
     this->intensity = intensity;
 }
 
+void LightSource::setColor(Util::Color color)
+{
+    this->color = color;
+}
+
+float LightSource::premultipliedChannel(uint8_t channel) const
+{
+    return this->intensity * (channel / 255.0f);
+}
+
+std::unique_ptr<LightSource> LightSource::deserialize(Serialization::Reader & reader)
+{
+    std::unique_ptr<LightSource> lightSource;
+    const uint8_t type = reader.readType(LIGHT_SOURCE_TYPE_NAMES, LIGHT_SOURCE_TYPE_COUNT);
+    if (type == UNIDIRECTIONAL_LIGHT_SOURCE)
+    {
+        UnidirectionalLightSource * unidirectionalLightSource = new UnidirectionalLightSource(reader.readVector3("direction"));
+        lightSource = std::unique_ptr<LightSource>(unidirectionalLightSource);
+        unidirectionalLightSource->setMaxRenderDistance(reader.readFloat("maxRenderDistance"));
+    }
+    else if (type == POINT_LIGHT_SOURCE)
+    {
+        lightSource = std::unique_ptr<LightSource>(new PointLightSource(reader.readVector3("point")));
+    }
+    else if (type == RECTANGLE_LIGHT_SOURCE)
+    {
+        const Math::Vector3 center = reader.readVector3("center");
+        const Math::Vector3 edgeU = reader.readVector3("edgeU");
+        lightSource = std::unique_ptr<LightSource>(new RectangleLightSource(center, edgeU, reader.readVector3("edgeV")));
+    }
+    else if (type == SPHERE_LIGHT_SOURCE)
+    {
+        const Math::Vector3 center = reader.readVector3("center");
+        lightSource = std::unique_ptr<LightSource>(new SphereLightSource(center, reader.readFloat("radius")));
+    }
+
+    if (lightSource == NULL)
+    {
+        reader.fail();
+        return NULL;
+    }
+    lightSource->setIntensity(reader.readFloat("intensity"));
+    lightSource->setColor(reader.readColor("color"));
+    if (!reader.isOk()) { return NULL; }
+    return lightSource;
+}
+
 UnidirectionalLightSource::UnidirectionalLightSource()
 {
-    this->direction = { 0, 0, -1 };
+    this->setDirection({ 0, 0, -1 });
 }
 
 UnidirectionalLightSource::UnidirectionalLightSource(Math::Vector3 direction)
 {
-    this->direction = direction;
+    this->setDirection(direction);
 }
 
 UnidirectionalLightSource::UnidirectionalLightSource(Math::Vector3 direction, float intensity)
     : LightSource::LightSource(intensity)
 {
-    this->direction = direction;
+    this->setDirection(direction);
 }
 
 UnidirectionalLightSource::UnidirectionalLightSource(Math::Vector3 direction, float intensity, Util::Color color)
     : LightSource::LightSource(intensity, color)
 {
-    this->direction = direction;
+    this->setDirection(direction);
 }
 
 Math::Vector3 UnidirectionalLightSource::getDirection() const
@@ -60,6 +125,7 @@ Math::Vector3 UnidirectionalLightSource::getDirection() const
 void UnidirectionalLightSource::setDirection(Math::Vector3 direction)
 {
     this->direction = direction;
+    this->unitDirection = direction / direction.norm();
 }
 
 void UnidirectionalLightSource::setMaxRenderDistance(float maxRenderDistance)
@@ -74,7 +140,28 @@ float UnidirectionalLightSource::timeToLightSource(Math::Ray ray) const
 
 Math::Vector3 UnidirectionalLightSource::getLightDirectionToSurfacePoint(Math::Vector3 surfacePoint) const
 {
-    return this->direction / this->direction.norm();
+    return this->unitDirection;
+}
+
+void UnidirectionalLightSource::addToLightTable(LightTable & lightTable) const
+{
+    const Util::Color color = this->getColor();
+    lightTable.addDirectionalLight(
+        -this->unitDirection,
+        this->maxRenderDistance,
+        this->premultipliedChannel(color.red),
+        this->premultipliedChannel(color.green),
+        this->premultipliedChannel(color.blue)
+    );
+}
+
+void UnidirectionalLightSource::serialize(Serialization::Writer & writer) const
+{
+    writer.writeType(UNIDIRECTIONAL_LIGHT_SOURCE, LIGHT_SOURCE_TYPE_NAMES);
+    writer.writeVector3("direction", this->direction);
+    writer.writeFloat("maxRenderDistance", this->maxRenderDistance);
+    writer.writeFloat("intensity", this->getIntensity());
+    writer.writeColor("color", this->getColor());
 }
 
 PointLightSource::PointLightSource()
@@ -112,7 +199,7 @@ void PointLightSource::setPoint(Math::Vector3 point)
 float PointLightSource::timeToLightSource(Math::Ray ray) const
 {
     float raySpeed = ray.direction.norm();
-    return std::abs(this->point.getX() - ray.origin.getX()) / raySpeed;
+    return (this->point - ray.origin).norm() / raySpeed;
 }
 
 Math::Vector3 PointLightSource::getLightDirectionToSurfacePoint(Math::Vector3 surfacePoint) const
@@ -120,3 +207,142 @@ Math::Vector3 PointLightSource::getLightDirectionToSurfacePoint(Math::Vector3 su
     const Math::Vector3 unnormalizedDirection = surfacePoint - this->point;
     return unnormalizedDirection / unnormalizedDirection.norm();
 }
+
+void PointLightSource::addToLightTable(LightTable & lightTable) const
+{
+    const Util::Color color = this->getColor();
+    lightTable.addPointLight(
+        this->point,
+        this->premultipliedChannel(color.red),
+        this->premultipliedChannel(color.green),
+        this->premultipliedChannel(color.blue)
+    );
+}
+
+void PointLightSource::serialize(Serialization::Writer & writer) const
+{
+    writer.writeType(POINT_LIGHT_SOURCE, LIGHT_SOURCE_TYPE_NAMES);
+    writer.writeVector3("point", this->point);
+    writer.writeFloat("intensity", this->getIntensity());
+    writer.writeColor("color", this->getColor());
+}
+
+RectangleLightSource::RectangleLightSource()
+{
+    this->edgeU = { 1, 0, 0 };
+    this->edgeV = { 0, 1, 0 };
+}
+
+RectangleLightSource::RectangleLightSource(Math::Vector3 center, Math::Vector3 edgeU, Math::Vector3 edgeV)
+    : PointLightSource::PointLightSource(center)
+{
+    this->edgeU = edgeU;
+    this->edgeV = edgeV;
+}
+
+RectangleLightSource::RectangleLightSource(Math::Vector3 center, Math::Vector3 edgeU, Math::Vector3 edgeV, float intensity)
+    : PointLightSource::PointLightSource(center, intensity)
+{
+    this->edgeU = edgeU;
+    this->edgeV = edgeV;
+}
+
+RectangleLightSource::RectangleLightSource(Math::Vector3 center, Math::Vector3 edgeU, Math::Vector3 edgeV, float intensity, Util::Color color)
+    : PointLightSource::PointLightSource(center, intensity, color)
+{
+    this->edgeU = edgeU;
+    this->edgeV = edgeV;
+}
+
+Math::Vector3 RectangleLightSource::getEdgeU() const
+{
+    return this->edgeU;
+}
+
+Math::Vector3 RectangleLightSource::getEdgeV() const
+{
+    return this->edgeV;
+}
+
+void RectangleLightSource::setEdges(Math::Vector3 edgeU, Math::Vector3 edgeV)
+{
+    this->edgeU = edgeU;
+    this->edgeV = edgeV;
+}
+
+void RectangleLightSource::addToLightTable(LightTable & lightTable) const
+{
+    const Util::Color color = this->getColor();
+    lightTable.addRectangleLight(
+        this->getPoint(),
+        this->edgeU,
+        this->edgeV,
+        this->premultipliedChannel(color.red),
+        this->premultipliedChannel(color.green),
+        this->premultipliedChannel(color.blue)
+    );
+}
+
+void RectangleLightSource::serialize(Serialization::Writer & writer) const
+{
+    writer.writeType(RECTANGLE_LIGHT_SOURCE, LIGHT_SOURCE_TYPE_NAMES);
+    writer.writeVector3("center", this->getPoint());
+    writer.writeVector3("edgeU", this->edgeU);
+    writer.writeVector3("edgeV", this->edgeV);
+    writer.writeFloat("intensity", this->getIntensity());
+    writer.writeColor("color", this->getColor());
+}
+
+SphereLightSource::SphereLightSource()
+{
+    this->radius = 1;
+}
+
+SphereLightSource::SphereLightSource(Math::Vector3 center, float radius)
+    : PointLightSource::PointLightSource(center)
+{
+    this->radius = radius;
+}
+
+SphereLightSource::SphereLightSource(Math::Vector3 center, float radius, float intensity)
+    : PointLightSource::PointLightSource(center, intensity)
+{
+    this->radius = radius;
+}
+
+SphereLightSource::SphereLightSource(Math::Vector3 center, float radius, float intensity, Util::Color color)
+    : PointLightSource::PointLightSource(center, intensity, color)
+{
+    this->radius = radius;
+}
+
+float SphereLightSource::getRadius() const
+{
+    return this->radius;
+}
+
+void SphereLightSource::setRadius(float radius)
+{
+    this->radius = radius;
+}
+
+void SphereLightSource::addToLightTable(LightTable & lightTable) const
+{
+    const Util::Color color = this->getColor();
+    lightTable.addSphereLight(
+        this->getPoint(),
+        this->radius,
+        this->premultipliedChannel(color.red),
+        this->premultipliedChannel(color.green),
+        this->premultipliedChannel(color.blue)
+    );
+}
+
+void SphereLightSource::serialize(Serialization::Writer & writer) const
+{
+    writer.writeType(SPHERE_LIGHT_SOURCE, LIGHT_SOURCE_TYPE_NAMES);
+    writer.writeVector3("center", this->getPoint());
+    writer.writeFloat("radius", this->radius);
+    writer.writeFloat("intensity", this->getIntensity());
+    writer.writeColor("color", this->getColor());
+}
@@ -4,7 +4,11 @@
 #include <stdint.h>
 #include "math.h"
 #include "util.h"
+#include "serialization.h"
 #include <limits>
+#include <memory>
+
+class LightTable;
 
 class LightSource
 {
@@ -14,14 +18,23 @@ public:
     LightSource(float intensity, Util::Color color);
 
     float getIntensity() const;
+    Util::Color getColor() const;
 
     void setIntensity(float intensity);
+    void setColor(Util::Color color); // white by default
 
     virtual float timeToLightSource(Math::Ray ray) const = 0;
     virtual Math::Vector3 getLightDirectionToSurfacePoint(Math::Vector3 surfacePoint) const = 0;
+    virtual void addToLightTable(LightTable & lightTable) const = 0;
+
+    virtual void serialize(Serialization::Writer & writer) const = 0;
+    static std::unique_ptr<LightSource> deserialize(Serialization::Reader & reader); // NULL if the reader does not hold a light
+protected:
+    // one channel of the color scaled by the intensity, where a full channel at intensity 1 is 1
+    float premultipliedChannel(uint8_t channel) const;
 private:
     float intensity;
-    Util::Color color; // TODO: wait when is this used?
+    Util::Color color;
 };
 
 class UnidirectionalLightSource : public LightSource
@@ -39,8 +52,11 @@ public:
 
     float timeToLightSource(Math::Ray ray) const;
     Math::Vector3 getLightDirectionToSurfacePoint(Math::Vector3 surfacePoint) const;
+    void addToLightTable(LightTable & lightTable) const;
+    void serialize(Serialization::Writer & writer) const;
 private:
     Math::Vector3 direction;
+    Math::Vector3 unitDirection; // kept in step with direction so lookups do not normalize
     float maxRenderDistance = std::numeric_limits<float>::max();
 };
 
@@ -58,8 +74,50 @@ public:
 
     float timeToLightSource(Math::Ray ray) const;
     Math::Vector3 getLightDirectionToSurfacePoint(Math::Vector3 surfacePoint) const;
+    void addToLightTable(LightTable & lightTable) const;
+    void serialize(Serialization::Writer & writer) const;
 private:
     Math::Vector3 point;
 };
 
+// a point light spread over the parallelogram spanned by edgeU and edgeV around its center, the point. it casts soft
+// shadows, estimated from a few shadow rays toward points across it
+class RectangleLightSource : public PointLightSource
+{
+public:
+    RectangleLightSource();
+    RectangleLightSource(Math::Vector3 center, Math::Vector3 edgeU, Math::Vector3 edgeV);
+    RectangleLightSource(Math::Vector3 center, Math::Vector3 edgeU, Math::Vector3 edgeV, float intensity);
+    RectangleLightSource(Math::Vector3 center, Math::Vector3 edgeU, Math::Vector3 edgeV, float intensity, Util::Color color);
+
+    Math::Vector3 getEdgeU() const;
+    Math::Vector3 getEdgeV() const;
+
+    void setEdges(Math::Vector3 edgeU, Math::Vector3 edgeV);
+
+    void addToLightTable(LightTable & lightTable) const;
+    void serialize(Serialization::Writer & writer) const;
+private:
+    Math::Vector3 edgeU, edgeV;
+};
+
+// a point light spread over a ball of the given radius around the point. it casts soft shadows like a rectangle light
+class SphereLightSource : public PointLightSource
+{
+public:
+    SphereLightSource();
+    SphereLightSource(Math::Vector3 center, float radius);
+    SphereLightSource(Math::Vector3 center, float radius, float intensity);
+    SphereLightSource(Math::Vector3 center, float radius, float intensity, Util::Color color);
+
+    float getRadius() const;
+
+    void setRadius(float radius);
+
+    void addToLightTable(LightTable & lightTable) const;
+    void serialize(Serialization::Writer & writer) const;
+private:
+    float radius;
+};
+
 #endif
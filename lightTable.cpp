@@ -0,0 +1,120 @@
+#include "lightTable.h"
+#include <limits>
+
+namespace
+{
+    const float QUARTER_PI = 0.78539816339;
+    const float HALF_PI = 1.57079632679;
+}
+
+LightTable::LightTable() {}
+
+LightTable::LightTable(const std::vector<std::unique_ptr<LightSource>> & lightSources)
+{
+    for (auto & lightSource : lightSources)
+    {
+        lightSource->addToLightTable(*this);
+    }
+}
+
+int LightTable::size() const
+{
+    return (int) this->types.size();
+}
+
+void LightTable::addDirectionalLight(Math::Vector3 unitDirectionToLight, float maxDistance, float red, float green, float blue)
+{
+    this->types.push_back(DIRECTIONAL);
+    this->x.push_back(unitDirectionToLight.getX());
+    this->y.push_back(unitDirectionToLight.getY());
+    this->z.push_back(unitDirectionToLight.getZ());
+    this->red.push_back(red);
+    this->green.push_back(green);
+    this->blue.push_back(blue);
+    this->maxDistances.push_back(maxDistance);
+    this->edgesU.push_back({ 0, 0, 0 });
+    this->edgesV.push_back({ 0, 0, 0 });
+    this->radii.push_back(0);
+}
+
+void LightTable::addPointLight(Math::Vector3 point, float red, float green, float blue)
+{
+    this->types.push_back(POINT);
+    this->x.push_back(point.getX());
+    this->y.push_back(point.getY());
+    this->z.push_back(point.getZ());
+    this->red.push_back(red);
+    this->green.push_back(green);
+    this->blue.push_back(blue);
+    this->maxDistances.push_back(std::numeric_limits<float>::max());
+    this->edgesU.push_back({ 0, 0, 0 });
+    this->edgesV.push_back({ 0, 0, 0 });
+    this->radii.push_back(0);
+}
+
+void LightTable::addRectangleLight(Math::Vector3 center, Math::Vector3 edgeU, Math::Vector3 edgeV, float red, float green, float blue)
+{
+    this->addPointLight(center, red, green, blue);
+    this->types.back() = RECTANGLE;
+    this->edgesU.back() = edgeU;
+    this->edgesV.back() = edgeV;
+}
+
+void LightTable::addSphereLight(Math::Vector3 center, float radius, float red, float green, float blue)
+{
+    this->addPointLight(center, red, green, blue);
+    this->types.back() = SPHERE;
+    this->radii.back() = radius;
+}
+
+bool LightTable::hasAreaLights() const
+{
+    for (int i = 0; i < this->size(); i++)
+    {
+        if (this->isAreaLight(i)) { return true; }
+    }
+    return false;
+}
+
+void LightTable::directionToLightSample(int lightIndex, Math::Vector3 point, float u, float v, Math::Vector3 & direction, float & distance) const
+{
+    Math::Vector3 target(this->x[lightIndex], this->y[lightIndex], this->z[lightIndex]);
+    if (this->types[lightIndex] == RECTANGLE)
+    {
+        target = target + (u - 0.5f) * this->edgesU[lightIndex] + (v - 0.5f) * this->edgesV[lightIndex];
+    }
+    else if (this->types[lightIndex] == SPHERE)
+    {
+        // the concentric map of the square onto the disk, which keeps neighbouring strata neighbours
+        const float a = 2 * u - 1, b = 2 * v - 1;
+        float radius = 0, angle = 0;
+        if (a * a > b * b) { radius = a; angle = QUARTER_PI * (b / a); }
+        else if (b != 0) { radius = b; angle = HALF_PI - QUARTER_PI * (a / b); }
+
+        const Math::Vector3 toCenter = target - point;
+        const float centerDistance = toCenter.norm();
+        if (centerDistance > 0)
+        {
+            const Math::Vector3 w = toCenter / centerDistance;
+            Math::Vector3 diskU = Math::cross(w, std::abs(w.getX()) > 0.9f ? Math::Vector3(0, 1, 0) : Math::Vector3(1, 0, 0));
+            diskU = diskU / diskU.norm();
+            const Math::Vector3 diskV = Math::cross(w, diskU);
+            radius *= this->radii[lightIndex];
+            target = target + (radius * std::cos(angle)) * diskU + (radius * std::sin(angle)) * diskV;
+        }
+    }
+    else
+    {
+        this->directionToLight(lightIndex, point, direction, distance);
+        return;
+    }
+
+    const Math::Vector3 toLight = target - point;
+    distance = toLight.norm();
+    direction = toLight / distance;
+}
+
+float LightTable::power(int lightIndex) const
+{
+    return (this->red[lightIndex] + this->green[lightIndex] + this->blue[lightIndex]) / 3;
+}
@@ -0,0 +1,66 @@
+#ifndef LIGHT_TABLE_HEADER
+#define LIGHT_TABLE_HEADER
+
+#include <stdint.h>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "math.h"
+#include "lightSource.h"
+
+// the lights of a scene flattened into parallel arrays when a render starts. shaders loop over the table by light
+// index instead of making virtual calls on every light, and light colors come premultiplied by intensity
+class LightTable
+{
+public:
+    enum LightType : uint8_t
+    {
+        DIRECTIONAL,
+        POINT,
+        RECTANGLE, // the area lights come last
+        SPHERE
+    };
+
+    LightTable();
+    LightTable(const std::vector<std::unique_ptr<LightSource>> & lightSources);
+
+    int size() const;
+
+    // for directional lights, the unit direction toward the light and how far shadow rays reach
+    void addDirectionalLight(Math::Vector3 unitDirectionToLight, float maxDistance, float red, float green, float blue);
+    void addPointLight(Math::Vector3 point, float red, float green, float blue);
+    void addRectangleLight(Math::Vector3 center, Math::Vector3 edgeU, Math::Vector3 edgeV, float red, float green, float blue);
+    void addSphereLight(Math::Vector3 center, float radius, float red, float green, float blue);
+
+    bool isAreaLight(int lightIndex) const { return this->types[lightIndex] >= RECTANGLE; }
+    bool hasAreaLights() const;
+
+    // the unit direction from point toward the light and the distance a shadow ray has to cover to get there
+    void directionToLight(int lightIndex, Math::Vector3 point, Math::Vector3 & direction, float & distance) const
+    {
+        if (this->types[lightIndex] == DIRECTIONAL)
+        {
+            direction = { this->x[lightIndex], this->y[lightIndex], this->z[lightIndex] };
+            distance = this->maxDistances[lightIndex];
+            return;
+        }
+        const Math::Vector3 toLight = Math::Vector3(this->x[lightIndex], this->y[lightIndex], this->z[lightIndex]) - point;
+        distance = toLight.norm();
+        direction = toLight / distance;
+    }
+
+    // directionToLight toward the point of an area light at u and v in [0, 1), laid out so that strata of the unit
+    // square stay strata of the light. a sphere light is sampled over its disk facing point. other lights ignore u and v
+    void directionToLightSample(int lightIndex, Math::Vector3 point, float u, float v, Math::Vector3 & direction, float & distance) const;
+
+    float power(int lightIndex) const; // the average of the premultiplied channels, used to rank lights
+
+    std::vector<uint8_t> types;
+    std::vector<float> x, y, z; // the unit direction toward a directional light or the position of any other light
+    std::vector<float> red, green, blue; // color times intensity, with a white light of intensity 1 being 1 in every channel
+    std::vector<float> maxDistances;
+    std::vector<Math::Vector3> edgesU, edgesV; // the edges of a rectangle light, which is centered on its position
+    std::vector<float> radii; // the radius of a sphere light
+};
+
+#endif
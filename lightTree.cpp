@@ -0,0 +1,164 @@
+#include "lightTree.h"
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+namespace
+{
+    const float HALF_PI = 1.57079632679;
+}
+
+LightTree::LightTree(const LightTable & lightTable)
+    : LightTree::LightTree(lightTable, 8, 0.02) {}
+
+LightTree::LightTree(const LightTable & lightTable, int maxLightCount, float errorBound)
+{
+    this->setMaxLightCount(maxLightCount);
+    this->setErrorBound(errorBound);
+
+    std::vector<int> pointLights;
+    this->intensities = std::vector<float>(lightTable.size(), 0);
+    this->positions = std::vector<Math::Vector3>(lightTable.size());
+    for (int i = 0; i < lightTable.size(); i++)
+    {
+        if (lightTable.types[i] != LightTable::POINT)
+        {
+            this->unclusteredLights.push_back(i);
+            continue;
+        }
+        this->intensities.at(i) = lightTable.power(i);
+        this->positions.at(i) = { lightTable.x[i], lightTable.y[i], lightTable.z[i] };
+        pointLights.push_back(i);
+    }
+
+    if (pointLights.empty()) { return; }
+    this->nodes.reserve(2 * pointLights.size() - 1);
+    this->build(pointLights, 0, (int) pointLights.size());
+}
+
+int LightTree::getMaxLightCount() const
+{
+    return this->maxLightCount;
+}
+
+float LightTree::getErrorBound() const
+{
+    return this->errorBound;
+}
+
+int LightTree::getNodeCount() const
+{
+    return (int) this->nodes.size();
+}
+
+void LightTree::setMaxLightCount(int maxLightCount)
+{
+    this->maxLightCount = std::max(1, maxLightCount);
+}
+
+void LightTree::setErrorBound(float errorBound)
+{
+    this->errorBound = std::max(0.0f, errorBound);
+}
+
+// builds the subtree over lights[begin, end) by splitting at the median of the longest axis and returns its index
+int LightTree::build(std::vector<int> & lights, int begin, int end)
+{
+    const int nodeIndex = (int) this->nodes.size();
+    this->nodes.push_back(Node());
+
+    Node node;
+    node.bounds = Math::Box::empty();
+    node.intensity = 0;
+    node.representative = lights.at(begin);
+    for (int i = begin; i < end; i++)
+    {
+        node.bounds.expand(this->positions.at(lights.at(i)));
+        node.intensity += this->intensities.at(lights.at(i));
+        if (this->intensities.at(lights.at(i)) > this->intensities.at(node.representative)) { node.representative = lights.at(i); }
+    }
+
+    if (end - begin > 1)
+    {
+        const Math::Vector3 extent = node.bounds.extent();
+        int axis = 0;
+        if (extent.getY() > extent.getX()) { axis = 1; }
+        if (extent.getZ() > std::max(extent.getX(), extent.getY())) { axis = 2; }
+        auto coordinate = [&](int light)
+        {
+            const Math::Vector3 & p = this->positions.at(light);
+            return axis == 0 ? p.getX() : (axis == 1 ? p.getY() : p.getZ());
+        };
+
+        const int middle = begin + (end - begin) / 2;
+        std::nth_element(lights.begin() + begin, lights.begin() + middle, lights.begin() + end, [&](int lhs, int rhs) { return coordinate(lhs) < coordinate(rhs); });
+        node.left = this->build(lights, begin, middle);
+        node.right = this->build(lights, middle, end);
+    }
+
+    this->nodes.at(nodeIndex) = node;
+    return nodeIndex;
+}
+
+// upper bound on what a node can add at the point, using the cosine bound of the cone around the bounding sphere of the node
+float LightTree::errorBoundAt(const Node & node, Math::Vector3 point, Math::Vector3 unitNormal) const
+{
+    const Math::Vector3 toCenter = node.bounds.centroid() - point;
+    const float distance = toCenter.norm();
+    const float radius = node.bounds.extent().norm() / 2;
+    if (distance <= radius) { return node.intensity; } // the point lies inside the node so light can come from anywhere
+
+    const float cosineToCenter = std::max(-1.0f, std::min(1.0f, Math::dot(unitNormal, toCenter / distance)));
+    const float angle = std::acos(cosineToCenter) - std::asin(radius / distance);
+    if (angle >= HALF_PI) { return 0; } // the whole node is behind the surface
+    return node.intensity * (angle <= 0 ? 1 : std::cos(angle));
+}
+
+void LightTree::selectLights(Math::Vector3 point, Math::Vector3 unitNormal, std::vector<SelectedLight> & selectedLights) const
+{
+    for (int lightIndex : this->unclusteredLights)
+    {
+        selectedLights.push_back({ lightIndex, 1 });
+    }
+    if (this->nodes.empty()) { return; }
+
+    // the cut is kept as a max heap on the error bound, so the worst node is always the one split next
+    typedef std::pair<float, int> CutNode;
+    std::priority_queue<CutNode> cut;
+    float totalEstimate = 0;
+    auto estimate = [&](const Node & node)
+    {
+        const Math::Vector3 toLight = this->positions.at(node.representative) - point;
+        return node.intensity * std::max(0.0f, Math::dot(unitNormal, toLight / toLight.norm()));
+    };
+    auto push = [&](int nodeIndex)
+    {
+        const Node & node = this->nodes.at(nodeIndex);
+        const bool isLeaf = node.left < 0;
+        const float error = isLeaf ? 0 : this->errorBoundAt(node, point, unitNormal); // a single light is exact
+        const float nodeEstimate = estimate(node);
+        if (isLeaf ? nodeEstimate <= 0 : error <= 0) { return; } // nothing below the node can light the point
+        totalEstimate += nodeEstimate;
+        cut.push({ error, nodeIndex });
+    };
+
+    push(0);
+    while (!cut.empty() && (int) cut.size() < this->maxLightCount)
+    {
+        const CutNode worst = cut.top();
+        if (worst.first <= 0 || worst.first <= this->errorBound * totalEstimate) { break; }
+        cut.pop();
+        const Node & node = this->nodes.at(worst.second);
+        totalEstimate -= estimate(node);
+        push(node.left);
+        push(node.right);
+    }
+
+    while (!cut.empty())
+    {
+        const Node & node = this->nodes.at(cut.top().second);
+        cut.pop();
+        if (node.intensity <= 0) { continue; }
+        selectedLights.push_back({ node.representative, node.intensity / this->intensities.at(node.representative) });
+    }
+}
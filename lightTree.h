@@ -0,0 +1,57 @@
+#ifndef LIGHT_TREE_HEADER
+#define LIGHT_TREE_HEADER
+
+#include <memory>
+#include <vector>
+#include "math.h"
+#include "lightTable.h"
+
+// a bounding volume hierarchy over the point lights of a light table. at a shading point it chooses a light cut: a set of
+// at most maxLightCount nodes covering every light, where each node stands in for all of the lights below it through
+// its brightest light. the node with the largest error bound is split first, so cost per point stays flat no matter
+// how many lights the scene has. lights that are not point lights are always selected on their own
+class LightTree
+{
+public:
+    // a light to shade with. intensityScale multiplies the color of the light so it accounts for its whole node
+    struct SelectedLight
+    {
+        int lightIndex;
+        float intensityScale;
+    };
+
+    LightTree(const LightTable & lightTable);
+    LightTree(const LightTable & lightTable, int maxLightCount, float errorBound);
+
+    int getMaxLightCount() const;
+    float getErrorBound() const;
+    int getNodeCount() const;
+
+    void setMaxLightCount(int maxLightCount);
+    // stop splitting once every node in the cut can be off by at most this fraction of the estimated total light
+    void setErrorBound(float errorBound);
+
+    // appends the lights that shade a point with the given unit normal to selectedLights
+    void selectLights(Math::Vector3 point, Math::Vector3 unitNormal, std::vector<SelectedLight> & selectedLights) const;
+
+private:
+    struct Node
+    {
+        Math::Box bounds; // bounds of the positions of the lights below the node
+        float intensity; // sum of the powers of the lights below the node
+        int representative; // index of the brightest light below the node
+        int left = -1, right = -1; // children. both are -1 for a leaf holding only its representative
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> unclusteredLights;
+    std::vector<float> intensities;
+    std::vector<Math::Vector3> positions;
+    int maxLightCount = 8;
+    float errorBound = 0.02;
+
+    int build(std::vector<int> & lights, int begin, int end);
+    float errorBoundAt(const Node & node, Math::Vector3 point, Math::Vector3 unitNormal) const;
+};
+
+#endif
@@ -2,6 +2,14 @@
 #include <assert.h>
 #include <cmath>
 #include <memory>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "math.h"
 #include "camera.h"
@@ -9,6 +17,14 @@
 #include "surface.h"
 #include "shader.h"
 #include "lightSource.h"
+#include "distributed.h"
+#include "sceneFile.h"
+#include "sequence.h"
+#include "imageWriter.h"
+#include "imageEncoder.h"
+#include "photonMap.h"
+#include "texture.h"
+#include "meshSimplifier.h"
 
 using namespace Math;
 
@@ -75,6 +91,45 @@ int testMath()
     assert (box.max.getZ() == 1);
     assert (box.isInside({ 0, 0, 0 }));
     assert (!box.isInside({ 10, 10, 10 }));
+    assert (box.surfaceArea() == 24);
+    assert (box.centroid() == Vector3(0, 0, 0));
+
+    float tEnter, tExit;
+    Ray boxRay = { { -5, 0, 0 }, { 1, 0, 0 } };
+    assert (box.hit(boxRay, inverse(boxRay.direction), 0, 100, tEnter, tExit));
+    assert (tEnter == 4 && tExit == 6);
+    assert (!box.hit(boxRay, inverse(boxRay.direction), 0, 3, tEnter, tExit));
+    Ray missRay = { { -5, 3, 0 }, { 1, 0, 0 } };
+    assert (!box.hit(missRay, inverse(missRay.direction), 0, 100, tEnter, tExit));
+
+    Box emptyBox = Box::empty();
+    assert (emptyBox.isEmpty());
+    emptyBox.expand(box);
+    assert (emptyBox.min == box.min && emptyBox.max == box.max);
+    emptyBox.expand(Box::empty());
+    assert (emptyBox.min == box.min && emptyBox.max == box.max);
+
+    PerspectiveCamera tableCamera({ 0, 0, 0 }, { 0, 1, 0 }, 8, 4, -0.5, 0.5, 0.25, -0.25, 1);
+    Ray tileRays[6];
+    tableCamera.computeViewingRays(2, 1, 5, 3, tileRays);
+    assert (tileRays[0].direction == tableCamera.computeViewingRay(2, 1).direction);
+    assert (tileRays[5].direction == tableCamera.computeViewingRay(4, 2).direction);
+    tableCamera.setResolution(16, 8);
+    tableCamera.computeViewingRays(15, 7, 16, 8, tileRays);
+    assert (tileRays[0].direction == tableCamera.computeViewingRay(15, 7).direction);
+
+    assert (Util::mortonIndex(3, 5) == 39);
+    uint32_t mortonX, mortonY;
+    Util::mortonPoint(39, mortonX, mortonY);
+    assert (mortonX == 3 && mortonY == 5);
+    assert (Util::hilbertIndex(2, 0, 0) == 0 && Util::hilbertIndex(2, 0, 1) == 1 && Util::hilbertIndex(2, 1, 1) == 2 && Util::hilbertIndex(2, 1, 0) == 3);
+    std::vector<Util::PixelRect> tiles = Util::computeTiles(100, 50, 32, Util::TileOrder::Hilbert);
+    int tiledPixelCount = 0;
+    for (auto & tile : tiles) { tiledPixelCount += tile.pixelCount(); }
+    assert (tiles.size() == 8 && tiledPixelCount == 100 * 50);
+    int zOrderPixelCount = 0;
+    Util::forEachPixelInZOrder({ 4, 4, 9, 7 }, [&](int i, int j) { assert (i >= 4 && i < 9 && j >= 4 && j < 7); zOrderPixelCount++; });
+    assert (zOrderPixelCount == 15);
 
     std::cout << "All tests passed.";
     return 0;
@@ -224,12 +279,1409 @@ int testRGBScene()
     return 0;
 }
 
+// renders the chapter 2 scene with forked worker processes, and checks that a serialized scene reads back the same
+// and that workers that hang up or hang lose their tiles
+int testDistributedRender()
+{
+    // forked before the renders below start any thread
+    TileCoordinator coordinator(2);
+    coordinator.startWorkers();
+
+    RGBScene rgbScene = RGBScene();
+
+    std::unique_ptr<Sphere> sphere(new Sphere(3, { 15, 5, 3 }));
+    sphere->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 0, 0, 255 }, 10, { 0, 0, 255 }, { 255, 255, 255 })));
+    std::unique_ptr<GroupSurface> plane(new GroupSurface());
+    plane->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { -300, 1000, 0 }, { 0, 0, 1 })));
+    plane->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { 300, -1000, 0 }, { 0, 0, 1 })));
+    plane->setMaterial(std::unique_ptr<Shader>(new MirrorShader({ 180, 180, 255 }, { 220, 220, 255 }, 0.7)));
+    std::unique_ptr<GroupSurface> groupSurface(new GroupSurface());
+    groupSurface->addSurface(std::move(sphere));
+    groupSurface->addSurface(std::move(plane));
+
+    std::unique_ptr<PerspectiveCamera> camera(new PerspectiveCamera());
+    camera->setOrigin({ 5, 0, 5 });
+    camera->setFocalLength(10);
+    camera->setOrientation({ 1, 0, -0.2 });
+    camera->setResolution(640, 360);
+    camera->setBounds(-16, 16, 9, -9);
+
+    rgbScene.setBackgroundColor({ 180, 180, 255 });
+    rgbScene.addLightSource(std::unique_ptr<LightSource>(new PointLightSource({ 10, 0, 5 }, 0.5)));
+    rgbScene.setCamera(std::move(camera));
+    rgbScene.setSurface(std::move(groupSurface));
+
+    Serialization::BinaryWriter writer;
+    rgbScene.serialize(writer);
+    Serialization::BinaryReader reader(writer.getBuffer());
+    std::unique_ptr<Scene> copy = Scene::deserialize(reader);
+    assert (copy != NULL && reader.isAtEnd());
+    Serialization::BinaryWriter copyWriter;
+    copy->serialize(copyWriter);
+    assert (copyWriter.getBuffer() == writer.getBuffer());
+
+    rgbScene.render();
+    const std::string localPixels = rgbScene.computePixelArray();
+    rgbScene.initializeBitmap();
+
+    const bool rendered = coordinator.render(rgbScene);
+    assert (rendered);
+    assert (rgbScene.computePixelArray() == localPixels);
+    rgbScene.exportToFile("test_distributed_render.bmp");
+
+    // a worker that hangs up at once loses its tile to the forked ones, and with no others the frame fails
+    auto deadWorker = [&]()
+    {
+        int sockets[2];
+        assert (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+        close(sockets[1]);
+        return sockets[0];
+    };
+    rgbScene.initializeBitmap();
+    coordinator.addWorkerConnection(deadWorker());
+    assert (coordinator.render(rgbScene));
+    assert (rgbScene.computePixelArray() == localPixels);
+    TileCoordinator remoteCoordinator(0);
+    remoteCoordinator.addWorkerConnection(deadWorker());
+    assert (!remoteCoordinator.render(rgbScene));
+    assert (!TileCoordinator(0).render(rgbScene));
+
+    // a worker that takes its tile and never answers loses it at the deadline, and alone it fails the frame
+    int hungSockets[2];
+    assert (socketpair(AF_UNIX, SOCK_STREAM, 0, hungSockets) == 0);
+    rgbScene.initializeBitmap();
+    coordinator.setTileTimeout(500);
+    coordinator.addWorkerConnection(hungSockets[0]);
+    assert (coordinator.render(rgbScene));
+    assert (rgbScene.computePixelArray() == localPixels);
+    TileCoordinator hungCoordinator(0);
+    hungCoordinator.setTileTimeout(100);
+    int hungAloneSockets[2];
+    assert (socketpair(AF_UNIX, SOCK_STREAM, 0, hungAloneSockets) == 0);
+    hungCoordinator.addWorkerConnection(hungAloneSockets[0]);
+    assert (!hungCoordinator.render(rgbScene));
+    close(hungSockets[1]);
+    close(hungAloneSockets[1]);
+
+    // forked workers that miss every deadline are killed and replaced until they run out, rather than waited on
+    TileCoordinator slowCoordinator(2);
+    slowCoordinator.setTileTimeout(1);
+    rgbScene.setSamplesPerPixel(16);
+    assert (!slowCoordinator.render(rgbScene));
+    rgbScene.setSamplesPerPixel(1);
+
+    return 0;
+}
+
+// saves a scene with a mesh in both file formats, and checks that each reads back the same and renders
+int testSceneFile()
+{
+    RGBScene rgbScene = RGBScene();
+
+    std::unique_ptr<Sphere> sphere(new Sphere(3, { 15, 5, 3 }));
+    sphere->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 0, 0, 255 }, 10, { 0, 0, 255 }, { 255, 255, 255 })));
+    std::unique_ptr<MeshSurface> plane(new MeshSurface(
+        { { 300, 1000, 0 }, { -300, -1000, 0 }, { -300, 1000, 0 }, { 300, -1000, 0 } },
+        { 1, 0, 2, 0, 1, 3 }
+    ));
+    plane->setMaterial(std::unique_ptr<Shader>(new MirrorShader({ 180, 180, 255 }, { 220, 220, 255 }, 0.7)));
+    std::unique_ptr<GroupSurface> groupSurface(new GroupSurface());
+    groupSurface->addSurface(std::move(sphere));
+    groupSurface->addSurface(std::move(plane));
+
+    std::unique_ptr<PerspectiveCamera> camera(new PerspectiveCamera());
+    camera->setOrigin({ 5, 0, 5 });
+    camera->setFocalLength(10);
+    camera->setOrientation({ 1, 0, -0.2 });
+    camera->setResolution(640, 360);
+    camera->setBounds(-16, 16, 9, -9);
+
+    rgbScene.setBackgroundColor({ 180, 180, 255 });
+    rgbScene.addLightSource(std::unique_ptr<LightSource>(new PointLightSource({ 10, 0, 5 }, 0.5)));
+    rgbScene.setCamera(std::move(camera));
+    rgbScene.setSurface(std::move(groupSurface));
+
+    Serialization::BinaryWriter writer;
+    rgbScene.serialize(writer);
+
+    assert (SceneFile::save(rgbScene, "test_scene.gescene"));
+    std::unique_ptr<Scene> binaryCopy = SceneFile::load("test_scene.gescene");
+    assert (binaryCopy != NULL);
+    Serialization::BinaryWriter binaryCopyWriter;
+    binaryCopy->serialize(binaryCopyWriter);
+    assert (binaryCopyWriter.getBuffer() == writer.getBuffer());
+
+    assert (SceneFile::saveText(rgbScene, "test_scene.txt"));
+    std::unique_ptr<Scene> textCopy = SceneFile::load("test_scene.txt");
+    assert (textCopy != NULL);
+    Serialization::BinaryWriter textCopyWriter;
+    textCopy->serialize(textCopyWriter);
+    assert (textCopyWriter.getBuffer() == writer.getBuffer());
+
+    assert (SceneFile::loadText("gescene 8\nrgbScene backgroundColor 0 0") == NULL);
+    assert (SceneFile::loadText("gescene 7\n") == NULL);
+
+    binaryCopy->render();
+    binaryCopy->exportToFile("test_scene_file.bmp");
+
+    return 0;
+}
+
+// checks that a mesh hit through its bvh matches testing every triangle, and that the bvh cache is reused only for the
+// same geometry. prints how long building and mapping took
+int testMeshBvh()
+{
+    // a sphere tessellated into 2 * rings * segments triangles
+    const int rings = 200, segments = 400;
+    std::vector<Math::Vector3> vertices;
+    std::vector<uint32_t> indices;
+    for (int r = 0; r <= rings; r++)
+    {
+        for (int s = 0; s < segments; s++)
+        {
+            const float polar = M_PI * r / rings, azimuth = 2 * M_PI * s / segments;
+            vertices.push_back({ 10 * std::sin(polar) * std::cos(azimuth), 10 * std::sin(polar) * std::sin(azimuth), 10 * std::cos(polar) });
+        }
+    }
+    for (int r = 0; r < rings; r++)
+    {
+        for (int s = 0; s < segments; s++)
+        {
+            const uint32_t a = r * segments + s, b = r * segments + (s + 1) % segments;
+            const uint32_t c = a + segments, d = b + segments;
+            indices.insert(indices.end(), { a, c, b, b, c, d });
+        }
+    }
+
+    MeshSurface bruteForceMesh(vertices, indices);
+    MeshSurface mesh(vertices, indices);
+
+    auto start = std::chrono::steady_clock::now();
+    mesh.buildAccelerationStructures(""); // built in memory even if an earlier run left this mesh in the cache
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "built " << mesh.getTriangleCount() << " triangles in " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+    assert (mesh.getBvh() != NULL);
+
+    std::shared_ptr<Util::HitRecord> bruteForceHitRecord(new Util::HitRecord);
+    std::shared_ptr<Util::HitRecord> hitRecord(new Util::HitRecord);
+    for (int k = 0; k < 10000; k++)
+    {
+        const Math::Ray ray = { { 30, (float) (k % 100) / 4 - 12.5f, (float) (k / 100) / 4 - 12.5f }, { -1, 0.01f * (k % 7), 0.01f * (k % 5) } };
+        const bool bruteForceHit = bruteForceMesh.hit(ray, 0, 1000, bruteForceHitRecord);
+        assert (mesh.hit(ray, 0, 1000, hitRecord) == bruteForceHit);
+        if (!bruteForceHit) { continue; }
+        // a ray through a shared edge may find either triangle first, and their times differ in the last bits
+        assert (std::abs(hitRecord->intersectionTime - bruteForceHitRecord->intersectionTime) < 1e-4);
+    }
+
+    assert (mesh.getBvh()->save("test_mesh.bvh", MeshBvh::hashGeometry(mesh)));
+    start = std::chrono::steady_clock::now();
+    std::shared_ptr<const MeshBvh> cachedBvh = MeshBvh::load("test_mesh.bvh", mesh, MeshBvh::hashGeometry(mesh));
+    end = std::chrono::steady_clock::now();
+    std::cout << "mapped the cached bvh in " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+    assert (cachedBvh != NULL && cachedBvh->getNodeCount() == mesh.getBvh()->getNodeCount());
+    assert (std::memcmp(cachedBvh->getNodes(), mesh.getBvh()->getNodes(), mesh.getBvh()->getNodeCount() * sizeof(MeshBvh::Node)) == 0);
+
+    // moving a vertex changes the hash, so the cached bvh does not apply
+    vertices[0] = { 0, 0, 11 };
+    MeshSurface changedMesh(vertices, indices);
+    assert (MeshBvh::hashGeometry(changedMesh) != MeshBvh::hashGeometry(mesh));
+    assert (MeshBvh::load("test_mesh.bvh", changedMesh, MeshBvh::hashGeometry(changedMesh)) == NULL);
+
+    // the second mesh with the same geometry maps what the first one left in the cache
+    MeshSurface firstMesh(vertices, indices), secondMesh(vertices, indices);
+    firstMesh.buildAccelerationStructures(".");
+    secondMesh.buildAccelerationStructures(".");
+    assert (secondMesh.getBvh()->getNodeCount() == firstMesh.getBvh()->getNodeCount());
+
+    return 0;
+}
+
+// edits the chapter 2 scene in place and checks that tracing only the dirtied pixels gives the same frame as tracing
+// all of them again
+int testIncrementalRender()
+{
+    RGBScene rgbScene = RGBScene();
+
+    std::unique_ptr<Sphere> sphere1(new Sphere(2, { 23, -14, 2 }));
+    sphere1->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 0, 255, 0 }, 10, { 0, 255, 0 }, { 255, 255, 255 })));
+    StandardShader * sphereMaterial2 = new StandardShader(0.2, { 0, 0, 255 }, 10, { 0, 0, 255 }, { 255, 255, 255 });
+    std::unique_ptr<Sphere> sphere2(new Sphere(3, { 15, 5, 3 }));
+    sphere2->setMaterial(std::unique_ptr<Shader>(sphereMaterial2));
+    Sphere * movingSphere = sphere1.get();
+
+    std::unique_ptr<GroupSurface> plane(new GroupSurface());
+    plane->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { -300, 1000, 0 }, { 0, 0, 1 })));
+    plane->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { 300, -1000, 0 }, { 0, 0, 1 })));
+    plane->setMaterial(std::unique_ptr<Shader>(new MirrorShader({ 180, 180, 255 }, { 220, 220, 255 }, 0.7)));
+
+    std::unique_ptr<GroupSurface> groupSurface(new GroupSurface());
+    groupSurface->addSurface(std::move(sphere1));
+    groupSurface->addSurface(std::move(sphere2));
+    groupSurface->addSurface(std::move(plane));
+
+    std::unique_ptr<PerspectiveCamera> camera(new PerspectiveCamera());
+    camera->setOrigin({ 5, 0, 5 });
+    camera->setFocalLength(10);
+    camera->setOrientation({ 1, 0, -0.2 });
+    camera->setResolution(1920, 1080);
+    camera->setBounds(-16, 16, 9, -9);
+
+    std::unique_ptr<LightSource> lightSource(new PointLightSource({ 10, 0, 5 }));
+    lightSource->setIntensity(0.5);
+
+    rgbScene.setBackgroundColor({ 180, 180, 255 });
+    rgbScene.addLightSource(std::move(lightSource));
+    rgbScene.setCamera(std::move(camera));
+    rgbScene.setSurface(std::move(groupSurface));
+    rgbScene.enableDependencyTracking();
+    rgbScene.render();
+    assert (rgbScene.renderChanges() == 0);
+
+    // a new color for the second sphere, then a move of the first
+    sphereMaterial2->setSurfaceColor({ 255, 128, 0 });
+    rgbScene.markSurfaceChanged(1);
+    const int recoloredPixelCount = rgbScene.renderChanges();
+    const Math::Box oldBounds = movingSphere->boundingBox();
+    movingSphere->setCenter({ 20, -10, 2 });
+    rgbScene.markBoundsChanged(oldBounds);
+    rgbScene.markBoundsChanged(movingSphere->boundingBox());
+    const int movedPixelCount = rgbScene.renderChanges();
+    std::cout << "recolored: " << recoloredPixelCount << " pixels, moved: " << movedPixelCount << " pixels of " << 1920 * 1080 << std::endl;
+    assert (recoloredPixelCount > 0 && recoloredPixelCount < 1920 * 1080 / 4);
+    assert (movedPixelCount > 0 && movedPixelCount < 1920 * 1080 / 4);
+
+    const std::string incrementalPixels = rgbScene.computePixelArray();
+    rgbScene.render();
+    assert (rgbScene.computePixelArray() == incrementalPixels);
+    rgbScene.exportToFile("test_incremental_render.bmp");
+
+    return 0;
+}
+
+// renders overlapping crops of a scene and checks them against the full frame, both in memory and spliced into a file
+int testCropRender()
+{
+    RGBScene rgbScene = RGBScene();
+
+    std::unique_ptr<Sphere> sphere(new Sphere(3, { 15, 5, 3 }));
+    sphere->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 0, 0, 255 }, 10, { 0, 0, 255 }, { 255, 255, 255 })));
+    std::unique_ptr<MeshSurface> plane(new MeshSurface(
+        { { 300, 1000, 0 }, { -300, -1000, 0 }, { -300, 1000, 0 }, { 300, -1000, 0 } },
+        { 1, 0, 2, 0, 1, 3 }
+    ));
+    plane->setMaterial(std::unique_ptr<Shader>(new MirrorShader({ 180, 180, 255 }, { 220, 220, 255 }, 0.7)));
+    std::unique_ptr<GroupSurface> groupSurface(new GroupSurface());
+    groupSurface->addSurface(std::move(sphere));
+    groupSurface->addSurface(std::move(plane));
+
+    std::unique_ptr<PerspectiveCamera> camera(new PerspectiveCamera());
+    camera->setOrigin({ 5, 0, 5 });
+    camera->setFocalLength(10);
+    camera->setOrientation({ 1, 0, -0.2 });
+    camera->setResolution(641, 360);
+    camera->setBounds(-16, 16, 9, -9);
+
+    rgbScene.setBackgroundColor({ 180, 180, 255 });
+    rgbScene.addLightSource(std::unique_ptr<LightSource>(new PointLightSource({ 10, 0, 5 }, 0.5)));
+    rgbScene.setCamera(std::move(camera));
+    rgbScene.setSurface(std::move(groupSurface));
+
+    Serialization::BinaryWriter writer;
+    rgbScene.serialize(writer);
+    Serialization::BinaryReader reader(writer.getBuffer());
+    std::unique_ptr<Scene> croppedScene = Scene::deserialize(reader);
+    assert (croppedScene != NULL);
+
+    // the second crop overlaps the first and hangs off the frame
+    const Util::PixelRect crop1 = { 100, 50, 300, 200 }, crop2 = { 250, 150, 700, 400 };
+    rgbScene.render();
+    croppedScene->exportToFile("test_splice.bmp");
+    croppedScene->render({ crop1, crop2 });
+    assert (croppedScene->computePixelArray(crop1) == rgbScene.computePixelArray(crop1));
+    assert (croppedScene->computePixelArray({ 250, 150, 641, 360 }) == rgbScene.computePixelArray({ 250, 150, 641, 360 }));
+    assert (croppedScene->computePixelArray({ 0, 0, 100, 360 }) != rgbScene.computePixelArray({ 0, 0, 100, 360 }));
+
+    // splicing everything rgbScene rendered into the export of the unrendered scene gives the full export
+    rgbScene.exportToFile("test_full.bmp");
+    assert (rgbScene.spliceIntoFile("test_splice.bmp", { 0, 0, 641, 360 }));
+    std::ifstream fullFile("test_full.bmp", std::ios::binary), splicedFile("test_splice.bmp", std::ios::binary);
+    const std::string fullBytes((std::istreambuf_iterator<char>(fullFile)), std::istreambuf_iterator<char>());
+    const std::string splicedBytes((std::istreambuf_iterator<char>(splicedFile)), std::istreambuf_iterator<char>());
+    assert (fullBytes == splicedBytes);
+
+    croppedScene->exportToFile("test_crop.bmp", crop1);
+    std::ifstream cropFile("test_crop.bmp", std::ios::binary | std::ios::ate);
+    assert (cropFile.tellg() == 54 + 150 * 600);
+    assert (!rgbScene.spliceIntoFile("test_crop.bmp", crop1));
+
+    return 0;
+}
+
+// checks that the random numbers depend only on their keys and that an antialiased frame comes out the same whatever
+// the thread count and tile order
+int testSampling()
+{
+    Util::Sampler sampler(7, 1000, 3, 1, Util::CAMERA_STREAM);
+    Util::Sampler sameSampler(7, 1000, 3, 1, Util::CAMERA_STREAM);
+    Util::Sampler otherStreamSampler(7, 1000, 3, 1, Util::CAMERA_STREAM + 1);
+    double sum = 0;
+    int matches = 0;
+    for (int k = 0; k < 100000; k++)
+    {
+        const uint32_t value = sampler.nextUint32();
+        assert (value == sameSampler.nextUint32());
+        if (value == otherStreamSampler.nextUint32()) { matches++; }
+        sum += Util::toUnitFloat(value);
+    }
+    assert (matches < 3);
+    assert (std::abs(sum / 100000 - 0.5) < 0.01);
+
+    // every run of four sobol points puts one point in each quadrant of the pixel
+    for (uint32_t start = 0; start < 64; start += 4)
+    {
+        int quadrants = 0;
+        for (uint32_t k = start; k < start + 4; k++)
+        {
+            float u, v;
+            Util::sobolPoint(k, 0x12345678, 0x9abcdef0, u, v);
+            assert (u >= 0 && u < 1 && v >= 0 && v < 1);
+            quadrants |= 1 << ((u < 0.5 ? 0 : 1) + (v < 0.5 ? 0 : 2));
+        }
+        assert (quadrants == 15);
+    }
+
+    RGBScene rgbScene = RGBScene();
+    std::unique_ptr<Sphere> sphere(new Sphere(3, { 15, 5, 3 }));
+    sphere->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 0, 0, 255 }, 10, { 0, 0, 255 }, { 255, 255, 255 })));
+    std::unique_ptr<GroupSurface> plane(new GroupSurface());
+    plane->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { -300, 1000, 0 }, { 0, 0, 1 })));
+    plane->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { 300, -1000, 0 }, { 0, 0, 1 })));
+    plane->setMaterial(std::unique_ptr<Shader>(new MirrorShader({ 180, 180, 255 }, { 220, 220, 255 }, 0.7)));
+    std::unique_ptr<GroupSurface> groupSurface(new GroupSurface());
+    groupSurface->addSurface(std::move(sphere));
+    groupSurface->addSurface(std::move(plane));
+
+    std::unique_ptr<PerspectiveCamera> camera(new PerspectiveCamera());
+    camera->setOrigin({ 5, 0, 5 });
+    camera->setFocalLength(10);
+    camera->setOrientation({ 1, 0, -0.2 });
+    camera->setResolution(480, 270);
+    camera->setBounds(-16, 16, 9, -9);
+
+    rgbScene.setBackgroundColor({ 180, 180, 255 });
+    rgbScene.addLightSource(std::unique_ptr<LightSource>(new PointLightSource({ 10, 0, 5 }, 0.5)));
+    rgbScene.setCamera(std::move(camera));
+    rgbScene.setSurface(std::move(groupSurface));
+    rgbScene.setSamplesPerPixel(8);
+    rgbScene.setSeed(42);
+
+    for (Util::SampleSequence sampleSequence : { Util::SampleSequence::R2, Util::SampleSequence::Sobol })
+    {
+        rgbScene.setSampleSequence(sampleSequence);
+        rgbScene.setThreadCount(1);
+        rgbScene.setTileOrder(Util::TileOrder::RowMajor);
+        rgbScene.render();
+        const std::string serialPixels = rgbScene.computePixelArray();
+        rgbScene.setThreadCount(8);
+        rgbScene.setTileSize(7);
+        rgbScene.setTileOrder(Util::TileOrder::Hilbert);
+        rgbScene.render();
+        assert (rgbScene.computePixelArray() == serialPixels);
+    }
+    rgbScene.exportToFile("test_sampling.bmp");
+
+    return 0;
+}
+
+// renders a sphere over a floor lit by an area light and checks that only the penumbra takes the extra shadow rays.
+// prints the shadow ray counts of every light shape
+int testAreaLights()
+{
+    RGBScene rgbScene = RGBScene();
+    std::unique_ptr<Sphere> sphere(new Sphere(2, { 15, 0, 3 }));
+    sphere->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 0, 0, 255 }, 10, { 0, 0, 255 }, { 255, 255, 255 })));
+    std::unique_ptr<GroupSurface> floor(new GroupSurface());
+    floor->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { -300, 1000, 0 }, { 0, 0, 1 })));
+    floor->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { 300, -1000, 0 }, { 0, 0, 1 })));
+    floor->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 200, 200, 200 }, 10, { 200, 200, 200 }, { 0, 0, 0 })));
+    std::unique_ptr<GroupSurface> groupSurface(new GroupSurface());
+    groupSurface->addSurface(std::move(sphere));
+    groupSurface->addSurface(std::move(floor));
+
+    std::unique_ptr<PerspectiveCamera> camera(new PerspectiveCamera());
+    camera->setOrigin({ 5, 0, 5 });
+    camera->setFocalLength(10);
+    camera->setOrientation({ 1, 0, -0.2 });
+    camera->setResolution(480, 270);
+    camera->setBounds(-16, 16, 9, -9);
+
+    rgbScene.setBackgroundColor({ 180, 180, 255 });
+    rgbScene.addLightSource(std::unique_ptr<LightSource>(new RectangleLightSource({ 15, 0, 12 }, { 4, 0, 0 }, { 0, 4, 0 }, 0.8)));
+    rgbScene.setCamera(std::move(camera));
+    rgbScene.setSurface(std::move(groupSurface));
+    rgbScene.setSeed(7);
+
+    rgbScene.setThreadCount(1);
+    rgbScene.render();
+    const std::string serialPixels = rgbScene.computePixelArray();
+    const ShadowRayStatistics statistics = rgbScene.getShadowRayStatistics();
+    std::cout << "rectangle light: " << statistics.shadowRayCount << " shadow rays for " << statistics.areaLightQueryCount
+        << " points, " << statistics.refinedQueryCount << " in the penumbra" << std::endl;
+    assert (statistics.areaLightQueryCount > 0);
+    assert (statistics.refinedQueryCount > 0 && statistics.refinedQueryCount < statistics.areaLightQueryCount / 4);
+    assert (statistics.shadowRayCount == 4 * statistics.areaLightQueryCount + 16 * statistics.refinedQueryCount);
+
+    rgbScene.setThreadCount(8);
+    rgbScene.setTileOrder(Util::TileOrder::Morton);
+    rgbScene.render();
+    assert (rgbScene.computePixelArray() == serialPixels);
+    rgbScene.setRenderMode(RenderMode::Specialized);
+    rgbScene.render();
+    assert (rgbScene.computePixelArray() == serialPixels);
+    rgbScene.exportToFile("test_area_light.bmp");
+
+    // the scene file keeps the light and the sample counts
+    rgbScene.setSoftShadowSamples(9, 25);
+    assert (SceneFile::saveText(rgbScene, "test_area_light.txt"));
+    std::unique_ptr<Scene> copy = SceneFile::load("test_area_light.txt");
+    assert (copy != NULL);
+    Serialization::BinaryWriter writer, copyWriter;
+    rgbScene.serialize(writer);
+    copy->serialize(copyWriter);
+    assert (copyWriter.getBuffer() == writer.getBuffer());
+
+    // a sphere light of the same power, and the fixed rays of the wavefront queues
+    copy->setRenderMode(RenderMode::Wavefront);
+    copy->render();
+    std::cout << "wavefront: " << copy->getShadowRayStatistics().shadowRayCount << " shadow rays" << std::endl;
+    assert (copy->getShadowRayStatistics().shadowRayCount == 9 * copy->getShadowRayStatistics().areaLightQueryCount);
+    rgbScene.addLightSource(std::unique_ptr<LightSource>(new SphereLightSource({ 10, -8, 10 }, 2, 0.3)));
+    rgbScene.render();
+    std::cout << "rectangle and sphere lights: " << rgbScene.getShadowRayStatistics().shadowRayCount << " shadow rays" << std::endl;
+
+    return 0;
+}
+
+// renders a sphere resting on a floor without ambient occlusion, with it at full resolution and with it at a quarter
+// of the pixels, checks that occlusion only darkens and that the upsampled frame stays close to the full one, and
+// prints the rays each took
+int testAmbientOcclusion()
+{
+    RGBScene rgbScene = RGBScene();
+    std::unique_ptr<Sphere> sphere(new Sphere(2, { 15, 0, 2 }));
+    sphere->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.5, { 0, 0, 255 }, 10, { 0, 0, 255 }, { 255, 255, 255 })));
+    std::unique_ptr<GroupSurface> floor(new GroupSurface());
+    floor->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { -300, 1000, 0 }, { 0, 0, 1 })));
+    floor->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { 300, -1000, 0 }, { 0, 0, 1 })));
+    floor->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.5, { 200, 200, 200 }, 10, { 200, 200, 200 }, { 0, 0, 0 })));
+    std::unique_ptr<GroupSurface> groupSurface(new GroupSurface());
+    groupSurface->addSurface(std::move(sphere));
+    groupSurface->addSurface(std::move(floor));
+
+    std::unique_ptr<PerspectiveCamera> camera(new PerspectiveCamera());
+    camera->setOrigin({ 5, 0, 5 });
+    camera->setFocalLength(10);
+    camera->setOrientation({ 1, 0, -0.2 });
+    camera->setResolution(480, 270);
+    camera->setBounds(-16, 16, 9, -9);
+
+    rgbScene.setBackgroundColor({ 180, 180, 255 });
+    rgbScene.addLightSource(std::unique_ptr<LightSource>(new PointLightSource({ 10, 0, 10 }, 0.3)));
+    rgbScene.setCamera(std::move(camera));
+    rgbScene.setSurface(std::move(groupSurface));
+    rgbScene.render();
+    const std::string plainPixels = rgbScene.computePixelArray();
+
+    rgbScene.setAmbientOcclusion(16, 3, 1);
+    auto start = std::chrono::steady_clock::now();
+    rgbScene.render();
+    auto end = std::chrono::steady_clock::now();
+    const std::string fullPixels = rgbScene.computePixelArray();
+    const ShadowRayStatistics fullStatistics = rgbScene.getShadowRayStatistics();
+    std::cout << "full resolution: " << fullStatistics.ambientOcclusionRayCount << " rays, "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+    rgbScene.exportToFile("test_ambient_occlusion.bmp");
+
+    int darkenedCount = 0;
+    for (size_t k = 0; k < plainPixels.size(); k++)
+    {
+        assert ((uint8_t) fullPixels[k] <= (uint8_t) plainPixels[k]);
+        if (fullPixels[k] != plainPixels[k]) { darkenedCount++; }
+    }
+    assert (darkenedCount > 0);
+
+    // the same frame on one thread in another mode
+    rgbScene.setThreadCount(1);
+    rgbScene.setRenderMode(RenderMode::Specialized);
+    rgbScene.render();
+    assert (rgbScene.computePixelArray() == fullPixels);
+    rgbScene.setThreadCount(Util::defaultThreadCount());
+    rgbScene.setRenderMode(RenderMode::Recursive);
+
+    rgbScene.setAmbientOcclusion(16, 3, 2);
+    start = std::chrono::steady_clock::now();
+    rgbScene.render();
+    end = std::chrono::steady_clock::now();
+    const std::string reducedPixels = rgbScene.computePixelArray();
+    const ShadowRayStatistics reducedStatistics = rgbScene.getShadowRayStatistics();
+    std::cout << "half resolution: " << reducedStatistics.ambientOcclusionRayCount << " rays, "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms, "
+        << reducedStatistics.ambientOcclusionQueryCount << " points traced" << std::endl;
+    rgbScene.exportToFile("test_ambient_occlusion_reduced.bmp");
+    assert (reducedStatistics.ambientOcclusionRayCount < fullStatistics.ambientOcclusionRayCount / 2);
+
+    long totalDifference = 0;
+    for (size_t k = 0; k < fullPixels.size(); k++)
+    {
+        totalDifference += std::abs((int) (uint8_t) reducedPixels[k] - (int) (uint8_t) fullPixels[k]);
+    }
+    std::cout << "mean difference: " << (double) totalDifference / fullPixels.size() << std::endl;
+    assert (totalDifference < 2 * (long) fullPixels.size());
+
+    // the wavefront queues read the same buffer
+    rgbScene.setRenderMode(RenderMode::Wavefront);
+    rgbScene.render();
+    std::cout << "wavefront: " << rgbScene.getShadowRayStatistics().ambientOcclusionRayCount << " rays" << std::endl;
+
+    return 0;
+}
+
+// renders a sphere resting on a floor without indirect light and with the irradiance cache, checks that the indirect
+// light only brightens and was gathered at far fewer points than it lit, then moves the camera and checks that the
+// second frame reuses the records of the first
+int testIrradianceCache()
+{
+    RGBScene rgbScene = RGBScene();
+    std::unique_ptr<Sphere> sphere(new Sphere(2, { 15, 0, 2 }));
+    sphere->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 0, 0, 255 }, 10, { 0, 0, 255 }, { 255, 255, 255 })));
+    std::unique_ptr<GroupSurface> floor(new GroupSurface());
+    floor->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { -300, 1000, 0 }, { 0, 0, 1 })));
+    floor->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { 300, -1000, 0 }, { 0, 0, 1 })));
+    floor->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 200, 200, 200 }, 10, { 200, 200, 200 }, { 0, 0, 0 })));
+    std::unique_ptr<GroupSurface> groupSurface(new GroupSurface());
+    groupSurface->addSurface(std::move(sphere));
+    groupSurface->addSurface(std::move(floor));
+
+    std::unique_ptr<PerspectiveCamera> camera(new PerspectiveCamera());
+    camera->setOrigin({ 5, 0, 5 });
+    camera->setFocalLength(10);
+    camera->setOrientation({ 1, 0, -0.2 });
+    camera->setResolution(480, 270);
+    camera->setBounds(-16, 16, 9, -9);
+
+    rgbScene.setBackgroundColor({ 40, 40, 60 });
+    rgbScene.addLightSource(std::unique_ptr<LightSource>(new PointLightSource({ 10, 0, 10 }, 0.5)));
+    rgbScene.setCamera(std::move(camera));
+    rgbScene.setSurface(std::move(groupSurface));
+    rgbScene.render();
+    const std::string plainPixels = rgbScene.computePixelArray();
+
+    rgbScene.enableIrradianceCache(64, 0.3, 0.2, 10);
+    auto start = std::chrono::steady_clock::now();
+    rgbScene.render();
+    auto end = std::chrono::steady_clock::now();
+    const std::string indirectPixels = rgbScene.computePixelArray();
+    const IrradianceCache::Statistics firstStatistics = rgbScene.getIrradianceCacheStatistics();
+    std::cout << "first frame: " << firstStatistics.recordCount << " records for " << firstStatistics.lookupCount << " points, "
+        << firstStatistics.gatherRayCount << " gather rays, "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+    rgbScene.exportToFile("test_irradiance_cache.bmp");
+
+    int brightenedCount = 0;
+    for (size_t k = 0; k < plainPixels.size(); k++)
+    {
+        assert ((uint8_t) indirectPixels[k] >= (uint8_t) plainPixels[k]);
+        if (indirectPixels[k] != plainPixels[k]) { brightenedCount++; }
+    }
+    assert (brightenedCount > 0);
+    assert (firstStatistics.recordCount > 0 && firstStatistics.recordCount * 10 < firstStatistics.lookupCount);
+
+    // a step to the side sees mostly what the records already cover
+    std::unique_ptr<PerspectiveCamera> movedCamera(new PerspectiveCamera());
+    movedCamera->setOrigin({ 5, 0.5, 5 });
+    movedCamera->setFocalLength(10);
+    movedCamera->setOrientation({ 1, 0, -0.2 });
+    movedCamera->setResolution(480, 270);
+    movedCamera->setBounds(-16, 16, 9, -9);
+    rgbScene.setCamera(std::move(movedCamera));
+    start = std::chrono::steady_clock::now();
+    rgbScene.render();
+    end = std::chrono::steady_clock::now();
+    const IrradianceCache::Statistics secondStatistics = rgbScene.getIrradianceCacheStatistics();
+    const long newRecordCount = secondStatistics.recordCount - firstStatistics.recordCount;
+    std::cout << "second frame: " << newRecordCount << " new records, "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+    assert (newRecordCount * 4 < firstStatistics.recordCount);
+
+    // the wavefront queues and the batched fallback read the same cache
+    rgbScene.setRenderMode(RenderMode::Wavefront);
+    rgbScene.render();
+    rgbScene.setRenderMode(RenderMode::Batched);
+    rgbScene.render();
+
+    // a new light drops every record
+    rgbScene.addLightSource(std::unique_ptr<LightSource>(new PointLightSource({ 10, 5, 10 }, 0.2)));
+    assert (rgbScene.getIrradianceCacheStatistics().recordCount == 0);
+
+    return 0;
+}
+
+// renders the scene of testIrradianceCache with the cache on one thread and on several, from an empty cache each
+// time, and checks that both give the same frame in the recursive and the wavefront modes
+int testIrradianceCacheThreads()
+{
+    RGBScene rgbScene = RGBScene();
+    std::unique_ptr<Sphere> sphere(new Sphere(2, { 15, 0, 2 }));
+    sphere->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 0, 0, 255 }, 10, { 0, 0, 255 }, { 255, 255, 255 })));
+    std::unique_ptr<GroupSurface> floor(new GroupSurface());
+    floor->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { -300, 1000, 0 }, { 0, 0, 1 })));
+    floor->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { 300, -1000, 0 }, { 0, 0, 1 })));
+    floor->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 200, 200, 200 }, 10, { 200, 200, 200 }, { 0, 0, 0 })));
+    std::unique_ptr<GroupSurface> groupSurface(new GroupSurface());
+    groupSurface->addSurface(std::move(sphere));
+    groupSurface->addSurface(std::move(floor));
+
+    std::unique_ptr<PerspectiveCamera> camera(new PerspectiveCamera());
+    camera->setOrigin({ 5, 0, 5 });
+    camera->setFocalLength(10);
+    camera->setOrientation({ 1, 0, -0.2 });
+    camera->setResolution(480, 270);
+    camera->setBounds(-16, 16, 9, -9);
+
+    rgbScene.setBackgroundColor({ 40, 40, 60 });
+    rgbScene.addLightSource(std::unique_ptr<LightSource>(new PointLightSource({ 10, 0, 10 }, 0.5)));
+    rgbScene.setCamera(std::move(camera));
+    rgbScene.setSurface(std::move(groupSurface));
+    rgbScene.enableIrradianceCache(64, 0.3, 0.2, 10);
+
+    for (RenderMode renderMode : { RenderMode::Recursive, RenderMode::Wavefront })
+    {
+        rgbScene.setRenderMode(renderMode);
+        rgbScene.clearIrradianceCache();
+        rgbScene.setThreadCount(1);
+        rgbScene.render();
+        const std::string singleThreadPixels = rgbScene.computePixelArray();
+        const IrradianceCache::Statistics statistics = rgbScene.getIrradianceCacheStatistics();
+
+        rgbScene.clearIrradianceCache();
+        rgbScene.setThreadCount(4);
+        rgbScene.render();
+        std::cout << "1 and 4 threads: " << statistics.recordCount << " and " << rgbScene.getIrradianceCacheStatistics().recordCount
+            << " records, " << statistics.gatherRayCount << " gather rays" << std::endl;
+        assert (rgbScene.computePixelArray() == singleThreadPixels);
+        assert (rgbScene.getIrradianceCacheStatistics().recordCount == statistics.recordCount);
+    }
+
+    return 0;
+}
+
+// checks the nearest photons of the kd-tree against a linear search, then lights a floor off a mirror wall and checks
+// the caustic against the light seen in the mirror, and that the rendered caustic only brightens the frame
+int testCaustics()
+{
+    std::vector<PhotonMap::Photon> randomPhotons(20000);
+    Util::Sampler sampler(0, 0, 0, 0, 0);
+    for (auto & photon : randomPhotons)
+    {
+        photon.position = { sampler.nextFloat() * 10, sampler.nextFloat() * 10, sampler.nextFloat() };
+        photon.direction = { 0, 0, -1 };
+        photon.power[0] = photon.power[1] = photon.power[2] = 1;
+    }
+    const PhotonMap randomMap(randomPhotons, 4);
+    assert (PhotonMap(randomPhotons, 1).getPhoton(123).position == randomMap.getPhoton(123).position);
+    std::vector<size_t> nearest;
+    for (int query = 0; query < 100; query++)
+    {
+        const Math::Vector3 point(sampler.nextFloat() * 10, sampler.nextFloat() * 10, sampler.nextFloat());
+        randomMap.findNearest(point, 20, 2, nearest);
+        assert (nearest.size() == 20);
+        float farthest = 0;
+        for (auto photonIndex : nearest)
+        {
+            farthest = std::max(farthest, (randomMap.getPhoton(photonIndex).position - point).norm());
+        }
+        int closerCount = 0;
+        for (size_t k = 0; k < randomMap.size(); k++)
+        {
+            if ((randomMap.getPhoton(k).position - point).norm() < farthest) { closerCount++; }
+        }
+        assert (closerCount == 19);
+    }
+
+    // a floor and a mirror wall at x = 20 facing a light at (10, 0, 6)
+    std::unique_ptr<GroupSurface> floor(new GroupSurface());
+    floor->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { -300, 1000, 0 }, { 0, 0, 1 })));
+    floor->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { 300, -1000, 0 }, { 0, 0, 1 })));
+    floor->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.1, { 200, 200, 200 }, 10, { 200, 200, 200 }, { 0, 0, 0 })));
+    std::unique_ptr<Triangle> mirror(new Triangle({ 20, -8, 0 }, { 20, 8, 0 }, { 20, 0, 16 }, { -1, 0, 0 }));
+    mirror->setMaterial(std::unique_ptr<Shader>(new MirrorShader({ 0, 0, 0 }, { 0, 0, 0 }, 0.2)));
+    std::shared_ptr<GroupSurface> groupSurface(new GroupSurface());
+    groupSurface->addSurface(std::move(floor));
+    groupSurface->addSurface(std::move(mirror));
+
+    LightTable lightTable;
+    lightTable.addPointLight({ 10, 0, 6 }, 0.5, 0.5, 0.5);
+    const std::vector<PhotonMap::Photon> photons = PhotonMap::traceCausticPhotons(lightTable, *groupSurface, 200000, 0, 4);
+    assert (!photons.empty());
+    assert (photons.size() == PhotonMap::traceCausticPhotons(lightTable, *groupSurface, 200000, 0, 1).size());
+    const PhotonMap causticMap(photons, 4);
+    // (15, 0, 0) sees the light mirrored to (30, 0, 6), at a cosine of 6 / |(15, 0, 6)|, through 0.8 of the mirror
+    float irradiance[3];
+    causticMap.estimateIrradiance({ 15, 0, 0 }, { 0, 0, 1 }, 200, 1, irradiance);
+    const float expected = 0.5f * 0.8f * 6 / Math::Vector3(15, 0, 6).norm();
+    std::cout << "caustic at (15, 0, 0): " << irradiance[0] << ", expected " << expected << std::endl;
+    assert (std::abs(irradiance[0] - expected) < 0.15 * expected);
+    // (25, 0, 0) is behind the mirror
+    causticMap.estimateIrradiance({ 25, 0, 0 }, { 0, 0, 1 }, 200, 1, irradiance);
+    assert (irradiance[0] == 0);
+
+    RGBScene rgbScene = RGBScene();
+    std::unique_ptr<PerspectiveCamera> camera(new PerspectiveCamera());
+    camera->setOrigin({ 0, 0, 8 });
+    camera->setFocalLength(10);
+    camera->setOrientation({ 1, 0, -0.4 });
+    camera->setResolution(480, 270);
+    camera->setBounds(-16, 16, 9, -9);
+    rgbScene.setBackgroundColor({ 40, 40, 60 });
+    rgbScene.addLightSource(std::unique_ptr<LightSource>(new PointLightSource({ 10, 0, 6 }, 0.5)));
+    rgbScene.setCamera(std::move(camera));
+    rgbScene.setSurface(groupSurface);
+    rgbScene.render();
+    const std::string plainPixels = rgbScene.computePixelArray();
+
+    rgbScene.setCaustics(200000, 100, 1);
+    const auto start = std::chrono::steady_clock::now();
+    rgbScene.render();
+    const auto end = std::chrono::steady_clock::now();
+    const std::string causticPixels = rgbScene.computePixelArray();
+    std::cout << "caustics: " << rgbScene.getCausticMapSize() << " photons, "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+    rgbScene.exportToFile("test_caustics.bmp");
+    assert (rgbScene.getCausticMapSize() == photons.size());
+
+    int brightenedCount = 0;
+    for (size_t k = 0; k < plainPixels.size(); k++)
+    {
+        assert ((uint8_t) causticPixels[k] >= (uint8_t) plainPixels[k]);
+        if (causticPixels[k] != plainPixels[k]) { brightenedCount++; }
+    }
+    assert (brightenedCount > 0);
+
+    // the other render modes shade the same caustics
+    rgbScene.setRenderMode(RenderMode::Batched);
+    rgbScene.render();
+    assert (rgbScene.computePixelArray() == causticPixels);
+    rgbScene.setRenderMode(RenderMode::Wavefront);
+    rgbScene.render();
+
+    // a new light traces the photons again
+    rgbScene.addLightSource(std::unique_ptr<LightSource>(new PointLightSource({ 5, 5, 6 }, 0.2)));
+    assert (rgbScene.getCausticMapSize() == 0);
+
+    return 0;
+}
+
+// checks the differentials of the view rays, of their hits and of their reflections off a sphere against the rays of
+// the neighbouring pixels
+int testRayDifferentials()
+{
+    PerspectiveCamera camera({ 0, 0, 5 }, { 1, 0, -0.4 }, 480, 270, -16, 16, 9, -9, 10);
+    Util::RayDifferential differential;
+    const Math::Ray ray = camera.computeViewingRay(200, 100, differential);
+    const Math::Ray rayX = camera.computeViewingRay(201, 100);
+    const Math::Ray rayY = camera.computeViewingRay(200, 101);
+    assert ((rayX.direction - ray.direction - differential.directionX).norm() < 1e-4);
+    assert ((rayY.direction - ray.direction - differential.directionY).norm() < 1e-4);
+    ParallelOrthographicCamera orthographicCamera;
+    assert ((orthographicCamera.computeViewingRay(1, 0).origin - orthographicCamera.computeViewingRay(0, 0).origin - orthographicCamera.computeRayDifferential().originX).norm() < 1e-4);
+
+    // where neighbouring view rays land on the floor
+    GroupSurface floor;
+    floor.addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { -300, 1000, 0 }, { 0, 0, 1 })));
+    floor.addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { 300, -1000, 0 }, { 0, 0, 1 })));
+    std::shared_ptr<Util::HitRecord> hitRecord(new Util::HitRecord), neighbourRecord(new Util::HitRecord);
+    assert (floor.hit(ray, 0, 1e6, hitRecord));
+    Math::Vector3 pointX, pointY;
+    Util::transferDifferential(ray, differential, hitRecord->intersectionTime, hitRecord->unitNormal, pointX, pointY);
+    assert (floor.hit(rayX, 0, 1e6, neighbourRecord));
+    assert ((neighbourRecord->intersectionPoint - hitRecord->intersectionPoint - pointX).norm() < 0.02 * pointX.norm());
+    assert (floor.hit(rayY, 0, 1e6, neighbourRecord));
+    assert ((neighbourRecord->intersectionPoint - hitRecord->intersectionPoint - pointY).norm() < 0.02 * pointY.norm());
+
+    // a pixel covers more of the floor further away
+    LightTable lightTable;
+    RenderContext context(lightTable);
+    context.rayDifferential = differential;
+    const Math::Ray farRay = camera.computeViewingRay(200, 130);
+    std::shared_ptr<Util::HitRecord> farRecord(new Util::HitRecord);
+    assert (floor.hit(farRay, 0, 1e6, farRecord));
+    assert (farRecord->intersectionTime > hitRecord->intersectionTime);
+    assert (context.computeFootprint(farRay, *farRecord) > context.computeFootprint(ray, *hitRecord));
+
+    // off a convex mirror onto a wall, the reflections of neighbouring view rays spread apart faster than off a flat one
+    Sphere mirror(2, { 15, 0, 2 });
+    Triangle wall({ -30, 1000, -300 }, { -30, -1000, -300 }, { -30, 0, 1000 }, { 1, 0, 0 });
+    const Math::Ray sphereRay = camera.computeViewingRay(240, 160, differential);
+    assert (mirror.hit(sphereRay, 0, 1e6, hitRecord));
+    const Util::RayDifferential reflected = Util::reflectDifferential(sphereRay, differential, *hitRecord);
+    auto reflect = [&](Math::Ray const& viewRay, Math::Vector3 & wallPoint) -> Math::Ray
+    {
+        std::shared_ptr<Util::HitRecord> mirrorRecord(new Util::HitRecord), wallRecord(new Util::HitRecord);
+        assert (mirror.hit(viewRay, 0, 1e6, mirrorRecord));
+        const Math::Vector3 d = viewRay.direction / viewRay.direction.norm();
+        const Math::Vector3 r = d - 2 * Math::dot(d, mirrorRecord->unitNormal) * mirrorRecord->unitNormal;
+        const Math::Ray reflection = { mirrorRecord->intersectionPoint, r };
+        assert (wall.hit(reflection, 0, 1e6, wallRecord));
+        wallPoint = wallRecord->intersectionPoint;
+        return reflection;
+    };
+    Math::Vector3 wallPoint, wallPointX, wallPointY;
+    const Math::Ray reflection = reflect(sphereRay, wallPoint);
+    reflect(camera.computeViewingRay(241, 160), wallPointX);
+    reflect(camera.computeViewingRay(240, 161), wallPointY);
+    std::shared_ptr<Util::HitRecord> wallRecord(new Util::HitRecord);
+    assert (wall.hit(reflection, 0, 1e6, wallRecord));
+    Util::transferDifferential(reflection, reflected, wallRecord->intersectionTime, wallRecord->unitNormal, pointX, pointY);
+    std::cout << "reflected footprint: " << (wallPointX - wallPoint).norm() << " by the rays, " << pointX.norm() << " by the differential" << std::endl;
+    assert ((wallPointX - wallPoint - pointX).norm() < 0.1 * pointX.norm());
+    assert ((wallPointY - wallPoint - pointY).norm() < 0.1 * pointY.norm());
+    Util::HitRecord flatRecord = *hitRecord;
+    flatRecord.curvature = 0;
+    const Util::RayDifferential flatReflected = Util::reflectDifferential(sphereRay, differential, flatRecord);
+    Math::Vector3 flatPointX, flatPointY;
+    Util::transferDifferential(reflection, flatReflected, wallRecord->intersectionTime, wallRecord->unitNormal, flatPointX, flatPointY);
+    assert (pointX.norm() > 2 * flatPointX.norm());
+
+    return 0;
+}
+
+// writes a checkerboard as a texture file and checks its levels, its filtering, its tile cache under several threads and
+// a floor rendered with it, which should fade to gray in the distance instead of aliasing
+int testTextures()
+{
+    const int size = 256, cellSize = 8;
+    std::vector<Util::Color> texels(size * size);
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            const uint8_t checker = (x / cellSize + y / cellSize) % 2 == 0 ? 255 : 0;
+            texels[y * size + x] = { checker, checker, (uint8_t) x };
+        }
+    }
+    assert (Texture::write("test_texture.getex", size, size, texels, 32));
+    std::shared_ptr<TileCache> cache(new TileCache(8 * 32 * 32 * 3, 2));
+    Texture texture("test_texture.getex", cache);
+    assert (texture.isOk() && texture.getWidth() == size && texture.getHeight() == size && texture.getLevelCount() == 9);
+    assert (!Texture("test_missing_texture.getex", cache).isOk());
+
+    for (int k = 0; k < 1000; k++)
+    {
+        const int x = (k * 37) % size, y = (k * 91) % size;
+        const Util::Color texel = texture.getTexel(0, x, y);
+        assert (texel.red == texels[y * size + x].red && texel.blue == texels[y * size + x].blue);
+    }
+    assert (std::abs(texture.getTexel(8, 0, 0).red - 128) <= 1);
+    // in the middle of a cell, a footprint smaller than a texel or as wide as the cell sees only the cell. one as wide
+    // as two cells or the whole texture sees the average
+    const float middle = (cellSize / 2) / (float) size;
+    assert (texture.sample(middle + 0.5f / size, middle + 0.5f / size, 0).red == 255);
+    assert (texture.sample(middle, middle, cellSize / (float) size).red == 255);
+    assert (std::abs(texture.sample(middle, middle, 2 * cellSize / (float) size).red - 128) <= 1);
+    assert (std::abs(texture.sample(0.3, 0.7, 1).red - 128) <= 1);
+    // coordinates repeat
+    assert (texture.sample(middle + 3, middle - 2, cellSize / (float) size).red == 255);
+
+    // a cache of eight tiles cannot hold the 64 tiles of the first level
+    TileCache::Statistics statistics = cache->getStatistics();
+    assert (statistics.missCount > 0 && statistics.hitCount > 0 && statistics.evictionCount > 0);
+    assert (statistics.residentBytes <= cache->getCapacity());
+
+    // threads sharing the cache sample what one thread does
+    const int sampleCount = 20000;
+    std::vector<Util::Color> expected(sampleCount);
+    auto samplePoint = [&](int k) { return texture.sample(k * 0.618034f, k * 0.414214f, (k % 7) / 64.0f); };
+    for (int k = 0; k < sampleCount; k++) { expected[k] = samplePoint(k); }
+    std::atomic<int> mismatchCount(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.push_back(std::thread([&, t]()
+        {
+            for (int k = t; k < sampleCount; k += 4)
+            {
+                const Util::Color color = samplePoint(k);
+                if (color.red != expected[k].red || color.green != expected[k].green || color.blue != expected[k].blue) { mismatchCount++; }
+            }
+        }));
+    }
+    for (auto & thread : threads) { thread.join(); }
+    assert (mismatchCount == 0);
+    statistics = cache->getStatistics();
+    std::cout << "tile cache: " << statistics.hitCount << " hits, " << statistics.missCount << " misses, " << statistics.evictionCount << " evictions" << std::endl;
+    assert (statistics.residentBytes <= cache->getCapacity());
+
+    // a floor with a cell every 0.625, seen from a height of 5
+    std::unique_ptr<GroupSurface> floor(new GroupSurface());
+    const Math::Vector3 corners[2][3] = { { { 300, 1000, 0 }, { -300, -1000, 0 }, { -300, 1000, 0 } }, { { 300, 1000, 0 }, { -300, -1000, 0 }, { 300, -1000, 0 } } };
+    for (auto & triangleCorners : corners)
+    {
+        std::unique_ptr<Triangle> triangle(new Triangle(triangleCorners[0], triangleCorners[1], triangleCorners[2], { 0, 0, 1 }));
+        float textureCoordinates[6];
+        const std::vector<Math::Vector3> vertices = triangle->getVertices();
+        for (int v = 0; v < 3; v++)
+        {
+            textureCoordinates[2 * v] = vertices[v].getX() / 20;
+            textureCoordinates[2 * v + 1] = vertices[v].getY() / 20;
+        }
+        triangle->setTextureCoordinates(textureCoordinates);
+        floor->addSurface(std::move(triangle));
+    }
+    std::unique_ptr<StandardShader> floorShader(new StandardShader(0.2, { 255, 255, 255 }, 10, { 255, 255, 255 }, { 0, 0, 0 }));
+    floorShader->setSurfaceTexture(std::shared_ptr<const Texture>(new Texture("test_texture.getex", TileCache::getShared())));
+    floor->setMaterial(std::move(floorShader));
+
+    RGBScene rgbScene = RGBScene();
+    std::unique_ptr<PerspectiveCamera> camera(new PerspectiveCamera());
+    camera->setOrigin({ 0, 0, 5 });
+    camera->setFocalLength(10);
+    camera->setOrientation({ 1, 0, -0.15 });
+    camera->setResolution(320, 180);
+    camera->setBounds(-16, 16, 9, -9);
+    rgbScene.setBackgroundColor({ 40, 40, 60 });
+    rgbScene.addLightSource(std::unique_ptr<LightSource>(new PointLightSource({ 0, 0, 100 }, 0.8)));
+    rgbScene.setCamera(std::move(camera));
+    rgbScene.setSurface(std::move(floor));
+    rgbScene.render();
+    rgbScene.exportToFile("test_texture.bmp");
+    const std::string pixels = rgbScene.computePixelArray();
+
+    // rows count from the bottom. row 10 sees the floor 5 away and row 95 sees it 50 away
+    auto rowContrast = [&](int row)
+    {
+        float difference = 0;
+        for (int x = 0; x + 1 < 320; x++)
+        {
+            difference += std::abs((uint8_t) pixels[3 * (row * 320 + x + 1) + 2] - (uint8_t) pixels[3 * (row * 320 + x) + 2]);
+        }
+        return difference / 319;
+    };
+    std::cout << "texture contrast: " << rowContrast(10) << " near, " << rowContrast(95) << " far" << std::endl;
+    assert (rowContrast(10) > 10);
+    assert (rowContrast(95) < 0.25 * rowContrast(10));
+
+    rgbScene.setRenderMode(RenderMode::Batched);
+    rgbScene.render();
+    assert (rgbScene.computePixelArray() == pixels);
+
+    // the scene files name the texture
+    assert (SceneFile::saveText(rgbScene, "test_texture_scene.txt"));
+    std::unique_ptr<Scene> copy = SceneFile::load("test_texture_scene.txt");
+    assert (copy != NULL);
+    Serialization::BinaryWriter writer, copyWriter;
+    rgbScene.serialize(writer);
+    copy->serialize(copyWriter);
+    assert (copyWriter.getBuffer() == writer.getBuffer());
+    copy->render();
+    assert (copy->computePixelArray() == pixels);
+
+    return 0;
+}
+
+// simplifies a finely cut sphere into levels of detail and checks that they stay on the sphere, that a camera further
+// away picks a coarser level without switching back and forth, and that the coarse level renders like the full mesh
+int testLevelsOfDetail()
+{
+    // rings of vertices from pole to pole, the first and last column and the poles repeated as a mesh cut at its seam
+    const float radius = 3;
+    const int columnCount = 128, rowCount = 64;
+    std::vector<Math::Vector3> vertices;
+    std::vector<uint32_t> indices;
+    for (int row = 0; row <= rowCount; row++)
+    {
+        const float polar = M_PI * row / rowCount;
+        const float ringRadius = row == 0 || row == rowCount ? 0 : radius * std::sin(polar);
+        for (int column = 0; column <= columnCount; column++)
+        {
+            const float azimuth = 2 * M_PI * (column % columnCount) / columnCount;
+            vertices.push_back({ ringRadius * std::cos(azimuth), ringRadius * std::sin(azimuth), radius * std::cos(polar) });
+        }
+    }
+    for (int row = 0; row < rowCount; row++)
+    {
+        for (int column = 0; column < columnCount; column++)
+        {
+            const uint32_t corner = row * (columnCount + 1) + column, below = corner + columnCount + 1;
+            if (row > 0) { indices.insert(indices.end(), { corner, below, corner + 1 }); }
+            if (row < rowCount - 1) { indices.insert(indices.end(), { corner + 1, below, below + 1 }); }
+        }
+    }
+    const size_t triangleCount = indices.size() / 3;
+
+    // the simplified mesh keeps to the sphere, and stays closed since no collapse leaves a hole at the seam
+    MeshSimplifier simplifier{ MeshSurface(vertices, indices) };
+    assert (simplifier.getTriangleCount() == triangleCount);
+    assert (simplifier.simplify(triangleCount / 16));
+    assert (simplifier.getTriangleCount() <= triangleCount / 16 && simplifier.getTriangleCount() > triangleCount / 20);
+    std::unique_ptr<MeshSurface> simplified = simplifier.createMesh();
+    assert (simplified->getTriangleCount() == simplifier.getTriangleCount());
+    assert (simplified->getVertexCount() == simplified->getTriangleCount() / 2 + 2);
+    for (size_t v = 0; v < simplified->getVertexCount(); v++)
+    {
+        assert (std::abs(simplified->getVertex(v).norm() - radius) < simplifier.getError() + 1e-3);
+    }
+    assert (simplifier.getError() < 0.05 * radius);
+
+    std::unique_ptr<MeshSurface> mesh(new MeshSurface(vertices, indices));
+    LodSurface * lodSurface = new LodSurface(std::move(mesh), 0.5, 0.25, 64);
+    lodSurface->buildAccelerationStructures("");
+    std::cout << "levels of detail:";
+    for (size_t level = 0; level < lodSurface->getLevelCount(); level++)
+    {
+        std::cout << " " << lodSurface->getLevel(level).getTriangleCount() << " (" << lodSurface->getLevelError(level) << ")";
+    }
+    std::cout << std::endl;
+    assert (lodSurface->getLevelCount() == 8);
+    for (size_t level = 1; level < lodSurface->getLevelCount(); level++)
+    {
+        assert (lodSurface->getLevel(level).getTriangleCount() <= lodSurface->getLevel(level - 1).getTriangleCount() / 2);
+        assert (lodSurface->getLevelError(level) >= lodSurface->getLevelError(level - 1));
+    }
+
+    // a pixel is 0.1 wide at the focal length of 10, so 0.01 per unit of distance to the front of the sphere
+    PerspectiveCamera camera({ -30, 0, 0 }, { 1, 0, 0 }, 320, 180, -16, 16, 9, -9, 10);
+    assert (std::abs(camera.computePixelWidth(lodSurface->boundingBox()) - 0.27) < 1e-3);
+    assert (camera.computePixelWidth(Math::Box({ -40, -1, -1 }, { -20, 1, 1 })) == 0);
+    ParallelOrthographicCamera orthographicCamera;
+    assert (std::abs(orthographicCamera.computePixelWidth(lodSurface->boundingBox()) - 2 / 64.0f) < 1e-6);
+
+    std::vector<size_t> selectedLevels;
+    std::vector<Math::Box> changedBounds;
+    for (float distance : { 6.0f, 30.0f, 300.0f })
+    {
+        camera.setOrigin({ -distance, 0, 0 });
+        lodSurface->selectLevelOfDetail(camera, changedBounds);
+        selectedLevels.push_back(lodSurface->getSelectedLevel());
+    }
+    assert (selectedLevels[0] < selectedLevels[1] && selectedLevels[1] < selectedLevels[2]);
+    assert (changedBounds.size() == 3 - (selectedLevels[0] == 0));
+
+    // a camera wobbling around the distance at which a level was picked stays with it
+    for (float distance = 6; distance < 300; distance *= 1.1)
+    {
+        changedBounds.clear();
+        camera.setOrigin({ -distance, 0, 0 });
+        lodSurface->selectLevelOfDetail(camera, changedBounds);
+        for (int frame = 0; frame < 10; frame++)
+        {
+            camera.setOrigin({ -distance * (frame % 2 == 0 ? 1.05f : 1 / 1.05f), 0, 0 });
+            lodSurface->selectLevelOfDetail(camera, changedBounds);
+        }
+        assert (changedBounds.size() <= 2);
+    }
+
+    // far enough away for a coarse level, the outline of the sphere is that of the full mesh to within a pixel. the
+    // flat shaded facets do not match, the error bounding how far the surface moves and not how far it turns
+    std::unique_ptr<MeshSurface> fullMesh(new MeshSurface(vertices, indices));
+    std::unique_ptr<MeshSurface> lodMesh(new MeshSurface(vertices, indices));
+    auto renderSphere = [&](std::unique_ptr<Surface> surface, std::vector<bool> & hits)
+    {
+        LodSurface * lod = dynamic_cast<LodSurface *>(surface.get());
+        surface->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 0, 0, 255 }, 10, { 0, 0, 255 }, { 255, 255, 255 })));
+        RGBScene rgbScene = RGBScene();
+        rgbScene.setCamera(std::unique_ptr<Camera>(new PerspectiveCamera({ -30, 0, 0 }, { 1, 0, 0 }, 320, 180, -16, 16, 9, -9, 10)));
+        rgbScene.addLightSource(std::unique_ptr<LightSource>(new PointLightSource({ -30, 20, 20 }, 0.8)));
+        rgbScene.setSurface(std::move(surface));
+        std::vector<Util::Color> colors;
+        rgbScene.computeRegion({ 0, 0, 320, 180 }, colors, hits);
+        return lod == NULL ? 0 : (int) lod->getSelectedLevel();
+    };
+    std::vector<bool> fullHits, lodHits;
+    renderSphere(std::move(fullMesh), fullHits);
+    const int coarseLevel = renderSphere(std::unique_ptr<Surface>(new LodSurface(std::move(lodMesh))), lodHits);
+    int spherePixelCount = 0, differentPixelCount = 0;
+    for (size_t p = 0; p < fullHits.size(); p++)
+    {
+        spherePixelCount += fullHits[p];
+        differentPixelCount += fullHits[p] != lodHits[p];
+    }
+    std::cout << "level " << coarseLevel << ": " << differentPixelCount << " of " << spherePixelCount << " sphere pixels differ" << std::endl;
+    assert (coarseLevel >= 3);
+    assert (differentPixelCount < spherePixelCount / 50);
+
+    // the levels are built again from the mesh in the file
+    std::unique_ptr<Surface> lodCopy(lodSurface);
+    Serialization::BinaryWriter writer, copyWriter;
+    lodCopy->serialize(writer);
+    Serialization::BinaryReader reader(writer.getBuffer());
+    std::unique_ptr<Surface> copy = Surface::deserialize(reader);
+    assert (copy != NULL && dynamic_cast<LodSurface *>(copy.get()) != NULL);
+    copy->serialize(copyWriter);
+    assert (copyWriter.getBuffer() == writer.getBuffer());
+    copy->buildAccelerationStructures("");
+    assert (dynamic_cast<LodSurface *>(copy.get())->getLevelCount() == lodSurface->getLevelCount());
+
+    return 0;
+}
+
+// renders a turntable once frame by frame and once through the sequence renderer, checks that both wrote the same
+// files and prints how long each took
+int testSequenceRender()
+{
+    RGBScene rgbScene = RGBScene();
+    std::unique_ptr<Sphere> sphere(new Sphere(3, { 15, 5, 3 }));
+    sphere->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 0, 0, 255 }, 10, { 0, 0, 255 }, { 255, 255, 255 })));
+    std::unique_ptr<GroupSurface> plane(new GroupSurface());
+    plane->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { -300, 1000, 0 }, { 0, 0, 1 })));
+    plane->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { 300, -1000, 0 }, { 0, 0, 1 })));
+    plane->setMaterial(std::unique_ptr<Shader>(new MirrorShader({ 180, 180, 255 }, { 220, 220, 255 }, 0.7)));
+    std::unique_ptr<GroupSurface> groupSurface(new GroupSurface());
+    groupSurface->addSurface(std::move(sphere));
+    groupSurface->addSurface(std::move(plane));
+
+    rgbScene.setBackgroundColor({ 180, 180, 255 });
+    rgbScene.addLightSource(std::unique_ptr<LightSource>(new PointLightSource({ 10, 0, 5 }, 0.5)));
+    rgbScene.setSurface(std::move(groupSurface));
+
+    // the camera circles the sphere once over the sequence
+    const int frameCount = 24;
+    auto updateFrame = [&](Scene & scene, int frameIndex)
+    {
+        const float angle = 2 * M_PI * frameIndex / frameCount;
+        std::unique_ptr<PerspectiveCamera> camera(new PerspectiveCamera());
+        camera->setOrigin({ 15 - 10 * std::cos(angle), 5 - 10 * std::sin(angle), 5 });
+        camera->setFocalLength(10);
+        camera->setOrientation({ std::cos(angle), std::sin(angle), -0.2 });
+        camera->setResolution(640, 360);
+        camera->setBounds(-16, 16, 9, -9);
+        scene.setCamera(std::move(camera));
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frameIndex = 0; frameIndex < frameCount; frameIndex++)
+    {
+        updateFrame(rgbScene, frameIndex);
+        rgbScene.render();
+        rgbScene.exportToFile(SequenceRenderer::computeFilename("test_serial_frame_", frameIndex));
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "frame by frame: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+
+    SequenceRenderer sequenceRenderer(rgbScene);
+    start = std::chrono::steady_clock::now();
+    assert (sequenceRenderer.render(frameCount, updateFrame, "test_frame_") == frameCount);
+    end = std::chrono::steady_clock::now();
+    std::cout << "pipelined: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+
+    for (int frameIndex = 0; frameIndex < frameCount; frameIndex += 7)
+    {
+        std::ifstream serialFile(SequenceRenderer::computeFilename("test_serial_frame_", frameIndex), std::ios::binary);
+        std::ifstream file(SequenceRenderer::computeFilename("test_frame_", frameIndex), std::ios::binary);
+        const std::string serialBytes((std::istreambuf_iterator<char>(serialFile)), std::istreambuf_iterator<char>());
+        const std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        assert (!bytes.empty() && bytes == serialBytes);
+    }
+
+    // a directory that does not exist fails every write without stopping the render
+    assert (sequenceRenderer.render(2, updateFrame, "missing_directory/test_frame_") == 0);
+
+    return 0;
+}
+
+// writes the same frame synchronously and through the async writer, with and without O_DIRECT, and checks that the
+// files match and that failures come back through the futures
+int testAsyncImageWriter()
+{
+    RGBScene rgbScene = RGBScene();
+    std::unique_ptr<PerspectiveCamera> camera(new PerspectiveCamera());
+    camera->setOrigin({ 0, 0, 0 });
+    camera->setFocalLength(10);
+    camera->setOrientation({ 1, 0, 0 });
+    camera->setResolution(203, 101); // rows padded in the file, and not a whole number of blocks
+    camera->setBounds(-16, 16, 8, -8);
+    rgbScene.setCamera(std::move(camera));
+    std::unique_ptr<Sphere> sphere(new Sphere(3, { 15, 0, 0 }));
+    sphere->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 0, 0, 255 }, 10, { 0, 0, 255 }, { 255, 255, 255 })));
+    rgbScene.setSurface(std::move(sphere));
+    rgbScene.setBackgroundColor({ 180, 180, 255 });
+    rgbScene.addLightSource(std::unique_ptr<LightSource>(new PointLightSource({ 10, 0, 5 }, 0.5)));
+    rgbScene.render();
+    assert (rgbScene.exportToFile("test_sync_write.bmp"));
+    assert (!rgbScene.exportToFile("missing_directory/test_sync_write.bmp"));
+
+    AsyncImageWriter writer;
+    std::future<AsyncImageWriter::Result> bufferedWrite = rgbScene.exportToFile(writer, "test_async_write.bmp");
+    writer.setDirectIo(true);
+    std::future<AsyncImageWriter::Result> directWrite = rgbScene.exportToFile(writer, "test_direct_write.bmp");
+    std::future<AsyncImageWriter::Result> failedWrite = rgbScene.exportToFile(writer, "missing_directory/test_async_write.bmp");
+    std::future<AsyncImageWriter::Result> failedEncode = writer.write("test_unwritten.bmp", []() -> std::string { throw std::runtime_error("encoder failed"); });
+    assert (bufferedWrite.get().success);
+    assert (directWrite.get().success);
+    const AsyncImageWriter::Result failure = failedWrite.get();
+    assert (!failure.success && !failure.error.empty());
+    std::cout << "expected failure: " << failure.error << std::endl;
+    assert (failedEncode.get().error == "test_unwritten.bmp: encoder failed");
+    writer.flush();
+
+    std::ifstream syncFile("test_sync_write.bmp", std::ios::binary);
+    const std::string syncBytes((std::istreambuf_iterator<char>(syncFile)), std::istreambuf_iterator<char>());
+    for (std::string filename : { "test_async_write.bmp", "test_direct_write.bmp" })
+    {
+        std::ifstream file(filename, std::ios::binary);
+        const std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        assert (!bytes.empty() && bytes == syncBytes);
+    }
+
+    return 0;
+}
+
+// writes a 1080p frame in every format, checks that the formats agree on the pixels and that the png does not depend on
+// the thread count, and prints the size of each file and how long the png took to encode
+int testImageEncoders()
+{
+    RGBScene rgbScene = RGBScene();
+    std::unique_ptr<Sphere> sphere(new Sphere(3, { 15, 5, 3 }));
+    sphere->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 0, 0, 255 }, 10, { 0, 0, 255 }, { 255, 255, 255 })));
+    std::unique_ptr<GroupSurface> plane(new GroupSurface());
+    plane->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { -300, 1000, 0 }, { 0, 0, 1 })));
+    plane->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { 300, -1000, 0 }, { 0, 0, 1 })));
+    plane->setMaterial(std::unique_ptr<Shader>(new MirrorShader({ 180, 180, 255 }, { 220, 220, 255 }, 0.7)));
+    std::unique_ptr<GroupSurface> groupSurface(new GroupSurface());
+    groupSurface->addSurface(std::move(sphere));
+    groupSurface->addSurface(std::move(plane));
+    std::unique_ptr<PerspectiveCamera> camera(new PerspectiveCamera());
+    camera->setOrigin({ 5, 0, 5 });
+    camera->setFocalLength(10);
+    camera->setOrientation({ 1, 0, -0.2 });
+    camera->setResolution(1920, 1080);
+    camera->setBounds(-16, 16, 9, -9);
+    rgbScene.setBackgroundColor({ 180, 180, 255 });
+    rgbScene.addLightSource(std::unique_ptr<LightSource>(new PointLightSource({ 10, 0, 5 }, 0.5)));
+    rgbScene.setCamera(std::move(camera));
+    rgbScene.setSurface(std::move(groupSurface));
+    rgbScene.render();
+
+    for (std::string filename : { "test_encoder.bmp", "test_encoder.ppm", "test_encoder.pfm", "test_encoder.png" })
+    {
+        assert (rgbScene.exportToFile(filename));
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        std::cout << filename << ": " << file.tellg() << " bytes" << std::endl;
+    }
+
+    // the pixel at (x, y) from the top left, as red, green and blue, agrees across the formats
+    const std::string pixelArray = rgbScene.computePixelArray();
+    const std::string ppm = PpmEncoder().encode(1920, 1080, pixelArray);
+    const std::string pfm = PfmEncoder().encode(1920, 1080, pixelArray);
+    assert (ppm.compare(0, 16, "P6\n1920 1080\n255") == 0 && pfm.compare(0, 18, "PF\n1920 1080\n-1.0\n") == 0);
+    for (int y = 0; y < 1080; y += 97)
+    {
+        for (int x = 0; x < 1920; x += 131)
+        {
+            const size_t bitmapOffset = ((size_t) (1079 - y) * 1920 + x) * 3;
+            for (int channel = 0; channel < 3; channel++)
+            {
+                const uint8_t value = pixelArray[bitmapOffset + 2 - channel];
+                assert ((uint8_t) ppm[ppm.size() - 1920 * 1080 * 3 + ((size_t) y * 1920 + x) * 3 + channel] == value);
+                float pfmValue;
+                std::memcpy(&pfmValue, &pfm[pfm.size() - 1920 * 1080 * 12 + (bitmapOffset + channel) * 4], 4);
+                assert (pfmValue == value / 255.0f);
+            }
+        }
+    }
+
+    PngEncoder pngEncoder;
+    pngEncoder.setThreadCount(1);
+    auto start = std::chrono::steady_clock::now();
+    const std::string serialPng = pngEncoder.encode(1920, 1080, pixelArray);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "png on 1 thread: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+    pngEncoder.setThreadCount(Util::defaultThreadCount());
+    start = std::chrono::steady_clock::now();
+    const std::string png = pngEncoder.encode(1920, 1080, pixelArray);
+    end = std::chrono::steady_clock::now();
+    std::cout << "png on " << pngEncoder.getThreadCount() << " threads: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+    assert (png == serialPng);
+    assert (png.size() < pixelArray.size() / 4);
+
+    return 0;
+}
+
+// renders the chapter 2 scene once per render mode and prints how long each took
+int benchmarkRenderPaths()
+{
+    const RenderMode renderModes[] = { RenderMode::Recursive, RenderMode::Batched, RenderMode::Wavefront, RenderMode::Specialized };
+    const char * renderModeNames[] = { "recursive", "batched", "wavefront", "specialized" };
+
+    for (int m = 0; m < 4; m++)
+    {
+        RGBScene rgbScene = RGBScene();
+
+        std::unique_ptr<Sphere> sphere1(new Sphere(2, { 23, -14, 2 }));
+        sphere1->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 0, 255, 0 }, 10, { 0, 255, 0 }, { 255, 255, 255 })));
+        std::unique_ptr<Sphere> sphere2(new Sphere(3, { 15, 5, 3 }));
+        sphere2->setMaterial(std::unique_ptr<Shader>(new StandardShader(0.2, { 0, 0, 255 }, 10, { 0, 0, 255 }, { 255, 255, 255 })));
+
+        std::unique_ptr<GroupSurface> plane(new GroupSurface());
+        plane->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { -300, 1000, 0 }, { 0, 0, 1 })));
+        plane->addSurface(std::unique_ptr<Triangle>(new Triangle({ 300, 1000, 0 }, { -300, -1000, 0 }, { 300, -1000, 0 }, { 0, 0, 1 })));
+        plane->setMaterial(std::unique_ptr<Shader>(new MirrorShader({ 180, 180, 255 }, { 220, 220, 255 }, 0.7)));
+
+        std::unique_ptr<GroupSurface> groupSurface(new GroupSurface());
+        groupSurface->addSurface(std::move(sphere1));
+        groupSurface->addSurface(std::move(sphere2));
+        groupSurface->addSurface(std::move(plane));
+        groupSurface->setMaterial(std::unique_ptr<Shader>(new StaticColorShader({ 255, 0, 0 })));
+
+        std::unique_ptr<PerspectiveCamera> camera(new PerspectiveCamera());
+        camera->setOrigin({ 5, 0, 5 });
+        camera->setFocalLength(10);
+        camera->setOrientation({ 1, 0, -0.2 });
+        camera->setResolution(1920, 1080);
+        camera->setBounds(-16, 16, 9, -9);
+
+        std::unique_ptr<LightSource> lightSource(new PointLightSource({ 10, 0, 5 }));
+        lightSource->setIntensity(0.5);
+
+        rgbScene.setBackgroundColor({ 180, 180, 255 });
+        rgbScene.addLightSource(std::move(lightSource));
+        rgbScene.setCamera(std::move(camera));
+        rgbScene.setSurface(std::move(groupSurface));
+        rgbScene.setRenderMode(renderModes[m]);
+
+        const auto start = std::chrono::steady_clock::now();
+        rgbScene.render();
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << renderModeNames[m] << ": " << elapsed.count() << " ms" << std::endl;
+    }
+
+    return 0;
+}
+
 int main()
 {
     // testMath();
     // testGrayscaleScene();
     // testRGBScene();
     chapter2TestRender();
+    // benchmarkRenderPaths();
+    // testDistributedRender();
+    // testSceneFile();
+    // testMeshBvh();
+    // testIncrementalRender();
+    // testCropRender();
+    // testSampling();
+    // testAreaLights();
+    // testAmbientOcclusion();
+    // testIrradianceCache();
+    // testIrradianceCacheThreads();
+    // testCaustics();
+    // testRayDifferentials();
+    // testTextures();
+    // testLevelsOfDetail();
+    // testSequenceRender();
+    // testAsyncImageWriter();
+    // testImageEncoders();
 
     return 0;
 }
@@ -1,6 +1,8 @@
 #include "math.h"
 #include <cmath>
 #include <ostream>
+#include <algorithm>
+#include <limits>
 
 Math::Vector3::Vector3()
 {
@@ -153,3 +155,68 @@ bool Math::Box::isInside(Math::Vector3 p) const
     if (p.getY() <= this->min.getY() || p.getY() >= this->max.getY()) { return false; };
     return p.getZ() > this->min.getZ() && p.getZ() < this->max.getZ();
 }
+
+Math::Box Math::Box::empty()
+{
+    const float infinity = std::numeric_limits<float>::infinity();
+    Math::Box box;
+    box.min = { infinity, infinity, infinity };
+    box.max = { -infinity, -infinity, -infinity };
+    return box;
+}
+
+bool Math::Box::isEmpty() const
+{
+    return this->min.getX() > this->max.getX() || this->min.getY() > this->max.getY() || this->min.getZ() > this->max.getZ();
+}
+
+Math::Vector3 Math::Box::centroid() const
+{
+    return (this->min + this->max) / 2;
+}
+
+Math::Vector3 Math::Box::extent() const
+{
+    return this->max - this->min;
+}
+
+float Math::Box::surfaceArea() const
+{
+    if (this->isEmpty()) { return 0; }
+    const Math::Vector3 e = this->extent();
+    return 2 * (e.getX() * e.getY() + e.getY() * e.getZ() + e.getZ() * e.getX());
+}
+
+void Math::Box::expand(Math::Vector3 p)
+{
+    this->min = { std::min(this->min.getX(), p.getX()), std::min(this->min.getY(), p.getY()), std::min(this->min.getZ(), p.getZ()) };
+    this->max = { std::max(this->max.getX(), p.getX()), std::max(this->max.getY(), p.getY()), std::max(this->max.getZ(), p.getZ()) };
+}
+
+void Math::Box::expand(Math::Box const& box)
+{
+    if (box.isEmpty()) { return; } // its inverted corners would make this box infinite
+    this->expand(box.min);
+    this->expand(box.max);
+}
+
+bool Math::Box::hit(Math::Ray const& ray, Math::Vector3 const& inverseDirection, float t0, float t1, float & tEnter, float & tExit) const
+{
+    const float tx1 = (this->min.getX() - ray.origin.getX()) * inverseDirection.getX();
+    const float tx2 = (this->max.getX() - ray.origin.getX()) * inverseDirection.getX();
+    const float ty1 = (this->min.getY() - ray.origin.getY()) * inverseDirection.getY();
+    const float ty2 = (this->max.getY() - ray.origin.getY()) * inverseDirection.getY();
+    const float tz1 = (this->min.getZ() - ray.origin.getZ()) * inverseDirection.getZ();
+    const float tz2 = (this->max.getZ() - ray.origin.getZ()) * inverseDirection.getZ();
+
+    // a ray parallel to a slab that starts exactly on one of its planes gives 0 * inf = NaN. std::min and std::max return
+    // their first argument when the second is NaN, so keeping the running value first stops NaN from poisoning the interval
+    tEnter = std::max(std::max(std::max(t0, std::min(tx1, tx2)), std::min(ty1, ty2)), std::min(tz1, tz2));
+    tExit = std::min(std::min(std::min(t1, std::max(tx1, tx2)), std::max(ty1, ty2)), std::max(tz1, tz2));
+    return tEnter <= tExit;
+}
+
+Math::Vector3 Math::inverse(Math::Vector3 const& v)
+{
+    return { 1 / v.getX(), 1 / v.getY(), 1 / v.getZ() };
+}
@@ -55,8 +55,23 @@ namespace Math
         Box(); // create the degenerate box that has min and max set to the origin
         Box(Vector3 u, Vector3 v);
 
+        static Box empty(); // the inverted box that contains nothing. expanding it by a point or box gives that point or box
+
         bool isInside(Vector3 p) const; // not edge inclusive
+        bool isEmpty() const;
+        Vector3 centroid() const;
+        Vector3 extent() const;
+        float surfaceArea() const;
+
+        void expand(Vector3 p);
+        void expand(Box const& box);
+
+        // slab test using the precomputed componentwise inverse of the ray direction. on a hit, tEnter and tExit hold
+        // where the ray enters and leaves the box clipped to [t0, t1]. the box must not be empty
+        bool hit(Ray const& ray, Vector3 const& inverseDirection, float t0, float t1, float & tEnter, float & tExit) const;
     };
+
+    Vector3 inverse(Vector3 const& v); // componentwise reciprocal. zero components become infinite
 }
 
 #endif
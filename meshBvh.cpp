@@ -0,0 +1,328 @@
+#include "meshBvh.h"
+#include "surface.h"
+#include "serialization.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    const char MAGIC[8] = { 'G', 'E', 'B', 'V', 'H', '\0', '\0', '\0' };
+    const uint32_t VERSION = 1;
+
+    const int MAX_LEAF_SIZE = 4;
+    const int BIN_COUNT = 16;
+    // past this depth nodes are split at the median, which bounds the depth of any tree by MAX_SAH_DEPTH + 32 and so
+    // the traversal stack in MeshSurface::hit
+    const int MAX_SAH_DEPTH = 64;
+    const int MAX_DEPTH = MAX_SAH_DEPTH + 32;
+
+    const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+    const uint64_t FNV_PRIME = 1099511628211ULL;
+
+    uint64_t fnv1a(const void * data, size_t size, uint64_t hash)
+    {
+        const unsigned char * bytes = (const unsigned char *) data;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+
+    float component(Math::Vector3 const& v, int axis)
+    {
+        if (axis == 0) { return v.getX(); }
+        if (axis == 1) { return v.getY(); }
+        return v.getZ();
+    }
+
+    struct Builder
+    {
+        std::vector<MeshBvh::Node> nodes;
+        std::vector<uint32_t> order;
+        std::vector<Math::Box> bounds; // of every triangle
+        std::vector<Math::Vector3> centroids;
+
+        // builds the subtree over order[begin, end) and returns its index
+        uint32_t build(size_t begin, size_t end, int depth)
+        {
+            const uint32_t nodeIndex = this->nodes.size();
+            this->nodes.push_back(MeshBvh::Node());
+
+            Math::Box nodeBounds = Math::Box::empty();
+            Math::Box centroidBounds = Math::Box::empty();
+            for (size_t k = begin; k < end; k++)
+            {
+                nodeBounds.expand(this->bounds[this->order[k]]);
+                centroidBounds.expand(this->centroids[this->order[k]]);
+            }
+
+            MeshBvh::Node node;
+            node.min[0] = nodeBounds.min.getX();
+            node.min[1] = nodeBounds.min.getY();
+            node.min[2] = nodeBounds.min.getZ();
+            node.max[0] = nodeBounds.max.getX();
+            node.max[1] = nodeBounds.max.getY();
+            node.max[2] = nodeBounds.max.getZ();
+
+            const size_t middle = this->split(begin, end, depth, nodeBounds, centroidBounds);
+            if (middle == begin)
+            {
+                node.offset = begin;
+                node.triangleCount = end - begin;
+                this->nodes[nodeIndex] = node;
+                return nodeIndex;
+            }
+
+            this->build(begin, middle, depth + 1);
+            node.offset = this->build(middle, end, depth + 1);
+            node.triangleCount = 0;
+            this->nodes[nodeIndex] = node;
+            return nodeIndex;
+        }
+
+        // partitions order[begin, end) into two children and returns where the second one starts, or begin when the
+        // triangles are better off in one leaf
+        size_t split(size_t begin, size_t end, int depth, Math::Box const& nodeBounds, Math::Box const& centroidBounds)
+        {
+            const size_t count = end - begin;
+            if (count <= MAX_LEAF_SIZE) { return begin; }
+
+            const Math::Vector3 extent = centroidBounds.extent();
+            int axis = 0;
+            if (extent.getY() > extent.getX()) { axis = 1; }
+            if (extent.getZ() > component(extent, axis)) { axis = 2; }
+            const float axisMin = component(centroidBounds.min, axis);
+            const float axisExtent = component(extent, axis);
+
+            auto medianSplit = [&]()
+            {
+                const size_t middle = begin + count / 2;
+                std::nth_element(this->order.begin() + begin, this->order.begin() + middle, this->order.begin() + end, [&](uint32_t lhs, uint32_t rhs)
+                {
+                    return component(this->centroids[lhs], axis) < component(this->centroids[rhs], axis);
+                });
+                return middle;
+            };
+            if (axisExtent <= 0 || depth >= MAX_SAH_DEPTH) { return medianSplit(); }
+
+            // binned surface area heuristic along the longest axis of the centroids
+            auto binOf = [&](uint32_t triangle)
+            {
+                const int bin = (int) (BIN_COUNT * (component(this->centroids[triangle], axis) - axisMin) / axisExtent);
+                return std::min(bin, BIN_COUNT - 1);
+            };
+            size_t binCounts[BIN_COUNT] = {};
+            Math::Box binBounds[BIN_COUNT];
+            for (int b = 0; b < BIN_COUNT; b++) { binBounds[b] = Math::Box::empty(); }
+            for (size_t k = begin; k < end; k++)
+            {
+                const int bin = binOf(this->order[k]);
+                binCounts[bin]++;
+                binBounds[bin].expand(this->bounds[this->order[k]]);
+            }
+
+            // cost of splitting after bin b, in units of triangle tests relative to the area of the node
+            float rightAreas[BIN_COUNT];
+            size_t rightCounts[BIN_COUNT];
+            Math::Box right = Math::Box::empty();
+            size_t rightCount = 0;
+            for (int b = BIN_COUNT - 1; b > 0; b--)
+            {
+                right.expand(binBounds[b]);
+                rightCount += binCounts[b];
+                rightAreas[b] = right.isEmpty() ? 0 : right.surfaceArea();
+                rightCounts[b] = rightCount;
+            }
+            int bestBin = -1;
+            float bestCost = std::numeric_limits<float>::max();
+            Math::Box left = Math::Box::empty();
+            size_t leftCount = 0;
+            for (int b = 0; b < BIN_COUNT - 1; b++)
+            {
+                left.expand(binBounds[b]);
+                leftCount += binCounts[b];
+                if (leftCount == 0 || rightCounts[b + 1] == 0) { continue; }
+                const float cost = left.surfaceArea() * leftCount + rightAreas[b + 1] * rightCounts[b + 1];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestBin = b;
+                }
+            }
+
+            const float leafCost = nodeBounds.surfaceArea() * count;
+            const float traversalCost = nodeBounds.surfaceArea(); // about one triangle test per node visited
+            if (bestBin < 0) { return medianSplit(); }
+            if (bestCost + traversalCost >= leafCost && count <= 4 * MAX_LEAF_SIZE) { return begin; }
+
+            const auto middle = std::partition(this->order.begin() + begin, this->order.begin() + end, [&](uint32_t triangle)
+            {
+                return binOf(triangle) <= bestBin;
+            });
+            return middle - this->order.begin();
+        }
+    };
+}
+
+MeshBvh::MeshBvh() {}
+
+MeshBvh::MeshBvh(MeshSurface const& mesh)
+{
+    Builder builder;
+    const size_t triangleCount = mesh.getTriangleCount();
+    builder.order.resize(triangleCount);
+    builder.bounds.resize(triangleCount);
+    builder.centroids.resize(triangleCount);
+    Math::Vector3 vertex1, vertex2, vertex3;
+    for (size_t k = 0; k < triangleCount; k++)
+    {
+        mesh.getTriangle(k, vertex1, vertex2, vertex3);
+        builder.order[k] = k;
+        builder.bounds[k] = Math::Box::empty();
+        builder.bounds[k].expand(vertex1);
+        builder.bounds[k].expand(vertex2);
+        builder.bounds[k].expand(vertex3);
+        builder.centroids[k] = builder.bounds[k].centroid();
+    }
+    if (triangleCount > 0)
+    {
+        builder.nodes.reserve(2 * triangleCount / MAX_LEAF_SIZE + 1);
+        builder.build(0, triangleCount, 0);
+    }
+
+    std::shared_ptr<Node> nodes(new Node[builder.nodes.size()], std::default_delete<Node[]>());
+    std::copy(builder.nodes.begin(), builder.nodes.end(), nodes.get());
+    std::shared_ptr<uint32_t> triangleOrder(new uint32_t[triangleCount], std::default_delete<uint32_t[]>());
+    std::copy(builder.order.begin(), builder.order.end(), triangleOrder.get());
+
+    this->nodes = nodes;
+    this->nodeCount = builder.nodes.size();
+    this->triangleOrder = triangleOrder;
+    this->triangleCount = triangleCount;
+}
+
+const MeshBvh::Node * MeshBvh::getNodes() const
+{
+    return this->nodes.get();
+}
+
+size_t MeshBvh::getNodeCount() const
+{
+    return this->nodeCount;
+}
+
+const uint32_t * MeshBvh::getTriangleOrder() const
+{
+    return this->triangleOrder.get();
+}
+
+uint64_t MeshBvh::hashGeometry(MeshSurface const& mesh)
+{
+    const uint64_t counts[2] = { mesh.getVertexCount(), mesh.getTriangleCount() };
+    uint64_t hash = fnv1a(counts, sizeof(counts), FNV_OFFSET_BASIS);
+    hash = fnv1a(mesh.getPositions(), 3 * mesh.getVertexCount() * sizeof(float), hash);
+    return fnv1a(mesh.getIndices(), 3 * mesh.getTriangleCount() * sizeof(uint32_t), hash);
+}
+
+std::shared_ptr<const MeshBvh> MeshBvh::loadOrBuild(MeshSurface const& mesh, std::string const& cacheDirectory)
+{
+    if (cacheDirectory.empty()) { return std::shared_ptr<const MeshBvh>(new MeshBvh(mesh)); }
+
+    const uint64_t geometryHash = MeshBvh::hashGeometry(mesh);
+    char hashName[17];
+    std::snprintf(hashName, sizeof(hashName), "%016llx", (unsigned long long) geometryHash);
+    const std::string filename = cacheDirectory + "/" + hashName + ".bvh";
+
+    std::shared_ptr<const MeshBvh> bvh = MeshBvh::load(filename, mesh, geometryHash);
+    if (bvh != NULL) { return bvh; }
+    bvh = std::shared_ptr<const MeshBvh>(new MeshBvh(mesh));
+    bvh->save(filename, geometryHash);
+    return bvh;
+}
+
+bool MeshBvh::save(std::string const& filename, uint64_t geometryHash) const
+{
+    Serialization::BinaryWriter writer;
+    writer.writeBytes(MAGIC, sizeof(MAGIC));
+    writer.writeUint32("version", VERSION);
+    writer.writeUint32("reserved", 0);
+    writer.writeUint32("geometryHashLow", (uint32_t) geometryHash);
+    writer.writeUint32("geometryHashHigh", (uint32_t) (geometryHash >> 32));
+    writer.writeUint32("triangleCount", this->triangleCount);
+    static_assert(sizeof(Node) == 8 * sizeof(uint32_t), "nodes are written as 8 words");
+    writer.writeUint32Array("nodes", (const uint32_t *) this->nodes.get(), 8 * this->nodeCount);
+    writer.writeUint32Array("triangleOrder", this->triangleOrder.get(), this->triangleCount);
+
+    // written under a temporary name and renamed into place, so that processes sharing the cache never map half a file
+    const std::string temporaryFilename = filename + "." + std::to_string(getpid()) + ".tmp";
+    std::ofstream file(temporaryFilename, std::ios::out | std::ios::binary | std::ios::trunc);
+    file.write(writer.getBuffer().data(), writer.getBuffer().size());
+    file.close();
+    if (!file || std::rename(temporaryFilename.c_str(), filename.c_str()) != 0)
+    {
+        std::cerr << "Could not write the bvh cache file " << filename << "." << std::endl;
+        std::remove(temporaryFilename.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const MeshBvh> MeshBvh::load(std::string const& filename, MeshSurface const& mesh, uint64_t geometryHash)
+{
+    size_t size;
+    std::shared_ptr<const char> mapping = Serialization::mapFile(filename, size);
+    if (mapping == NULL || size < sizeof(MAGIC) || std::memcmp(mapping.get(), MAGIC, sizeof(MAGIC)) != 0) { return NULL; }
+
+    Serialization::BinaryReader reader(mapping.get(), size, mapping);
+    reader.readBytes(sizeof(MAGIC));
+    const uint32_t version = reader.readUint32("version");
+    reader.readUint32("reserved");
+    const uint64_t hashLow = reader.readUint32("geometryHashLow");
+    const uint64_t hashHigh = reader.readUint32("geometryHashHigh");
+    const uint32_t triangleCount = reader.readUint32("triangleCount");
+    if (version != VERSION || (hashLow | (hashHigh << 32)) != geometryHash || triangleCount != mesh.getTriangleCount()) { return NULL; }
+
+    size_t nodeWordCount, orderCount;
+    std::shared_ptr<const uint32_t> nodeWords = reader.readUint32Array("nodes", nodeWordCount);
+    std::shared_ptr<const uint32_t> triangleOrder = reader.readUint32Array("triangleOrder", orderCount);
+    if (!reader.isOk() || !reader.isAtEnd() || nodeWordCount % 8 != 0 || orderCount != triangleCount) { return NULL; }
+    const size_t nodeCount = nodeWordCount / 8;
+    if ((nodeCount == 0) != (triangleCount == 0)) { return NULL; }
+
+    // the traversal trusts the file, so check that every node stays inside the arrays and the depth inside its stack.
+    // children always come after their parent, so this one pass also rules out cycles
+    std::shared_ptr<const Node> nodes(nodeWords, (const Node *) nodeWords.get());
+    std::vector<uint8_t> depths(nodeCount, 0);
+    for (size_t n = 0; n < nodeCount; n++)
+    {
+        const Node & node = nodes.get()[n];
+        if (depths[n] > MAX_DEPTH) { return NULL; }
+        if (node.triangleCount > 0)
+        {
+            if (node.offset > triangleCount || node.triangleCount > triangleCount - node.offset) { return NULL; }
+            continue;
+        }
+        if (n + 1 >= nodeCount || node.offset <= n + 1 || node.offset >= nodeCount) { return NULL; }
+        depths[n + 1] = std::max<uint8_t>(depths[n + 1], depths[n] + 1);
+        depths[node.offset] = std::max<uint8_t>(depths[node.offset], depths[n] + 1);
+    }
+    for (size_t k = 0; k < orderCount; k++)
+    {
+        if (triangleOrder.get()[k] >= triangleCount) { return NULL; }
+    }
+
+    std::shared_ptr<MeshBvh> bvh(new MeshBvh());
+    bvh->nodes = nodes;
+    bvh->nodeCount = nodeCount;
+    bvh->triangleOrder = triangleOrder;
+    bvh->triangleCount = triangleCount;
+    return bvh;
+}
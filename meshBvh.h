@@ -0,0 +1,53 @@
+#ifndef MESH_BVH_HEADER
+#define MESH_BVH_HEADER
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+class MeshSurface;
+
+// a bounding volume hierarchy over the triangles of a mesh, built with the surface area heuristic. nodes live in one
+// flat array in depth first order so that the whole hierarchy can be written to a file and mapped back in place.
+//
+// building takes a while on big meshes, so loadOrBuild keeps built hierarchies in a cache directory under a hash of
+// the mesh geometry. a mesh whose geometry has not changed since the last run maps its hierarchy straight from there
+class MeshBvh
+{
+public:
+    // 32 bytes, the layout of the nodes in cache files
+    struct Node
+    {
+        float min[3], max[3];
+        // a leaf holds triangleCount triangles from triangleOrder[offset]. an interior node has triangleCount 0, its
+        // first child right after it and its second child at offset
+        uint32_t offset;
+        uint32_t triangleCount;
+    };
+
+    MeshBvh(MeshSurface const& mesh);
+
+    const Node * getNodes() const;
+    size_t getNodeCount() const;
+    const uint32_t * getTriangleOrder() const; // the triangle indices of the mesh, leaf by leaf
+
+    // 64 bit fnv-1a over the positions and indices of the mesh
+    static uint64_t hashGeometry(MeshSurface const& mesh);
+
+    // maps the hierarchy of mesh from cacheDirectory if one was cached for the same geometry, and otherwise builds it
+    // and writes it there for the next run. an empty cacheDirectory always builds
+    static std::shared_ptr<const MeshBvh> loadOrBuild(MeshSurface const& mesh, std::string const& cacheDirectory);
+    bool save(std::string const& filename, uint64_t geometryHash) const;
+    // NULL if the file is missing or was not written for this geometry
+    static std::shared_ptr<const MeshBvh> load(std::string const& filename, MeshSurface const& mesh, uint64_t geometryHash);
+
+private:
+    MeshBvh();
+
+    std::shared_ptr<const Node> nodes;
+    size_t nodeCount = 0;
+    std::shared_ptr<const uint32_t> triangleOrder;
+    size_t triangleCount = 0;
+};
+
+#endif
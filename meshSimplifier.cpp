@@ -0,0 +1,276 @@
+#include "meshSimplifier.h"
+#include "surface.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+
+namespace
+{
+    // how much more a plane across the edge of a hole weighs than the plane of a triangle
+    const double BOUNDARY_WEIGHT = 10;
+    // a collapse may turn no triangle around it further than this cosine
+    const float MIN_NORMAL_COSINE = 0.2;
+
+    uint64_t edgeKey(uint32_t vertex1, uint32_t vertex2)
+    {
+        return ((uint64_t) std::min(vertex1, vertex2) << 32) | std::max(vertex1, vertex2);
+    }
+}
+
+void MeshSimplifier::Quadric::addPlane(Math::Vector3 const& unitNormal, Math::Vector3 const& point, double weight)
+{
+    const double a = unitNormal.getX(), b = unitNormal.getY(), c = unitNormal.getZ();
+    const double d = -Math::dot(unitNormal, point);
+    const double terms[10] = { a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d };
+    for (int k = 0; k < 10; k++) { this->q[k] += weight * terms[k]; }
+}
+
+void MeshSimplifier::Quadric::add(Quadric const& other)
+{
+    for (int k = 0; k < 10; k++) { this->q[k] += other.q[k]; }
+}
+
+double MeshSimplifier::Quadric::evaluate(Math::Vector3 const& p) const
+{
+    const double x = p.getX(), y = p.getY(), z = p.getZ();
+    return this->q[0] * x * x + 2 * this->q[1] * x * y + 2 * this->q[2] * x * z + 2 * this->q[3] * x
+        + this->q[4] * y * y + 2 * this->q[5] * y * z + 2 * this->q[6] * y
+        + this->q[7] * z * z + 2 * this->q[8] * z + this->q[9];
+}
+
+bool MeshSimplifier::Quadric::findMinimum(Math::Vector3 & p) const
+{
+    // the gradient is zero where the upper 3x3 block times p is minus the last column, solved by cramer's rule. on a
+    // flat or creased patch the block is singular and the minimum is a plane or a line instead of a point
+    const double a = this->q[0], b = this->q[1], c = this->q[2], e = this->q[4], f = this->q[5], i = this->q[7];
+    const double rx = -this->q[3], ry = -this->q[6], rz = -this->q[8];
+    const double determinant = a * (e * i - f * f) - b * (b * i - f * c) + c * (b * f - e * c);
+    const double trace = a + e + i;
+    if (std::abs(determinant) <= 1e-9 * trace * trace * trace) { return false; }
+
+    const double x = (rx * (e * i - f * f) - b * (ry * i - f * rz) + c * (ry * f - e * rz)) / determinant;
+    const double y = (a * (ry * i - f * rz) - rx * (b * i - f * c) + c * (b * rz - ry * c)) / determinant;
+    const double z = (a * (e * rz - ry * f) - b * (b * rz - ry * c) + rx * (b * f - e * c)) / determinant;
+    p = { (float) x, (float) y, (float) z };
+    return true;
+}
+
+MeshSimplifier::MeshSimplifier(MeshSurface const& mesh)
+{
+    // merge the vertices that share a position, which meshes split along seams have
+    std::map<std::tuple<float, float, float>, uint32_t> weldedVertices;
+    std::vector<uint32_t> vertexMap(mesh.getVertexCount());
+    for (size_t v = 0; v < mesh.getVertexCount(); v++)
+    {
+        const Math::Vector3 position = mesh.getVertex(v);
+        auto inserted = weldedVertices.insert({ std::make_tuple(position.getX(), position.getY(), position.getZ()), (uint32_t) this->positions.size() });
+        if (inserted.second) { this->positions.push_back(position); }
+        vertexMap[v] = inserted.first->second;
+    }
+    for (size_t t = 0; t < mesh.getTriangleCount(); t++)
+    {
+        const uint32_t * triangle = mesh.getIndices() + 3 * t;
+        const uint32_t a = vertexMap[triangle[0]], b = vertexMap[triangle[1]], c = vertexMap[triangle[2]];
+        if (a == b || b == c || c == a) { continue; }
+        this->indices.insert(this->indices.end(), { a, b, c });
+    }
+    this->triangleCount = this->indices.size() / 3;
+
+    const size_t vertexCount = this->positions.size();
+    this->quadrics.resize(vertexCount);
+    this->versions.assign(vertexCount, 0);
+    this->removedVertices.assign(vertexCount, 0);
+    this->removedTriangles.assign(this->triangleCount, 0);
+    this->vertexTriangles.resize(vertexCount);
+    std::vector<uint64_t> edges;
+    for (size_t t = 0; t < this->triangleCount; t++)
+    {
+        const uint32_t * triangle = &this->indices[3 * t];
+        for (int corner = 0; corner < 3; corner++)
+        {
+            this->vertexTriangles[triangle[corner]].push_back(t);
+            edges.push_back(edgeKey(triangle[corner], triangle[(corner + 1) % 3]));
+        }
+        const Math::Vector3 normal = Math::cross(this->positions[triangle[1]] - this->positions[triangle[0]], this->positions[triangle[2]] - this->positions[triangle[0]]);
+        if (normal.norm() <= 0) { continue; }
+        Quadric quadric;
+        quadric.addPlane(normal / normal.norm(), this->positions[triangle[0]], 1);
+        for (int corner = 0; corner < 3; corner++) { this->quadrics[triangle[corner]].add(quadric); }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    // an edge that only one triangle has borders a hole. the plane through it upright on the triangle keeps it in place
+    for (size_t t = 0; t < this->triangleCount; t++)
+    {
+        const uint32_t * triangle = &this->indices[3 * t];
+        const Math::Vector3 normal = Math::cross(this->positions[triangle[1]] - this->positions[triangle[0]], this->positions[triangle[2]] - this->positions[triangle[0]]);
+        for (int corner = 0; corner < 3; corner++)
+        {
+            const uint32_t vertex1 = triangle[corner], vertex2 = triangle[(corner + 1) % 3];
+            const auto range = std::equal_range(edges.begin(), edges.end(), edgeKey(vertex1, vertex2));
+            if (range.second - range.first != 1) { continue; }
+            const Math::Vector3 across = Math::cross(this->positions[vertex2] - this->positions[vertex1], normal);
+            if (across.norm() <= 0) { continue; }
+            Quadric quadric;
+            quadric.addPlane(across / across.norm(), this->positions[vertex1], BOUNDARY_WEIGHT);
+            this->quadrics[vertex1].add(quadric);
+            this->quadrics[vertex2].add(quadric);
+        }
+    }
+
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    for (auto edge : edges) { this->addCandidate(edge >> 32, (uint32_t) edge); }
+}
+
+size_t MeshSimplifier::getTriangleCount() const
+{
+    return this->triangleCount;
+}
+
+float MeshSimplifier::getError() const
+{
+    return this->error;
+}
+
+bool MeshSimplifier::simplify(size_t triangleCount)
+{
+    while (this->triangleCount > triangleCount && !this->candidates.empty())
+    {
+        const Candidate candidate = this->candidates.top();
+        this->candidates.pop();
+        this->collapse(candidate);
+    }
+    return this->triangleCount <= triangleCount;
+}
+
+std::unique_ptr<MeshSurface> MeshSimplifier::createMesh() const
+{
+    std::vector<uint32_t> vertexMap(this->positions.size(), UINT32_MAX);
+    std::vector<Math::Vector3> vertices;
+    std::vector<uint32_t> indices;
+    for (size_t t = 0; t < this->removedTriangles.size(); t++)
+    {
+        if (this->removedTriangles[t]) { continue; }
+        for (int corner = 0; corner < 3; corner++)
+        {
+            const uint32_t vertex = this->indices[3 * t + corner];
+            if (vertexMap[vertex] == UINT32_MAX)
+            {
+                vertexMap[vertex] = vertices.size();
+                vertices.push_back(this->positions[vertex]);
+            }
+            indices.push_back(vertexMap[vertex]);
+        }
+    }
+    return std::unique_ptr<MeshSurface>(new MeshSurface(vertices, indices));
+}
+
+void MeshSimplifier::addCandidate(uint32_t vertex1, uint32_t vertex2)
+{
+    Quadric quadric = this->quadrics[vertex1];
+    quadric.add(this->quadrics[vertex2]);
+    const Math::Vector3 position1 = this->positions[vertex1], position2 = this->positions[vertex2];
+    const Math::Vector3 midpoint = (position1 + position2) / 2;
+
+    // the minimum of the quadric when there is one near the edge, and otherwise the best of its ends and middle
+    Math::Vector3 position;
+    if (!quadric.findMinimum(position) || (position - midpoint).norm() > (position2 - position1).norm())
+    {
+        position = midpoint;
+        for (auto & end : { position1, position2 })
+        {
+            if (quadric.evaluate(end) < quadric.evaluate(position)) { position = end; }
+        }
+    }
+    this->candidates.push({ std::max(0.0, quadric.evaluate(position)), vertex1, vertex2, this->versions[vertex1], this->versions[vertex2], position });
+}
+
+bool MeshSimplifier::collapse(Candidate const& candidate)
+{
+    const uint32_t vertex1 = candidate.vertex1, vertex2 = candidate.vertex2;
+    if (this->removedVertices[vertex1] || this->removedVertices[vertex2]) { return false; }
+    if (this->versions[vertex1] != candidate.version1 || this->versions[vertex2] != candidate.version2) { return false; }
+
+    // the ends of an edge inside a manifold share exactly the neighbours across its triangles. sharing another would
+    // fold the surface onto itself
+    std::vector<uint32_t> neighbours1, neighbours2, sharedNeighbours;
+    this->collectNeighbours(vertex1, neighbours1);
+    this->collectNeighbours(vertex2, neighbours2);
+    std::set_intersection(neighbours1.begin(), neighbours1.end(), neighbours2.begin(), neighbours2.end(), std::back_inserter(sharedNeighbours));
+    size_t sharedTriangleCount = 0;
+    for (auto vertex : { vertex1, vertex2 })
+    {
+        for (auto t : this->vertexTriangles[vertex])
+        {
+            if (this->removedTriangles[t]) { continue; }
+            const uint32_t * triangle = &this->indices[3 * t];
+            const bool hasVertex1 = triangle[0] == vertex1 || triangle[1] == vertex1 || triangle[2] == vertex1;
+            const bool hasVertex2 = triangle[0] == vertex2 || triangle[1] == vertex2 || triangle[2] == vertex2;
+            if (hasVertex1 && hasVertex2)
+            {
+                if (vertex == vertex1) { sharedTriangleCount++; }
+                continue;
+            }
+
+            // the triangles that stay must not turn over
+            Math::Vector3 corners[3], movedCorners[3];
+            for (int corner = 0; corner < 3; corner++)
+            {
+                corners[corner] = this->positions[triangle[corner]];
+                movedCorners[corner] = triangle[corner] == vertex ? candidate.position : corners[corner];
+            }
+            const Math::Vector3 normal = Math::cross(corners[1] - corners[0], corners[2] - corners[0]);
+            const Math::Vector3 movedNormal = Math::cross(movedCorners[1] - movedCorners[0], movedCorners[2] - movedCorners[0]);
+            if (Math::dot(normal, movedNormal) <= MIN_NORMAL_COSINE * normal.norm() * movedNormal.norm()) { return false; }
+        }
+    }
+    if (sharedNeighbours.size() != sharedTriangleCount) { return false; }
+
+    this->positions[vertex1] = candidate.position;
+    this->quadrics[vertex1].add(this->quadrics[vertex2]);
+    this->removedVertices[vertex2] = 1;
+    this->versions[vertex1]++;
+    this->versions[vertex2]++;
+    for (auto t : this->vertexTriangles[vertex2])
+    {
+        if (this->removedTriangles[t]) { continue; }
+        uint32_t * triangle = &this->indices[3 * t];
+        if (triangle[0] == vertex1 || triangle[1] == vertex1 || triangle[2] == vertex1)
+        {
+            this->removedTriangles[t] = 1;
+            this->triangleCount--;
+            continue;
+        }
+        for (int corner = 0; corner < 3; corner++)
+        {
+            if (triangle[corner] == vertex2) { triangle[corner] = vertex1; }
+        }
+        this->vertexTriangles[vertex1].push_back(t);
+    }
+    this->vertexTriangles[vertex2].clear();
+    std::vector<uint32_t> & triangles = this->vertexTriangles[vertex1];
+    triangles.erase(std::remove_if(triangles.begin(), triangles.end(), [&](uint32_t t) { return this->removedTriangles[t] != 0; }), triangles.end());
+    this->error = std::max(this->error, (float) std::sqrt(candidate.cost));
+
+    std::vector<uint32_t> neighbours;
+    this->collectNeighbours(vertex1, neighbours);
+    for (auto neighbour : neighbours) { this->addCandidate(vertex1, neighbour); }
+    return true;
+}
+
+// the vertices that share a triangle with vertex, sorted
+void MeshSimplifier::collectNeighbours(uint32_t vertex, std::vector<uint32_t> & neighbours) const
+{
+    neighbours.clear();
+    for (auto t : this->vertexTriangles[vertex])
+    {
+        if (this->removedTriangles[t]) { continue; }
+        for (int corner = 0; corner < 3; corner++)
+        {
+            if (this->indices[3 * t + corner] != vertex) { neighbours.push_back(this->indices[3 * t + corner]); }
+        }
+    }
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+}
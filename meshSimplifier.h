@@ -0,0 +1,69 @@
+#ifndef MESH_SIMPLIFIER_HEADER
+#define MESH_SIMPLIFIER_HEADER
+
+#include <stdint.h>
+#include <memory>
+#include <queue>
+#include <vector>
+#include "math.h"
+
+class MeshSurface;
+
+// simplifies a mesh by collapsing edges, cheapest first, under the quadric error metric (garland and heckbert 1997).
+// every vertex keeps the sum of the squared distance functions of the planes of the triangles it came from, and an
+// edge collapses to the point that function is smallest at. the edges of holes keep a plane across them as well, so
+// that open meshes do not shrink from their borders. collapses that would flip a triangle or pinch the surface into
+// a non manifold are skipped. vertices at the same position are merged first, so meshes cut along seams stay closed
+class MeshSimplifier
+{
+public:
+    MeshSimplifier(MeshSurface const& mesh);
+
+    size_t getTriangleCount() const; // the triangles left
+    // the largest square root of the error of a collapse so far, which is about how far from the original mesh the
+    // surface has moved at worst, in its units
+    float getError() const;
+
+    // collapses edges until at most triangleCount triangles are left. false when the edges ran out first
+    bool simplify(size_t triangleCount);
+    // the mesh as it is now, with only the vertices still in use
+    std::unique_ptr<MeshSurface> createMesh() const;
+
+private:
+    // the symmetric 4x4 matrix of a sum of squared plane distances: aa ab ac ad bb bc bd cc cd dd
+    struct Quadric
+    {
+        double q[10] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+        void addPlane(Math::Vector3 const& unitNormal, Math::Vector3 const& point, double weight);
+        void add(Quadric const& other);
+        double evaluate(Math::Vector3 const& p) const;
+        bool findMinimum(Math::Vector3 & p) const; // false when the minimum is not a single point
+    };
+
+    struct Candidate
+    {
+        double cost;
+        uint32_t vertex1, vertex2;
+        uint32_t version1, version2; // of the vertices when the candidate was made, stale once either changed
+        Math::Vector3 position;
+        bool operator<(Candidate const& other) const { return this->cost > other.cost; } // the cheapest on top
+    };
+
+    void addCandidate(uint32_t vertex1, uint32_t vertex2);
+    bool collapse(Candidate const& candidate);
+    void collectNeighbours(uint32_t vertex, std::vector<uint32_t> & neighbours) const;
+
+    std::vector<Math::Vector3> positions;
+    std::vector<Quadric> quadrics;
+    std::vector<uint32_t> versions;
+    std::vector<uint8_t> removedVertices;
+    std::vector<uint32_t> indices;
+    std::vector<uint8_t> removedTriangles;
+    std::vector<std::vector<uint32_t>> vertexTriangles; // the triangles around every vertex, removed ones included
+    std::priority_queue<Candidate> candidates;
+    size_t triangleCount = 0;
+    float error = 0;
+};
+
+#endif
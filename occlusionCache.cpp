@@ -0,0 +1,55 @@
+#include "occlusionCache.h"
+
+float OcclusionCache::Statistics::hitRate() const
+{
+    if (this->occludedCount == 0) { return 0; }
+    return (float) this->cacheHitCount / this->occludedCount;
+}
+
+void OcclusionCache::Statistics::add(OcclusionCache::Statistics const& statistics)
+{
+    this->shadowRayCount += statistics.shadowRayCount;
+    this->cacheHitCount += statistics.cacheHitCount;
+    this->occludedCount += statistics.occludedCount;
+}
+
+OcclusionCache::OcclusionCache()
+{
+    this->hitRecord = std::shared_ptr<Util::HitRecord>(new Util::HitRecord);
+}
+
+bool OcclusionCache::isOccluded(int lightIndex, const Renderable & surface, Math::Ray shadowRay, float t0, float t1)
+{
+    if (lightIndex >= (int) this->lastOccluders.size()) { this->lastOccluders.resize(lightIndex + 1, NULL); }
+    this->statistics.shadowRayCount++;
+
+    const Renderable * lastOccluder = this->lastOccluders.at(lightIndex);
+    if (lastOccluder != NULL && lastOccluder->hit(shadowRay, t0, t1, this->hitRecord))
+    {
+        this->statistics.cacheHitCount++;
+        this->statistics.occludedCount++;
+        return true;
+    }
+
+    this->hitRecord->hitSurface = NULL;
+    if (!surface.hit(shadowRay, t0, t1, this->hitRecord)) { return false; }
+    this->statistics.occludedCount++;
+    this->lastOccluders.at(lightIndex) = this->hitRecord->hitSurface;
+    return true;
+}
+
+OcclusionCache::Statistics OcclusionCache::getStatistics() const
+{
+    return this->statistics;
+}
+
+void OcclusionCache::addStatistics(OcclusionCache::Statistics const& statistics)
+{
+    this->statistics.add(statistics);
+}
+
+void OcclusionCache::clear()
+{
+    this->lastOccluders.clear();
+    this->statistics = Statistics();
+}
@@ -0,0 +1,41 @@
+#ifndef OCCLUSION_CACHE_HEADER
+#define OCCLUSION_CACHE_HEADER
+
+#include <memory>
+#include <vector>
+#include "math.h"
+#include "util.h"
+#include "hittable.h"
+
+// remembers, for every light, the surface that last blocked a shadow ray toward it. neighbouring shading points
+// usually share an occluder, so testing that one surface first skips the full traversal for most shadowed points.
+// a cache is not thread safe and belongs to one thread
+class OcclusionCache
+{
+public:
+    struct Statistics
+    {
+        long shadowRayCount = 0; // shadow rays tested through the cache
+        long cacheHitCount = 0; // shadow rays blocked by the cached occluder without a full traversal
+        long occludedCount = 0; // shadow rays blocked by anything
+
+        float hitRate() const; // fraction of the occluded shadow rays that the cache answered
+        void add(Statistics const& statistics);
+    };
+
+    OcclusionCache();
+
+    // true if anything in surface lies on shadowRay between t0 and t1
+    bool isOccluded(int lightIndex, const Renderable & surface, Math::Ray shadowRay, float t0, float t1);
+
+    Statistics getStatistics() const;
+    void addStatistics(Statistics const& statistics); // folds in the counters of another thread's cache
+    void clear(); // forgets the cached occluders and the statistics
+
+private:
+    std::vector<const Renderable *> lastOccluders;
+    std::shared_ptr<Util::HitRecord> hitRecord;
+    Statistics statistics;
+};
+
+#endif
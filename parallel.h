@@ -0,0 +1,51 @@
+#ifndef PARALLEL_HEADER
+#define PARALLEL_HEADER
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace Util
+{
+    // hands out [0, count) in consecutive batches to threadCount threads. body(begin, end, threadIndex) is called once per
+    // batch, threadIndex being in [0, threadCount) so callers can keep per thread output without locking
+    template <typename Body>
+    void parallelFor(size_t count, size_t batchSize, int threadCount, Body body)
+    {
+        std::atomic<size_t> nextBatch(0);
+        auto worker = [&](int threadIndex)
+        {
+            while (true)
+            {
+                const size_t begin = nextBatch.fetch_add(batchSize);
+                if (begin >= count) { return; }
+                body(begin, std::min(begin + batchSize, count), threadIndex);
+            }
+        };
+
+        if (threadCount <= 1 || count <= batchSize)
+        {
+            worker(0);
+            return;
+        }
+
+        std::vector<std::thread> threads;
+        for (int threadIndex = 1; threadIndex < threadCount; threadIndex++)
+        {
+            threads.push_back(std::thread(worker, threadIndex));
+        }
+        worker(0);
+        for (auto & thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    inline int defaultThreadCount()
+    {
+        return std::max(1, (int) std::thread::hardware_concurrency());
+    }
+};
+
+#endif
@@ -0,0 +1,356 @@
+#include "photonMap.h"
+#include "parallel.h"
+#include "sampling.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace
+{
+    // how far a reflected photon starts from the mirror, as MirrorShader does for reflected view rays
+    const float PHOTON_EPSILON = 0.0001;
+    // a photon bouncing between mirrors longer than this is dropped
+    const int MAX_PHOTON_BOUNCES = 8;
+    const size_t PHOTONS_PER_BATCH = 256;
+    // ranges smaller than this are not worth a thread of their own when building the tree
+    const size_t MIN_PARALLEL_BUILD_SIZE = 4096;
+
+    float component(Math::Vector3 const& v, int axis)
+    {
+        return axis == 0 ? v.getX() : (axis == 1 ? v.getY() : v.getZ());
+    }
+
+    Math::Vector3 withComponent(Math::Vector3 const& v, int axis, float value)
+    {
+        return { axis == 0 ? value : v.getX(), axis == 1 ? value : v.getY(), axis == 2 ? value : v.getZ() };
+    }
+
+    // the sphere around the bounds of a mirror
+    struct Target
+    {
+        Math::Vector3 center;
+        float radius;
+    };
+
+    // a direction from origin toward one of the targets, each picked by the solid angle it covers and sampled uniformly
+    // over that cone. returns the density of the directions over solid angle, counting every cone the direction falls
+    // in, since the cones of nearby mirrors overlap
+    float sampleTargetDirection(Math::Vector3 const& origin, std::vector<Target> const& targets, Util::Sampler & sampler, Math::Vector3 & direction)
+    {
+        std::vector<float> cosMaxAngles(targets.size());
+        std::vector<Math::Vector3> axes(targets.size());
+        float totalSolidAngle = 0;
+        for (size_t j = 0; j < targets.size(); j++)
+        {
+            const Math::Vector3 toTarget = targets[j].center - origin;
+            const float distance = toTarget.norm();
+            if (distance <= targets[j].radius)
+            {
+                // inside the sphere every direction may reach the mirror
+                cosMaxAngles[j] = -1;
+                axes[j] = { 0, 0, 1 };
+            }
+            else
+            {
+                cosMaxAngles[j] = std::sqrt(1 - (targets[j].radius * targets[j].radius) / (distance * distance));
+                axes[j] = toTarget / distance;
+            }
+            totalSolidAngle += 2 * (float) M_PI * (1 - cosMaxAngles[j]);
+        }
+
+        float pick = sampler.nextFloat() * totalSolidAngle;
+        size_t picked = targets.size() - 1;
+        for (size_t j = 0; j < targets.size(); j++)
+        {
+            pick -= 2 * (float) M_PI * (1 - cosMaxAngles[j]);
+            if (pick < 0) { picked = j; break; }
+        }
+        const float u = sampler.nextFloat(), v = sampler.nextFloat();
+        direction = Util::coneDirection(axes[picked], cosMaxAngles[picked], u, v);
+
+        int coveringCount = 0;
+        for (size_t j = 0; j < targets.size(); j++)
+        {
+            if (Math::dot(direction, axes[j]) >= cosMaxAngles[j]) { coveringCount++; }
+        }
+        return std::max(1, coveringCount) / totalSolidAngle;
+    }
+
+    // a point of the plane through planePoint across the unit direction toward a directional light, on the shadow of one
+    // of the targets, each picked by the area of its shadow. returns the density of the points over area
+    float sampleTargetShadow(Math::Vector3 const& planePoint, Math::Vector3 const& towardLight, std::vector<Target> const& targets, Util::Sampler & sampler, Math::Vector3 & point)
+    {
+        std::vector<Math::Vector3> centers(targets.size());
+        float totalArea = 0;
+        for (size_t j = 0; j < targets.size(); j++)
+        {
+            centers[j] = targets[j].center - Math::dot(targets[j].center - planePoint, towardLight) * towardLight;
+            totalArea += (float) M_PI * targets[j].radius * targets[j].radius;
+        }
+
+        float pick = sampler.nextFloat() * totalArea;
+        size_t picked = targets.size() - 1;
+        for (size_t j = 0; j < targets.size(); j++)
+        {
+            pick -= (float) M_PI * targets[j].radius * targets[j].radius;
+            if (pick < 0) { picked = j; break; }
+        }
+        Math::Vector3 tangent, bitangent;
+        Util::orthonormalBasis(towardLight, tangent, bitangent);
+        const float radius = targets[picked].radius * std::sqrt(sampler.nextFloat());
+        const float angle = 2 * (float) M_PI * sampler.nextFloat();
+        point = centers[picked] + (radius * std::cos(angle)) * tangent + (radius * std::sin(angle)) * bitangent;
+
+        int coveringCount = 0;
+        for (size_t j = 0; j < targets.size(); j++)
+        {
+            if ((point - centers[j]).norm() <= targets[j].radius) { coveringCount++; }
+        }
+        return std::max(1, coveringCount) / totalArea;
+    }
+}
+
+PhotonMap::PhotonMap(std::vector<Photon> photons, int threadCount)
+{
+    this->photons = std::move(photons);
+    this->axes.assign(this->photons.size(), 0);
+    Math::Box bounds = Math::Box::empty();
+    for (auto & photon : this->photons)
+    {
+        bounds.expand(photon.position);
+    }
+    this->build(0, this->photons.size(), bounds, std::max(1, threadCount));
+}
+
+size_t PhotonMap::size() const
+{
+    return this->photons.size();
+}
+
+const PhotonMap::Photon & PhotonMap::getPhoton(size_t photonIndex) const
+{
+    return this->photons.at(photonIndex);
+}
+
+void PhotonMap::build(size_t begin, size_t end, Math::Box bounds, int threadCount)
+{
+    if (end - begin <= 1) { return; }
+
+    const Math::Vector3 extent = bounds.extent();
+    int axis = 0;
+    if (extent.getY() > component(extent, axis)) { axis = 1; }
+    if (extent.getZ() > component(extent, axis)) { axis = 2; }
+    const size_t median = begin + (end - begin) / 2;
+    std::nth_element(this->photons.begin() + begin, this->photons.begin() + median, this->photons.begin() + end,
+        [axis](Photon const& a, Photon const& b) { return component(a.position, axis) < component(b.position, axis); });
+    this->axes[median] = (uint8_t) axis;
+
+    const float split = component(this->photons[median].position, axis);
+    Math::Box lowerBounds = bounds, upperBounds = bounds;
+    lowerBounds.max = withComponent(bounds.max, axis, split);
+    upperBounds.min = withComponent(bounds.min, axis, split);
+    // the two halves are disjoint ranges of the array, so they build side by side
+    if (threadCount > 1 && end - begin >= MIN_PARALLEL_BUILD_SIZE)
+    {
+        std::thread lowerThread(&PhotonMap::build, this, begin, median, lowerBounds, threadCount / 2);
+        this->build(median + 1, end, upperBounds, threadCount - threadCount / 2);
+        lowerThread.join();
+        return;
+    }
+    this->build(begin, median, lowerBounds, 1);
+    this->build(median + 1, end, upperBounds, 1);
+}
+
+void PhotonMap::findNearest(Math::Vector3 point, int count, float maxDistance, std::vector<size_t> & photonIndices) const
+{
+    photonIndices.clear();
+    if (count <= 0) { return; }
+    std::vector<Neighbour> heap;
+    float maxSquaredDistance = maxDistance * maxDistance;
+    this->findNearest(0, this->photons.size(), point, count, maxSquaredDistance, heap);
+    for (auto & neighbour : heap)
+    {
+        photonIndices.push_back(neighbour.photonIndex);
+    }
+}
+
+void PhotonMap::findNearest(size_t begin, size_t end, Math::Vector3 const& point, size_t count, float & maxSquaredDistance, std::vector<Neighbour> & heap) const
+{
+    if (begin >= end) { return; }
+
+    const size_t median = begin + (end - begin) / 2;
+    const Photon & photon = this->photons[median];
+    const int axis = this->axes[median];
+    const float planeDistance = component(point, axis) - component(photon.position, axis);
+    // the side of the split holding point first, so that the search sphere has shrunk before the other side
+    if (planeDistance < 0) { this->findNearest(begin, median, point, count, maxSquaredDistance, heap); }
+    else { this->findNearest(median + 1, end, point, count, maxSquaredDistance, heap); }
+
+    const Math::Vector3 offset = photon.position - point;
+    const float squaredDistance = Math::dot(offset, offset);
+    if (squaredDistance < maxSquaredDistance)
+    {
+        // a max heap on distance, whose top is the photon to drop once count are found
+        if (heap.size() == count)
+        {
+            std::pop_heap(heap.begin(), heap.end());
+            heap.pop_back();
+        }
+        heap.push_back({ squaredDistance, median });
+        std::push_heap(heap.begin(), heap.end());
+        if (heap.size() == count) { maxSquaredDistance = heap.front().squaredDistance; }
+    }
+
+    if (planeDistance * planeDistance < maxSquaredDistance)
+    {
+        if (planeDistance < 0) { this->findNearest(median + 1, end, point, count, maxSquaredDistance, heap); }
+        else { this->findNearest(begin, median, point, count, maxSquaredDistance, heap); }
+    }
+}
+
+void PhotonMap::estimateIrradiance(Math::Vector3 point, Math::Vector3 unitNormal, int count, float maxDistance, float irradiance[3]) const
+{
+    irradiance[0] = irradiance[1] = irradiance[2] = 0;
+    if (this->photons.empty() || count <= 0 || maxDistance <= 0) { return; }
+
+    std::vector<Neighbour> heap;
+    heap.reserve(count);
+    float maxSquaredDistance = maxDistance * maxDistance;
+    this->findNearest(0, this->photons.size(), point, count, maxSquaredDistance, heap);
+    if (heap.empty()) { return; }
+
+    // the sphere holding count photons, or the whole search sphere when fewer were found
+    const float radius = std::sqrt(maxSquaredDistance);
+    if (radius <= 0) { return; }
+    for (auto & neighbour : heap)
+    {
+        const Photon & photon = this->photons[neighbour.photonIndex];
+        if (Math::dot(photon.direction, unitNormal) >= 0) { continue; } // arrived on the other side
+        const float weight = 1 - std::sqrt(neighbour.squaredDistance) / radius;
+        irradiance[0] += weight * photon.power[0];
+        irradiance[1] += weight * photon.power[1];
+        irradiance[2] += weight * photon.power[2];
+    }
+    // the cone filter keeps a third of the photons of a uniform density
+    const float area = (float) M_PI * radius * radius / 3;
+    irradiance[0] /= area;
+    irradiance[1] /= area;
+    irradiance[2] /= area;
+}
+
+std::vector<PhotonMap::Photon> PhotonMap::traceCausticPhotons(const LightTable & lightTable, const Surface & surface, int photonCount, uint32_t seed, int threadCount)
+{
+    std::vector<Photon> storedPhotons;
+    std::vector<Math::Box> mirrorBounds;
+    surface.collectMirrorBounds(NULL, mirrorBounds);
+    if (mirrorBounds.empty() || lightTable.size() == 0 || photonCount <= 0) { return storedPhotons; }
+
+    std::vector<Target> targets;
+    for (auto & bounds : mirrorBounds)
+    {
+        targets.push_back({ bounds.centroid(), bounds.extent().norm() / 2 });
+    }
+    const Math::Box sceneBounds = surface.boundingBox();
+    const Math::Vector3 sceneCenter = sceneBounds.centroid();
+    const float sceneRadius = sceneBounds.extent().norm() / 2;
+
+    // photon k leaves light i when firstPhotons[i] <= k < firstPhotons[i + 1]
+    float totalPower = 0;
+    for (int i = 0; i < lightTable.size(); i++)
+    {
+        totalPower += lightTable.power(i);
+    }
+    if (totalPower <= 0) { return storedPhotons; }
+    std::vector<int> firstPhotons(lightTable.size() + 1, 0);
+    float cumulativePower = 0;
+    for (int i = 0; i < lightTable.size(); i++)
+    {
+        cumulativePower += lightTable.power(i);
+        firstPhotons[i + 1] = (int) std::lround(photonCount * (cumulativePower / totalPower));
+    }
+    firstPhotons.back() = photonCount;
+
+    // every photon has a slot of its own, so the photons kept come out in the same order on any number of threads
+    std::vector<Photon> slots(photonCount);
+    std::vector<uint8_t> stored(photonCount, 0);
+    Util::parallelFor(photonCount, PHOTONS_PER_BATCH, threadCount, [&](size_t begin, size_t end, int)
+    {
+        std::shared_ptr<Util::HitRecord> hitRecord(new Util::HitRecord);
+        int lightIndex = 0;
+        for (size_t k = begin; k < end; k++)
+        {
+            while (firstPhotons[lightIndex + 1] <= (int) k) { lightIndex++; }
+            const int lightPhotonCount = firstPhotons[lightIndex + 1] - firstPhotons[lightIndex];
+            Util::Sampler sampler(seed, (uint32_t) k, 0, 0, Util::PHOTON_STREAM);
+
+            // where the photon leaves the light, and the light it carries once divided by the density it was sampled with
+            const Math::Vector3 lightPosition(lightTable.x[lightIndex], lightTable.y[lightIndex], lightTable.z[lightIndex]);
+            Math::Ray ray;
+            float density;
+            const bool directional = lightTable.types[lightIndex] == LightTable::DIRECTIONAL;
+            if (directional)
+            {
+                // parallel rays across a plane through the middle of the scene, starting beyond it
+                Math::Vector3 planePoint;
+                density = sampleTargetShadow(sceneCenter, lightPosition, targets, sampler, planePoint);
+                ray = { planePoint + (sceneRadius + 1) * lightPosition, -lightPosition };
+            }
+            else
+            {
+                ray.origin = lightPosition;
+                if (lightTable.types[lightIndex] == LightTable::RECTANGLE)
+                {
+                    const float u = sampler.nextFloat(), v = sampler.nextFloat();
+                    ray.origin = ray.origin + (u - 0.5f) * lightTable.edgesU[lightIndex] + (v - 0.5f) * lightTable.edgesV[lightIndex];
+                }
+                else if (lightTable.types[lightIndex] == LightTable::SPHERE)
+                {
+                    const float u = sampler.nextFloat(), v = sampler.nextFloat();
+                    ray.origin = ray.origin + lightTable.radii[lightIndex] * Util::coneDirection({ 0, 0, 1 }, -1, u, v);
+                }
+                density = sampleTargetDirection(ray.origin, targets, sampler, ray.direction);
+            }
+            const float share = 1 / (density * lightPhotonCount);
+            float power[3] = { lightTable.red[lightIndex] * share, lightTable.green[lightIndex] * share, lightTable.blue[lightIndex] * share };
+
+            float pathLength = 0;
+            for (int bounce = 0; bounce <= MAX_PHOTON_BOUNCES; bounce++)
+            {
+                if (!surface.hit(ray, 0, std::numeric_limits<float>::max(), hitRecord)) { break; }
+                pathLength += hitRecord->intersectionTime;
+                const MirrorShader * mirror = dynamic_cast<const MirrorShader *>(surface.resolveShader(*hitRecord));
+                if (mirror == NULL)
+                {
+                    // only light that came off a mirror is a caustic. the light straight from the lights is shaded
+                    // with shadow rays
+                    if (bounce == 0) { break; }
+                    const float falloff = directional ? 1 : pathLength * pathLength;
+                    Photon & photon = slots[k];
+                    photon.position = hitRecord->intersectionPoint;
+                    photon.direction = ray.direction;
+                    photon.power[0] = power[0] * falloff;
+                    photon.power[1] = power[1] * falloff;
+                    photon.power[2] = power[2] * falloff;
+                    stored[k] = 1;
+                    break;
+                }
+
+                // a mirror passes on the part of the light that it does not replace with its specular color
+                const float reflectance = 1 - mirror->getSpecularWeight();
+                if (reflectance <= 0) { break; }
+                power[0] *= reflectance;
+                power[1] *= reflectance;
+                power[2] *= reflectance;
+                const Math::Vector3 r = ray.direction - 2 * Math::dot(ray.direction, hitRecord->unitNormal) * hitRecord->unitNormal;
+                ray = { hitRecord->intersectionPoint + (PHOTON_EPSILON * r), r };
+            }
+        }
+    });
+
+    for (int k = 0; k < photonCount; k++)
+    {
+        if (stored[k]) { storedPhotons.push_back(slots[k]); }
+    }
+    return storedPhotons;
+}
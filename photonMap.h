@@ -0,0 +1,61 @@
+#ifndef PHOTON_MAP_HEADER
+#define PHOTON_MAP_HEADER
+
+#include <stdint.h>
+#include <vector>
+#include "math.h"
+#include "lightTable.h"
+#include "surface.h"
+
+// photons that reached a diffuse surface by way of one or more mirrors, in a kd-tree for finding the nearest ones to a
+// point (jensen 1996). shadow rays cannot find light that comes off a mirror, so the caustics it throws are estimated
+// from the density of the photons around each point instead. the tree is balanced and lives in the photon array itself:
+// the median of every range is its node and splits it along its widest axis, so a lookup is logarithmic in the photon
+// count and takes no memory besides the photons
+class PhotonMap
+{
+public:
+    struct Photon
+    {
+        Math::Vector3 position;
+        Math::Vector3 direction; // unit, the way the photon was travelling
+        float power[3];
+    };
+
+    // builds the tree over photons on threadCount threads
+    PhotonMap(std::vector<Photon> photons, int threadCount);
+
+    size_t size() const;
+    const Photon & getPhoton(size_t photonIndex) const;
+
+    // indices of the at most count photons nearest to point and within maxDistance of it, in no particular order
+    void findNearest(Math::Vector3 point, int count, float maxDistance, std::vector<size_t> & photonIndices) const;
+
+    // the light per channel that the nearest photons bring to point from the side unitNormal faces, in the units of
+    // LightTable::red and the others. the photons are weighted by a cone filter over the smallest sphere around point
+    // that holds them
+    void estimateIrradiance(Math::Vector3 point, Math::Vector3 unitNormal, int count, float maxDistance, float irradiance[3]) const;
+
+    // sends photonCount photons from the lights toward the surfaces a MirrorShader shades, each light taking a share
+    // by its power, and keeps those that reach another surface after at least one mirror. the lights of this renderer
+    // do not fall off with distance, so neither does the light of a photon: a flat mirror lights a point like the light
+    // seen in it, and a curved one by how much it gathers or spreads the light. the same seed gives the same photons on
+    // any number of threads
+    static std::vector<Photon> traceCausticPhotons(const LightTable & lightTable, const Surface & surface, int photonCount, uint32_t seed, int threadCount);
+
+private:
+    struct Neighbour
+    {
+        float squaredDistance;
+        size_t photonIndex;
+        bool operator<(Neighbour const& other) const { return this->squaredDistance < other.squaredDistance; }
+    };
+
+    void build(size_t begin, size_t end, Math::Box bounds, int threadCount);
+    void findNearest(size_t begin, size_t end, Math::Vector3 const& point, size_t count, float & maxSquaredDistance, std::vector<Neighbour> & heap) const;
+
+    std::vector<Photon> photons;
+    std::vector<uint8_t> axes; // the axis the node at each index splits its range along
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include "rayDifferential.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // the change of direction / |direction| for a change of directionChange in direction
+    Math::Vector3 normalizeDifferential(Math::Vector3 const& direction, Math::Vector3 const& directionChange)
+    {
+        const float squaredLength = Math::dot(direction, direction);
+        const float length = std::sqrt(squaredLength);
+        return (squaredLength * directionChange - Math::dot(direction, directionChange) * direction) / (squaredLength * length);
+    }
+
+    // the change of the reflection of unit direction d about the unit normal n, for changes of d and of n
+    Math::Vector3 reflectChange(Math::Vector3 const& d, Math::Vector3 const& n, Math::Vector3 const& directionChange, Math::Vector3 const& normalChange)
+    {
+        const float cosine = Math::dot(d, n);
+        const float cosineChange = Math::dot(directionChange, n) + Math::dot(d, normalChange);
+        return directionChange - 2 * (cosine * normalChange + cosineChange * n);
+    }
+}
+
+Util::RayDifferential Util::scaleDifferential(RayDifferential const& differential, float scale)
+{
+    return { scale * differential.originX, scale * differential.originY, scale * differential.directionX, scale * differential.directionY };
+}
+
+void Util::transferDifferential(Math::Ray const& ray, RayDifferential const& differential, float t, Math::Vector3 const& unitNormal,
+    Math::Vector3 & pointX, Math::Vector3 & pointY)
+{
+    const float cosine = Math::dot(ray.direction, unitNormal);
+    // a ray along the surface never meets its tangent plane, so the offsets are taken as they are
+    if (std::abs(cosine) < 1e-8f)
+    {
+        pointX = differential.originX + t * differential.directionX;
+        pointY = differential.originY + t * differential.directionY;
+        return;
+    }
+    const Math::Vector3 offsetX = differential.originX + t * differential.directionX;
+    const Math::Vector3 offsetY = differential.originY + t * differential.directionY;
+    // the neighbouring ray travels a little more or less before it meets the tangent plane
+    pointX = offsetX - (Math::dot(offsetX, unitNormal) / cosine) * ray.direction;
+    pointY = offsetY - (Math::dot(offsetY, unitNormal) / cosine) * ray.direction;
+}
+
+Util::RayDifferential Util::reflectDifferential(Math::Ray const& ray, RayDifferential const& differential, HitRecord const& hitRecord)
+{
+    RayDifferential reflected;
+    transferDifferential(ray, differential, hitRecord.intersectionTime, hitRecord.unitNormal, reflected.originX, reflected.originY);
+
+    const Math::Vector3 d = ray.direction / ray.direction.norm();
+    const Math::Vector3 & n = hitRecord.unitNormal;
+    reflected.directionX = reflectChange(d, n, normalizeDifferential(ray.direction, differential.directionX), hitRecord.curvature * reflected.originX);
+    reflected.directionY = reflectChange(d, n, normalizeDifferential(ray.direction, differential.directionY), hitRecord.curvature * reflected.originY);
+    return reflected;
+}
+
+float Util::footprintWidth(Math::Vector3 const& pointX, Math::Vector3 const& pointY)
+{
+    return std::max(pointX.norm(), pointY.norm());
+}
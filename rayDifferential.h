@@ -0,0 +1,33 @@
+#ifndef RAY_DIFFERENTIAL_HEADER
+#define RAY_DIFFERENTIAL_HEADER
+
+#include "math.h"
+#include "util.h"
+
+namespace Util
+{
+    // how a ray changes from its pixel to the next one along x and along y (igehy 1999). carried along with a ray, it
+    // tells how wide an area of a surface one pixel covers wherever the ray lands, after any number of reflections, so
+    // that textures and geometry can be filtered to that size instead of being supersampled
+    struct RayDifferential
+    {
+        Math::Vector3 originX, originY;
+        Math::Vector3 directionX, directionY; // of the direction as the ray holds it, not normalized
+    };
+
+    RayDifferential scaleDifferential(RayDifferential const& differential, float scale);
+
+    // the change of the point where ray hits a surface with unitNormal at time t, from one pixel to the next along x
+    // and y. the neighbouring rays are taken to hit the tangent plane at that point
+    void transferDifferential(Math::Ray const& ray, RayDifferential const& differential, float t, Math::Vector3 const& unitNormal,
+        Math::Vector3 & pointX, Math::Vector3 & pointY);
+
+    // the differential of the ray that leaves hitRecord in the mirror direction of ray, as MirrorShader reflects it. the
+    // normal turns by hitRecord.curvature along the surface, which spreads the reflection off a convex mirror
+    RayDifferential reflectDifferential(Math::Ray const& ray, RayDifferential const& differential, HitRecord const& hitRecord);
+
+    // the width of the area that one pixel covers around a hit, from the changes of its point along x and y
+    float footprintWidth(Math::Vector3 const& pointX, Math::Vector3 const& pointY);
+}
+
+#endif
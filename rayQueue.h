@@ -0,0 +1,56 @@
+#ifndef RAY_QUEUE_HEADER
+#define RAY_QUEUE_HEADER
+
+#include <vector>
+#include "math.h"
+#include "util.h"
+#include "rayDifferential.h"
+
+// work items passed between the stages of the wavefront renderer
+namespace Wavefront
+{
+    // a view or reflection ray waiting to be intersected
+    struct PathRay
+    {
+        Math::Ray ray;
+        int pixelIndex;
+        int depth = 0;
+        float weight = 1; // the fraction of the pixel color carried by this path
+        Util::Color missColor = { 0, 0, 0 }; // what the path sees when the ray leaves the scene
+        Util::RayDifferential differential; // see RenderContext::rayDifferential
+    };
+
+    // a shadow ray whose color is added to its pixel unless something lies between t0 and t1
+    struct ShadowRay
+    {
+        Math::Ray ray;
+        float t0, t1;
+        int pixelIndex;
+        int lightIndex;
+        float red, green, blue;
+    };
+
+    // light that reached a pixel without needing any more rays
+    struct Contribution
+    {
+        int pixelIndex;
+        float red, green, blue;
+    };
+
+    // everything a stage emits for the stages after it
+    struct RayQueues
+    {
+        std::vector<PathRay> pathRays;
+        std::vector<ShadowRay> shadowRays;
+        std::vector<Contribution> contributions;
+
+        void clear()
+        {
+            this->pathRays.clear();
+            this->shadowRays.clear();
+            this->contributions.clear();
+        }
+    };
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include "renderContext.h"
+#include "hittable.h"
+#include "occlusionCache.h"
+#include "dependencyBuffer.h"
+#include "ambientOcclusion.h"
+#include "photonMap.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // how far along an ambient occlusion ray to start looking, so that it does not find the surface it left
+    const float AMBIENT_OCCLUSION_EPSILON = 0.001;
+}
+
+void RenderContext::selectLights(Math::Vector3 point, Math::Vector3 unitNormal, std::vector<LightTree::SelectedLight> & selectedLights) const
+{
+    selectedLights.clear();
+    if (this->lightTree != NULL)
+    {
+        this->lightTree->selectLights(point, unitNormal, selectedLights);
+        return;
+    }
+    for (int i = 0; i < this->lightTable.size(); i++)
+    {
+        selectedLights.push_back({ i, 1 });
+    }
+}
+
+Util::Sampler RenderContext::sampler(uint32_t stream) const
+{
+    return Util::Sampler(this->seed, this->pixelIndex, this->sampleIndex, this->bounce, stream);
+}
+
+bool RenderContext::isOccluded(int lightIndex, const Renderable & surface, Math::Ray shadowRay, float t0, float t1) const
+{
+    // the whole segment is recorded, hit or not, since a change anywhere along it can change the answer
+    if (this->dependencies != NULL) { this->dependencies->recordRay(shadowRay, t0, t1); }
+    if (this->shadowRayStatistics != NULL) { this->shadowRayStatistics->shadowRayCount++; }
+    if (this->occlusionCache != NULL) { return this->occlusionCache->isOccluded(lightIndex, surface, shadowRay, t0, t1); }
+
+    return surface.hitAny(shadowRay, t0, t1);
+}
+
+float RenderContext::computeVisibility(int lightIndex, const Renderable & surface, Math::Ray shadowRay, float t0, float t1) const
+{
+    if (!this->lightTable.isAreaLight(lightIndex)) { return this->isOccluded(lightIndex, surface, shadowRay, t0, t1) ? 0 : 1; }
+    if (this->shadowRayStatistics != NULL) { this->shadowRayStatistics->areaLightQueryCount++; }
+
+    Util::Sampler sampler = this->sampler(Util::LIGHT_STREAM + lightIndex);
+    int sampleCount = 0, visibleCount = 0;
+    Math::Vector3 direction;
+    float distance;
+    // one jittered shadow ray per cell of a gridSize x gridSize grid over the light
+    auto sampleGrid = [&](int gridSize)
+    {
+        for (int cell = 0; cell < gridSize * gridSize; cell++)
+        {
+            const float u = (cell % gridSize + sampler.nextFloat()) / gridSize;
+            const float v = (cell / gridSize + sampler.nextFloat()) / gridSize;
+            this->lightTable.directionToLightSample(lightIndex, shadowRay.origin, u, v, direction, distance);
+            if (!this->isOccluded(lightIndex, surface, { shadowRay.origin, direction }, t0, distance)) { visibleCount++; }
+            sampleCount++;
+        }
+    };
+
+    sampleGrid(std::max(1, (int) std::lround(std::sqrt(this->shadowSamples))));
+    if (visibleCount == 0 || visibleCount == sampleCount) { return (float) visibleCount / sampleCount; }
+
+    if (this->shadowRayStatistics != NULL) { this->shadowRayStatistics->refinedQueryCount++; }
+    sampleGrid(std::max(1, (int) std::lround(std::sqrt(this->penumbraShadowSamples))));
+    return (float) visibleCount / sampleCount;
+}
+
+float RenderContext::computeAmbientOcclusion(const Renderable & surface, Math::Vector3 point, Math::Vector3 unitNormal, Math::Vector3 viewDirection) const
+{
+    if (this->ambientOcclusionSamples <= 0) { return 1; }
+    if (Math::dot(unitNormal, viewDirection) > 0) { unitNormal = -unitNormal; }
+    if (this->ambientOcclusionBuffer != NULL && this->bounce == 0 && this->resolutionX > 0)
+    {
+        const float visibility = this->ambientOcclusionBuffer->lookup(this->pixelIndex % this->resolutionX, this->pixelIndex / this->resolutionX, point, unitNormal);
+        if (visibility >= 0) { return visibility; }
+    }
+    return this->traceAmbientOcclusion(surface, point, unitNormal);
+}
+
+float RenderContext::traceAmbientOcclusion(const Renderable & surface, Math::Vector3 point, Math::Vector3 unitNormal) const
+{
+    if (this->shadowRayStatistics != NULL)
+    {
+        this->shadowRayStatistics->ambientOcclusionQueryCount++;
+        this->shadowRayStatistics->ambientOcclusionRayCount += this->ambientOcclusionSamples;
+    }
+
+    // r2 points under a random shift per point, mapped to cosine weighted directions so that the fraction of open rays
+    // is the occlusion itself, with no weights to apply
+    Util::Sampler sampler = this->sampler(Util::AMBIENT_OCCLUSION_STREAM);
+    const float offsetU = sampler.nextFloat(), offsetV = sampler.nextFloat();
+    int openCount = 0;
+    for (int k = 0; k < this->ambientOcclusionSamples; k++)
+    {
+        float u, v;
+        Util::r2Point(k, offsetU, offsetV, u, v);
+        const Math::Ray ray = { point, Util::cosineDirection(unitNormal, u, v) };
+        if (this->dependencies != NULL) { this->dependencies->recordRay(ray, AMBIENT_OCCLUSION_EPSILON, this->ambientOcclusionDistance); }
+        if (!surface.hitAny(ray, AMBIENT_OCCLUSION_EPSILON, this->ambientOcclusionDistance)) { openCount++; }
+    }
+    return (float) openCount / this->ambientOcclusionSamples;
+}
+
+void RenderContext::addCausticLight(Math::Vector3 point, Math::Vector3 unitNormal, Math::Vector3 viewDirection, float light[3]) const
+{
+    if (this->causticMap == NULL) { return; }
+    if (Math::dot(unitNormal, viewDirection) > 0) { unitNormal = -unitNormal; }
+    float irradiance[3];
+    this->causticMap->estimateIrradiance(point, unitNormal, this->causticPhotons, this->causticDistance, irradiance);
+    light[0] += irradiance[0];
+    light[1] += irradiance[1];
+    light[2] += irradiance[2];
+}
+
+float RenderContext::computeFootprint(Math::Ray const& ray, Util::HitRecord const& hitRecord) const
+{
+    Math::Vector3 pointX, pointY;
+    Util::transferDifferential(ray, this->rayDifferential, hitRecord.intersectionTime, hitRecord.unitNormal, pointX, pointY);
+    return Util::footprintWidth(pointX, pointY);
+}
+
+void ShadowRayStatistics::add(ShadowRayStatistics const& statistics)
+{
+    this->shadowRayCount += statistics.shadowRayCount;
+    this->areaLightQueryCount += statistics.areaLightQueryCount;
+    this->refinedQueryCount += statistics.refinedQueryCount;
+    this->ambientOcclusionRayCount += statistics.ambientOcclusionRayCount;
+    this->ambientOcclusionQueryCount += statistics.ambientOcclusionQueryCount;
+}
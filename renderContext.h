@@ -0,0 +1,96 @@
+#ifndef RENDER_CONTEXT_HEADER
+#define RENDER_CONTEXT_HEADER
+
+#include <memory>
+#include <vector>
+#include "math.h"
+#include "lightTable.h"
+#include "lightTree.h"
+#include "util.h"
+#include "sampling.h"
+#include "rayDifferential.h"
+
+class Renderable;
+class OcclusionCache;
+class DependencyRecorder;
+class AmbientOcclusionBuffer;
+class IrradianceCache;
+class PhotonMap;
+
+// counters of the shadow and ambient occlusion rays traced for a frame
+struct ShadowRayStatistics
+{
+    long shadowRayCount = 0; // every shadow ray, toward any light
+    long areaLightQueryCount = 0; // estimates of how much of an area light a point sees
+    long refinedQueryCount = 0; // the estimates in a penumbra, whose first shadow rays disagreed and that took more
+    long ambientOcclusionRayCount = 0;
+    long ambientOcclusionQueryCount = 0; // points whose occlusion was traced rather than read from the buffer
+
+    void add(ShadowRayStatistics const& statistics);
+};
+
+// what a shader can read about the frame being rendered besides the surface it is shading
+struct RenderContext
+{
+    const LightTable & lightTable;
+    const LightTree * lightTree = NULL; // when set, points are lit by their light cut instead of by every light
+    OcclusionCache * occlusionCache = NULL; // when set, shadow rays try the last occluder of their light first. one per thread
+    DependencyRecorder * dependencies = NULL; // when set, every ray traced and surface shaded is recorded. one per thread
+    // what the random numbers drawn while shading are keyed by, so that a frame comes out the same on any number of
+    // threads in any tile order. pixelIndex is y * resolutionX + x, and bounce counts the reflections on the way here
+    uint32_t seed = 0;
+    uint32_t pixelIndex = 0;
+    uint32_t sampleIndex = 0;
+    uint32_t bounce = 0;
+    // an area light is first sampled with shadowSamples shadow rays over a stratified grid. only in a penumbra, where
+    // some of those are blocked and some are not, does it take penumbraShadowSamples more over a finer grid
+    int shadowSamples = 4;
+    int penumbraShadowSamples = 16;
+    ShadowRayStatistics * shadowRayStatistics = NULL; // when set, counts the shadow rays. one per thread
+    // 0 turns ambient occlusion off. otherwise a point traces this many rays over the hemisphere above it, none
+    // longer than ambientOcclusionDistance
+    int ambientOcclusionSamples = 0;
+    float ambientOcclusionDistance = 1;
+    // when set, the points seen straight from the camera read their occlusion from here where they can
+    const AmbientOcclusionBuffer * ambientOcclusionBuffer = NULL;
+    int resolutionX = 0; // turns pixelIndex back into the pixel for ambientOcclusionBuffer
+    // when set, the points seen straight from the camera add the indirect diffuse light it holds. shared by every thread
+    IrradianceCache * irradianceCache = NULL;
+    Util::Color backgroundColor = { 0, 0, 0 }; // what a ray that leaves the scene sees, for the rays that gather indirect light
+    // when set, diffuse shaders add the caustics estimated from the causticPhotons nearest to each point, none further
+    // than causticDistance
+    const PhotonMap * causticMap = NULL;
+    int causticPhotons = 50;
+    float causticDistance = 1;
+    // how the ray being shaded changes from one pixel to the next, set from the camera and carried through reflections.
+    // all zero, which asks for the finest detail, when nothing set it
+    Util::RayDifferential rayDifferential;
+
+    RenderContext(const LightTable & lightTable)
+        : lightTable(lightTable) {}
+
+    // indices into lightTable of the lights that shade a point. without a light tree that is every light at scale 1
+    void selectLights(Math::Vector3 point, Math::Vector3 unitNormal, std::vector<LightTree::SelectedLight> & selectedLights) const;
+
+    // the random numbers of the current pixel, sample and bounce. see Util::Sampler for stream
+    Util::Sampler sampler(uint32_t stream) const;
+
+    // true if anything in surface blocks the shadow ray toward the light with the given index
+    bool isOccluded(int lightIndex, const Renderable & surface, Math::Ray shadowRay, float t0, float t1) const;
+    // how much of the light with the given index the origin of shadowRay sees, from 0 in full shadow to 1. shadowRay,
+    // t0 and t1 are as isOccluded takes them toward the light position, and other lights take just that one ray
+    float computeVisibility(int lightIndex, const Renderable & surface, Math::Ray shadowRay, float t0, float t1) const;
+    // how open the hemisphere above point is, from 0 where every ambient occlusion ray is blocked to 1. the normal is
+    // turned to face against viewDirection first, so either side of a surface works. 1 when ambient occlusion is off
+    float computeAmbientOcclusion(const Renderable & surface, Math::Vector3 point, Math::Vector3 unitNormal, Math::Vector3 viewDirection) const;
+    // traces the ambient occlusion rays of point, whose unitNormal already faces the viewer, ignoring the buffer
+    float traceAmbientOcclusion(const Renderable & surface, Math::Vector3 point, Math::Vector3 unitNormal) const;
+    // adds the light that reaches point off mirrors to light, per channel in the units of LightTable::red and the
+    // others. the normal is turned to face against viewDirection first. adds nothing without a caustic map
+    void addCausticLight(Math::Vector3 point, Math::Vector3 unitNormal, Math::Vector3 viewDirection, float light[3]) const;
+    // the width of the area around the hit of ray that one pixel covers, by rayDifferential. textures and geometry pick
+    // their level of detail by it
+    float computeFootprint(Math::Ray const& ray, Util::HitRecord const& hitRecord) const;
+};
+
+#endif
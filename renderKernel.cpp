@@ -0,0 +1,32 @@
+#include "renderKernel.h"
+#include <typeinfo>
+
+Kernel::ShaderVariant Kernel::specialize(const Shader * shader)
+{
+    const std::type_info & type = typeid(*shader);
+    if (type == typeid(StaticColorShader)) { return static_cast<const StaticColorShader *>(shader); }
+    if (type == typeid(LambertShader)) { return static_cast<const LambertShader *>(shader); }
+    if (type == typeid(BlinnPhongShader)) { return static_cast<const BlinnPhongShader *>(shader); }
+    if (type == typeid(StandardShader)) { return static_cast<const StandardShader *>(shader); }
+    if (type == typeid(MirrorShader)) { return static_cast<const MirrorShader *>(shader); }
+    return shader;
+}
+
+Kernel::ShaderVariant Kernel::ShaderTable::lookup(const Shader * shader)
+{
+    if (this->lastIndex < this->entries.size() && this->entries[this->lastIndex].first == shader)
+    {
+        return this->entries[this->lastIndex].second;
+    }
+    for (size_t k = 0; k < this->entries.size(); k++)
+    {
+        if (this->entries[k].first == shader)
+        {
+            this->lastIndex = k;
+            return this->entries[k].second;
+        }
+    }
+    this->entries.push_back({ shader, specialize(shader) });
+    this->lastIndex = this->entries.size() - 1;
+    return this->entries.back().second;
+}
@@ -0,0 +1,104 @@
+#ifndef RENDER_KERNEL_HEADER
+#define RENDER_KERNEL_HEADER
+
+#include <memory>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "util.h"
+#include "camera.h"
+#include "surface.h"
+#include "shader.h"
+#include "renderContext.h"
+#include "tiling.h"
+
+// a render path with the virtual calls taken out of the per pixel loop. the camera type is a template parameter, and
+// shaders are looked up once and then called through a closed variant of the built in shader types, so the compiler
+// sees the concrete ray generation and shading code. shaders of any other type still go through the virtual call
+namespace Kernel
+{
+    typedef std::variant<
+        const Shader *, // any shader that is not one of the types below
+        const StaticColorShader *,
+        const LambertShader *,
+        const BlinnPhongShader *,
+        const StandardShader *,
+        const MirrorShader *
+    > ShaderVariant;
+
+    // picks the alternative whose type is exactly the dynamic type of shader, so subclasses of the built in shaders
+    // keep their overrides
+    ShaderVariant specialize(const Shader * shader);
+
+    // remembers the variant of every shader seen so far. scenes hold a handful of shaders, so a linear scan with the
+    // last hit checked first is cheaper than hashing
+    class ShaderTable
+    {
+    public:
+        ShaderVariant lookup(const Shader * shader);
+
+    private:
+        std::vector<std::pair<const Shader *, ShaderVariant>> entries;
+        size_t lastIndex = 0;
+    };
+
+    inline Util::Color shade(
+        const ShaderVariant & shader,
+        const RenderContext & context,
+        Math::Ray const& viewRay,
+        std::shared_ptr<Renderable> const& surface,
+        std::shared_ptr<Util::HitRecord> const& hitRecord
+    )
+    {
+        return std::visit([&](auto concreteShader) -> Util::Color
+        {
+            typedef std::remove_const_t<std::remove_pointer_t<decltype(concreteShader)>> ShaderType;
+            if constexpr (std::is_same<ShaderType, Shader>::value)
+            {
+                return concreteShader->shade(context, viewRay, surface, hitRecord);
+            }
+            else
+            {
+                return concreteShader->ShaderType::shade(context, viewRay, surface, hitRecord); // qualified, so not virtual
+            }
+        }, shader);
+    }
+
+    // renders the pixels of tile in z-order into colors and hits, which are laid out row by row
+    template <typename CameraType>
+    void renderTile(
+        const CameraType & camera,
+        std::shared_ptr<Surface> const& surface,
+        const RenderContext & context,
+        ShaderTable & shaders,
+        Util::PixelRect const& tile,
+        std::vector<Util::Color> & colors,
+        std::vector<bool> & hits
+    )
+    {
+        colors.assign(tile.pixelCount(), { 0, 0, 0 });
+        hits.assign(tile.pixelCount(), false);
+
+        const std::shared_ptr<Renderable> renderable = surface;
+        std::shared_ptr<Util::HitRecord> hitRecord(new Util::HitRecord);
+        RenderContext pixelContext = context;
+        const int resolutionX = camera.getResolutionX();
+        Util::forEachPixelInZOrder(tile, [&](int i, int j)
+        {
+            const int index = (j - tile.y0) * tile.width() + (i - tile.x0);
+            pixelContext.pixelIndex = j * resolutionX + i;
+            const Math::Ray viewRay = camera.viewingRay(i, j);
+            *hitRecord = Util::HitRecord();
+            if (!surface->hit(viewRay, 0, std::numeric_limits<float>::max(), hitRecord)) { return; }
+
+            hits[index] = true;
+            const Shader * shader = surface->resolveShader(*hitRecord);
+            if (shader == NULL) { return; } // a hit without a shader displays black
+            colors[index] = shade(shaders.lookup(shader), pixelContext, viewRay, renderable, hitRecord);
+        });
+    }
+}
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef SAMPLING_HEADER
+#define SAMPLING_HEADER
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "math.h"
+
+namespace Util
+{
+    enum class SampleSequence
+    {
+        R2, // the additive recurrence over the plastic number. cheap and even for any sample count
+        Sobol // the first two sobol dimensions. best spread when the sample count is a power of two
+    };
+
+    // philox 4x32 with 10 rounds: a bijection of the 128 bit counter under a 64 bit key. every output is a pure function
+    // of its counter, so any thread can draw the numbers of any pixel without sharing state
+    inline void philox4x32(const uint32_t counter[4], uint32_t key0, uint32_t key1, uint32_t result[4])
+    {
+        uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+        for (int round = 0; round < 10; round++)
+        {
+            const uint64_t product0 = (uint64_t) 0xD2511F53 * c0;
+            const uint64_t product1 = (uint64_t) 0xCD9E8D57 * c2;
+            c0 = (uint32_t) (product1 >> 32) ^ c1 ^ key0;
+            c1 = (uint32_t) product1;
+            c2 = (uint32_t) (product0 >> 32) ^ c3 ^ key1;
+            c3 = (uint32_t) product0;
+            key0 += 0x9E3779B9;
+            key1 += 0xBB67AE85;
+        }
+        result[0] = c0;
+        result[1] = c1;
+        result[2] = c2;
+        result[3] = c3;
+    }
+
+    // the top 24 bits of bits as a float in [0, 1)
+    inline float toUnitFloat(uint32_t bits)
+    {
+        return (bits >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // the stream of the subpixel offsets of the camera rays
+    const uint32_t CAMERA_STREAM = 0;
+    // the first stream of the shadow rays toward area lights, which draw from LIGHT_STREAM plus their light index
+    const uint32_t LIGHT_STREAM = 1;
+    // the stream of the ambient occlusion rays, well past any light index
+    const uint32_t AMBIENT_OCCLUSION_STREAM = 0x80000000;
+    // the stream of the rays that gather indirect light for the irradiance cache
+    const uint32_t INDIRECT_STREAM = 0x80000001;
+    // the stream of the caustic photons, whose sampler takes the photon index in place of the pixel
+    const uint32_t PHOTON_STREAM = 0x80000002;
+
+    // the random numbers of one sample of one pixel at one bounce. stream tells apart the things that draw numbers at
+    // the same bounce, such as the lights, so that they do not see the same numbers
+    class Sampler
+    {
+    public:
+        Sampler(uint32_t seed, uint32_t pixelIndex, uint32_t sampleIndex, uint32_t bounce, uint32_t stream)
+        {
+            this->counter[0] = pixelIndex;
+            this->counter[1] = sampleIndex;
+            this->counter[2] = (bounce << 16) ^ stream;
+            this->counter[3] = 0;
+            this->key0 = seed;
+            this->key1 = stream;
+        }
+
+        uint32_t nextUint32()
+        {
+            if (this->position == 4)
+            {
+                philox4x32(this->counter, this->key0, this->key1, this->block);
+                this->counter[3]++;
+                this->position = 0;
+            }
+            return this->block[this->position++];
+        }
+
+        float nextFloat() { return toUnitFloat(this->nextUint32()); } // in [0, 1)
+
+    private:
+        uint32_t counter[4];
+        uint32_t key0, key1;
+        uint32_t block[4];
+        int position = 4;
+    };
+
+    // the index-th point of the r2 sequence, toroidally shifted by offsetU and offsetV in [0, 1)
+    inline void r2Point(uint32_t index, float offsetU, float offsetV, float & u, float & v)
+    {
+        // 1 / g and 1 / g^2 for the plastic number g, as 32 bit fractions so that the sum wraps around exactly
+        const uint32_t alpha1 = 3242174889u, alpha2 = 2447445414u;
+        u = toUnitFloat(index * alpha1 + (uint32_t) (offsetU * 4294967296.0));
+        v = toUnitFloat(index * alpha2 + (uint32_t) (offsetV * 4294967296.0));
+    }
+
+    // the index-th point of the first two sobol dimensions with the digits xor scrambled, which keeps every power of two
+    // run of points stratified
+    inline void sobolPoint(uint32_t index, uint32_t scrambleU, uint32_t scrambleV, float & u, float & v)
+    {
+        // the first dimension is the van der corput sequence, the bits of index reversed
+        uint32_t bitsU = index;
+        bitsU = (bitsU << 16) | (bitsU >> 16);
+        bitsU = ((bitsU & 0x00FF00FF) << 8) | ((bitsU & 0xFF00FF00) >> 8);
+        bitsU = ((bitsU & 0x0F0F0F0F) << 4) | ((bitsU & 0xF0F0F0F0) >> 4);
+        bitsU = ((bitsU & 0x33333333) << 2) | ((bitsU & 0xCCCCCCCC) >> 2);
+        bitsU = ((bitsU & 0x55555555) << 1) | ((bitsU & 0xAAAAAAAA) >> 1);
+
+        uint32_t bitsV = 0;
+        for (uint32_t direction = 1u << 31; index != 0; index >>= 1, direction ^= direction >> 1)
+        {
+            if (index & 1) { bitsV ^= direction; }
+        }
+
+        u = toUnitFloat(bitsU ^ scrambleU);
+        v = toUnitFloat(bitsV ^ scrambleV);
+    }
+
+    // two unit vectors that make an orthonormal basis with the unit vector axis, built without branches (duff et al. 2017)
+    inline void orthonormalBasis(Math::Vector3 const& axis, Math::Vector3 & tangent, Math::Vector3 & bitangent)
+    {
+        const float sign = std::copysign(1.0f, axis.getZ());
+        const float a = -1.0f / (sign + axis.getZ());
+        const float b = axis.getX() * axis.getY() * a;
+        tangent = Math::Vector3(1 + sign * axis.getX() * axis.getX() * a, sign * b, -sign * axis.getX());
+        bitangent = Math::Vector3(b, sign + axis.getY() * axis.getY() * a, -axis.getY());
+    }
+
+    // the direction above the unit normal that (u, v) in [0, 1)^2 maps to, with a density proportional to the cosine of
+    // its angle to the normal
+    inline Math::Vector3 cosineDirection(Math::Vector3 const& unitNormal, float u, float v)
+    {
+        Math::Vector3 tangent, bitangent;
+        orthonormalBasis(unitNormal, tangent, bitangent);
+        const float radius = std::sqrt(u);
+        const float angle = 2 * (float) M_PI * v;
+        return radius * std::cos(angle) * tangent + radius * std::sin(angle) * bitangent + std::sqrt(std::max(0.0f, 1 - u)) * unitNormal;
+    }
+
+    // the direction that (u, v) in [0, 1)^2 maps to, uniform over the solid angle of the cone around the unit axis whose
+    // half angle has the cosine cosMaxAngle. -1 covers the whole sphere
+    inline Math::Vector3 coneDirection(Math::Vector3 const& unitAxis, float cosMaxAngle, float u, float v)
+    {
+        Math::Vector3 tangent, bitangent;
+        orthonormalBasis(unitAxis, tangent, bitangent);
+        const float cosAngle = 1 - u * (1 - cosMaxAngle);
+        const float sinAngle = std::sqrt(std::max(0.0f, 1 - cosAngle * cosAngle));
+        const float angle = 2 * (float) M_PI * v;
+        return sinAngle * std::cos(angle) * tangent + sinAngle * std::sin(angle) * bitangent + cosAngle * unitAxis;
+    }
+}
+
+#endif
@@ -2,18 +2,58 @@
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <algorithm>
+#include <utility>
 #include "scene.h"
 #include "camera.h"
 #include "surface.h"
 #include "hittable.h"
+#include "wavefront.h"
+#include "renderKernel.h"
+#include "dependencyBuffer.h"
+#include "ambientOcclusion.h"
+#include "bitmap.h"
+#include "imageEncoder.h"
 
-// https://stackoverflow.com/a/47785639/21190150
-
-const int BYTES_PER_PIXEL = 3;
-const int FILE_HEADER_SIZE = 14;
-const int INFO_HEADER_SIZE = 40;
+using Bitmap::BYTES_PER_PIXEL;
+using Bitmap::FILE_HEADER_SIZE;
+using Bitmap::INFO_HEADER_SIZE;
 const float EPSILON = 0.001;
 
+namespace
+{
+    // type tags of the serialized scenes
+    const uint8_t GRAYSCALE_SCENE = 1;
+    const uint8_t RGB_SCENE = 2;
+    // the keywords of the text format, indexed by type tag
+    const char * const SCENE_TYPE_NAMES[] = { "", "grayscaleScene", "rgbScene" };
+    const size_t SCENE_TYPE_COUNT = sizeof(SCENE_TYPE_NAMES) / sizeof(SCENE_TYPE_NAMES[0]);
+    // the spacing in pixels of the coarsest grid that prepareIrradianceCache shades
+    const int IRRADIANCE_PASS_STRIDE = 8;
+
+    // lets the specialized kernel run with camera types it was not compiled for, through the virtual call
+    struct VirtualCamera
+    {
+        const Camera & camera;
+
+        Math::Ray viewingRay(int pixelIndexX, int pixelIndexY) const
+        {
+            return this->camera.computeViewingRay(pixelIndexX, pixelIndexY);
+        }
+
+        int getResolutionX() const
+        {
+            return this->camera.getResolutionX();
+        }
+    };
+
+    // the little endian 32 bit integer at offset, as bitmap headers store them
+    int readInt32(std::string const& bytes, size_t offset)
+    {
+        return (int) ((uint8_t) bytes[offset] | ((uint8_t) bytes[offset + 1] << 8) | ((uint8_t) bytes[offset + 2] << 16) | ((uint32_t) (uint8_t) bytes[offset + 3] << 24));
+    }
+}
+
 Scene::Scene()
 {
     this->camera = std::unique_ptr<Camera>(new ParallelOrthographicCamera());
@@ -29,70 +69,846 @@ Scene::Scene(std::unique_ptr<Camera> camera)
 void Scene::setCamera(std::unique_ptr<Camera> camera)
 {
     this->camera = std::move(camera);
+    this->dependencyBuffer.markAllDirty();
 };
 
 void Scene::setSurface(std::shared_ptr<Surface> surface)
 {
     this->surface = std::move(surface);
+    this->dependencyBuffer.markAllDirty();
+    this->dropLightCaches();
 }
 
 void Scene::addLightSource(std::unique_ptr<LightSource> lightSource)
 {
     this->lightSources.push_back(std::move(lightSource));
+    this->dependencyBuffer.markAllDirty();
+    this->dropLightCaches();
+}
+
+void Scene::setRenderMode(RenderMode renderMode)
+{
+    this->renderMode = renderMode;
+}
+
+void Scene::setThreadCount(int threadCount)
+{
+    this->threadCount = std::max(1, threadCount);
+}
+
+void Scene::setSamplesPerPixel(int samplesPerPixel)
+{
+    this->samplesPerPixel = std::max(1, samplesPerPixel);
+}
+
+void Scene::setSampleSequence(Util::SampleSequence sampleSequence)
+{
+    this->sampleSequence = sampleSequence;
+}
+
+void Scene::setSeed(uint32_t seed)
+{
+    this->seed = seed;
+}
+
+void Scene::setSoftShadowSamples(int shadowSamples, int penumbraShadowSamples)
+{
+    this->shadowSamples = std::max(1, shadowSamples);
+    this->penumbraShadowSamples = std::max(0, penumbraShadowSamples);
+}
+
+void Scene::setAmbientOcclusion(int sampleCount, float maxDistance, int resolutionDivisor)
+{
+    this->ambientOcclusionSamples = std::max(0, sampleCount);
+    this->ambientOcclusionDistance = maxDistance > 0 ? maxDistance : 1;
+    this->ambientOcclusionResolutionDivisor = std::max(1, resolutionDivisor);
+}
+
+ShadowRayStatistics Scene::getShadowRayStatistics() const
+{
+    return this->shadowRayStatistics;
+}
+
+void Scene::enableIrradianceCache(int sampleCount, float accuracy, float minRadius, float maxRadius)
+{
+    this->irradianceCache = std::unique_ptr<IrradianceCache>(new IrradianceCache(sampleCount, accuracy, minRadius, maxRadius));
+    this->irradianceCacheView.clear();
+}
+
+void Scene::disableIrradianceCache()
+{
+    this->irradianceCache = NULL;
+    this->irradianceCacheView.clear();
+}
+
+void Scene::clearIrradianceCache()
+{
+    if (this->irradianceCache != NULL) { this->irradianceCache->clear(); }
+    this->irradianceCacheView.clear();
+}
+
+IrradianceCache::Statistics Scene::getIrradianceCacheStatistics() const
+{
+    if (this->irradianceCache == NULL) { return IrradianceCache::Statistics(); }
+    return this->irradianceCache->getStatistics();
+}
+
+void Scene::setCaustics(int photonCount, int nearestPhotonCount, float maxDistance)
+{
+    this->causticPhotonCount = std::max(0, photonCount);
+    this->causticNearestPhotons = std::max(1, nearestPhotonCount);
+    this->causticDistance = maxDistance > 0 ? maxDistance : 1;
+    this->causticMap = NULL;
+}
+
+size_t Scene::getCausticMapSize() const
+{
+    return this->causticMap == NULL ? 0 : this->causticMap->size();
+}
+
+void Scene::dropLightCaches()
+{
+    this->clearIrradianceCache();
+    this->causticMap = NULL;
+}
+
+void Scene::selectLevelsOfDetail()
+{
+    if (this->surface == NULL) { return; }
+    std::vector<Math::Box> changedBounds;
+    this->surface->selectLevelOfDetail(*this->camera, changedBounds);
+    if (!this->dependencyTrackingEnabled) { return; }
+    for (auto & bounds : changedBounds)
+    {
+        this->dependencyBuffer.markBoundsChanged(bounds);
+    }
+}
+
+void Scene::setTileSize(int tileSize)
+{
+    this->tileSize = std::max(1, tileSize);
+}
+
+void Scene::setTileOrder(Util::TileOrder tileOrder)
+{
+    this->tileOrder = tileOrder;
+}
+
+void Scene::enableLightTree(int maxLightCount, float errorBound)
+{
+    this->lightTreeEnabled = true;
+    this->lightTreeMaxLightCount = maxLightCount;
+    this->lightTreeErrorBound = errorBound;
 }
 
-void Scene::exportToFile(std::string filename) const
+void Scene::disableLightTree()
 {
-    int width = this->camera->getResolutionX();
-    int height = this->camera->getResolutionY();
-    int widthInBytes = width * BYTES_PER_PIXEL;
-    char padding[3] = { 0, 0, 0 };
-    int paddingSize = (4 - (widthInBytes % 4)) % 4;
-    int scanLineSize = widthInBytes + paddingSize;
-    int fileSize = FILE_HEADER_SIZE + INFO_HEADER_SIZE + (scanLineSize * this->camera->getResolutionY());
+    this->lightTreeEnabled = false;
+}
 
-    // create file header
-    std::string fileHeader = std::string(FILE_HEADER_SIZE, (char) 0);
-    fileHeader.replace(0, 1, 1, 'B');
-    fileHeader.replace(1, 1, 1, 'M');
-    fileHeader.replace(2, 1, 1, (char) fileSize);
-    fileHeader.replace(3, 1, 1, (char) (fileSize >> 8));
-    fileHeader.replace(4, 1, 1, (char) (fileSize >> 16));
-    fileHeader.replace(5, 1, 1, (char) (fileSize >> 24));
-    fileHeader.replace(10, 1, 1, (char) (FILE_HEADER_SIZE + INFO_HEADER_SIZE));
+void Scene::enableOcclusionCache()
+{
+    this->occlusionCacheEnabled = true;
+}
 
-    // create info header
-    std::string infoHeader = std::string(INFO_HEADER_SIZE, 0);
-    infoHeader.replace(0, 1, 1, INFO_HEADER_SIZE);
-    infoHeader.replace(4, 1, 1, (char) width);
-    infoHeader.replace(5, 1, 1, (char) (width >> 8));
-    infoHeader.replace(6, 1, 1, (char) (width >> 16));
-    infoHeader.replace(7, 1, 1, (char) (width >> 24));
-    infoHeader.replace(8, 1, 1, (char) height);
-    infoHeader.replace(9, 1, 1, (char) (height >> 8));
-    infoHeader.replace(10, 1, 1, (char) (height >> 16));
-    infoHeader.replace(11, 1, 1, (char) (height >> 24));
-    infoHeader.replace(12, 1, 1, (char) 1);
-    infoHeader.replace(14, 1, 1, (char) (BYTES_PER_PIXEL * 8));
+void Scene::disableOcclusionCache()
+{
+    this->occlusionCacheEnabled = false;
+}
 
-    const std::string pixelArray = this->computePixelArray();
+OcclusionCache::Statistics Scene::getOcclusionCacheStatistics() const
+{
+    return this->occlusionCacheStatistics;
+}
 
-    // write out
-    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+void Scene::setAccelerationCacheDirectory(std::string accelerationCacheDirectory)
+{
+    this->accelerationCacheDirectory = accelerationCacheDirectory;
+}
+
+std::string Scene::getAccelerationCacheDirectory() const
+{
+    return this->accelerationCacheDirectory;
+}
+
+void Scene::enableDependencyTracking()
+{
+    this->dependencyTrackingEnabled = true;
+}
+
+void Scene::disableDependencyTracking()
+{
+    this->dependencyTrackingEnabled = false;
+    this->dependencyBuffer.reset(0);
+}
 
-    if (file.is_open())
+void Scene::markSurfaceChanged(int topLevelSurfaceIndex)
+{
+    this->dependencyBuffer.markSurfaceChanged(topLevelSurfaceIndex);
+    this->dropLightCaches();
+}
+
+void Scene::markBoundsChanged(Math::Box const& bounds)
+{
+    this->dependencyBuffer.markBoundsChanged(bounds);
+    this->boundsChanged = true;
+    this->dropLightCaches();
+}
+
+void Scene::render()
+{
+    this->render({ 0, 0, this->camera->getResolutionX(), this->camera->getResolutionY() });
+}
+
+void Scene::render(Util::PixelRect const& region)
+{
+    this->render(std::vector<Util::PixelRect> { region });
+}
+
+void Scene::render(std::vector<Util::PixelRect> const& regions)
+{
+    // clip to the frame and cut the overlaps off so that no pixel is traced twice
+    const Util::PixelRect frame = { 0, 0, this->camera->getResolutionX(), this->camera->getResolutionY() };
+    std::vector<Util::PixelRect> disjointRegions;
+    for (auto & region : regions)
     {
-        file.write(fileHeader.c_str(), FILE_HEADER_SIZE);
-        file.write(infoHeader.c_str(), INFO_HEADER_SIZE);
-        for (int i = 0; i < this->camera->getResolutionY(); i++)
+        std::vector<Util::PixelRect> pieces = { Util::intersect(region, frame) };
+        for (auto & taken : disjointRegions)
         {
-            file.write(pixelArray.c_str() + (i * widthInBytes), widthInBytes);
-            file.write(padding, paddingSize);
+            std::vector<Util::PixelRect> remainingPieces;
+            for (auto & piece : pieces)
+            {
+                const std::vector<Util::PixelRect> remainder = Util::subtract(piece, taken);
+                remainingPieces.insert(remainingPieces.end(), remainder.begin(), remainder.end());
+            }
+            pieces.swap(remainingPieces);
         }
+        for (auto & piece : pieces)
+        {
+            if (!piece.isEmpty()) { disjointRegions.push_back(piece); }
+        }
+    }
+    if (disjointRegions.empty()) { return; }
+
+    Util::PixelRect bounds = disjointRegions.front();
+    for (auto & region : disjointRegions)
+    {
+        bounds = { std::min(bounds.x0, region.x0), std::min(bounds.y0, region.y0), std::max(bounds.x1, region.x1), std::max(bounds.y1, region.y1) };
     }
 
-    file.close();
+    std::vector<Util::Color> colors;
+    std::vector<bool> hits;
+    this->computeRegions(disjointRegions, bounds, colors, hits, NULL);
+    for (auto & region : disjointRegions)
+    {
+        for (int j = region.y0; j < region.y1; j++)
+        {
+            for (int i = region.x0; i < region.x1; i++)
+            {
+                const int index = (j - bounds.y0) * bounds.width() + (i - bounds.x0);
+                this->setPixel(i, j, colors.at(index), hits.at(index));
+            }
+        }
+    }
+}
+
+void Scene::computeRegion(Util::PixelRect const& region, std::vector<Util::Color> & colors, std::vector<bool> & hits)
+{
+    this->computeRegions({ region }, region, colors, hits, NULL);
+}
+
+void Scene::computeRegions(
+    std::vector<Util::PixelRect> const& regions,
+    Util::PixelRect const& bounds,
+    std::vector<Util::Color> & colors,
+    std::vector<bool> & hits,
+    const std::vector<uint8_t> * tracedPixels
+)
+{
+    // only the first render of a surface builds anything
+    if (this->surface != NULL) { this->surface->buildAccelerationStructures(this->accelerationCacheDirectory); }
+    this->selectLevelsOfDetail();
+
+    // flattened once per frame so the shading loops read contiguous arrays instead of chasing light pointers
+    LightTable lightTable(this->lightSources);
+    RenderContext context(lightTable);
+    context.seed = this->seed;
+    context.shadowSamples = this->shadowSamples;
+    context.penumbraShadowSamples = this->penumbraShadowSamples;
+    context.ambientOcclusionSamples = this->ambientOcclusionSamples;
+    context.ambientOcclusionDistance = this->ambientOcclusionDistance;
+    context.resolutionX = this->camera->getResolutionX();
+    context.backgroundColor = this->computeMissColor();
+    // samples spread over a pixel each cover a share of it
+    context.rayDifferential = Util::scaleDifferential(this->camera->computeRayDifferential(), 1 / std::sqrt((float) this->samplesPerPixel));
+    ShadowRayStatistics shadowRayStatistics;
+    context.shadowRayStatistics = &shadowRayStatistics;
+    std::unique_ptr<LightTree> lightTree;
+    if (this->lightTreeEnabled)
+    {
+        lightTree = std::unique_ptr<LightTree>(new LightTree(lightTable, this->lightTreeMaxLightCount, this->lightTreeErrorBound));
+        context.lightTree = lightTree.get();
+    }
+    OcclusionCache occlusionCache;
+    if (this->occlusionCacheEnabled) { context.occlusionCache = &occlusionCache; }
+
+    const bool tracking = this->dependencyTrackingEnabled;
+    const int resolutionX = this->camera->getResolutionX();
+    if (tracking && this->dependencyBuffer.getPixelCount() != resolutionX * this->camera->getResolutionY())
+    {
+        this->dependencyBuffer.reset(resolutionX * this->camera->getResolutionY());
+    }
+
+    // traced before anything is shaded so that the shaders can share it. a tracked pixel traces its own rays, which
+    // records them as its dependencies
+    std::unique_ptr<AmbientOcclusionBuffer> ambientOcclusionBuffer;
+    if (this->ambientOcclusionSamples > 0 && this->ambientOcclusionResolutionDivisor > 1 && !tracking && this->surface != NULL)
+    {
+        ambientOcclusionBuffer = std::unique_ptr<AmbientOcclusionBuffer>(new AmbientOcclusionBuffer(bounds, this->ambientOcclusionResolutionDivisor));
+        shadowRayStatistics.add(ambientOcclusionBuffer->compute(*this->camera, *this->surface, context, this->threadCount));
+        context.ambientOcclusionBuffer = ambientOcclusionBuffer.get();
+    }
+    if (!tracking && this->irradianceCache != NULL && this->surface != NULL)
+    {
+        this->prepareIrradianceCache(context);
+        context.irradianceCache = this->irradianceCache.get();
+    }
+    if (this->causticPhotonCount > 0 && !tracking && this->surface != NULL)
+    {
+        if (this->causticMap == NULL)
+        {
+            std::vector<PhotonMap::Photon> photons = PhotonMap::traceCausticPhotons(lightTable, *this->surface, this->causticPhotonCount, this->seed, this->threadCount);
+            this->causticMap = std::unique_ptr<PhotonMap>(new PhotonMap(std::move(photons), this->threadCount));
+        }
+        context.causticMap = this->causticMap.get();
+        context.causticPhotons = this->causticNearestPhotons;
+        context.causticDistance = this->causticDistance;
+    }
+
+    if (this->renderMode == RenderMode::Wavefront && !tracking && this->samplesPerPixel == 1)
+    {
+        WavefrontRenderer wavefrontRenderer(this->threadCount);
+        wavefrontRenderer.setTileSize(this->tileSize);
+        wavefrontRenderer.setTileOrder(this->tileOrder);
+        colors.assign(bounds.pixelCount(), { 0, 0, 0 });
+        hits.assign(bounds.pixelCount(), false);
+        std::vector<Util::Color> regionColors;
+        std::vector<bool> regionHits;
+        for (auto & region : regions)
+        {
+            wavefrontRenderer.render(*this->camera, this->surface, context, region, regionColors, regionHits);
+            for (int j = region.y0; j < region.y1; j++)
+            {
+                for (int i = region.x0; i < region.x1; i++)
+                {
+                    const int regionIndex = (j - region.y0) * region.width() + (i - region.x0);
+                    const int index = (j - bounds.y0) * bounds.width() + (i - bounds.x0);
+                    colors[index] = regionColors.at(regionIndex);
+                    hits[index] = regionHits.at(regionIndex);
+                }
+            }
+        }
+    }
+    else
+    {
+        // every thread renders whole tiles with its own copy of the context so that it can own its occlusion cache
+        std::vector<Util::PixelRect> tiles;
+        for (auto & region : regions)
+        {
+            const std::vector<Util::PixelRect> regionTiles = Util::computeTiles(region, this->tileSize, this->tileOrder);
+            tiles.insert(tiles.end(), regionTiles.begin(), regionTiles.end());
+        }
+        std::vector<OcclusionCache> threadOcclusionCaches(this->threadCount);
+        std::vector<ShadowRayStatistics> threadShadowRayStatistics(this->threadCount);
+        std::vector<RenderContext> threadContexts(this->threadCount, context);
+        std::vector<DependencyRecorder> threadRecorders(tracking ? this->threadCount : 0);
+        for (int t = 0; t < this->threadCount; t++)
+        {
+            if (context.occlusionCache != NULL) { threadContexts[t].occlusionCache = &threadOcclusionCaches[t]; }
+            threadContexts[t].shadowRayStatistics = &threadShadowRayStatistics[t];
+            if (tracking) { threadContexts[t].dependencies = &threadRecorders[t]; }
+        }
+
+        colors.assign(bounds.pixelCount(), { 0, 0, 0 });
+        std::vector<uint8_t> regionHits(bounds.pixelCount(), 0); // unlike vector<bool>, threads can write neighbouring entries
+        Util::parallelFor(tiles.size(), 1, this->threadCount, [&](size_t begin, size_t end, int threadIndex)
+        {
+            std::vector<Util::Color> tileColors;
+            std::vector<bool> tileHits;
+            for (size_t t = begin; t < end; t++)
+            {
+                const Util::PixelRect & tile = tiles[t];
+                if (tracking)
+                {
+                    this->computeTileTracked(threadContexts[threadIndex], tile, tracedPixels, tileColors, tileHits);
+                    this->dependencyBuffer.commit(threadRecorders[threadIndex]);
+                }
+                else
+                {
+                    this->computeTile(threadContexts[threadIndex], tile, tileColors, tileHits);
+                }
+                for (int j = tile.y0; j < tile.y1; j++)
+                {
+                    for (int i = tile.x0; i < tile.x1; i++)
+                    {
+                        const int tileIndex = (j - tile.y0) * tile.width() + (i - tile.x0);
+                        const int index = (j - bounds.y0) * bounds.width() + (i - bounds.x0);
+                        colors[index] = tileColors.at(tileIndex);
+                        regionHits[index] = tileHits.at(tileIndex);
+                    }
+                }
+            }
+        });
+        hits.assign(regionHits.begin(), regionHits.end());
+
+        for (auto & threadOcclusionCache : threadOcclusionCaches)
+        {
+            occlusionCache.addStatistics(threadOcclusionCache.getStatistics());
+        }
+        for (auto & threadStatistics : threadShadowRayStatistics)
+        {
+            shadowRayStatistics.add(threadStatistics);
+        }
+    }
+
+    this->occlusionCacheStatistics = occlusionCache.getStatistics();
+    this->shadowRayStatistics = shadowRayStatistics;
+    if (tracking) { this->dependencyBuffer.compact(); }
+}
+
+int Scene::renderChanges()
+{
+    const int resolutionX = this->camera->getResolutionX();
+    const int resolutionY = this->camera->getResolutionY();
+    if (!this->dependencyTrackingEnabled || this->dependencyBuffer.getPixelCount() != resolutionX * resolutionY)
+    {
+        this->render();
+        return resolutionX * resolutionY;
+    }
+    if (this->boundsChanged && this->surface != NULL) { this->surface->updateBounds(); }
+    this->boundsChanged = false;
+    this->selectLevelsOfDetail();
+
+    // a copy, since the threads clean the buffer as they commit
+    const std::vector<uint8_t> dirtyPixels = this->dependencyBuffer.getDirtyPixels();
+    const int dirtyPixelCount = this->dependencyBuffer.getDirtyPixelCount();
+    if (dirtyPixelCount == 0) { return 0; }
+
+    std::vector<Util::Color> colors;
+    std::vector<bool> hits;
+    const Util::PixelRect frame = { 0, 0, resolutionX, resolutionY };
+    this->computeRegions({ frame }, frame, colors, hits, &dirtyPixels);
+    for (int j = 0; j < resolutionY; j++)
+    {
+        for (int i = 0; i < resolutionX; i++)
+        {
+            const int index = j * resolutionX + i;
+            if (dirtyPixels[index]) { this->setPixel(i, j, colors.at(index), hits.at(index)); }
+        }
+    }
+    return dirtyPixelCount;
+}
+
+void Scene::computeTileTracked(const RenderContext & context, Util::PixelRect const& tile, const std::vector<uint8_t> * tracedPixels, std::vector<Util::Color> & colors, std::vector<bool> & hits) const
+{
+    colors.assign(tile.pixelCount(), { 0, 0, 0 });
+    hits.assign(tile.pixelCount(), false);
+    const int resolutionX = this->camera->getResolutionX();
+    Util::forEachPixelInZOrder(tile, [&](int i, int j)
+    {
+        const int pixelIndex = j * resolutionX + i;
+        if (tracedPixels != NULL && !tracedPixels->at(pixelIndex)) { return; }
+
+        bool hit;
+        const int index = (j - tile.y0) * tile.width() + (i - tile.x0);
+        context.dependencies->beginPixel(pixelIndex);
+        colors.at(index) = this->computeColorAtPixelIndex(context, i, j, hit);
+        hits.at(index) = hit;
+    });
+}
+
+void Scene::prepareIrradianceCache(const RenderContext & context)
+{
+    // the records a view needs are gathered once, on its first render or on its first tile of a distributed one
+    Serialization::BinaryWriter view;
+    this->camera->serialize(view);
+    view.writeUint32("seed", this->seed);
+    view.writeInt32("samplesPerPixel", this->samplesPerPixel);
+    view.writeUint8("sampleSequence", (uint8_t) this->sampleSequence);
+    if (view.getBuffer() == this->irradianceCacheView) { return; }
+    this->irradianceCacheView = view.getBuffer();
+
+    // shades the whole frame on ever finer grids of pixels, each grid only queueing the points that the records of the
+    // coarser ones miss, so that every record is gathered in the same order whatever the threads and tiles. the frame
+    // then only reads the records. the grids only have to find the points the view rays hit, so they are shaded
+    // without lights, and the gathers alone see the lights of context
+    const LightTable noLights;
+    RenderContext passContext(noLights);
+    passContext.seed = context.seed;
+    passContext.resolutionX = context.resolutionX;
+    passContext.rayDifferential = context.rayDifferential; // the view rays pick the levels of detail the frame sees
+    passContext.irradianceCache = this->irradianceCache.get();
+    RenderContext gatherContext = context;
+    gatherContext.occlusionCache = NULL;
+    gatherContext.shadowRayStatistics = NULL;
+    gatherContext.ambientOcclusionBuffer = NULL; // only holds the pixels of the region being rendered
+    const int resolutionX = this->camera->getResolutionX();
+    const int resolutionY = this->camera->getResolutionY();
+    this->irradianceCache->setMissMode(IrradianceCache::MissMode::Defer);
+    for (int stride = IRRADIANCE_PASS_STRIDE; stride >= 1; stride /= 2)
+    {
+        const int rowCount = (resolutionY + stride - 1) / stride;
+        Util::parallelFor(rowCount, 1, this->threadCount, [&](size_t begin, size_t end, int)
+        {
+            for (size_t row = begin; row < end; row++)
+            {
+                const int j = row * stride;
+                for (int i = 0; i < resolutionX; i += stride)
+                {
+                    // the pixels of the coarser grid were shaded already
+                    if (stride < IRRADIANCE_PASS_STRIDE && i % (2 * stride) == 0 && j % (2 * stride) == 0) { continue; }
+                    bool hit;
+                    this->computeColorAtPixelIndex(passContext, i, j, hit);
+                }
+            }
+        });
+        this->irradianceCache->insertPending(gatherContext, this->surface, this->threadCount);
+    }
+    this->irradianceCache->setMissMode(IrradianceCache::MissMode::Gather);
+}
+
+void Scene::computeTile(const RenderContext & context, Util::PixelRect const& tile, std::vector<Util::Color> & colors, std::vector<bool> & hits) const
+{
+    // only the recursive path traces more than one sample per pixel, and a batch has no pixel to key the area light,
+    // ambient occlusion and indirect light samples of each hit by
+    RenderMode renderMode = this->renderMode;
+    const bool batchNeedsPixels = context.lightTable.hasAreaLights() || context.ambientOcclusionSamples > 0 || context.irradianceCache != NULL;
+    if (this->samplesPerPixel > 1 || (renderMode == RenderMode::Batched && batchNeedsPixels))
+    {
+        renderMode = RenderMode::Recursive;
+    }
+    if (renderMode == RenderMode::Batched)
+    {
+        this->computeTileBatched(context, tile, colors, hits);
+    }
+    else if (renderMode == RenderMode::Specialized)
+    {
+        Kernel::ShaderTable shaders;
+        if (const PerspectiveCamera * camera = dynamic_cast<const PerspectiveCamera *>(this->camera.get()))
+        {
+            Kernel::renderTile(*camera, this->surface, context, shaders, tile, colors, hits);
+        }
+        else if (const ParallelOrthographicCamera * camera = dynamic_cast<const ParallelOrthographicCamera *>(this->camera.get()))
+        {
+            Kernel::renderTile(*camera, this->surface, context, shaders, tile, colors, hits);
+        }
+        else
+        {
+            Kernel::renderTile(VirtualCamera { *this->camera }, this->surface, context, shaders, tile, colors, hits);
+        }
+    }
+    else
+    {
+        colors.resize(tile.pixelCount());
+        hits.resize(tile.pixelCount());
+        Util::forEachPixelInZOrder(tile, [&](int i, int j)
+        {
+            bool hit;
+            const int index = (j - tile.y0) * tile.width() + (i - tile.x0);
+            colors.at(index) = this->computeColorAtPixelIndex(context, i, j, hit);
+            hits.at(index) = hit;
+        });
+    }
+}
+
+Util::Color Scene::computeColorAtPixelIndex(const RenderContext & context, int pixelIndexX, int pixelIndexY, bool & hit) const
+{
+    RenderContext pixelContext = context;
+    pixelContext.pixelIndex = pixelIndexY * this->camera->getResolutionX() + pixelIndexX;
+    std::shared_ptr<Util::HitRecord> hitRecord(new Util::HitRecord);
+    if (this->samplesPerPixel == 1)
+    {
+        const Math::Ray viewRay = this->camera->computeViewingRay(pixelIndexX, pixelIndexY);
+        const Util::Color pixelColor = this->surface->computeColor(pixelContext, viewRay, this->surface, hitRecord);
+        hit = hitRecord->intersectionTime >= 0;
+        return pixelColor;
+    }
+
+    // every pixel walks the same sequence shifted by its own random offset, so that neighbours do not share a pattern
+    Util::Sampler sampler = pixelContext.sampler(Util::CAMERA_STREAM);
+    const uint32_t shiftU = sampler.nextUint32();
+    const uint32_t shiftV = sampler.nextUint32();
+    const Util::Color missColor = this->computeMissColor();
+    int red = 0, green = 0, blue = 0;
+    hit = false;
+    for (int s = 0; s < this->samplesPerPixel; s++)
+    {
+        float u, v;
+        if (this->sampleSequence == Util::SampleSequence::Sobol) { Util::sobolPoint(s, shiftU, shiftV, u, v); }
+        else { Util::r2Point(s, Util::toUnitFloat(shiftU), Util::toUnitFloat(shiftV), u, v); }
+
+        pixelContext.sampleIndex = s;
+        *hitRecord = Util::HitRecord();
+        const Math::Ray viewRay = this->camera->computeJitteredViewingRay(pixelIndexX, pixelIndexY, u - 0.5f, v - 0.5f);
+        Util::Color sampleColor = this->surface->computeColor(pixelContext, viewRay, this->surface, hitRecord);
+        if (hitRecord->intersectionTime >= 0) { hit = true; }
+        else { sampleColor = missColor; }
+        red += sampleColor.red;
+        green += sampleColor.green;
+        blue += sampleColor.blue;
+    }
+
+    const int half = this->samplesPerPixel / 2;
+    return {
+        (uint8_t) ((red + half) / this->samplesPerPixel),
+        (uint8_t) ((green + half) / this->samplesPerPixel),
+        (uint8_t) ((blue + half) / this->samplesPerPixel)
+    };
+}
+
+void Scene::computeTileBatched(const RenderContext & context, Util::PixelRect const& tile, std::vector<Util::Color> & colors, std::vector<bool> & hits) const
+{
+    const int pixelCount = tile.pixelCount();
+    colors.assign(pixelCount, { 0, 0, 0 });
+    hits.assign(pixelCount, false);
+
+    std::vector<Math::Ray> viewRays(pixelCount);
+    std::vector<Util::HitRecord> hitRecords(pixelCount);
+    std::vector<std::pair<const Shader *, int>> shadedPixels; // the shader of every hit and its index in the tile
+    std::shared_ptr<Util::HitRecord> hitRecord(new Util::HitRecord);
+    this->camera->computeViewingRays(tile.x0, tile.y0, tile.x1, tile.y1, viewRays.data());
+    Util::forEachPixelInZOrder(tile, [&](int i, int j)
+    {
+        const int index = (j - tile.y0) * tile.width() + (i - tile.x0);
+        *hitRecord = Util::HitRecord();
+        if (!this->surface->hit(viewRays.at(index), 0, std::numeric_limits<float>::max(), hitRecord)) { return; }
+
+        const Shader * shader = this->surface->resolveShader(*hitRecord);
+        if (shader == NULL)
+        {
+            // nothing to batch, so let the surface decide what an unshaded hit looks like
+            std::shared_ptr<Util::HitRecord> unshadedHitRecord(new Util::HitRecord);
+            colors.at(index) = this->surface->computeColor(context, viewRays.at(index), this->surface, unshadedHitRecord);
+            hits.at(index) = unshadedHitRecord->intersectionTime >= 0;
+            return;
+        }
+        hitRecords.at(index) = *hitRecord;
+        hits.at(index) = true;
+        shadedPixels.push_back({ shader, index });
+    });
+
+    // group the hits by shader so that each shader runs once over every hit it owns in the tile
+    std::sort(shadedPixels.begin(), shadedPixels.end());
+
+    std::vector<Math::Ray> batchViewRays;
+    std::vector<Util::HitRecord> batchHitRecords;
+    std::vector<Util::Color> batchColors;
+    size_t batchStart = 0;
+    while (batchStart < shadedPixels.size())
+    {
+        const Shader * shader = shadedPixels.at(batchStart).first;
+        size_t batchEnd = batchStart;
+        batchViewRays.clear();
+        batchHitRecords.clear();
+        while (batchEnd < shadedPixels.size() && shadedPixels.at(batchEnd).first == shader)
+        {
+            batchViewRays.push_back(viewRays.at(shadedPixels.at(batchEnd).second));
+            batchHitRecords.push_back(hitRecords.at(shadedPixels.at(batchEnd).second));
+            batchEnd++;
+        }
+
+        batchColors.resize(batchEnd - batchStart);
+        shader->shadeBatch(context, batchViewRays, this->surface, batchHitRecords, batchColors);
+        for (size_t k = batchStart; k < batchEnd; k++)
+        {
+            colors.at(shadedPixels.at(k).second) = batchColors.at(k - batchStart);
+        }
+        batchStart = batchEnd;
+    }
+}
+
+bool Scene::exportToFile(std::string filename) const
+{
+    return this->exportToFile(filename, { 0, 0, this->camera->getResolutionX(), this->camera->getResolutionY() });
+}
+
+bool Scene::exportToFile(std::string filename, Util::PixelRect const& crop) const
+{
+    Util::PixelRect region = Util::intersect(crop, { 0, 0, this->camera->getResolutionX(), this->camera->getResolutionY() });
+    if (region.isEmpty()) { region = { 0, 0, 0, 0 }; }
+    const std::unique_ptr<ImageEncoder> encoder = ImageEncoder::createForFilename(filename);
+    const std::string contents = encoder->encode(region.width(), region.height(), this->computePixelArray(region));
+    const AsyncImageWriter::Result result = AsyncImageWriter::writeFile(filename, contents, false);
+    if (!result.success)
+    {
+        std::cerr << "Could not write " << result.error << std::endl;
+        return false;
+    }
     std::cout << "File written out successfully." << std::endl;
+    return true;
+}
+
+std::future<AsyncImageWriter::Result> Scene::exportToFile(AsyncImageWriter & writer, std::string filename) const
+{
+    const int width = this->camera->getResolutionX();
+    const int height = this->camera->getResolutionY();
+    // the pixel array is copied out here, on the render thread. only the encoding and the write move to the writer
+    auto pixelArray = std::make_shared<std::string>(this->computePixelArray());
+    std::shared_ptr<ImageEncoder> encoder = ImageEncoder::createForFilename(filename);
+    return writer.write(filename, [width, height, pixelArray, encoder]() { return encoder->encode(width, height, *pixelArray); });
+}
+
+bool Scene::spliceIntoFile(std::string filename, Util::PixelRect const& region) const
+{
+    const int width = this->camera->getResolutionX();
+    const int height = this->camera->getResolutionY();
+    std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+    if (!file.is_open()) { return false; }
+
+    // any uncompressed 24 bit bottom up bitmap of the frame size will do, wherever its pixels start
+    std::string headers(FILE_HEADER_SIZE + INFO_HEADER_SIZE, 0);
+    if (!file.read(&headers[0], headers.size())) { return false; }
+    if (headers[0] != 'B' || headers[1] != 'M') { return false; }
+    if (readInt32(headers, FILE_HEADER_SIZE + 4) != width || readInt32(headers, FILE_HEADER_SIZE + 8) != height) { return false; }
+    if ((uint8_t) headers[FILE_HEADER_SIZE + 14] != BYTES_PER_PIXEL * 8 || readInt32(headers, FILE_HEADER_SIZE + 16) != 0) { return false; }
+    const int pixelArrayOffset = readInt32(headers, 10);
+    const int scanLineSize = Bitmap::computeScanLineSize(width);
+
+    const Util::PixelRect clippedRegion = Util::intersect(region, { 0, 0, width, height });
+    if (clippedRegion.isEmpty()) { return true; }
+    const std::string pixelArray = this->computePixelArray(clippedRegion);
+    const int regionWidthInBytes = clippedRegion.width() * BYTES_PER_PIXEL;
+    for (int j = clippedRegion.y0; j < clippedRegion.y1; j++)
+    {
+        file.seekp(pixelArrayOffset + (std::streamoff) j * scanLineSize + clippedRegion.x0 * BYTES_PER_PIXEL);
+        file.write(pixelArray.c_str() + (j - clippedRegion.y0) * regionWidthInBytes, regionWidthInBytes);
+    }
+    return file.good();
+}
+
+std::string Scene::computePixelArray() const
+{
+    return this->computePixelArray({ 0, 0, this->camera->getResolutionX(), this->camera->getResolutionY() });
+}
+
+void Scene::serialize(Serialization::Writer & writer) const
+{
+    this->serializeImageSettings(writer);
+    this->camera->serialize(writer);
+
+    writer.beginList("surface", this->surface == NULL ? 0 : 1);
+    if (this->surface != NULL) { this->surface->serialize(writer); }
+    writer.endList();
+
+    writer.beginList("lights", this->lightSources.size());
+    for (auto & lightSource : this->lightSources)
+    {
+        lightSource->serialize(writer);
+    }
+    writer.endList();
+
+    writer.writeUint8("renderMode", (uint8_t) this->renderMode);
+    writer.writeInt32("tileSize", this->tileSize);
+    writer.writeUint8("tileOrder", (uint8_t) this->tileOrder);
+    writer.writeUint8("lightTree", this->lightTreeEnabled ? 1 : 0);
+    writer.writeInt32("lightTreeMaxLightCount", this->lightTreeMaxLightCount);
+    writer.writeFloat("lightTreeErrorBound", this->lightTreeErrorBound);
+    writer.writeUint8("occlusionCache", this->occlusionCacheEnabled ? 1 : 0);
+    writer.writeInt32("samplesPerPixel", this->samplesPerPixel);
+    writer.writeUint8("sampleSequence", (uint8_t) this->sampleSequence);
+    writer.writeUint32("seed", this->seed);
+    writer.writeInt32("shadowSamples", this->shadowSamples);
+    writer.writeInt32("penumbraShadowSamples", this->penumbraShadowSamples);
+    writer.writeInt32("ambientOcclusionSamples", this->ambientOcclusionSamples);
+    writer.writeFloat("ambientOcclusionDistance", this->ambientOcclusionDistance);
+    writer.writeInt32("ambientOcclusionResolutionDivisor", this->ambientOcclusionResolutionDivisor);
+    // the settings of the irradiance cache, not its records
+    writer.writeUint8("irradianceCache", this->irradianceCache != NULL ? 1 : 0);
+    writer.writeInt32("irradianceCacheSamples", this->irradianceCache != NULL ? this->irradianceCache->getSampleCount() : 0);
+    writer.writeFloat("irradianceCacheAccuracy", this->irradianceCache != NULL ? this->irradianceCache->getAccuracy() : 0);
+    writer.writeFloat("irradianceCacheMinRadius", this->irradianceCache != NULL ? this->irradianceCache->getMinRadius() : 0);
+    writer.writeFloat("irradianceCacheMaxRadius", this->irradianceCache != NULL ? this->irradianceCache->getMaxRadius() : 0);
+    writer.writeInt32("causticPhotonCount", this->causticPhotonCount);
+    writer.writeInt32("causticNearestPhotons", this->causticNearestPhotons);
+    writer.writeFloat("causticDistance", this->causticDistance);
+}
+
+std::unique_ptr<Scene> Scene::deserialize(Serialization::Reader & reader)
+{
+    std::unique_ptr<Scene> scene;
+    const uint8_t type = reader.readType(SCENE_TYPE_NAMES, SCENE_TYPE_COUNT);
+    if (type == GRAYSCALE_SCENE)
+    {
+        GrayscaleScene * grayscaleScene = new GrayscaleScene();
+        scene = std::unique_ptr<Scene>(grayscaleScene);
+        grayscaleScene->setBackgroundColor(reader.readUint8("backgroundColor"));
+    }
+    else if (type == RGB_SCENE)
+    {
+        RGBScene * rgbScene = new RGBScene();
+        scene = std::unique_ptr<Scene>(rgbScene);
+        rgbScene->setBackgroundColor(reader.readColor("backgroundColor"));
+    }
+    if (scene == NULL)
+    {
+        reader.fail();
+        return NULL;
+    }
+
+    scene->camera = Camera::deserialize(reader);
+    if (scene->camera == NULL) { return NULL; }
+    scene->initializeBitmap();
+
+    reader.beginList("surface");
+    if (reader.nextInList())
+    {
+        scene->surface = Surface::deserialize(reader);
+        if (reader.nextInList()) { reader.fail(); }
+    }
+
+    reader.beginList("lights");
+    while (reader.nextInList())
+    {
+        std::unique_ptr<LightSource> lightSource = LightSource::deserialize(reader);
+        if (lightSource != NULL) { scene->addLightSource(std::move(lightSource)); }
+    }
+
+    const uint8_t renderMode = reader.readUint8("renderMode");
+    if (renderMode > (uint8_t) RenderMode::Specialized) { reader.fail(); }
+    scene->setRenderMode((RenderMode) renderMode);
+    scene->setTileSize(reader.readInt32("tileSize"));
+    const uint8_t tileOrder = reader.readUint8("tileOrder");
+    if (tileOrder > (uint8_t) Util::TileOrder::Hilbert) { reader.fail(); }
+    scene->setTileOrder((Util::TileOrder) tileOrder);
+    scene->lightTreeEnabled = reader.readUint8("lightTree") != 0;
+    scene->lightTreeMaxLightCount = reader.readInt32("lightTreeMaxLightCount");
+    scene->lightTreeErrorBound = reader.readFloat("lightTreeErrorBound");
+    scene->occlusionCacheEnabled = reader.readUint8("occlusionCache") != 0;
+    scene->setSamplesPerPixel(reader.readInt32("samplesPerPixel"));
+    const uint8_t sampleSequence = reader.readUint8("sampleSequence");
+    if (sampleSequence > (uint8_t) Util::SampleSequence::Sobol) { reader.fail(); }
+    scene->setSampleSequence((Util::SampleSequence) sampleSequence);
+    scene->setSeed(reader.readUint32("seed"));
+    const int shadowSamples = reader.readInt32("shadowSamples");
+    scene->setSoftShadowSamples(shadowSamples, reader.readInt32("penumbraShadowSamples"));
+    const int ambientOcclusionSamples = reader.readInt32("ambientOcclusionSamples");
+    const float ambientOcclusionDistance = reader.readFloat("ambientOcclusionDistance");
+    scene->setAmbientOcclusion(ambientOcclusionSamples, ambientOcclusionDistance, reader.readInt32("ambientOcclusionResolutionDivisor"));
+    const bool irradianceCacheEnabled = reader.readUint8("irradianceCache") != 0;
+    const int irradianceCacheSamples = reader.readInt32("irradianceCacheSamples");
+    const float irradianceCacheAccuracy = reader.readFloat("irradianceCacheAccuracy");
+    const float irradianceCacheMinRadius = reader.readFloat("irradianceCacheMinRadius");
+    const float irradianceCacheMaxRadius = reader.readFloat("irradianceCacheMaxRadius");
+    if (irradianceCacheEnabled)
+    {
+        scene->enableIrradianceCache(irradianceCacheSamples, irradianceCacheAccuracy, irradianceCacheMinRadius, irradianceCacheMaxRadius);
+    }
+    const int causticPhotonCount = reader.readInt32("causticPhotonCount");
+    const int causticNearestPhotons = reader.readInt32("causticNearestPhotons");
+    scene->setCaustics(causticPhotonCount, causticNearestPhotons, reader.readFloat("causticDistance"));
+
+    if (!reader.isOk()) { return NULL; }
+    return scene;
 }
 
 uint8_t GrayscaleScene::colorToGrayscale(Util::Color color)
@@ -124,38 +940,36 @@ void GrayscaleScene::setCamera(std::unique_ptr<Camera> camera)
 void GrayscaleScene::setBackgroundColor(uint8_t backgroundColor)
 {
     this->backgroundColor = backgroundColor;
+    this->dependencyBuffer.markAllDirty();
+    this->dropLightCaches();
 }
 
-uint8_t GrayscaleScene::computeValueAtPixelIndex(int pixelIndexX, int pixelIndexY) const
+Util::Color GrayscaleScene::computeMissColor() const
 {
-    std::shared_ptr<Util::HitRecord> hitRecord(new Util::HitRecord);
-    const Math::Ray viewRay = this->camera->computeViewingRay(pixelIndexX, pixelIndexY);
-    const Util::Color pixelColor = this->surface->computeColor(this->lightSources, viewRay, this->surface, hitRecord);
-    if (hitRecord->intersectionTime < 0) { return this->backgroundColor; }
-    return GrayscaleScene::colorToGrayscale(pixelColor);
+    return { this->backgroundColor, this->backgroundColor, this->backgroundColor };
 }
 
-void GrayscaleScene::render()
+void GrayscaleScene::setPixel(int pixelIndexX, int pixelIndexY, Util::Color color, bool hit)
 {
-    for (int j = 0; j < this->camera->getResolutionY(); j++)
-    {
-        for (int i = 0; i < this->camera->getResolutionX(); i++)
-        {
-            this->bitmap.at(j).at(i) = this->computeValueAtPixelIndex(i, j);
-        }
-    }
+    this->bitmap.at(pixelIndexY).at(pixelIndexX) = hit ? GrayscaleScene::colorToGrayscale(color) : this->backgroundColor;
 }
 
-std::string GrayscaleScene::computePixelArray() const
+void GrayscaleScene::serializeImageSettings(Serialization::Writer & writer) const
 {
-    std::string pixelArray(this->camera->getResolutionX() * this->camera->getResolutionY() * BYTES_PER_PIXEL, 0);
+    writer.writeType(GRAYSCALE_SCENE, SCENE_TYPE_NAMES);
+    writer.writeUint8("backgroundColor", this->backgroundColor);
+}
+
+std::string GrayscaleScene::computePixelArray(Util::PixelRect const& region) const
+{
+    std::string pixelArray(region.pixelCount() * BYTES_PER_PIXEL, 0);
     int idx = 0;
     uint8_t bitmapValue = 0;
-    for (int i = 0; i < this->camera->getResolutionY(); i++)
+    for (int i = region.y0; i < region.y1; i++)
     {
-        for (int j = 0; j < this->camera->getResolutionX(); j++)
+        for (int j = region.x0; j < region.x1; j++)
         {
-            idx = 3 * (i * this->camera->getResolutionX() + j);
+            idx = 3 * ((i - region.y0) * region.width() + (j - region.x0));
             bitmapValue = this->bitmap.at(i).at(j);
             pixelArray.replace(idx, 3, 3, (char) bitmapValue);
         }
@@ -176,35 +990,32 @@ void RGBScene::initializeBitmap()
 }
 void RGBScene::setCamera(std::unique_ptr<Camera> camera)
 {
-    this->camera = std::move(camera);
+    Scene::setCamera(std::move(camera));
     this->initializeBitmap();
 }
 void RGBScene::setBackgroundColor(Util::Color backgroundColor)
 {
     this->backgroundColor = backgroundColor;
+    this->dependencyBuffer.markAllDirty();
+    this->dropLightCaches();
 }
 
-void RGBScene::render()
+void RGBScene::serializeImageSettings(Serialization::Writer & writer) const
 {
-    for (int j = 0; j < this->camera->getResolutionY(); j++)
-    {
-        for (int i = 0; i < this->camera->getResolutionX(); i++)
-        {
-            this->bitmap.at(j).at(i) = this->computeValueAtPixelIndex(i, j);
-        }
-    }
+    writer.writeType(RGB_SCENE, SCENE_TYPE_NAMES);
+    writer.writeColor("backgroundColor", this->backgroundColor);
 }
 
-std::string RGBScene::computePixelArray() const
+std::string RGBScene::computePixelArray(Util::PixelRect const& region) const
 {
-    std::string pixelArray(this->camera->getResolutionX() * this->camera->getResolutionY() * BYTES_PER_PIXEL, 0);
+    std::string pixelArray(region.pixelCount() * BYTES_PER_PIXEL, 0);
     int idx = 0;
     Util::Color bitmapValue = this->backgroundColor;
-    for (int i = 0; i < this->camera->getResolutionY(); i++)
+    for (int i = region.y0; i < region.y1; i++)
     {
-        for (int j = 0; j < this->camera->getResolutionX(); j++)
+        for (int j = region.x0; j < region.x1; j++)
         {
-            idx = 3 * (i * this->camera->getResolutionX() + j);
+            idx = 3 * ((i - region.y0) * region.width() + (j - region.x0));
             bitmapValue = this->bitmap.at(i).at(j);
             pixelArray.replace(idx, 1, 1, (char) bitmapValue.blue);
             pixelArray.replace(idx + 1, 1, 1, (char) bitmapValue.green);
@@ -214,11 +1025,12 @@ std::string RGBScene::computePixelArray() const
     return pixelArray;
 }
 
-Util::Color RGBScene::computeValueAtPixelIndex(int pixelIndexX, int pixelIndexY) const
+Util::Color RGBScene::computeMissColor() const
 {
-    std::shared_ptr<Util::HitRecord> hitRecord(new Util::HitRecord);
-    const Math::Ray viewRay = this->camera->computeViewingRay(pixelIndexX, pixelIndexY);
-    const Util::Color pixelColor = this->surface->computeColor(this->lightSources, viewRay, this->surface, hitRecord);
-    if (hitRecord->intersectionTime < 0) { return this->backgroundColor; }
-    return pixelColor;
+    return this->backgroundColor;
+}
+
+void RGBScene::setPixel(int pixelIndexX, int pixelIndexY, Util::Color color, bool hit)
+{
+    this->bitmap.at(pixelIndexY).at(pixelIndexX) = hit ? color : this->backgroundColor;
 }
@@ -8,6 +8,29 @@
 #include "surface.h"
 #include "shader.h"
 #include "lightSource.h"
+#include "lightTable.h"
+#include "lightTree.h"
+#include "renderContext.h"
+#include "occlusionCache.h"
+#include "irradianceCache.h"
+#include "photonMap.h"
+#include "dependencyBuffer.h"
+#include "imageWriter.h"
+#include "parallel.h"
+#include "tiling.h"
+#include "sampling.h"
+#include "serialization.h"
+
+enum class RenderMode
+{
+    Recursive, // every pixel intersects and shades its own view ray through computeColor
+    Batched, // tiles of view rays are intersected first, then shaded one shader at a time
+    // every stage runs over queues of rays for waves of tiles across threads. see WavefrontRenderer. it copies every hit
+    // and ray between its queues, so on benchmarkRenderPaths it runs about as fast as Recursive and half again slower
+    // than Batched and Specialized
+    Wavefront,
+    Specialized // like Recursive, but through a kernel compiled for the camera type and the built in shaders. see Kernel
+};
 
 class Scene
 {
@@ -15,18 +38,168 @@ public:
     Scene(); // by default uses a parallel orthographic camera
     Scene(std::unique_ptr<Camera> camera);
 
-    void setCamera(std::unique_ptr<Camera>);
+    virtual void setCamera(std::unique_ptr<Camera>); // subclasses also resize the bitmap
     void setSurface(std::shared_ptr<Surface>);
     void addLightSource(std::unique_ptr<LightSource> lightSource);
+    void setRenderMode(RenderMode renderMode);
+    void setThreadCount(int threadCount);
+    // every mode but Wavefront renders the frame in tiles of tileSize x tileSize pixels, handed to the threads in
+    // tileOrder. pixels inside a tile are traced in z-order so that neighbouring rays stay close in the scene
+    void setTileSize(int tileSize);
+    void setTileOrder(Util::TileOrder tileOrder);
+    // traces samplesPerPixel view rays spread over every pixel by sampleSequence and averages them. more than one
+    // sample traces pixel by pixel like Recursive whatever the render mode
+    void setSamplesPerPixel(int samplesPerPixel);
+    void setSampleSequence(Util::SampleSequence sampleSequence);
+    // every random number of a frame is keyed by the seed, pixel, sample and bounce, so the same seed gives the same
+    // frame on any number of threads and workers. the irradiance records are gathered in frame order before the frame
+    // is shaded, so that holds with them too, as long as the frames start from the same records: workers start from
+    // none, while the scene keeps those of the frames it rendered before
+    void setSeed(uint32_t seed);
+    // area lights take shadowSamples shadow rays per shading point, and penumbraShadowSamples more where those disagree.
+    // Wavefront takes shadowSamples rays everywhere since its queues cannot wait on the first ones
+    void setSoftShadowSamples(int shadowSamples, int penumbraShadowSamples);
+    // darkens the ambient term of StandardShader by how much of the hemisphere above each point is blocked, tracing
+    // sampleCount cosine weighted rays no longer than maxDistance. with a resolutionDivisor above 1, points seen straight
+    // from the camera share rays traced once per resolutionDivisor x resolutionDivisor block of pixels, see
+    // AmbientOcclusionBuffer. 0 samples, the default, turns it off
+    void setAmbientOcclusion(int sampleCount, float maxDistance, int resolutionDivisor);
+    ShadowRayStatistics getShadowRayStatistics() const; // counters of the last render, ambient occlusion rays included
+    // adds one bounce of indirect diffuse light to StandardShader through an IrradianceCache, see there for the
+    // parameters. the records outlive a render, so the frames of a moving camera reuse them, and are dropped whenever
+    // the surface, lights or background change. the first render of each view fills them over the whole frame, even
+    // for a region, and the frame itself only reads them. dependency tracking leaves indirect light out, since an
+    // interpolated record does not say which surfaces it saw
+    void enableIrradianceCache(int sampleCount, float accuracy, float minRadius, float maxRadius);
+    void disableIrradianceCache();
+    void clearIrradianceCache(); // call after editing the scene in place
+    IrradianceCache::Statistics getIrradianceCacheStatistics() const; // counters since the records were last dropped
+    // adds the light that mirrors throw onto diffuse surfaces. photonCount photons are sent from the lights toward the
+    // mirrors, and every point gathers the nearestPhotonCount nearest to it within maxDistance, see PhotonMap. the
+    // photons are traced on the next render and kept until the surface or lights change. 0 photons, the default, turns
+    // caustics off. like indirect light, dependency tracking leaves them out
+    void setCaustics(int photonCount, int nearestPhotonCount, float maxDistance);
+    size_t getCausticMapSize() const; // the photons kept by the last trace, 0 until one ran
+    // light each point with a light cut of at most maxLightCount lights from a light tree built over the point lights.
+    // see LightTree for what errorBound means
+    void enableLightTree(int maxLightCount, float errorBound);
+    void disableLightTree();
+    // shadow rays first try the surface that last blocked a shadow ray toward the same light
+    void enableOcclusionCache();
+    void disableOcclusionCache();
+    OcclusionCache::Statistics getOcclusionCacheStatistics() const; // counters of the last render
+    // keeps the bvh of every mesh in this directory between runs, so that unchanged meshes are not built again. empty,
+    // the default, builds them in memory on the first render
+    void setAccelerationCacheDirectory(std::string accelerationCacheDirectory);
+    std::string getAccelerationCacheDirectory() const;
+    // remembers which surfaces and ray segments every pixel depended on, so that renderChanges can trace only the
+    // pixels an edit could have changed. while tracking, every render mode traces pixel by pixel like Recursive
+    void enableDependencyTracking();
+    void disableDependencyTracking();
+    // call these after editing the scene in place and before renderChanges. a change to the shading of the
+    // topLevelSurfaceIndex-th surface of the root group, or of the root when it is not a group
+    void markSurfaceChanged(int topLevelSurfaceIndex);
+    // a change to geometry inside bounds. mark both the old and the new bounds of a moved surface
+    void markBoundsChanged(Math::Box const& bounds);
 
-    virtual void render() = 0;
-    virtual std::string computePixelArray() const = 0;
-    void exportToFile(std::string filename) const;
+    void render(); // updates the bitmap. note bitmap(0,0) is at the bottom left of the frame
+    // updates only the pixels in region, or in any of regions. pixels outside the frame are ignored and pixels in more
+    // than one region are traced once
+    void render(Util::PixelRect const& region);
+    void render(std::vector<Util::PixelRect> const& regions);
+    // traces again only the pixels dirtied since the last render, and returns how many. renders the whole frame when
+    // tracking is off or nothing has been tracked yet. new cameras, surfaces and lights dirty every pixel
+    int renderChanges();
+    // renders the pixels in region without touching the bitmap. colors and hits are laid out over region row by row,
+    // hits being false where the view ray missed
+    void computeRegion(Util::PixelRect const& region, std::vector<Util::Color> & colors, std::vector<bool> & hits);
+    std::string computePixelArray() const;
+    // the bitmap over region as bottom up rows of blue, green and red bytes, without padding
+    virtual std::string computePixelArray(Util::PixelRect const& region) const = 0;
+    // encoded by the extension of filename, see ImageEncoder::createForFilename. false, with the reason on
+    // std::cerr, if the file cannot be written
+    bool exportToFile(std::string filename) const;
+    bool exportToFile(std::string filename, Util::PixelRect const& crop) const; // writes only the pixels in crop
+    // hands a copy of the bitmap to writer and returns at once. the scene can render the next frame right away
+    std::future<AsyncImageWriter::Result> exportToFile(AsyncImageWriter & writer, std::string filename) const;
+    // overwrites the pixels in region of a bitmap file the size of the frame, such as an earlier full export. false
+    // if the file is missing or is not an uncompressed 24 bit bitmap of the frame size
+    bool spliceIntoFile(std::string filename, Util::PixelRect const& region) const;
+    virtual void initializeBitmap() = 0; // sizes the bitmap to the camera resolution
+
+    // writes everything needed to render the scene again somewhere else: the camera, surfaces, lights and render
+    // settings. the bitmap and the thread count stay behind
+    void serialize(Serialization::Writer & writer) const;
+    static std::unique_ptr<Scene> deserialize(Serialization::Reader & reader); // NULL if the reader does not hold a scene
 
 protected:
+    friend class TileCoordinator; // assembles the tiles rendered by its workers straight into the bitmap
+    friend class SequenceRenderer; // sizes the frames it hands to its writer thread
+
+
     std::shared_ptr<Surface> surface;
     std::unique_ptr<Camera> camera;
     std::vector<std::unique_ptr<LightSource>> lightSources;
+    RenderMode renderMode = RenderMode::Recursive;
+    int threadCount = Util::defaultThreadCount();
+    int tileSize = 32;
+    Util::TileOrder tileOrder = Util::TileOrder::Hilbert;
+    int samplesPerPixel = 1;
+    Util::SampleSequence sampleSequence = Util::SampleSequence::R2;
+    uint32_t seed = 0;
+    int shadowSamples = 4;
+    int penumbraShadowSamples = 16;
+    int ambientOcclusionSamples = 0;
+    float ambientOcclusionDistance = 1;
+    int ambientOcclusionResolutionDivisor = 1;
+    ShadowRayStatistics shadowRayStatistics;
+    std::unique_ptr<IrradianceCache> irradianceCache;
+    std::string irradianceCacheView; // the camera and sampling the records were last prepared for
+    int causticPhotonCount = 0;
+    int causticNearestPhotons = 50;
+    float causticDistance = 1;
+    std::unique_ptr<PhotonMap> causticMap;
+    bool lightTreeEnabled = false;
+    int lightTreeMaxLightCount = 8;
+    float lightTreeErrorBound = 0.02;
+    bool occlusionCacheEnabled = false;
+    OcclusionCache::Statistics occlusionCacheStatistics;
+    std::string accelerationCacheDirectory;
+    bool dependencyTrackingEnabled = false;
+    DependencyBuffer dependencyBuffer;
+    bool boundsChanged = false; // the surface bounds need updating before the next render
+
+    // stores the color of a pixel in the bitmap. hit is false when the view ray missed the surface
+    virtual void setPixel(int pixelIndexX, int pixelIndexY, Util::Color color, bool hit) = 0;
+    virtual Util::Color computeMissColor() const = 0; // the color of a view ray that missed, for averaging samples
+    Util::Color computeColorAtPixelIndex(const RenderContext & context, int pixelIndexX, int pixelIndexY, bool & hit) const;
+    // writes the subclass type tag followed by its own settings, which deserialize reads before anything else
+    virtual void serializeImageSettings(Serialization::Writer & writer) const = 0;
+
+    // renders the pixels of tile with the render mode. colors and hits are filled in row major order, hits being false
+    // where the view ray missed
+    void computeTile(const RenderContext & context, Util::PixelRect const& tile, std::vector<Util::Color> & colors, std::vector<bool> & hits) const;
+    // intersects every pixel in tile, buckets the hits by shader, and shades each bucket with one shadeBatch call
+    void computeTileBatched(const RenderContext & context, Util::PixelRect const& tile, std::vector<Util::Color> & colors, std::vector<bool> & hits) const;
+    // computeRegion over several disjoint regions at once, with colors and hits laid out over bounds, which holds them
+    // all. traces only the pixels nonzero in tracedPixels, indexed over the frame, when it is not NULL
+    void computeRegions(
+        std::vector<Util::PixelRect> const& regions,
+        Util::PixelRect const& bounds,
+        std::vector<Util::Color> & colors,
+        std::vector<bool> & hits,
+        const std::vector<uint8_t> * tracedPixels
+    );
+    // traces the pixels of tile one by one, recording their dependencies into context. skips pixels as computeRegion
+    void computeTileTracked(const RenderContext & context, Util::PixelRect const& tile, const std::vector<uint8_t> * tracedPixels, std::vector<Util::Color> & colors, std::vector<bool> & hits) const;
+    // fills the irradiance cache for the view of the camera, unless it was filled for it already, and leaves it to be
+    // read by the frame
+    void prepareIrradianceCache(const RenderContext & context);
+    // drops the irradiance records and caustic photons, which a change to the surface or lights makes stale
+    void dropLightCaches();
+    // lets every LodSurface pick its level for the camera, dirtying the pixels of the ones that switched. the light
+    // caches are kept, since the levels are picked to differ by less than a pixel
+    void selectLevelsOfDetail();
 };
 
 class GrayscaleScene : public Scene
@@ -42,13 +215,17 @@ public:
     void setCamera(std::unique_ptr<Camera> camera);
     void setBackgroundColor(uint8_t backgroundColor);
 
-    void render(); // updates the bitmap. note bitmap(0,0) is at the bottom left of the frame
-    std::string computePixelArray() const;
+    using Scene::computePixelArray;
+    std::string computePixelArray(Util::PixelRect const& region) const;
+
+protected:
+    void setPixel(int pixelIndexX, int pixelIndexY, Util::Color color, bool hit);
+    Util::Color computeMissColor() const;
+    void serializeImageSettings(Serialization::Writer & writer) const;
 
 private:
     std::vector<std::vector<uint8_t>> bitmap;
     uint8_t backgroundColor = 0;
-    uint8_t computeValueAtPixelIndex(int pixelIndexX, int pixelIndexY) const;
 };
 
 class RGBScene : public Scene
@@ -62,13 +239,17 @@ public:
     void setCamera(std::unique_ptr<Camera> camera);
     void setBackgroundColor(Util::Color backgroundColor);
 
-    void render();
-    std::string computePixelArray() const;
+    using Scene::computePixelArray;
+    std::string computePixelArray(Util::PixelRect const& region) const;
+
+protected:
+    void setPixel(int pixelIndexX, int pixelIndexY, Util::Color color, bool hit);
+    Util::Color computeMissColor() const;
+    void serializeImageSettings(Serialization::Writer & writer) const;
 
 private:
     std::vector<std::vector<Util::Color>> bitmap;
     Util::Color backgroundColor = { 0, 0, 0 };
-    Util::Color computeValueAtPixelIndex(int pixelIndexX, int pixelIndexY) const;
 };
 
 #endif
@@ -0,0 +1,97 @@
+#include "sceneFile.h"
+#include "serialization.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+    const char MAGIC[8] = { 'G', 'E', 'S', 'C', 'E', 'N', 'E', '\0' };
+    const char * const TEXT_KEYWORD = "gescene";
+
+    bool writeFile(std::string const& filename, std::string const& contents)
+    {
+        std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+        file.write(contents.data(), contents.size());
+        file.close();
+        if (!file)
+        {
+            std::cerr << "Could not write the scene to " << filename << "." << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+bool SceneFile::save(Scene const& scene, std::string filename)
+{
+    Serialization::BinaryWriter writer;
+    writer.writeBytes(MAGIC, sizeof(MAGIC));
+    writer.writeUint32("version", VERSION);
+    writer.writeUint32("reserved", 0); // pads the header to 16 bytes so arrays are aligned to the start of the mapping
+    scene.serialize(writer);
+    return writeFile(filename, writer.getBuffer());
+}
+
+bool SceneFile::saveText(Scene const& scene, std::string filename)
+{
+    Serialization::TextWriter writer;
+    scene.serialize(writer);
+    return writeFile(filename, std::string(TEXT_KEYWORD) + " " + std::to_string(VERSION) + "\n" + writer.getText());
+}
+
+std::unique_ptr<Scene> SceneFile::load(std::string filename)
+{
+    // meshes read from the mapping hold on to it, so it is unmapped once the last of them is gone
+    size_t size;
+    std::shared_ptr<const char> mapping = Serialization::mapFile(filename, size);
+    if (mapping == NULL)
+    {
+        std::cerr << "Could not open the scene file " << filename << "." << std::endl;
+        return NULL;
+    }
+    const char * data = mapping.get();
+
+    if (size < sizeof(MAGIC) || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0)
+    {
+        return SceneFile::loadText(std::string(data, size));
+    }
+
+    Serialization::BinaryReader reader(data, size, mapping);
+    reader.readBytes(sizeof(MAGIC));
+    const uint32_t version = reader.readUint32("version");
+    reader.readUint32("reserved");
+    if (reader.isOk() && version != VERSION)
+    {
+        std::cerr << filename << " is a version " << version << " scene file but only version " << VERSION << " can be read." << std::endl;
+        return NULL;
+    }
+
+    std::unique_ptr<Scene> scene = Scene::deserialize(reader);
+    if (scene == NULL || !reader.isAtEnd())
+    {
+        std::cerr << filename << " is not a valid scene file." << std::endl;
+        return NULL;
+    }
+    return scene;
+}
+
+std::unique_ptr<Scene> SceneFile::loadText(std::string const& text)
+{
+    Serialization::TextReader reader(text);
+    const uint32_t version = reader.readUint32(TEXT_KEYWORD);
+    if (reader.isOk() && version != VERSION)
+    {
+        std::cerr << "This is a version " << version << " scene file but only version " << VERSION << " can be read." << std::endl;
+        return NULL;
+    }
+
+    std::unique_ptr<Scene> scene = Scene::deserialize(reader);
+    if (scene != NULL && !reader.isAtEnd()) { reader.fail(); }
+    if (!reader.isOk())
+    {
+        std::cerr << "Could not read the scene: " << reader.getError() << std::endl;
+        return NULL;
+    }
+    return scene;
+}
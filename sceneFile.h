@@ -0,0 +1,31 @@
+#ifndef SCENE_FILE_HEADER
+#define SCENE_FILE_HEADER
+
+#include <memory>
+#include <string>
+#include "scene.h"
+
+// scenes on disk, so that they can be changed without a recompile.
+//
+// a binary scene file is the 8 byte magic "GESCENE\0", a 4 byte little endian format version, 4 reserved bytes, and
+// then the scene as Scene::serialize writes it through a BinaryWriter. loading maps the file and mesh arrays are used
+// straight from the mapping, so a large mesh costs page faults rather than parsing.
+//
+// a text scene file is the keyword "gescene" and the version, followed by the scene as Scene::serialize writes it
+// through a TextWriter. it is meant for writing scenes by hand and reads back the same as the binary file
+namespace SceneFile
+{
+    const uint32_t VERSION = 8; // 2 added the sampling settings, 3 area lights and soft shadow sample counts, 4 ambient occlusion, 5 the irradiance cache, 6 caustics, 7 textures, 8 levels of detail
+
+    // both return false and say why on std::cerr when the file cannot be written
+    bool save(Scene const& scene, std::string filename);
+    bool saveText(Scene const& scene, std::string filename);
+
+    // reads either kind of file, telling them apart by the magic. NULL, with the reason on std::cerr, when the file
+    // cannot be read or does not hold a scene of this version
+    std::unique_ptr<Scene> load(std::string filename);
+    // reads a scene from the contents of a text scene file
+    std::unique_ptr<Scene> loadText(std::string const& text);
+}
+
+#endif
@@ -0,0 +1,60 @@
+#include "sequence.h"
+#include "imageWriter.h"
+#include <algorithm>
+#include <cstdio>
+#include <future>
+#include <iostream>
+#include <vector>
+
+SequenceRenderer::SequenceRenderer(Scene & scene)
+    : scene(scene) {}
+
+int SequenceRenderer::getMaxFramesInFlight() const
+{
+    return this->maxFramesInFlight;
+}
+
+void SequenceRenderer::setMaxFramesInFlight(int maxFramesInFlight)
+{
+    this->maxFramesInFlight = std::max(1, maxFramesInFlight);
+}
+
+std::string SequenceRenderer::getFileExtension() const
+{
+    return this->fileExtension;
+}
+
+void SequenceRenderer::setFileExtension(std::string const& fileExtension)
+{
+    this->fileExtension = fileExtension;
+}
+
+std::string SequenceRenderer::computeFilename(std::string const& filenamePrefix, int frameIndex, std::string const& fileExtension)
+{
+    char number[16];
+    std::snprintf(number, sizeof(number), "%04d", frameIndex);
+    return filenamePrefix + number + "." + fileExtension;
+}
+
+int SequenceRenderer::render(int frameCount, FrameUpdate updateFrame, std::string const& filenamePrefix)
+{
+    AsyncImageWriter writer(this->maxFramesInFlight);
+    std::vector<std::future<AsyncImageWriter::Result>> writes;
+    writes.reserve(std::max(0, frameCount));
+
+    for (int frameIndex = 0; frameIndex < frameCount; frameIndex++)
+    {
+        if (updateFrame) { updateFrame(this->scene, frameIndex); }
+        this->scene.render();
+        writes.push_back(this->scene.exportToFile(writer, computeFilename(filenamePrefix, frameIndex, this->fileExtension)));
+    }
+
+    int writtenFrameCount = 0;
+    for (auto & write : writes)
+    {
+        const AsyncImageWriter::Result result = write.get();
+        if (result.success) { writtenFrameCount++; }
+        else { std::cerr << "Could not write " << result.error << std::endl; }
+    }
+    return writtenFrameCount;
+}
@@ -0,0 +1,38 @@
+#ifndef SEQUENCE_HEADER
+#define SEQUENCE_HEADER
+
+#include <functional>
+#include <string>
+#include "scene.h"
+
+// renders an animation into numbered image files. an AsyncImageWriter encodes and writes each finished frame while the
+// render thread already updates the scene and traces the next one. at most maxFramesInFlight finished frames wait for
+// the writer, so a slow disk holds the render thread back instead of filling memory
+class SequenceRenderer
+{
+public:
+    // moves the camera, lights and surfaces of scene to where they are in frame frameIndex. runs on the render thread
+    typedef std::function<void(Scene & scene, int frameIndex)> FrameUpdate;
+
+    SequenceRenderer(Scene & scene);
+
+    int getMaxFramesInFlight() const;
+    std::string getFileExtension() const;
+
+    void setMaxFramesInFlight(int maxFramesInFlight); // 2 by default
+    void setFileExtension(std::string const& fileExtension); // picks the ImageEncoder. "bmp" by default
+
+    // renders frames [0, frameCount), calling updateFrame before each, and writes them to computeFilename. returns
+    // how many frames were written, which is short of frameCount only when writes failed. failures go to std::cerr
+    int render(int frameCount, FrameUpdate updateFrame, std::string const& filenamePrefix);
+
+    // filenamePrefix followed by frameIndex in at least four digits, a dot and fileExtension
+    static std::string computeFilename(std::string const& filenamePrefix, int frameIndex, std::string const& fileExtension = "bmp");
+
+private:
+    Scene & scene;
+    int maxFramesInFlight = 2;
+    std::string fileExtension = "bmp";
+};
+
+#endif
@@ -0,0 +1,651 @@
+#include "serialization.h"
+#include <assert.h>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace Serialization;
+
+namespace
+{
+    // arrays start on this boundary so that they can be used in place
+    const size_t ARRAY_ALIGNMENT = 16;
+
+    // arrays wrap in the text format after this many values
+    const size_t TEXT_VALUES_PER_LINE = 12;
+}
+
+bool Reader::isOk() const
+{
+    return this->ok;
+}
+
+void Reader::fail()
+{
+    this->ok = false;
+}
+
+void BinaryWriter::writeUint8(const char *, uint8_t value)
+{
+    this->buffer.push_back((char) value);
+}
+
+void BinaryWriter::writeInt32(const char * name, int32_t value)
+{
+    this->writeUint32(name, (uint32_t) value);
+}
+
+void BinaryWriter::writeUint32(const char *, uint32_t value)
+{
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        this->buffer.push_back((char) ((value >> shift) & 0xff));
+    }
+}
+
+void BinaryWriter::writeFloat(const char * name, float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    this->writeUint32(name, bits);
+}
+
+void BinaryWriter::writeVector3(const char * name, Math::Vector3 const& value)
+{
+    this->writeFloat(name, value.getX());
+    this->writeFloat(name, value.getY());
+    this->writeFloat(name, value.getZ());
+}
+
+void BinaryWriter::writeColor(const char * name, Util::Color const& value)
+{
+    this->writeUint8(name, value.red);
+    this->writeUint8(name, value.green);
+    this->writeUint8(name, value.blue);
+}
+
+void BinaryWriter::writeString(const char * name, std::string const& value)
+{
+    assert (value.size() <= UINT32_MAX);
+    this->writeUint32(name, value.size());
+    this->writeBytes(value.data(), value.size());
+}
+
+void BinaryWriter::writeType(uint8_t tag, const char * const[])
+{
+    this->writeUint8("type", tag);
+}
+
+void BinaryWriter::beginList(const char * name, uint32_t count)
+{
+    this->writeUint32(name, count);
+}
+
+void BinaryWriter::endList() {}
+
+void BinaryWriter::writeFloatArray(const char *, const float * values, size_t count)
+{
+    this->writeArray(values, count, sizeof(float));
+}
+
+void BinaryWriter::writeUint32Array(const char *, const uint32_t * values, size_t count)
+{
+    this->writeArray(values, count, sizeof(uint32_t));
+}
+
+void BinaryWriter::writeArray(const void * values, size_t count, size_t valueSize)
+{
+    // the count is stored in 32 bits, so a longer array would read back as garbage
+    assert (count <= UINT32_MAX);
+    // the padding is written out instead of implied so the reader skips the same bytes wherever the buffer ends up
+    this->writeUint32("count", count);
+    const uint8_t padding = (ARRAY_ALIGNMENT - (this->buffer.size() + 1) % ARRAY_ALIGNMENT) % ARRAY_ALIGNMENT;
+    this->writeUint8("padding", padding);
+    this->buffer.append(padding, (char) 0);
+    this->writeBytes((const char *) values, count * valueSize);
+}
+
+void BinaryWriter::writeBytes(const char * bytes, size_t size)
+{
+    this->buffer.append(bytes, size);
+}
+
+std::string const& BinaryWriter::getBuffer() const
+{
+    return this->buffer;
+}
+
+void BinaryWriter::clear()
+{
+    this->buffer.clear();
+}
+
+BinaryReader::BinaryReader(const char * data, size_t size)
+{
+    this->data = data;
+    this->size = size;
+}
+
+BinaryReader::BinaryReader(std::string const& buffer)
+{
+    this->data = buffer.data();
+    this->size = buffer.size();
+}
+
+BinaryReader::BinaryReader(const char * data, size_t size, std::shared_ptr<const void> owner)
+{
+    this->data = data;
+    this->size = size;
+    this->owner = owner;
+}
+
+uint8_t BinaryReader::readUint8(const char *)
+{
+    const char * bytes = this->readBytes(1);
+    if (bytes == NULL) { return 0; }
+    return (uint8_t) bytes[0];
+}
+
+int32_t BinaryReader::readInt32(const char * name)
+{
+    return (int32_t) this->readUint32(name);
+}
+
+uint32_t BinaryReader::readUint32(const char *)
+{
+    const char * bytes = this->readBytes(4);
+    if (bytes == NULL) { return 0; }
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        value |= ((uint32_t) (uint8_t) bytes[i]) << (8 * i);
+    }
+    return value;
+}
+
+float BinaryReader::readFloat(const char * name)
+{
+    const uint32_t bits = this->readUint32(name);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+Math::Vector3 BinaryReader::readVector3(const char * name)
+{
+    const float x = this->readFloat(name);
+    const float y = this->readFloat(name);
+    const float z = this->readFloat(name);
+    return { x, y, z };
+}
+
+Util::Color BinaryReader::readColor(const char * name)
+{
+    const uint8_t red = this->readUint8(name);
+    const uint8_t green = this->readUint8(name);
+    const uint8_t blue = this->readUint8(name);
+    return { red, green, blue };
+}
+
+std::string BinaryReader::readString(const char * name)
+{
+    const uint32_t size = this->readUint32(name);
+    const char * bytes = this->readBytes(size);
+    return bytes == NULL ? std::string() : std::string(bytes, size);
+}
+
+uint8_t BinaryReader::readType(const char * const[], size_t typeCount)
+{
+    const uint8_t tag = this->readUint8("type");
+    if (tag == 0 || tag >= typeCount)
+    {
+        this->fail();
+        return 0;
+    }
+    return tag;
+}
+
+void BinaryReader::beginList(const char * name)
+{
+    this->listCounts.push_back(this->readUint32(name));
+}
+
+bool BinaryReader::nextInList()
+{
+    if (!this->ok || this->listCounts.empty()) { return false; }
+    if (this->listCounts.back() == 0)
+    {
+        this->listCounts.pop_back();
+        return false;
+    }
+    this->listCounts.back()--;
+    return true;
+}
+
+std::shared_ptr<const float> BinaryReader::readFloatArray(const char *, size_t & count)
+{
+    const float * values = (const float *) this->readArray(count, sizeof(float));
+    if (values == NULL) { return NULL; }
+    if (this->owner != NULL && ((uintptr_t) values) % alignof(float) == 0)
+    {
+        return std::shared_ptr<const float>(this->owner, values);
+    }
+
+    std::shared_ptr<float> copy(new float[count], std::default_delete<float[]>());
+    std::memcpy(copy.get(), values, count * sizeof(float));
+    return copy;
+}
+
+std::shared_ptr<const uint32_t> BinaryReader::readUint32Array(const char *, size_t & count)
+{
+    const uint32_t * values = (const uint32_t *) this->readArray(count, sizeof(uint32_t));
+    if (values == NULL) { return NULL; }
+    if (this->owner != NULL && ((uintptr_t) values) % alignof(uint32_t) == 0)
+    {
+        return std::shared_ptr<const uint32_t>(this->owner, values);
+    }
+
+    std::shared_ptr<uint32_t> copy(new uint32_t[count], std::default_delete<uint32_t[]>());
+    std::memcpy(copy.get(), values, count * sizeof(uint32_t));
+    return copy;
+}
+
+const void * BinaryReader::readArray(size_t & count, size_t valueSize)
+{
+    count = this->readUint32("count");
+    const uint8_t padding = this->readUint8("padding");
+    this->readBytes(padding);
+    if (count > (this->size - this->position) / valueSize) { this->fail(); }
+    if (!this->ok)
+    {
+        count = 0;
+        return NULL;
+    }
+
+    return this->readBytes(count * valueSize);
+}
+
+const char * BinaryReader::readBytes(size_t size)
+{
+    if (!this->ok || size > this->size - this->position)
+    {
+        this->fail();
+        return NULL;
+    }
+    const char * bytes = this->data + this->position;
+    this->position += size;
+    return bytes;
+}
+
+bool BinaryReader::isAtEnd() const
+{
+    return this->position == this->size;
+}
+
+void TextWriter::writeUint8(const char * name, uint8_t value)
+{
+    this->text << " " << name << " " << (int) value;
+}
+
+void TextWriter::writeInt32(const char * name, int32_t value)
+{
+    this->text << " " << name << " " << value;
+}
+
+void TextWriter::writeUint32(const char * name, uint32_t value)
+{
+    this->text << " " << name << " " << value;
+}
+
+void TextWriter::writeFloat(const char * name, float value)
+{
+    this->text << " " << name << " ";
+    this->writeNumber(value);
+}
+
+void TextWriter::writeVector3(const char * name, Math::Vector3 const& value)
+{
+    this->text << " " << name << " ";
+    this->writeNumber(value.getX());
+    this->text << " ";
+    this->writeNumber(value.getY());
+    this->text << " ";
+    this->writeNumber(value.getZ());
+}
+
+void TextWriter::writeColor(const char * name, Util::Color const& value)
+{
+    this->text << " " << name << " " << (int) value.red << " " << (int) value.green << " " << (int) value.blue;
+}
+
+void TextWriter::writeString(const char * name, std::string const& value)
+{
+    // quoted, so that it may hold blanks and #. quotes, backslashes and line breaks inside are escaped
+    this->text << " " << name << " \"";
+    for (char c : value)
+    {
+        if (c == '"' || c == '\\') { this->text << '\\' << c; }
+        else if (c == '\n') { this->text << "\\n"; }
+        else { this->text << c; }
+    }
+    this->text << "\"";
+}
+
+void TextWriter::writeType(uint8_t tag, const char * const typeNames[])
+{
+    this->newLine();
+    this->text << typeNames[tag];
+}
+
+void TextWriter::beginList(const char * name, uint32_t)
+{
+    this->text << " " << name << " {";
+    this->depth++;
+}
+
+void TextWriter::endList()
+{
+    this->depth--;
+    this->newLine();
+    this->text << "}";
+}
+
+void TextWriter::writeFloatArray(const char * name, const float * values, size_t count)
+{
+    this->text << " " << name << " [";
+    this->depth++;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i % TEXT_VALUES_PER_LINE == 0) { this->newLine(); }
+        else { this->text << " "; }
+        this->writeNumber(values[i]);
+    }
+    this->depth--;
+    this->newLine();
+    this->text << "]";
+}
+
+void TextWriter::writeUint32Array(const char * name, const uint32_t * values, size_t count)
+{
+    this->text << " " << name << " [";
+    this->depth++;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i % TEXT_VALUES_PER_LINE == 0) { this->newLine(); }
+        else { this->text << " "; }
+        this->text << values[i];
+    }
+    this->depth--;
+    this->newLine();
+    this->text << "]";
+}
+
+std::string TextWriter::getText() const
+{
+    return this->text.str() + "\n";
+}
+
+void TextWriter::newLine()
+{
+    if (this->text.tellp() > 0) { this->text << "\n"; }
+    this->text << std::string(4 * this->depth, ' ');
+}
+
+void TextWriter::writeNumber(float value)
+{
+    for (int precision = 6; precision <= 9; precision++)
+    {
+        std::ostringstream number;
+        number.precision(precision);
+        number << value;
+        if (precision == 9 || std::strtof(number.str().c_str(), NULL) == value)
+        {
+            this->text << number.str();
+            return;
+        }
+    }
+}
+
+TextReader::TextReader(std::string const& text)
+{
+    this->text = text;
+}
+
+uint8_t TextReader::readUint8(const char * name)
+{
+    this->expect(name);
+    return (uint8_t) this->readNumber(0, 255);
+}
+
+int32_t TextReader::readInt32(const char * name)
+{
+    this->expect(name);
+    return (int32_t) this->readNumber(std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max());
+}
+
+uint32_t TextReader::readUint32(const char * name)
+{
+    this->expect(name);
+    return (uint32_t) this->readNumber(0, std::numeric_limits<uint32_t>::max());
+}
+
+float TextReader::readFloat(const char * name)
+{
+    this->expect(name);
+    return (float) this->readNumber(-std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity());
+}
+
+Math::Vector3 TextReader::readVector3(const char * name)
+{
+    this->expect(name);
+    const double infinity = std::numeric_limits<double>::infinity();
+    const float x = (float) this->readNumber(-infinity, infinity);
+    const float y = (float) this->readNumber(-infinity, infinity);
+    const float z = (float) this->readNumber(-infinity, infinity);
+    return { x, y, z };
+}
+
+Util::Color TextReader::readColor(const char * name)
+{
+    this->expect(name);
+    const uint8_t red = (uint8_t) this->readNumber(0, 255);
+    const uint8_t green = (uint8_t) this->readNumber(0, 255);
+    const uint8_t blue = (uint8_t) this->readNumber(0, 255);
+    return { red, green, blue };
+}
+
+std::string TextReader::readString(const char * name)
+{
+    this->expect(name);
+    if (!this->ok) { return std::string(); }
+    this->skipBlanks();
+    if (this->position >= this->text.size() || this->text[this->position] != '"')
+    {
+        this->fail();
+        this->error = "line " + std::to_string(this->line) + ": expected a quoted string";
+        return std::string();
+    }
+
+    std::string value;
+    for (this->position++; this->position < this->text.size(); this->position++)
+    {
+        char c = this->text[this->position];
+        if (c == '"')
+        {
+            this->position++;
+            return value;
+        }
+        if (c == '\n') { this->line++; }
+        if (c == '\\' && this->position + 1 < this->text.size())
+        {
+            c = this->text[++this->position];
+            if (c == 'n') { c = '\n'; }
+        }
+        value.push_back(c);
+    }
+    this->fail();
+    this->error = "line " + std::to_string(this->line) + ": unexpected end of input in a string";
+    return std::string();
+}
+
+uint8_t TextReader::readType(const char * const typeNames[], size_t typeCount)
+{
+    const std::string token = this->nextToken();
+    for (size_t tag = 1; tag < typeCount && this->ok; tag++)
+    {
+        if (token == typeNames[tag]) { return tag; }
+    }
+    this->fail();
+    return 0;
+}
+
+void TextReader::beginList(const char * name)
+{
+    this->expect(name);
+    this->expect("{");
+}
+
+bool TextReader::nextInList()
+{
+    if (!this->ok) { return false; }
+    if (this->peekToken() != "}") { return true; }
+    this->nextToken();
+    return false;
+}
+
+std::shared_ptr<const float> TextReader::readFloatArray(const char * name, size_t & count)
+{
+    this->expect(name);
+    this->expect("[");
+    std::vector<float> values;
+    const double infinity = std::numeric_limits<double>::infinity();
+    while (this->ok && this->peekToken() != "]")
+    {
+        values.push_back((float) this->readNumber(-infinity, infinity));
+    }
+    this->expect("]");
+
+    count = this->ok ? values.size() : 0;
+    std::shared_ptr<float> array(new float[count], std::default_delete<float[]>());
+    std::copy(values.begin(), values.begin() + count, array.get());
+    return array;
+}
+
+std::shared_ptr<const uint32_t> TextReader::readUint32Array(const char * name, size_t & count)
+{
+    this->expect(name);
+    this->expect("[");
+    std::vector<uint32_t> values;
+    while (this->ok && this->peekToken() != "]")
+    {
+        values.push_back((uint32_t) this->readNumber(0, std::numeric_limits<uint32_t>::max()));
+    }
+    this->expect("]");
+
+    count = this->ok ? values.size() : 0;
+    std::shared_ptr<uint32_t> array(new uint32_t[count], std::default_delete<uint32_t[]>());
+    std::copy(values.begin(), values.begin() + count, array.get());
+    return array;
+}
+
+void TextReader::fail()
+{
+    if (this->ok) { this->error = "line " + std::to_string(this->line) + ": unexpected input"; }
+    Reader::fail();
+}
+
+bool TextReader::isAtEnd()
+{
+    return this->peekToken().empty();
+}
+
+std::string TextReader::getError() const
+{
+    return this->error;
+}
+
+void TextReader::skipBlanks()
+{
+    while (this->position < this->text.size())
+    {
+        const char c = this->text[this->position];
+        if (c == '#')
+        {
+            while (this->position < this->text.size() && this->text[this->position] != '\n') { this->position++; }
+        }
+        else if (std::isspace((unsigned char) c))
+        {
+            if (c == '\n') { this->line++; }
+            this->position++;
+        }
+        else { break; }
+    }
+}
+
+std::string TextReader::nextToken()
+{
+    this->skipBlanks();
+    const size_t start = this->position;
+    while (this->position < this->text.size() && !std::isspace((unsigned char) this->text[this->position]) && this->text[this->position] != '#')
+    {
+        this->position++;
+    }
+    return this->text.substr(start, this->position - start);
+}
+
+std::string TextReader::peekToken()
+{
+    const size_t position = this->position;
+    const int line = this->line;
+    const std::string token = this->nextToken();
+    this->position = position;
+    this->line = line;
+    return token;
+}
+
+void TextReader::expect(const char * token)
+{
+    if (!this->ok) { return; }
+    const std::string found = this->nextToken();
+    if (found == token) { return; }
+    this->fail();
+    this->error = "line " + std::to_string(this->line) + ": expected '" + token + "' but found '" + found + "'";
+}
+
+double TextReader::readNumber(double min, double max)
+{
+    if (!this->ok) { return 0; }
+    const std::string token = this->nextToken();
+    char * end = NULL;
+    const double value = std::strtod(token.c_str(), &end);
+    if (token.empty() || *end != '\0' || std::isnan(value) || value < min || value > max)
+    {
+        this->fail();
+        if (token.empty()) { this->error = "line " + std::to_string(this->line) + ": unexpected end of input"; }
+        else { this->error = "line " + std::to_string(this->line) + ": '" + token + "' is not a valid number here"; }
+        return 0;
+    }
+    return value;
+}
+
+std::shared_ptr<const char> Serialization::mapFile(std::string const& filename, size_t & size)
+{
+    size = 0;
+    const int file = open(filename.c_str(), O_RDONLY);
+    if (file < 0) { return NULL; }
+    struct stat status;
+    const bool hasSize = fstat(file, &status) == 0 && status.st_size > 0;
+    void * mapping = hasSize ? mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+    close(file); // the mapping stays valid without the descriptor
+    if (mapping == MAP_FAILED) { return NULL; }
+
+    size = status.st_size;
+    const size_t mappingSize = size;
+    return std::shared_ptr<const char>((const char *) mapping, [mappingSize](const char * mapping) { munmap((void *) mapping, mappingSize); });
+}
@@ -0,0 +1,198 @@
+#ifndef SERIALIZATION_HEADER
+#define SERIALIZATION_HEADER
+
+#include <stdint.h>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "math.h"
+#include "util.h"
+
+// objects describe themselves once through a Writer and read themselves back through a Reader, and the format is picked
+// by the writer and reader in use: a compact binary one for files and sockets, and a text one for people.
+// every value has a name. the binary format ignores it, the text format writes it before the value and expects it back
+namespace Serialization
+{
+    class Writer
+    {
+    public:
+        virtual ~Writer() {}
+
+        virtual void writeUint8(const char * name, uint8_t value) = 0;
+        virtual void writeInt32(const char * name, int32_t value) = 0;
+        virtual void writeUint32(const char * name, uint32_t value) = 0;
+        virtual void writeFloat(const char * name, float value) = 0;
+        virtual void writeVector3(const char * name, Math::Vector3 const& value) = 0;
+        virtual void writeColor(const char * name, Util::Color const& value) = 0;
+        virtual void writeString(const char * name, std::string const& value) = 0;
+        // starts an object. typeNames[tag] is the keyword the text format uses for it
+        virtual void writeType(uint8_t tag, const char * const typeNames[]) = 0;
+        // a list of count objects or values, closed by endList
+        virtual void beginList(const char * name, uint32_t count) = 0;
+        virtual void endList() = 0;
+        // the binary format keeps the values aligned so that a mapped file can be read in place. count must fit in 32 bits
+        virtual void writeFloatArray(const char * name, const float * values, size_t count) = 0;
+        virtual void writeUint32Array(const char * name, const uint32_t * values, size_t count) = 0;
+    };
+
+    // reading past the end or finding a value that makes no sense marks the reader as failed, after which every read
+    // returns zero. callers check isOk() once they are done instead of after every read
+    class Reader
+    {
+    public:
+        virtual ~Reader() {}
+
+        virtual uint8_t readUint8(const char * name) = 0;
+        virtual int32_t readInt32(const char * name) = 0;
+        virtual uint32_t readUint32(const char * name) = 0;
+        virtual float readFloat(const char * name) = 0;
+        virtual Math::Vector3 readVector3(const char * name) = 0;
+        virtual Util::Color readColor(const char * name) = 0;
+        virtual std::string readString(const char * name) = 0;
+        // the tag of the next object, or 0 after failing when it is not one of the typeCount entries of typeNames
+        virtual uint8_t readType(const char * const typeNames[], size_t typeCount) = 0;
+        virtual void beginList(const char * name) = 0;
+        virtual bool nextInList() = 0; // false once the list is over
+        // the returned arrays may point straight into the data being read, which they then keep alive
+        virtual std::shared_ptr<const float> readFloatArray(const char * name, size_t & count) = 0;
+        virtual std::shared_ptr<const uint32_t> readUint32Array(const char * name, size_t & count) = 0;
+
+        bool isOk() const;
+        virtual void fail();
+
+    protected:
+        bool ok = true;
+    };
+
+    // little endian
+    class BinaryWriter : public Writer
+    {
+    public:
+        void writeUint8(const char * name, uint8_t value);
+        void writeInt32(const char * name, int32_t value);
+        void writeUint32(const char * name, uint32_t value);
+        void writeFloat(const char * name, float value);
+        void writeVector3(const char * name, Math::Vector3 const& value);
+        void writeColor(const char * name, Util::Color const& value);
+        void writeString(const char * name, std::string const& value);
+        void writeType(uint8_t tag, const char * const typeNames[]);
+        void beginList(const char * name, uint32_t count);
+        void endList();
+        void writeFloatArray(const char * name, const float * values, size_t count);
+        void writeUint32Array(const char * name, const uint32_t * values, size_t count);
+        void writeBytes(const char * bytes, size_t size);
+
+        std::string const& getBuffer() const;
+        void clear();
+
+    private:
+        std::string buffer;
+
+        void writeArray(const void * values, size_t count, size_t valueSize);
+    };
+
+    class BinaryReader : public Reader
+    {
+    public:
+        // arrays are copied out of data, which only has to outlive the reader
+        BinaryReader(const char * data, size_t size);
+        BinaryReader(std::string const& buffer);
+        // arrays point into data and keep owner alive, so data must stay put for as long as owner lives
+        BinaryReader(const char * data, size_t size, std::shared_ptr<const void> owner);
+
+        uint8_t readUint8(const char * name);
+        int32_t readInt32(const char * name);
+        uint32_t readUint32(const char * name);
+        float readFloat(const char * name);
+        Math::Vector3 readVector3(const char * name);
+        Util::Color readColor(const char * name);
+        std::string readString(const char * name);
+        uint8_t readType(const char * const typeNames[], size_t typeCount);
+        void beginList(const char * name);
+        bool nextInList();
+        std::shared_ptr<const float> readFloatArray(const char * name, size_t & count);
+        std::shared_ptr<const uint32_t> readUint32Array(const char * name, size_t & count);
+        const char * readBytes(size_t size); // points into the data. NULL when fewer than size bytes are left
+
+        bool isAtEnd() const;
+
+    private:
+        const char * data;
+        size_t size;
+        size_t position = 0;
+        std::shared_ptr<const void> owner;
+        std::vector<uint32_t> listCounts; // items left in every open list, innermost last
+
+        const void * readArray(size_t & count, size_t valueSize);
+    };
+
+    // one object per line, fields as "name value" pairs after the type keyword, and lists in braces
+    class TextWriter : public Writer
+    {
+    public:
+        void writeUint8(const char * name, uint8_t value);
+        void writeInt32(const char * name, int32_t value);
+        void writeUint32(const char * name, uint32_t value);
+        void writeFloat(const char * name, float value);
+        void writeVector3(const char * name, Math::Vector3 const& value);
+        void writeColor(const char * name, Util::Color const& value);
+        void writeString(const char * name, std::string const& value);
+        void writeType(uint8_t tag, const char * const typeNames[]);
+        void beginList(const char * name, uint32_t count);
+        void endList();
+        void writeFloatArray(const char * name, const float * values, size_t count);
+        void writeUint32Array(const char * name, const uint32_t * values, size_t count);
+
+        std::string getText() const;
+
+    private:
+        std::ostringstream text;
+        int depth = 0;
+
+        void newLine();
+        void writeNumber(float value); // the shortest form that reads back as the same float
+    };
+
+    // reads what a TextWriter wrote. fields have to come in the order the writer puts them, and # starts a comment
+    class TextReader : public Reader
+    {
+    public:
+        TextReader(std::string const& text);
+
+        uint8_t readUint8(const char * name);
+        int32_t readInt32(const char * name);
+        uint32_t readUint32(const char * name);
+        float readFloat(const char * name);
+        Math::Vector3 readVector3(const char * name);
+        Util::Color readColor(const char * name);
+        std::string readString(const char * name);
+        uint8_t readType(const char * const typeNames[], size_t typeCount);
+        void beginList(const char * name);
+        bool nextInList();
+        std::shared_ptr<const float> readFloatArray(const char * name, size_t & count);
+        std::shared_ptr<const uint32_t> readUint32Array(const char * name, size_t & count);
+        void fail();
+
+        bool isAtEnd();
+        std::string getError() const; // where reading first went wrong, empty while isOk()
+
+    private:
+        std::string text;
+        size_t position = 0;
+        int line = 1;
+        std::string error;
+
+        void skipBlanks(); // and comments
+        std::string nextToken();
+        std::string peekToken();
+        void expect(const char * token);
+        double readNumber(double min, double max);
+    };
+
+    // maps a whole file read only, for a BinaryReader to read in place. the mapping goes away with the last copy of the
+    // returned pointer, which is NULL when the file cannot be opened or is empty
+    std::shared_ptr<const char> mapFile(std::string const& filename, size_t & size);
+};
+
+#endif
@@ -1,12 +1,109 @@
 #include "shader.h"
 #include "util.h"
 #include "hittable.h"
+#include "dependencyBuffer.h"
+#include "irradianceCache.h"
+#include "texture.h"
 #include <cmath>
 #include <iostream>
 
 // TODO: make render distance settable
 const float EPSILON = 0.0001;
 
+namespace
+{
+    // type tags of the serialized shaders
+    const uint8_t STATIC_COLOR_SHADER = 1;
+    const uint8_t LAMBERT_SHADER = 2;
+    const uint8_t BLINN_PHONG_SHADER = 3;
+    const uint8_t STANDARD_SHADER = 4;
+    const uint8_t MIRROR_SHADER = 5;
+    // the keywords of the text format, indexed by type tag
+    const char * const SHADER_TYPE_NAMES[] = { "", "staticColorShader", "lambertShader", "blinnPhongShader", "standardShader", "mirrorShader" };
+    const size_t SHADER_TYPE_COUNT = sizeof(SHADER_TYPE_NAMES) / sizeof(SHADER_TYPE_NAMES[0]);
+}
+
+Util::Color Shader::computeColor(const RenderContext &context, Math::Ray viewRay, std::shared_ptr<Renderable> surface, std::shared_ptr<Util::HitRecord> hitRecord) const
+{
+    const bool hit = surface->hit(viewRay, 0, std::numeric_limits<float>::max(), hitRecord);
+    if (context.dependencies != NULL)
+    {
+        context.dependencies->recordRay(viewRay, 0, hit ? hitRecord->intersectionTime : std::numeric_limits<float>::max());
+    }
+    if (!hit) {
+        hitRecord->intersectionTime = -1;
+        return { 0, 0, 0 };
+    }
+    return this->shade(context, viewRay, surface, hitRecord);
+}
+
+void Shader::shadeBatch(const RenderContext &context, const std::vector<Math::Ray> &viewRays, std::shared_ptr<Renderable> surface, const std::vector<Util::HitRecord> &hitRecords, std::vector<Util::Color> &colors) const
+{
+    std::shared_ptr<Util::HitRecord> hitRecord(new Util::HitRecord);
+    for (size_t i = 0; i < hitRecords.size(); i++)
+    {
+        *hitRecord = hitRecords.at(i);
+        colors.at(i) = this->shade(context, viewRays.at(i), surface, hitRecord);
+    }
+}
+
+void Shader::emitRays(const RenderContext &context, std::shared_ptr<Renderable> surface, const Wavefront::PathRay &pathRay, const Util::HitRecord &hitRecord, Wavefront::RayQueues &queues) const
+{
+    std::shared_ptr<Util::HitRecord> shadedHitRecord(new Util::HitRecord(hitRecord));
+    const Util::Color color = this->shade(context, pathRay.ray, surface, shadedHitRecord);
+    queues.contributions.push_back({ pathRay.pixelIndex, pathRay.weight * color.red, pathRay.weight * color.green, pathRay.weight * color.blue });
+}
+
+std::unique_ptr<Shader> Shader::deserialize(Serialization::Reader & reader)
+{
+    std::unique_ptr<Shader> shader;
+    const uint8_t type = reader.readType(SHADER_TYPE_NAMES, SHADER_TYPE_COUNT);
+    if (type == STATIC_COLOR_SHADER)
+    {
+        shader = std::unique_ptr<Shader>(new StaticColorShader(reader.readColor("surfaceColor")));
+    }
+    else if (type == LAMBERT_SHADER)
+    {
+        shader = std::unique_ptr<Shader>(new LambertShader(reader.readColor("surfaceColor")));
+    }
+    else if (type == BLINN_PHONG_SHADER)
+    {
+        const float phongExponent = reader.readFloat("phongExponent");
+        shader = std::unique_ptr<Shader>(new BlinnPhongShader(phongExponent, reader.readColor("specularColor")));
+    }
+    else if (type == STANDARD_SHADER)
+    {
+        const float ambientIntensity = reader.readFloat("ambientIntensity");
+        const Util::Color ambientColor = reader.readColor("ambientColor");
+        const float phongExponent = reader.readFloat("phongExponent");
+        const Util::Color surfaceColor = reader.readColor("surfaceColor");
+        const Util::Color specularColor = reader.readColor("specularColor");
+        StandardShader * standardShader = new StandardShader(ambientIntensity, ambientColor, phongExponent, surfaceColor, specularColor);
+        shader = std::unique_ptr<Shader>(standardShader);
+        // textures named in scene files share one tile cache. one that cannot be opened stays, so that the scene
+        // is written back as it was read, but shades black
+        auto openTexture = [](std::string const& filename) -> std::shared_ptr<const Texture>
+        {
+            if (filename.empty()) { return NULL; }
+            std::shared_ptr<const Texture> texture(new Texture(filename, TileCache::getShared()));
+            if (!texture->isOk()) { std::cerr << "Could not open the texture " << filename << "." << std::endl; }
+            return texture;
+        };
+        standardShader->setSurfaceTexture(openTexture(reader.readString("surfaceTexture")));
+        standardShader->setSpecularTexture(openTexture(reader.readString("specularTexture")));
+    }
+    else if (type == MIRROR_SHADER)
+    {
+        const Util::Color backgroundColor = reader.readColor("backgroundColor");
+        const Util::Color specularColor = reader.readColor("specularColor");
+        shader = std::unique_ptr<Shader>(new MirrorShader(backgroundColor, specularColor, reader.readFloat("specularWeight")));
+    }
+
+    if (shader == NULL) { reader.fail(); }
+    if (!reader.isOk()) { return NULL; }
+    return shader;
+}
+
 StaticColorShader::StaticColorShader()
 {
     this->surfaceColor = { 0, 0, 0 };
@@ -27,39 +124,58 @@ void StaticColorShader::setSurfaceColor(Util::Color surfaceColor)
     this->surfaceColor = surfaceColor;
 }
 
-Util::Color StaticColorShader::computeColor(const std::vector<std::unique_ptr<LightSource>> &lightSources, Math::Ray viewRay, std::shared_ptr<Renderable> surface, std::shared_ptr<Util::HitRecord> hitRecord) const
+Util::Color StaticColorShader::shade(const RenderContext &, Math::Ray, std::shared_ptr<Renderable>, std::shared_ptr<Util::HitRecord>) const
 {
-    if (!surface->hit(viewRay, 0, std::numeric_limits<float>::max(), hitRecord)) {
-        hitRecord->intersectionTime = -1;
-        return { 0, 0, 0};
-    }
     return this->surfaceColor;
 }
 
+void StaticColorShader::serialize(Serialization::Writer & writer) const
+{
+    writer.writeType(STATIC_COLOR_SHADER, SHADER_TYPE_NAMES);
+    writer.writeColor("surfaceColor", this->surfaceColor);
+}
+
 LambertShader::LambertShader() {}
 
 LambertShader::LambertShader(Util::Color surfaceColor)
     : StaticColorShader::StaticColorShader(surfaceColor) {}
 
-Util::Color LambertShader::computeColor(const std::vector<std::unique_ptr<LightSource>> &lightSources, Math::Ray viewRay, std::shared_ptr<Renderable> surface, std::shared_ptr<Util::HitRecord> hitRecord) const
+Util::Color LambertShader::shade(const RenderContext &context, Math::Ray viewRay, std::shared_ptr<Renderable>, std::shared_ptr<Util::HitRecord> hitRecord) const
 {
-    if (!surface->hit(viewRay, 0, std::numeric_limits<float>::max(), hitRecord)) {
-        hitRecord->intersectionTime = -1;
-        return { 0, 0, 0 };
-    }
-    float scalingFactor = 0;
-    for (auto & lightSource : lightSources)
+    const LightTable &lightTable = context.lightTable;
+    float red = 0, green = 0, blue = 0;
+    Math::Vector3 l;
+    float distance;
+    std::vector<LightTree::SelectedLight> selectedLights;
+    context.selectLights(hitRecord->intersectionPoint, hitRecord->unitNormal, selectedLights);
+    for (auto & selectedLight : selectedLights)
     {
-        scalingFactor += lightSource->getIntensity() * std::max((float) 0, Math::dot(hitRecord->unitNormal, -lightSource->getLightDirectionToSurfacePoint(hitRecord->intersectionPoint)));
+        const int i = selectedLight.lightIndex;
+        lightTable.directionToLight(i, hitRecord->intersectionPoint, l, distance);
+        const float scalingFactor = selectedLight.intensityScale * std::max((float) 0, Math::dot(hitRecord->unitNormal, l));
+        red += lightTable.red[i] * scalingFactor;
+        green += lightTable.green[i] * scalingFactor;
+        blue += lightTable.blue[i] * scalingFactor;
     }
-    
+    float causticLight[3] = { 0, 0, 0 };
+    context.addCausticLight(hitRecord->intersectionPoint, hitRecord->unitNormal, viewRay.direction, causticLight);
+    red += causticLight[0];
+    green += causticLight[1];
+    blue += causticLight[2];
+
     return {
-        (uint8_t) std::min(255, (int) std::floor(this->surfaceColor.red * scalingFactor)),
-        (uint8_t) std::min(255, (int) std::floor(this->surfaceColor.green * scalingFactor)),
-        (uint8_t) std::min(255, (int) std::floor(this->surfaceColor.blue * scalingFactor))
+        (uint8_t) std::min(255, (int) std::floor(this->surfaceColor.red * red)),
+        (uint8_t) std::min(255, (int) std::floor(this->surfaceColor.green * green)),
+        (uint8_t) std::min(255, (int) std::floor(this->surfaceColor.blue * blue))
     };
 }
 
+void LambertShader::serialize(Serialization::Writer & writer) const
+{
+    writer.writeType(LAMBERT_SHADER, SHADER_TYPE_NAMES);
+    writer.writeColor("surfaceColor", this->surfaceColor);
+}
+
 BlinnPhongShader::BlinnPhongShader()
 {
     this->phongExponent = 1;
@@ -104,28 +220,40 @@ void BlinnPhongShader::setSpecularColor(Util::Color specularColor)
     this->specularColor = specularColor;
 }
 
-Util::Color BlinnPhongShader::computeColor(const std::vector<std::unique_ptr<LightSource>> &lightSources, Math::Ray viewRay, std::shared_ptr<Renderable> surface, std::shared_ptr<Util::HitRecord> hitRecord) const
+Util::Color BlinnPhongShader::shade(const RenderContext &context, Math::Ray viewRay, std::shared_ptr<Renderable>, std::shared_ptr<Util::HitRecord> hitRecord) const
 {
-    if (!surface->hit(viewRay, 0, std::numeric_limits<float>::max(), hitRecord)) {
-        hitRecord->intersectionTime = -1;
-        return { 0, 0, 0 };
-    }
-    float scalingFactor = 0;
+    const LightTable &lightTable = context.lightTable;
+    float red = 0, green = 0, blue = 0;
     Math::Vector3 v = viewRay.direction / viewRay.direction.norm();
-    Math::Vector3 h;
+    Math::Vector3 h, l;
+    float distance;
 
-    for (auto & lightSource : lightSources)
+    std::vector<LightTree::SelectedLight> selectedLights;
+    context.selectLights(hitRecord->intersectionPoint, hitRecord->unitNormal, selectedLights);
+    for (auto & selectedLight : selectedLights)
     {
-        h = (-v - lightSource->getLightDirectionToSurfacePoint(hitRecord->intersectionPoint));
-        scalingFactor += lightSource->getIntensity() * std::pow(std::max(0.0f, Math::dot(hitRecord->unitNormal, h / h.norm())), this->phongExponent);
+        const int i = selectedLight.lightIndex;
+        lightTable.directionToLight(i, hitRecord->intersectionPoint, l, distance);
+        h = (-v + l);
+        const float scalingFactor = selectedLight.intensityScale * std::pow(std::max(0.0f, Math::dot(hitRecord->unitNormal, h / h.norm())), this->phongExponent);
+        red += lightTable.red[i] * scalingFactor;
+        green += lightTable.green[i] * scalingFactor;
+        blue += lightTable.blue[i] * scalingFactor;
     }
     return {
-        (uint8_t) std::min(255, (int) std::floor(this->specularColor.red * scalingFactor)),
-        (uint8_t) std::min(255, (int) std::floor(this->specularColor.green * scalingFactor)),
-        (uint8_t) std::min(255, (int) std::floor(this->specularColor.blue * scalingFactor))
+        (uint8_t) std::min(255, (int) std::floor(this->specularColor.red * red)),
+        (uint8_t) std::min(255, (int) std::floor(this->specularColor.green * green)),
+        (uint8_t) std::min(255, (int) std::floor(this->specularColor.blue * blue))
     };
 }
 
+void BlinnPhongShader::serialize(Serialization::Writer & writer) const
+{
+    writer.writeType(BLINN_PHONG_SHADER, SHADER_TYPE_NAMES);
+    writer.writeFloat("phongExponent", this->phongExponent);
+    writer.writeColor("specularColor", this->specularColor);
+}
+
 StandardShader::StandardShader()
 {
     this->surfaceColor = { 255, 255, 255 };
@@ -196,6 +324,16 @@ Util::Color StandardShader::getAmbientColor() const
     return this->ambientColor;
 }
 
+std::shared_ptr<const Texture> StandardShader::getSurfaceTexture() const
+{
+    return this->surfaceTexture;
+}
+
+std::shared_ptr<const Texture> StandardShader::getSpecularTexture() const
+{
+    return this->specularTexture;
+}
+
 void StandardShader::setAmbientIntensity(float ambientIntensity)
 {
     this->ambientIntensity = ambientIntensity;
@@ -221,50 +359,253 @@ void StandardShader::setAmbientColor(Util::Color ambientColor)
     this->ambientColor = ambientColor;
 }
 
-Util::Color StandardShader::computeColor(const std::vector<std::unique_ptr<LightSource>> &lightSources, Math::Ray viewRay, std::shared_ptr<Renderable> surface, std::shared_ptr<Util::HitRecord> hitRecord) const
+void StandardShader::setSurfaceTexture(std::shared_ptr<const Texture> surfaceTexture)
 {
-    if (!surface->hit(viewRay, 0, std::numeric_limits<float>::max(), hitRecord)) {
-        hitRecord->intersectionTime = -1;
-        return { 0, 0, 0 };
+    this->surfaceTexture = surfaceTexture;
+}
+
+void StandardShader::setSpecularTexture(std::shared_ptr<const Texture> specularTexture)
+{
+    this->specularTexture = specularTexture;
+}
+
+Util::Color StandardShader::shade(const RenderContext &context, Math::Ray viewRay, std::shared_ptr<Renderable> surface, std::shared_ptr<Util::HitRecord> hitRecord) const
+{
+    const LightTable &lightTable = context.lightTable;
+    std::vector<LightTree::SelectedLight> selectedLights;
+    context.selectLights(hitRecord->intersectionPoint, hitRecord->unitNormal, selectedLights);
+
+    float lambert[3] = { 0, 0, 0 };
+    float blinnPhong[3] = { 0, 0, 0 };
+    Math::Vector3 unitViewDirection = viewRay.direction / viewRay.direction.norm();
+    Math::Vector3 h, l;
+    float distance;
+    for (auto & selectedLight : selectedLights)
+    {
+        const int i = selectedLight.lightIndex;
+        lightTable.directionToLight(i, hitRecord->intersectionPoint, l, distance);
+        const float visibility = context.computeVisibility(i, *surface, { hitRecord->intersectionPoint, l }, EPSILON, distance);
+        if (visibility == 0) { continue; }
+
+        h = (-unitViewDirection + l);
+        const float lightScale = selectedLight.intensityScale * visibility;
+        const float lambertScalingFactor = lightScale * std::max((float) 0, Math::dot(hitRecord->unitNormal, l));
+        const float blinnPhongScalingFactor = lightScale * std::pow(std::max(0.0f, Math::dot(hitRecord->unitNormal, h / h.norm())), this->phongExponent);
+        lambert[0] += lightTable.red[i] * lambertScalingFactor;
+        lambert[1] += lightTable.green[i] * lambertScalingFactor;
+        lambert[2] += lightTable.blue[i] * lambertScalingFactor;
+        blinnPhong[0] += lightTable.red[i] * blinnPhongScalingFactor;
+        blinnPhong[1] += lightTable.green[i] * blinnPhongScalingFactor;
+        blinnPhong[2] += lightTable.blue[i] * blinnPhongScalingFactor;
+    }
+
+    this->addIndirectLight(context, surface, hitRecord->intersectionPoint, hitRecord->unitNormal, viewRay.direction, lambert);
+    context.addCausticLight(hitRecord->intersectionPoint, hitRecord->unitNormal, viewRay.direction, lambert);
+    const float ambientVisibility = this->ambientIntensity <= 0 ? 1 : context.computeAmbientOcclusion(*surface, hitRecord->intersectionPoint, hitRecord->unitNormal, viewRay.direction);
+    const Util::Color surfaceColor = this->lookupColor(this->surfaceTexture, this->surfaceColor, context, viewRay, *hitRecord);
+    const Util::Color specularColor = this->lookupColor(this->specularTexture, this->specularColor, context, viewRay, *hitRecord);
+    return this->combineLighting(lambert, blinnPhong, ambientVisibility, surfaceColor, specularColor);
+}
+
+void StandardShader::shadeBatch(const RenderContext &context, const std::vector<Math::Ray> &viewRays, std::shared_ptr<Renderable> surface, const std::vector<Util::HitRecord> &hitRecords, std::vector<Util::Color> &colors) const
+{
+    const LightTable &lightTable = context.lightTable;
+    const size_t hitCount = hitRecords.size();
+
+    // one entry per (hit, selected light) pair, the pairs of hit i being [firstTerms[i], firstTerms[i + 1]).
+    // occluded pairs keep zero terms so every pass below can run without branches
+    std::vector<size_t> firstTerms(hitCount + 1, 0);
+    std::vector<int> lightIndices;
+    std::vector<float> intensityScales;
+    std::vector<float> lambertTerms;
+    std::vector<float> blinnPhongTerms;
+
+    std::vector<LightTree::SelectedLight> selectedLights;
+    Math::Vector3 h, l;
+    float distance;
+    for (size_t i = 0; i < hitCount; i++)
+    {
+        const Util::HitRecord &hitRecord = hitRecords.at(i);
+        const Math::Vector3 unitViewDirection = viewRays.at(i).direction / viewRays.at(i).direction.norm();
+        context.selectLights(hitRecord.intersectionPoint, hitRecord.unitNormal, selectedLights);
+        for (auto & selectedLight : selectedLights)
+        {
+            lightTable.directionToLight(selectedLight.lightIndex, hitRecord.intersectionPoint, l, distance);
+            lightIndices.push_back(selectedLight.lightIndex);
+            const float visibility = context.computeVisibility(selectedLight.lightIndex, *surface, { hitRecord.intersectionPoint, l }, EPSILON, distance);
+            if (visibility == 0)
+            {
+                intensityScales.push_back(0);
+                lambertTerms.push_back(0);
+                blinnPhongTerms.push_back(0);
+                continue;
+            }
+
+            h = (-unitViewDirection + l);
+            intensityScales.push_back(selectedLight.intensityScale * visibility);
+            lambertTerms.push_back(std::max((float) 0, Math::dot(hitRecord.unitNormal, l)));
+            blinnPhongTerms.push_back(std::max(0.0f, Math::dot(hitRecord.unitNormal, h / h.norm())));
+        }
+        firstTerms.at(i + 1) = lightIndices.size();
     }
 
-    std::vector<std::shared_ptr<Util::HitRecord>> lightSourceHitRecords = std::vector<std::shared_ptr<Util::HitRecord>>();
-    Math::Ray p;
-    for (auto & lightSource : lightSources)
+    const float phongExponent = this->phongExponent;
+    const size_t termCount = blinnPhongTerms.size();
+    float * terms = blinnPhongTerms.data();
+    const float * scales = intensityScales.data();
+    float * lambertScales = lambertTerms.data();
+    for (size_t k = 0; k < termCount; k++)
     {
-        std::shared_ptr<Util::HitRecord> lightSourceHitRecord(new Util::HitRecord);
-        p = { hitRecord->intersectionPoint, -lightSource->getLightDirectionToSurfacePoint(hitRecord->intersectionPoint) };
-        surface->hit(p, EPSILON, lightSource->timeToLightSource(p), lightSourceHitRecord); // TODO: if it's a single point light should not go to render distance, but to the light
-        lightSourceHitRecords.push_back(lightSourceHitRecord);
+        terms[k] = scales[k] * std::pow(terms[k], phongExponent);
+        lambertScales[k] = scales[k] * lambertScales[k];
     }
-    float redAmbientColor = this->ambientColor.red * this->ambientIntensity;
-    float greenAmbientColor = this->ambientColor.green * this->ambientIntensity;
-    float blueAmbientColor = this->ambientColor.blue * this->ambientIntensity;
 
-    int lightSourceIndex = 0;
-    float lambertScalingFactor = 0;
-    float blinnPhongScalingFactor = 0;
-    Math::Vector3 unitViewDirection = viewRay.direction / viewRay.direction.norm();
-    Math::Vector3 h;
-    for (auto & lightSource : lightSources)
+    for (size_t i = 0; i < hitCount; i++)
     {
-        if (lightSourceHitRecords.at(lightSourceIndex)->intersectionTime < 0)
+        float lambert[3] = { 0, 0, 0 };
+        float blinnPhong[3] = { 0, 0, 0 };
+        for (size_t k = firstTerms.at(i); k < firstTerms.at(i + 1); k++)
         {
-            lambertScalingFactor += lightSource->getIntensity() * std::max((float) 0, Math::dot(hitRecord->unitNormal, -lightSource->getLightDirectionToSurfacePoint(hitRecord->intersectionPoint)));
-        
-            h = (-unitViewDirection - lightSource->getLightDirectionToSurfacePoint(hitRecord->intersectionPoint));
-            blinnPhongScalingFactor += lightSource->getIntensity() * std::pow(std::max(0.0f, Math::dot(hitRecord->unitNormal, h / h.norm())), this->getPhongExponent());
+            const int j = lightIndices[k];
+            lambert[0] += lightTable.red[j] * lambertTerms[k];
+            lambert[1] += lightTable.green[j] * lambertTerms[k];
+            lambert[2] += lightTable.blue[j] * lambertTerms[k];
+            blinnPhong[0] += lightTable.red[j] * blinnPhongTerms[k];
+            blinnPhong[1] += lightTable.green[j] * blinnPhongTerms[k];
+            blinnPhong[2] += lightTable.blue[j] * blinnPhongTerms[k];
         }
-        lightSourceIndex++;
+        this->addIndirectLight(context, surface, hitRecords.at(i).intersectionPoint, hitRecords.at(i).unitNormal, viewRays.at(i).direction, lambert);
+        context.addCausticLight(hitRecords.at(i).intersectionPoint, hitRecords.at(i).unitNormal, viewRays.at(i).direction, lambert);
+        const float ambientVisibility = this->ambientIntensity <= 0 ? 1 : context.computeAmbientOcclusion(*surface, hitRecords.at(i).intersectionPoint, hitRecords.at(i).unitNormal, viewRays.at(i).direction);
+        const Util::Color surfaceColor = this->lookupColor(this->surfaceTexture, this->surfaceColor, context, viewRays.at(i), hitRecords.at(i));
+        const Util::Color specularColor = this->lookupColor(this->specularTexture, this->specularColor, context, viewRays.at(i), hitRecords.at(i));
+        colors.at(i) = this->combineLighting(lambert, blinnPhong, ambientVisibility, surfaceColor, specularColor);
     }
+}
+
+void StandardShader::emitRays(const RenderContext &context, std::shared_ptr<Renderable> surface, const Wavefront::PathRay &pathRay, const Util::HitRecord &hitRecord, Wavefront::RayQueues &queues) const
+{
+    const LightTable &lightTable = context.lightTable;
+    const float ambientVisibility = this->ambientIntensity <= 0 ? 1 : context.computeAmbientOcclusion(*surface, hitRecord.intersectionPoint, hitRecord.unitNormal, pathRay.ray.direction);
+    const float ambientWeight = pathRay.weight * this->ambientIntensity * ambientVisibility;
+    queues.contributions.push_back({
+        pathRay.pixelIndex,
+        ambientWeight * this->ambientColor.red,
+        ambientWeight * this->ambientColor.green,
+        ambientWeight * this->ambientColor.blue
+    });
+    const Util::Color surfaceColor = this->lookupColor(this->surfaceTexture, this->surfaceColor, context, pathRay.ray, hitRecord);
+    const Util::Color specularColor = this->lookupColor(this->specularTexture, this->specularColor, context, pathRay.ray, hitRecord);
+    float bouncedLight[3] = { 0, 0, 0 };
+    this->addIndirectLight(context, surface, hitRecord.intersectionPoint, hitRecord.unitNormal, pathRay.ray.direction, bouncedLight);
+    context.addCausticLight(hitRecord.intersectionPoint, hitRecord.unitNormal, pathRay.ray.direction, bouncedLight);
+    if (bouncedLight[0] > 0 || bouncedLight[1] > 0 || bouncedLight[2] > 0)
+    {
+        queues.contributions.push_back({
+            pathRay.pixelIndex,
+            pathRay.weight * bouncedLight[0] * surfaceColor.red,
+            pathRay.weight * bouncedLight[1] * surfaceColor.green,
+            pathRay.weight * bouncedLight[2] * surfaceColor.blue
+        });
+    }
+
+    std::vector<LightTree::SelectedLight> selectedLights;
+    context.selectLights(hitRecord.intersectionPoint, hitRecord.unitNormal, selectedLights);
+
+    const Math::Vector3 unitViewDirection = pathRay.ray.direction / pathRay.ray.direction.norm();
+    Math::Vector3 h, l;
+    float distance;
+    for (auto & selectedLight : selectedLights)
+    {
+        const int i = selectedLight.lightIndex;
+        lightTable.directionToLight(i, hitRecord.intersectionPoint, l, distance);
+        h = (-unitViewDirection + l);
+        const float lambertScalingFactor = pathRay.weight * selectedLight.intensityScale * std::max((float) 0, Math::dot(hitRecord.unitNormal, l));
+        const float blinnPhongScalingFactor = pathRay.weight * selectedLight.intensityScale * std::pow(std::max(0.0f, Math::dot(hitRecord.unitNormal, h / h.norm())), this->phongExponent);
+        if (lambertScalingFactor <= 0 && blinnPhongScalingFactor <= 0) { continue; } // the shadow ray could not change anything
+
+        Wavefront::ShadowRay shadowRay;
+        shadowRay.ray = { hitRecord.intersectionPoint, l };
+        shadowRay.t0 = EPSILON;
+        shadowRay.t1 = distance;
+        shadowRay.pixelIndex = pathRay.pixelIndex;
+        shadowRay.lightIndex = i;
+        shadowRay.red = lightTable.red[i] * (lambertScalingFactor * surfaceColor.red + blinnPhongScalingFactor * specularColor.red);
+        shadowRay.green = lightTable.green[i] * (lambertScalingFactor * surfaceColor.green + blinnPhongScalingFactor * specularColor.green);
+        shadowRay.blue = lightTable.blue[i] * (lambertScalingFactor * surfaceColor.blue + blinnPhongScalingFactor * specularColor.blue);
+        if (!lightTable.isAreaLight(i))
+        {
+            queues.shadowRays.push_back(shadowRay);
+            continue;
+        }
+
+        // the queues cannot wait for a first batch of shadow rays before deciding on more, so an area light takes one
+        // stratified grid of shadowSamples rays, each carrying its share of the light
+        if (context.shadowRayStatistics != NULL) { context.shadowRayStatistics->areaLightQueryCount++; }
+        Util::Sampler sampler = context.sampler(Util::LIGHT_STREAM + i);
+        const int gridSize = std::max(1, (int) std::lround(std::sqrt(context.shadowSamples)));
+        const float share = 1.0f / (gridSize * gridSize);
+        shadowRay.red *= share;
+        shadowRay.green *= share;
+        shadowRay.blue *= share;
+        for (int cell = 0; cell < gridSize * gridSize; cell++)
+        {
+            const float u = (cell % gridSize + sampler.nextFloat()) / gridSize;
+            const float v = (cell / gridSize + sampler.nextFloat()) / gridSize;
+            lightTable.directionToLightSample(i, hitRecord.intersectionPoint, u, v, shadowRay.ray.direction, shadowRay.t1);
+            queues.shadowRays.push_back(shadowRay);
+        }
+    }
+}
+
+// adds the indirect diffuse light at point to lambert, from the irradiance cache of the context. only points seen
+// straight from the camera take it: the rays that gather it see one bounce of direct light and no more
+void StandardShader::addIndirectLight(const RenderContext &context, std::shared_ptr<Renderable> surface, Math::Vector3 point, Math::Vector3 unitNormal, Math::Vector3 viewDirection, float lambert[3]) const
+{
+    if (context.irradianceCache == NULL || context.bounce != 0) { return; }
+
+    float irradiance[3];
+    context.irradianceCache->computeIrradiance(context, surface, point, unitNormal, viewDirection, irradiance);
+    lambert[0] += irradiance[0];
+    lambert[1] += irradiance[1];
+    lambert[2] += irradiance[2];
+}
+
+// the color texture gives the hit, filtered over the width the view ray covers there, or color without a texture
+Util::Color StandardShader::lookupColor(std::shared_ptr<const Texture> const& texture, Util::Color color, const RenderContext &context, Math::Ray const& viewRay, Util::HitRecord const& hitRecord) const
+{
+    if (texture == NULL) { return color; }
+    const float footprint = context.computeFootprint(viewRay, hitRecord) * hitRecord.textureScale;
+    return texture->sample(hitRecord.textureU, hitRecord.textureV, footprint);
+}
+
+// lambert and blinnPhong hold the light reaching the point per channel, already weighted by the two shading terms.
+// ambientVisibility scales the ambient term down by the ambient occlusion of the point
+Util::Color StandardShader::combineLighting(const float lambert[3], const float blinnPhong[3], float ambientVisibility, Util::Color surfaceColor, Util::Color specularColor) const
+{
+    float redAmbientColor = this->ambientColor.red * this->ambientIntensity * ambientVisibility;
+    float greenAmbientColor = this->ambientColor.green * this->ambientIntensity * ambientVisibility;
+    float blueAmbientColor = this->ambientColor.blue * this->ambientIntensity * ambientVisibility;
 
     return {
-        (uint8_t) std::min(255, (int) std::floor(redAmbientColor + (lambertScalingFactor * this->surfaceColor.red) + (blinnPhongScalingFactor * this->specularColor.red))),
-        (uint8_t) std::min(255, (int) std::floor(greenAmbientColor + (lambertScalingFactor * this->surfaceColor.green) + (blinnPhongScalingFactor * this->specularColor.green))),
-        (uint8_t) std::min(255, (int) std::floor(blueAmbientColor + (lambertScalingFactor * this->surfaceColor.blue) + (blinnPhongScalingFactor * this->specularColor.blue)))
+        (uint8_t) std::min(255, (int) std::floor(redAmbientColor + (lambert[0] * surfaceColor.red) + (blinnPhong[0] * specularColor.red))),
+        (uint8_t) std::min(255, (int) std::floor(greenAmbientColor + (lambert[1] * surfaceColor.green) + (blinnPhong[1] * specularColor.green))),
+        (uint8_t) std::min(255, (int) std::floor(blueAmbientColor + (lambert[2] * surfaceColor.blue) + (blinnPhong[2] * specularColor.blue)))
     };
 }
 
+void StandardShader::serialize(Serialization::Writer & writer) const
+{
+    writer.writeType(STANDARD_SHADER, SHADER_TYPE_NAMES);
+    writer.writeFloat("ambientIntensity", this->ambientIntensity);
+    writer.writeColor("ambientColor", this->ambientColor);
+    writer.writeFloat("phongExponent", this->phongExponent);
+    writer.writeColor("surfaceColor", this->surfaceColor);
+    writer.writeColor("specularColor", this->specularColor);
+    writer.writeString("surfaceTexture", this->surfaceTexture == NULL ? std::string() : this->surfaceTexture->getFilename());
+    writer.writeString("specularTexture", this->specularTexture == NULL ? std::string() : this->specularTexture->getFilename());
+}
+
 MirrorShader::MirrorShader() {}
 
 MirrorShader::MirrorShader(float specularWeight)
@@ -279,6 +620,21 @@ MirrorShader::MirrorShader(Util::Color backgroundColor, Util::Color specularColo
     this->backgroundColor = backgroundColor;
 }
 
+Util::Color MirrorShader::getBackgroundColor() const
+{
+    return this->backgroundColor;
+}
+
+Util::Color MirrorShader::getSpecularColor() const
+{
+    return this->specularColor;
+}
+
+float MirrorShader::getSpecularWeight() const
+{
+    return this->specularWeight;
+}
+
 void MirrorShader::setBackgroundColor(Util::Color backgroundColor)
 {
     this->backgroundColor = backgroundColor;
@@ -302,18 +658,16 @@ void MirrorShader::setSpecularWeight(float specularWeight)
     this->specularWeight = specularWeight;
 }
 
-Util::Color MirrorShader::computeColor(const std::vector<std::unique_ptr<LightSource>> &lightSources, Math::Ray viewRay, std::shared_ptr<Renderable> surface, std::shared_ptr<Util::HitRecord> hitRecord) const
+Util::Color MirrorShader::shade(const RenderContext &context, Math::Ray viewRay, std::shared_ptr<Renderable> surface, std::shared_ptr<Util::HitRecord> hitRecord) const
 {
-    if (!surface->hit(viewRay, 0, std::numeric_limits<float>::max(), hitRecord)) {
-        hitRecord->intersectionTime = -1;
-        return { 0, 0, 0 };
-    }
-
-    // TODO: check if the light bounces off the mirror and add that to lightSources
+    // the light that bounces off the mirror onto other surfaces comes from the caustic photon map, see PhotonMap
     const Math::Vector3 d = viewRay.direction / viewRay.direction.norm();
     const Math::Vector3 r = d - 2 * Math::dot(d, hitRecord->unitNormal) * hitRecord->unitNormal;
     const Math::Ray reflectionRay = { hitRecord->intersectionPoint + (EPSILON * r), r };
-    Util::Color reflectionColor = surface->computeColor(lightSources, reflectionRay, surface, hitRecord);
+    RenderContext reflectionContext = context;
+    reflectionContext.bounce++;
+    reflectionContext.rayDifferential = Util::reflectDifferential(viewRay, context.rayDifferential, *hitRecord);
+    Util::Color reflectionColor = surface->computeColor(reflectionContext, reflectionRay, surface, hitRecord);
     if (hitRecord->intersectionTime < 0) {
         hitRecord->intersectionTime = 1; // TODO: must represent a valid hit. there's a better way to do this
         reflectionColor = this->backgroundColor;
@@ -324,3 +678,33 @@ Util::Color MirrorShader::computeColor(const std::vector<std::unique_ptr<LightSo
         (uint8_t) std::floor(this->specularWeight * this->specularColor.blue + (1 - this->specularWeight) * reflectionColor.blue)
     };
 }
+
+void MirrorShader::emitRays(const RenderContext &, std::shared_ptr<Renderable>, const Wavefront::PathRay &pathRay, const Util::HitRecord &hitRecord, Wavefront::RayQueues &queues) const
+{
+    const float specularWeight = pathRay.weight * this->specularWeight;
+    queues.contributions.push_back({
+        pathRay.pixelIndex,
+        specularWeight * this->specularColor.red,
+        specularWeight * this->specularColor.green,
+        specularWeight * this->specularColor.blue
+    });
+
+    const Math::Vector3 d = pathRay.ray.direction / pathRay.ray.direction.norm();
+    const Math::Vector3 r = d - 2 * Math::dot(d, hitRecord.unitNormal) * hitRecord.unitNormal;
+    Wavefront::PathRay reflectionRay;
+    reflectionRay.ray = { hitRecord.intersectionPoint + (EPSILON * r), r };
+    reflectionRay.pixelIndex = pathRay.pixelIndex;
+    reflectionRay.depth = pathRay.depth + 1;
+    reflectionRay.weight = pathRay.weight * (1 - this->specularWeight);
+    reflectionRay.differential = Util::reflectDifferential(pathRay.ray, pathRay.differential, hitRecord);
+    reflectionRay.missColor = this->backgroundColor;
+    queues.pathRays.push_back(reflectionRay);
+}
+
+void MirrorShader::serialize(Serialization::Writer & writer) const
+{
+    writer.writeType(MIRROR_SHADER, SHADER_TYPE_NAMES);
+    writer.writeColor("backgroundColor", this->backgroundColor);
+    writer.writeColor("specularColor", this->specularColor);
+    writer.writeFloat("specularWeight", this->specularWeight);
+}
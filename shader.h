@@ -2,20 +2,57 @@
 #define SHADER_HEADER
 
 #include "util.h"
-#include "lightSource.h"
+#include "lightTable.h"
+#include "renderContext.h"
 #include "hittable.h"
+#include "rayQueue.h"
+#include "serialization.h"
 #include <memory>
 #include <vector>
 
+class Texture;
+
 class Shader
 {
 public:
+    // intersects viewRay with surface and shades the closest hit. on a miss, hitRecord->intersectionTime is set to -1
     virtual Util::Color computeColor(
-        const std::vector<std::unique_ptr<LightSource>> &lightSources,
+        const RenderContext &context,
+        Math::Ray viewRay,
+        std::shared_ptr<Renderable> surface,
+        std::shared_ptr<Util::HitRecord> hitRecord
+    ) const;
+
+    // shades a hit that the caller has already found and stored in hitRecord
+    virtual Util::Color shade(
+        const RenderContext &context,
         Math::Ray viewRay,
         std::shared_ptr<Renderable> surface,
         std::shared_ptr<Util::HitRecord> hitRecord
     ) const = 0;
+
+    // shades a batch of hits that all resolved to this shader. viewRays, hitRecords and colors are parallel arrays.
+    // by default every hit is shaded on its own, shaders with heavy per light math override this to loop over the batch
+    virtual void shadeBatch(
+        const RenderContext &context,
+        const std::vector<Math::Ray> &viewRays,
+        std::shared_ptr<Renderable> surface,
+        const std::vector<Util::HitRecord> &hitRecords,
+        std::vector<Util::Color> &colors
+    ) const;
+
+    // wavefront shading. instead of tracing secondary rays itself, the shader adds what it can see directly to
+    // queues.contributions and queues up shadow and reflection rays for later stages. the default adds shade() as is
+    virtual void emitRays(
+        const RenderContext &context,
+        std::shared_ptr<Renderable> surface,
+        const Wavefront::PathRay &pathRay,
+        const Util::HitRecord &hitRecord,
+        Wavefront::RayQueues &queues
+    ) const;
+
+    virtual void serialize(Serialization::Writer &writer) const = 0;
+    static std::unique_ptr<Shader> deserialize(Serialization::Reader &reader); // NULL if the reader does not hold a shader
 };
 
 class StaticColorShader : public Shader
@@ -28,12 +65,14 @@ public:
 
     void setSurfaceColor(Util::Color color);
 
-    Util::Color computeColor(
-        const std::vector<std::unique_ptr<LightSource>> &lightSources,
+    Util::Color shade(
+        const RenderContext &context,
         Math::Ray viewRay,
         std::shared_ptr<Renderable> surface,
         std::shared_ptr<Util::HitRecord> hitRecord
     ) const;
+
+    void serialize(Serialization::Writer &writer) const;
 protected:
     Util::Color surfaceColor;
 };
@@ -43,12 +82,14 @@ class LambertShader : public StaticColorShader
 public:
     LambertShader();
     LambertShader(Util::Color surfaceColor);
-    Util::Color computeColor(
-        const std::vector<std::unique_ptr<LightSource>> &lightSources,
+    Util::Color shade(
+        const RenderContext &context,
         Math::Ray viewRay,
         std::shared_ptr<Renderable> surface,
         std::shared_ptr<Util::HitRecord> hitRecord
     ) const;
+
+    void serialize(Serialization::Writer &writer) const;
 };
 
 class BlinnPhongShader : public Shader
@@ -66,18 +107,21 @@ public:
     void setPhongExponent(float phongExponent);
     void setSpecularColor(Util::Color specularColor);
 
-    Util::Color computeColor(
-        const std::vector<std::unique_ptr<LightSource>> &lightSources,
+    Util::Color shade(
+        const RenderContext &context,
         Math::Ray viewRay,
         std::shared_ptr<Renderable> surface,
         std::shared_ptr<Util::HitRecord> hitRecord
     ) const;
+
+    void serialize(Serialization::Writer &writer) const;
 private:
     Util::Color specularColor;
     float phongExponent;
 };
 
-// combination of lambert, blinn-phong, and ambient shading
+// combination of lambert, blinn-phong, and ambient shading. the surface and specular colors may come from textures,
+// filtered over the footprint of the view ray
 class StandardShader : public Shader
 {
 public:
@@ -92,22 +136,51 @@ public:
     Util::Color getSurfaceColor() const;
     Util::Color getSpecularColor() const;
     Util::Color getAmbientColor() const;
+    std::shared_ptr<const Texture> getSurfaceTexture() const;
+    std::shared_ptr<const Texture> getSpecularTexture() const;
 
     void setAmbientIntensity(float ambientIntensity);
     void setPhongExponent(float phongExponent);
     void setSurfaceColor(Util::Color surfaceColor);
     void setSpecularColor(Util::Color specularColor);
     void setAmbientColor(Util::Color ambientColor);
+    // the texture takes the place of the color, until it is set back to NULL
+    void setSurfaceTexture(std::shared_ptr<const Texture> surfaceTexture);
+    void setSpecularTexture(std::shared_ptr<const Texture> specularTexture);
 
-    Util::Color computeColor(
-        const std::vector<std::unique_ptr<LightSource>> &lightSources,
+    Util::Color shade(
+        const RenderContext &context,
         Math::Ray viewRay,
         std::shared_ptr<Renderable> surface,
         std::shared_ptr<Util::HitRecord> hitRecord
     ) const;
+
+    // casts the shadow rays of the whole batch first, then evaluates the blinn-phong power over one flat array so it can vectorize
+    void shadeBatch(
+        const RenderContext &context,
+        const std::vector<Math::Ray> &viewRays,
+        std::shared_ptr<Renderable> surface,
+        const std::vector<Util::HitRecord> &hitRecords,
+        std::vector<Util::Color> &colors
+    ) const;
+
+    void emitRays(
+        const RenderContext &context,
+        std::shared_ptr<Renderable> surface,
+        const Wavefront::PathRay &pathRay,
+        const Util::HitRecord &hitRecord,
+        Wavefront::RayQueues &queues
+    ) const;
+
+    void serialize(Serialization::Writer &writer) const;
 private:
     Util::Color surfaceColor, specularColor, ambientColor;
     float ambientIntensity, phongExponent;
+    std::shared_ptr<const Texture> surfaceTexture, specularTexture;
+
+    Util::Color combineLighting(const float lambert[3], const float blinnPhong[3], float ambientVisibility, Util::Color surfaceColor, Util::Color specularColor) const;
+    Util::Color lookupColor(std::shared_ptr<const Texture> const& texture, Util::Color color, const RenderContext &context, Math::Ray const& viewRay, Util::HitRecord const& hitRecord) const;
+    void addIndirectLight(const RenderContext &context, std::shared_ptr<Renderable> surface, Math::Vector3 point, Math::Vector3 unitNormal, Math::Vector3 viewDirection, float lambert[3]) const;
 };
 
 class MirrorShader : public Shader
@@ -117,17 +190,31 @@ public:
     MirrorShader(float specularWeight);
     MirrorShader(Util::Color backgroundColor, Util::Color specularColor, float specularWeight);
 
+    Util::Color getBackgroundColor() const;
+    Util::Color getSpecularColor() const;
+    float getSpecularWeight() const;
+
     void setBackgroundColor(Util::Color backgroundColor);
     void setSpecularColor(Util::Color specularColor);
     void setSpecularWeight(float specularWeight);
 
     // TODO: figure out a way to add a specular component
-    Util::Color computeColor(
-        const std::vector<std::unique_ptr<LightSource>> &lightSources,
+    Util::Color shade(
+        const RenderContext &context,
         Math::Ray viewRay,
         std::shared_ptr<Renderable> surface,
         std::shared_ptr<Util::HitRecord> hitRecord
     ) const;
+
+    void emitRays(
+        const RenderContext &context,
+        std::shared_ptr<Renderable> surface,
+        const Wavefront::PathRay &pathRay,
+        const Util::HitRecord &hitRecord,
+        Wavefront::RayQueues &queues
+    ) const;
+
+    void serialize(Serialization::Writer &writer) const;
 private:
     Util::Color backgroundColor = { 255, 255, 255 };
     Util::Color specularColor = { 0, 0, 0 };
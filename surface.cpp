@@ -2,8 +2,108 @@
 #include "surface.h"
 #include "util.h"
 #include "shader.h"
+#include "dependencyBuffer.h"
+#include "camera.h"
+#include "meshSimplifier.h"
 #include <iostream>
 #include <algorithm>
+#include <assert.h>
+
+namespace
+{
+    // type tags of the serialized surfaces
+    const uint8_t SPHERE = 1;
+    const uint8_t TRIANGLE = 2;
+    const uint8_t GROUP_SURFACE = 3;
+    const uint8_t MESH_SURFACE = 4;
+    const uint8_t LOD_SURFACE = 5;
+    // the keywords of the text format, indexed by type tag
+    const char * const SURFACE_TYPE_NAMES[] = { "", "sphere", "triangle", "group", "mesh", "lodMesh" };
+    const size_t SURFACE_TYPE_COUNT = sizeof(SURFACE_TYPE_NAMES) / sizeof(SURFACE_TYPE_NAMES[0]);
+
+    // the time at which ray hits the counterclockwise triangle vertex1, vertex2, vertex3 within [t0, t1], by cramer's rule
+    // beta and gamma are the barycentric weights of vertex2 and vertex3 at the hit
+    bool hitTriangle(Math::Vector3 const& vertex1, Math::Vector3 const& vertex2, Math::Vector3 const& vertex3, Math::Ray const& ray, float t0, float t1, float & t, float & beta, float & gamma)
+    {
+        const float a = vertex1.getX() - vertex2.getX();
+        const float b = vertex1.getY() - vertex2.getY();
+        const float c = vertex1.getZ() - vertex2.getZ();
+        const float d = vertex1.getX() - vertex3.getX();
+        const float e = vertex1.getY() - vertex3.getY();
+        const float f = vertex1.getZ() - vertex3.getZ();
+        const float g = ray.direction.getX();
+        const float h = ray.direction.getY();
+        const float i = ray.direction.getZ();
+        const float j = vertex1.getX() - ray.origin.getX();
+        const float k = vertex1.getY() - ray.origin.getY();
+        const float l = vertex1.getZ() - ray.origin.getZ();
+
+        const float eiMinusHf = e * i - h * f;
+        const float gfMinusDi = g * f - d * i;
+        const float dhMinusEg = d * h - e * g;
+        const float akMinusJb = a * k - j * b;
+        const float jcMinusAl = j * c - a * l;
+        const float blMinusKc = b * l - k * c;
+        const float M = a * eiMinusHf + b * gfMinusDi + c * dhMinusEg;
+
+        t = -((f * akMinusJb + e * jcMinusAl + d * blMinusKc) / M);
+        if (t < t0 || t > t1) { return false; }
+
+        gamma = (i * akMinusJb + h * jcMinusAl + g * blMinusKc) / M;
+        if (gamma < 0 || gamma > 1) { return false; }
+
+        beta = (j * eiMinusHf + k * gfMinusDi + l * dhMinusEg) / M;
+        if (beta < 0 || beta > 1 - gamma) { return false; }
+        return true;
+    }
+
+    bool hitTriangle(Math::Vector3 const& vertex1, Math::Vector3 const& vertex2, Math::Vector3 const& vertex3, Math::Ray const& ray, float t0, float t1, float & t)
+    {
+        float beta, gamma;
+        return hitTriangle(vertex1, vertex2, vertex3, ray, t0, t1, t, beta, gamma);
+    }
+
+    // how fast the texture coordinates of a triangle change along it, the larger of the gradients of u and v. edge1
+    // and edge2 run from the first vertex to the other two, and the coordinates change by du1, dv1 and du2, dv2 along them
+    float computeTextureScale(Math::Vector3 const& edge1, Math::Vector3 const& edge2, float du1, float dv1, float du2, float dv2)
+    {
+        const Math::Vector3 normal = Math::cross(edge1, edge2);
+        const float squaredArea = Math::dot(normal, normal);
+        if (squaredArea <= 0) { return 0; }
+        // the gradient of a coordinate is the in plane vector whose dot products with the edges are its changes
+        const Math::Vector3 across1 = Math::cross(edge2, normal), across2 = Math::cross(normal, edge1);
+        const float uGradient = (du1 * across1 + du2 * across2).norm();
+        const float vGradient = (dv1 * across1 + dv2 * across2).norm();
+        return std::max(uGradient, vGradient) / squaredArea;
+    }
+
+    // deeper than any bvh MeshBvh builds or loads, since every level leaves at most one node waiting
+    const int MESH_BVH_STACK_SIZE = 128;
+
+    Math::Box nodeBounds(MeshBvh::Node const& node)
+    {
+        return Math::Box({ node.min[0], node.min[1], node.min[2] }, { node.max[0], node.max[1], node.max[2] });
+    }
+
+    std::shared_ptr<const float> packPositions(std::vector<Math::Vector3> const& vertices)
+    {
+        std::shared_ptr<float> positions(new float[3 * vertices.size()], std::default_delete<float[]>());
+        for (size_t k = 0; k < vertices.size(); k++)
+        {
+            positions.get()[3 * k] = vertices[k].getX();
+            positions.get()[3 * k + 1] = vertices[k].getY();
+            positions.get()[3 * k + 2] = vertices[k].getZ();
+        }
+        return positions;
+    }
+
+    std::shared_ptr<const uint32_t> packIndices(std::vector<uint32_t> const& indices)
+    {
+        std::shared_ptr<uint32_t> packed(new uint32_t[indices.size()], std::default_delete<uint32_t[]>());
+        std::copy(indices.begin(), indices.end(), packed.get());
+        return packed;
+    }
+}
 
 Sphere::Sphere()
 {
@@ -60,6 +160,9 @@ bool Sphere::hit(Math::Ray ray, float t0, float t1, std::shared_ptr<Util::HitRec
         const Math::Vector3 p = ray.origin + t * ray.direction;
         hitRecord->unitNormal = (p - this->center) / this->radius;
         hitRecord->intersectionPoint = p;
+        hitRecord->hitSurface = this;
+        hitRecord->curvature = 1 / this->radius;
+        this->computeTextureCoordinates(*hitRecord);
         return true;
     }
 
@@ -74,9 +177,22 @@ bool Sphere::hit(Math::Ray ray, float t0, float t1, std::shared_ptr<Util::HitRec
     const Math::Vector3 p = ray.origin + t * ray.direction;
     hitRecord->unitNormal = (p - this->center) / this->radius;
     hitRecord->intersectionPoint = p;
+    hitRecord->hitSurface = this;
+    hitRecord->curvature = 1 / this->radius;
+    this->computeTextureCoordinates(*hitRecord);
     return true;
 };
 
+// longitude around the z axis from the -x side and latitude from the north pole, so v = 0 is the top row of a texture
+void Sphere::computeTextureCoordinates(Util::HitRecord & hitRecord) const
+{
+    const Math::Vector3 n = hitRecord.unitNormal;
+    hitRecord.textureU = 0.5f + std::atan2(n.getY(), n.getX()) / (2 * (float) M_PI);
+    hitRecord.textureV = std::acos(std::min(1.0f, std::max(-1.0f, n.getZ()))) / (float) M_PI;
+    // v runs pole to pole over half the circumference. u runs faster except at the equator, but that takes the poles
+    hitRecord.textureScale = 1 / ((float) M_PI * this->radius);
+}
+
 Math::Box Sphere::boundingBox() const
 {
     Math::Vector3 min = { this->center.getX() - radius, this->center.getY() - radius, this->center.getZ() - radius };
@@ -84,6 +200,14 @@ Math::Box Sphere::boundingBox() const
     return Math::Box(min, max);
 };
 
+void Sphere::serialize(Serialization::Writer & writer) const
+{
+    writer.writeType(SPHERE, SURFACE_TYPE_NAMES);
+    writer.writeFloat("radius", this->radius);
+    writer.writeVector3("center", this->center);
+    this->serializeMaterial(writer);
+};
+
 Triangle::Triangle()
 {
     this->vertex1 = { 0, 0, 0 };
@@ -137,42 +261,31 @@ void Triangle::setVertices(Math::Vector3 vertex1, Math::Vector3 vertex2, Math::V
 
 bool Triangle::hit(Math::Ray ray, float t0, float t1, std::shared_ptr<Util::HitRecord> & hitRecord) const
 {
-    const float a = this->vertex1.getX() - this->vertex2.getX();
-    const float b = this->vertex1.getY() - this->vertex2.getY();
-    const float c = this->vertex1.getZ() - this->vertex2.getZ();
-    const float d = this->vertex1.getX() - this->vertex3.getX();
-    const float e = this->vertex1.getY() - this->vertex3.getY();
-    const float f = this->vertex1.getZ() - this->vertex3.getZ();
-    const float g = ray.direction.getX();
-    const float h = ray.direction.getY();
-    const float i = ray.direction.getZ();
-    const float j = this->vertex1.getX() - ray.origin.getX();
-    const float k = this->vertex1.getY() - ray.origin.getY();
-    const float l = this->vertex1.getZ() - ray.origin.getZ();
-
-    const float eiMinusHf = e * i - h * f;
-    const float gfMinusDi = g * f - d * i;
-    const float dhMinusEg = d * h - e * g;
-    const float akMinusJb = a * k - j * b;
-    const float jcMinusAl = j * c - a * l;
-    const float blMinusKc = b * l - k * c;
-    const float M = a * eiMinusHf + b * gfMinusDi + c * dhMinusEg;
-
-    const float t = -((f * akMinusJb + e * jcMinusAl + d * blMinusKc) / M);
-    if (t < t0 || t > t1) { return false; }
-
-    const float gamma = (i * akMinusJb + h * jcMinusAl + g * blMinusKc) / M;
-    if (gamma < 0 || gamma > 1) { return false; }
-
-    const float beta = (j * eiMinusHf + k * gfMinusDi + l * dhMinusEg) / M;
-    if (beta < 0 || beta > 1 - gamma) { return false; }
+    float t, beta, gamma;
+    if (!hitTriangle(this->vertex1, this->vertex2, this->vertex3, ray, t0, t1, t, beta, gamma)) { return false; }
 
     hitRecord->intersectionTime = t;
     hitRecord->unitNormal = Math::Vector3(this->getUnitNormal());
     hitRecord->intersectionPoint = ray.origin + t * ray.direction;
+    hitRecord->hitSurface = this;
+    hitRecord->curvature = 0;
+    const float * uv = this->textureCoordinates;
+    hitRecord->textureU = uv[0] + beta * (uv[2] - uv[0]) + gamma * (uv[4] - uv[0]);
+    hitRecord->textureV = uv[1] + beta * (uv[3] - uv[1]) + gamma * (uv[5] - uv[1]);
+    hitRecord->textureScale = computeTextureScale(this->vertex2 - this->vertex1, this->vertex3 - this->vertex1, uv[2] - uv[0], uv[3] - uv[1], uv[4] - uv[0], uv[5] - uv[1]);
     return true;
 }
 
+void Triangle::getTextureCoordinates(float textureCoordinates[6]) const
+{
+    std::copy(this->textureCoordinates, this->textureCoordinates + 6, textureCoordinates);
+}
+
+void Triangle::setTextureCoordinates(const float textureCoordinates[6])
+{
+    std::copy(textureCoordinates, textureCoordinates + 6, this->textureCoordinates);
+}
+
 
 Math::Box Triangle::boundingBox() const
 {
@@ -187,30 +300,37 @@ Math::Box Triangle::boundingBox() const
     return Math::Box({ minX, minY, minZ }, { maxX, maxY, maxZ });
 }
 
+void Triangle::serialize(Serialization::Writer & writer) const
+{
+    // the vertices are already in counterclockwise order, so they are read back without a facing direction
+    writer.writeType(TRIANGLE, SURFACE_TYPE_NAMES);
+    writer.writeVector3("vertex1", this->vertex1);
+    writer.writeVector3("vertex2", this->vertex2);
+    writer.writeVector3("vertex3", this->vertex3);
+    writer.writeFloatArray("textureCoordinates", this->textureCoordinates, 6);
+    this->serializeMaterial(writer);
+}
+
 GroupSurface::GroupSurface()
 {
     this->surfaces = std::vector<std::unique_ptr<Surface>>();
-    this->minBound = { 0, 0, 0 };
-    this->maxBound = { 0, 0, 0 };
+    this->bounds = Math::Box::empty();
 }
 
 void GroupSurface::addSurface(std::unique_ptr<Surface> surface)
 {
-    this->minBound = {
-        std::min(this->minBound.getX(), surface->boundingBox().min.getX()),
-        std::min(this->minBound.getY(), surface->boundingBox().min.getY()),
-        std::min(this->minBound.getZ(), surface->boundingBox().min.getZ())
-    };
-    this->maxBound = {
-        std::max(this->maxBound.getX(), surface->boundingBox().max.getX()),
-        std::max(this->maxBound.getY(), surface->boundingBox().max.getY()),
-        std::max(this->maxBound.getZ(), surface->boundingBox().max.getZ())
-    };
+    this->bounds.expand(surface->boundingBox());
     this->surfaces.push_back(std::move(surface));
 }
 
 bool GroupSurface::hit(Math::Ray ray, float t0, float t1, std::shared_ptr<Util::HitRecord> & hitRecord) const
 {
+    if (this->surfaces.empty()) { return false; }
+
+    // reject the ray against the bounds of the whole group before testing any of the surfaces inside it
+    float tEnter, tExit;
+    if (!this->bounds.hit(ray, Math::inverse(ray.direction), t0, t1, tEnter, tExit)) { return false; }
+
     bool groupHit = false;
     bool surfaceHit;
     float tMax = t1;
@@ -218,7 +338,7 @@ bool GroupSurface::hit(Math::Ray ray, float t0, float t1, std::shared_ptr<Util::
     std::shared_ptr<Util::HitRecord> surfaceHitRecord = std::shared_ptr<Util::HitRecord>(new Util::HitRecord);
     for (auto & surface : this->surfaces)
     {
-        surfaceHit = surface->hit(ray, t0, t1, surfaceHitRecord);
+        surfaceHit = surface->hit(ray, t0, tMax, surfaceHitRecord);
         if (surfaceHit && surfaceHitRecord->intersectionTime >= t0 && surfaceHitRecord->intersectionTime <= tMax)
         {
             groupHit = true;
@@ -227,6 +347,11 @@ bool GroupSurface::hit(Math::Ray ray, float t0, float t1, std::shared_ptr<Util::
             hitRecord->unitNormal = surfaceHitRecord->unitNormal;
             hitRecord->intersectionPoint = surfaceHitRecord->intersectionPoint;
             hitRecord->hitObjectIndex = surfaceIndex;
+            hitRecord->hitSurface = surfaceHitRecord->hitSurface;
+            hitRecord->curvature = surfaceHitRecord->curvature;
+            hitRecord->textureU = surfaceHitRecord->textureU;
+            hitRecord->textureV = surfaceHitRecord->textureV;
+            hitRecord->textureScale = surfaceHitRecord->textureScale;
         }
         surfaceIndex += 1;
     }
@@ -234,9 +359,367 @@ bool GroupSurface::hit(Math::Ray ray, float t0, float t1, std::shared_ptr<Util::
 }
 
 
+bool GroupSurface::hitAny(Math::Ray ray, float t0, float t1) const
+{
+    if (this->surfaces.empty()) { return false; }
+
+    float tEnter, tExit;
+    if (!this->bounds.hit(ray, Math::inverse(ray.direction), t0, t1, tEnter, tExit)) { return false; }
+    for (auto & surface : this->surfaces)
+    {
+        if (surface->hitAny(ray, t0, t1)) { return true; }
+    }
+    return false;
+}
+
 Math::Box GroupSurface::boundingBox() const
 {
-    return Math::Box(this->minBound, this->maxBound);
+    return this->bounds;
+}
+
+void GroupSurface::serialize(Serialization::Writer & writer) const
+{
+    writer.writeType(GROUP_SURFACE, SURFACE_TYPE_NAMES);
+    writer.beginList("surfaces", this->surfaces.size());
+    for (auto & surface : this->surfaces)
+    {
+        surface->serialize(writer);
+    }
+    writer.endList();
+    this->serializeMaterial(writer);
+}
+
+MeshSurface::MeshSurface(std::vector<Math::Vector3> const& vertices, std::vector<uint32_t> const& indices)
+    : MeshSurface(packPositions(vertices), vertices.size(), packIndices(indices), indices.size() / 3)
+{
+    assert (indices.size() % 3 == 0);
+}
+
+MeshSurface::MeshSurface(std::shared_ptr<const float> positions, size_t vertexCount, std::shared_ptr<const uint32_t> indices, size_t triangleCount)
+{
+    this->positions = positions;
+    this->vertexCount = vertexCount;
+    this->indices = indices;
+    this->triangleCount = triangleCount;
+
+    this->bounds = Math::Box::empty();
+    for (size_t k = 0; k < 3 * triangleCount; k++)
+    {
+        assert (indices.get()[k] < vertexCount);
+        this->bounds.expand(this->getVertex(indices.get()[k]));
+    }
+}
+
+size_t MeshSurface::getVertexCount() const
+{
+    return this->vertexCount;
+}
+
+size_t MeshSurface::getTriangleCount() const
+{
+    return this->triangleCount;
+}
+
+Math::Vector3 MeshSurface::getVertex(size_t vertexIndex) const
+{
+    const float * position = this->positions.get() + 3 * vertexIndex;
+    return { position[0], position[1], position[2] };
+}
+
+void MeshSurface::getTriangle(size_t triangleIndex, Math::Vector3 & vertex1, Math::Vector3 & vertex2, Math::Vector3 & vertex3) const
+{
+    const uint32_t * triangle = this->indices.get() + 3 * triangleIndex;
+    vertex1 = this->getVertex(triangle[0]);
+    vertex2 = this->getVertex(triangle[1]);
+    vertex3 = this->getVertex(triangle[2]);
+}
+
+bool MeshSurface::hit(Math::Ray ray, float t0, float t1, std::shared_ptr<Util::HitRecord> & hitRecord) const
+{
+    if (this->triangleCount == 0) { return false; }
+
+    float tEnter, tExit;
+    if (!this->bounds.hit(ray, Math::inverse(ray.direction), t0, t1, tEnter, tExit)) { return false; }
+
+    float tMax = t1;
+    int hitTriangleIndex = -1;
+    Math::Vector3 vertex1, vertex2, vertex3;
+    auto hitTriangleAt = [&](size_t k)
+    {
+        float t;
+        this->getTriangle(k, vertex1, vertex2, vertex3);
+        if (!hitTriangle(vertex1, vertex2, vertex3, ray, t0, tMax, t)) { return; }
+        tMax = t;
+        hitTriangleIndex = k;
+    };
+
+    if (this->bvh == NULL)
+    {
+        for (size_t k = 0; k < this->triangleCount; k++) { hitTriangleAt(k); }
+    }
+    else
+    {
+        // children are tested when their parent is visited so that the nearer one is visited first, and a node is
+        // skipped once a triangle closer than where the ray enters it has been found
+        struct PendingNode
+        {
+            uint32_t index;
+            float tEnter;
+        };
+        PendingNode pendingNodes[MESH_BVH_STACK_SIZE];
+        int pendingNodeCount = 0;
+        pendingNodes[pendingNodeCount++] = { 0, tEnter };
+
+        const MeshBvh::Node * nodes = this->bvh->getNodes();
+        const uint32_t * triangleOrder = this->bvh->getTriangleOrder();
+        const Math::Vector3 inverseDirection = Math::inverse(ray.direction);
+        while (pendingNodeCount > 0)
+        {
+            const PendingNode pendingNode = pendingNodes[--pendingNodeCount];
+            if (pendingNode.tEnter > tMax) { continue; }
+            const MeshBvh::Node & node = nodes[pendingNode.index];
+            if (node.triangleCount > 0)
+            {
+                for (uint32_t k = node.offset; k < node.offset + node.triangleCount; k++) { hitTriangleAt(triangleOrder[k]); }
+                continue;
+            }
+
+            float firstEnter, secondEnter, childExit;
+            const bool hitsFirst = nodeBounds(nodes[pendingNode.index + 1]).hit(ray, inverseDirection, t0, tMax, firstEnter, childExit);
+            const bool hitsSecond = nodeBounds(nodes[node.offset]).hit(ray, inverseDirection, t0, tMax, secondEnter, childExit);
+            const PendingNode first = { pendingNode.index + 1, firstEnter };
+            const PendingNode second = { node.offset, secondEnter };
+            if (hitsFirst && hitsSecond)
+            {
+                pendingNodes[pendingNodeCount++] = firstEnter <= secondEnter ? second : first;
+                pendingNodes[pendingNodeCount++] = firstEnter <= secondEnter ? first : second;
+            }
+            else if (hitsFirst) { pendingNodes[pendingNodeCount++] = first; }
+            else if (hitsSecond) { pendingNodes[pendingNodeCount++] = second; }
+        }
+    }
+    if (hitTriangleIndex < 0) { return false; }
+
+    this->getTriangle(hitTriangleIndex, vertex1, vertex2, vertex3);
+    const Math::Vector3 normal = Math::cross(vertex2 - vertex1, vertex3 - vertex2);
+    hitRecord->intersectionTime = tMax;
+    hitRecord->unitNormal = normal / normal.norm();
+    hitRecord->intersectionPoint = ray.origin + tMax * ray.direction;
+    hitRecord->hitObjectIndex = hitTriangleIndex;
+    hitRecord->hitSurface = this;
+    hitRecord->curvature = 0;
+    // meshes have no texture coordinates, so every triangle takes the corner of the texture a lone Triangle does
+    float t, beta = 0, gamma = 0;
+    hitTriangle(vertex1, vertex2, vertex3, ray, -std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), t, beta, gamma);
+    hitRecord->textureU = beta;
+    hitRecord->textureV = gamma;
+    hitRecord->textureScale = computeTextureScale(vertex2 - vertex1, vertex3 - vertex1, 1, 0, 0, 1);
+    return true;
+}
+
+bool MeshSurface::hitAny(Math::Ray ray, float t0, float t1) const
+{
+    if (this->triangleCount == 0) { return false; }
+
+    float tEnter, tExit;
+    if (!this->bounds.hit(ray, Math::inverse(ray.direction), t0, t1, tEnter, tExit)) { return false; }
+
+    float t;
+    Math::Vector3 vertex1, vertex2, vertex3;
+    if (this->bvh == NULL)
+    {
+        for (size_t k = 0; k < this->triangleCount; k++)
+        {
+            this->getTriangle(k, vertex1, vertex2, vertex3);
+            if (hitTriangle(vertex1, vertex2, vertex3, ray, t0, t1, t)) { return true; }
+        }
+        return false;
+    }
+
+    uint32_t pendingNodes[MESH_BVH_STACK_SIZE];
+    int pendingNodeCount = 0;
+    pendingNodes[pendingNodeCount++] = 0;
+    const MeshBvh::Node * nodes = this->bvh->getNodes();
+    const uint32_t * triangleOrder = this->bvh->getTriangleOrder();
+    const Math::Vector3 inverseDirection = Math::inverse(ray.direction);
+    while (pendingNodeCount > 0)
+    {
+        const MeshBvh::Node & node = nodes[pendingNodes[--pendingNodeCount]];
+        if (node.triangleCount > 0)
+        {
+            for (uint32_t k = node.offset; k < node.offset + node.triangleCount; k++)
+            {
+                this->getTriangle(triangleOrder[k], vertex1, vertex2, vertex3);
+                if (hitTriangle(vertex1, vertex2, vertex3, ray, t0, t1, t)) { return true; }
+            }
+            continue;
+        }
+
+        const uint32_t firstChild = &node - nodes + 1;
+        if (nodeBounds(nodes[firstChild]).hit(ray, inverseDirection, t0, t1, tEnter, tExit)) { pendingNodes[pendingNodeCount++] = firstChild; }
+        if (nodeBounds(nodes[node.offset]).hit(ray, inverseDirection, t0, t1, tEnter, tExit)) { pendingNodes[pendingNodeCount++] = node.offset; }
+    }
+    return false;
+}
+
+const float * MeshSurface::getPositions() const
+{
+    return this->positions.get();
+}
+
+const uint32_t * MeshSurface::getIndices() const
+{
+    return this->indices.get();
+}
+
+const MeshBvh * MeshSurface::getBvh() const
+{
+    return this->bvh.get();
+}
+
+void MeshSurface::buildAccelerationStructures(std::string const& cacheDirectory)
+{
+    if (this->bvh == NULL) { this->bvh = MeshBvh::loadOrBuild(*this, cacheDirectory); }
+}
+
+Math::Box MeshSurface::boundingBox() const
+{
+    return this->bounds;
+}
+
+void MeshSurface::serialize(Serialization::Writer & writer) const
+{
+    writer.writeType(MESH_SURFACE, SURFACE_TYPE_NAMES);
+    writer.writeFloatArray("positions", this->positions.get(), 3 * this->vertexCount);
+    writer.writeUint32Array("indices", this->indices.get(), 3 * this->triangleCount);
+    this->serializeMaterial(writer);
+}
+
+LodSurface::LodSurface(std::unique_ptr<MeshSurface> mesh, float pixelError, float hysteresis, size_t minTriangleCount)
+{
+    assert (mesh != NULL);
+    this->bounds = mesh->boundingBox();
+    this->levels.push_back(std::move(mesh));
+    this->levelErrors.push_back(0);
+    this->pixelError = pixelError;
+    this->hysteresis = hysteresis;
+    this->minTriangleCount = minTriangleCount;
+}
+
+float LodSurface::getPixelError() const
+{
+    return this->pixelError;
+}
+
+float LodSurface::getHysteresis() const
+{
+    return this->hysteresis;
+}
+
+size_t LodSurface::getMinTriangleCount() const
+{
+    return this->minTriangleCount;
+}
+
+size_t LodSurface::getLevelCount() const
+{
+    return this->levels.size();
+}
+
+const MeshSurface & LodSurface::getLevel(size_t level) const
+{
+    return *this->levels.at(level);
+}
+
+float LodSurface::getLevelError(size_t level) const
+{
+    return this->levelErrors.at(level);
+}
+
+size_t LodSurface::getSelectedLevel() const
+{
+    return this->selectedLevel;
+}
+
+void LodSurface::setPixelError(float pixelError)
+{
+    this->pixelError = pixelError;
+}
+
+void LodSurface::setHysteresis(float hysteresis)
+{
+    this->hysteresis = hysteresis;
+}
+
+void LodSurface::selectLevel(size_t level)
+{
+    this->selectedLevel = std::min(level, this->levels.size() - 1);
+}
+
+void LodSurface::buildAccelerationStructures(std::string const& cacheDirectory)
+{
+    if (!this->levelsBuilt)
+    {
+        // every level goes on from the one before, so the whole chain costs about as much as the finest step
+        MeshSimplifier simplifier(*this->levels.front());
+        size_t triangleCount = this->levels.front()->getTriangleCount();
+        while (triangleCount / 2 >= this->minTriangleCount)
+        {
+            simplifier.simplify(triangleCount / 2);
+            // a mesh whose edges ran out before losing a quarter of its triangles has no coarser level worth having
+            if (4 * simplifier.getTriangleCount() > 3 * triangleCount) { break; }
+            triangleCount = simplifier.getTriangleCount();
+            this->levels.push_back(simplifier.createMesh());
+            this->levelErrors.push_back(simplifier.getError());
+            this->bounds.expand(this->levels.back()->boundingBox());
+        }
+        this->levelsBuilt = true;
+    }
+    for (auto & level : this->levels)
+    {
+        level->buildAccelerationStructures(cacheDirectory);
+    }
+}
+
+void LodSurface::selectLevelOfDetail(const Camera & camera, std::vector<Math::Box> & changedBounds)
+{
+    const float maxError = this->pixelError * camera.computePixelWidth(this->bounds);
+    size_t level = this->selectedLevel;
+    while (level > 0 && this->levelErrors[level] > maxError) { level--; }
+    if (level == this->selectedLevel)
+    {
+        while (level + 1 < this->levels.size() && this->levelErrors[level + 1] <= (1 - this->hysteresis) * maxError) { level++; }
+    }
+    if (level == this->selectedLevel) { return; }
+    this->selectedLevel = level;
+    changedBounds.push_back(this->bounds);
+}
+
+bool LodSurface::hit(Math::Ray ray, float t0, float t1, std::shared_ptr<Util::HitRecord> & hitRecord) const
+{
+    if (!this->levels[this->selectedLevel]->hit(ray, t0, t1, hitRecord)) { return false; }
+    hitRecord->hitSurface = this;
+    return true;
+}
+
+bool LodSurface::hitAny(Math::Ray ray, float t0, float t1) const
+{
+    return this->levels[this->selectedLevel]->hitAny(ray, t0, t1);
+}
+
+Math::Box LodSurface::boundingBox() const
+{
+    return this->bounds;
+}
+
+void LodSurface::serialize(Serialization::Writer & writer) const
+{
+    writer.writeType(LOD_SURFACE, SURFACE_TYPE_NAMES);
+    writer.writeFloat("pixelError", this->pixelError);
+    writer.writeFloat("hysteresis", this->hysteresis);
+    writer.writeUint32("minTriangleCount", this->minTriangleCount);
+    this->levels.front()->serialize(writer);
+    this->serializeMaterial(writer);
 }
 
 void Surface::setMaterial(std::unique_ptr<Shader> shader)
@@ -244,21 +727,180 @@ void Surface::setMaterial(std::unique_ptr<Shader> shader)
     this->shader = std::move(shader);
 }
 
-Util::Color Surface::computeColor(const std::vector<std::unique_ptr<LightSource>> &lightSources, Math::Ray viewRay, std::shared_ptr<Renderable> surface, std::shared_ptr<Util::HitRecord> hitRecord) const
+// computeColor is only called on the root surface, children being shaded through resolveShader. so a surface that is
+// not a group records itself as top level surface 0, and a group records the index of the child it hit
+Util::Color Surface::computeColor(const RenderContext &context, Math::Ray viewRay, std::shared_ptr<Renderable> surface, std::shared_ptr<Util::HitRecord> hitRecord) const
 {
-    if (this->shader == NULL) { return { 0, 0, 0 }; }
-    return this->shader->computeColor(lightSources, viewRay, surface, hitRecord);
+    if (this->shader == NULL)
+    {
+        // nothing was traced, but giving the surface a shader would change every pixel looking its way
+        if (context.dependencies != NULL)
+        {
+            context.dependencies->recordRay(viewRay, 0, std::numeric_limits<float>::max());
+            context.dependencies->recordSurface(0);
+        }
+        return { 0, 0, 0 };
+    }
+    const Util::Color color = this->shader->computeColor(context, viewRay, surface, hitRecord);
+    if (context.dependencies != NULL && hitRecord->intersectionTime >= 0) { context.dependencies->recordSurface(0); }
+    return color;
 }
 
-Util::Color GroupSurface::computeColor(const std::vector<std::unique_ptr<LightSource>> &lightSources, Math::Ray viewRay, std::shared_ptr<Renderable> surface, std::shared_ptr<Util::HitRecord> hitRecord) const
+Util::Color GroupSurface::computeColor(const RenderContext &context, Math::Ray viewRay, std::shared_ptr<Renderable> surface, std::shared_ptr<Util::HitRecord> hitRecord) const
 {
     const bool hitsGroup = this->hit(viewRay, 0, std::numeric_limits<float>::max(), hitRecord);
+    const Shader * shader = hitsGroup ? this->resolveShader(*hitRecord) : NULL;
+    if (context.dependencies != NULL)
+    {
+        // a shaded hit records its ray when the shader traces it again
+        if (hitsGroup) { context.dependencies->recordSurface(hitRecord->hitObjectIndex); }
+        if (shader == NULL) { context.dependencies->recordRay(viewRay, 0, hitsGroup ? hitRecord->intersectionTime : std::numeric_limits<float>::max()); }
+    }
 
     if (!hitsGroup) {
         hitRecord->intersectionTime = -1;
         return { 0, 0, 0 };
     } // hitRecord shows that no hit occured
-    if (this->surfaces.at(hitRecord->hitObjectIndex)->shader == NULL && this->shader == NULL) { return { 0, 0, 0 }; } // hitRecord shows a hit and no shader displays black
-    if (this->surfaces.at(hitRecord->hitObjectIndex)->shader == NULL) { return this->shader->computeColor(lightSources, viewRay, surface, hitRecord); } // use the shader of the group surface
-    return this->surfaces.at(hitRecord->hitObjectIndex)->shader->computeColor(lightSources, viewRay, surface, hitRecord);
+    if (shader == NULL) { return { 0, 0, 0 }; } // hitRecord shows a hit and no shader displays black
+    return shader->computeColor(context, viewRay, surface, hitRecord);
+}
+
+const Shader * Surface::resolveShader(const Util::HitRecord &) const
+{
+    return this->shader.get();
+}
+
+void Surface::collectMirrorBounds(const Shader * groupShader, std::vector<Math::Box> & bounds) const
+{
+    const Shader * shader = this->shader != NULL ? this->shader.get() : groupShader;
+    if (dynamic_cast<const MirrorShader *>(shader) != NULL) { bounds.push_back(this->boundingBox()); }
+}
+
+void Surface::buildAccelerationStructures(std::string const&) {}
+
+void Surface::updateBounds() {}
+
+void Surface::selectLevelOfDetail(const Camera &, std::vector<Math::Box> &) {}
+
+void GroupSurface::updateBounds()
+{
+    this->bounds = Math::Box::empty();
+    for (auto & surface : this->surfaces)
+    {
+        surface->updateBounds();
+        this->bounds.expand(surface->boundingBox());
+    }
+}
+
+void GroupSurface::collectMirrorBounds(const Shader * groupShader, std::vector<Math::Box> & bounds) const
+{
+    for (auto & surface : this->surfaces)
+    {
+        surface->collectMirrorBounds(this->shader != NULL ? this->shader.get() : groupShader, bounds);
+    }
+}
+
+void GroupSurface::buildAccelerationStructures(std::string const& cacheDirectory)
+{
+    for (auto & surface : this->surfaces)
+    {
+        surface->buildAccelerationStructures(cacheDirectory);
+    }
+}
+
+void GroupSurface::selectLevelOfDetail(const Camera & camera, std::vector<Math::Box> & changedBounds)
+{
+    for (auto & surface : this->surfaces)
+    {
+        surface->selectLevelOfDetail(camera, changedBounds);
+    }
+}
+
+const Shader * GroupSurface::resolveShader(const Util::HitRecord & hitRecord) const
+{
+    const Shader * surfaceShader = this->surfaces.at(hitRecord.hitObjectIndex)->shader.get();
+    if (surfaceShader == NULL) { return this->shader.get(); } // use the shader of the group surface
+    return surfaceShader;
+}
+
+std::unique_ptr<Surface> Surface::deserialize(Serialization::Reader & reader)
+{
+    std::unique_ptr<Surface> surface;
+    const uint8_t type = reader.readType(SURFACE_TYPE_NAMES, SURFACE_TYPE_COUNT);
+    if (type == SPHERE)
+    {
+        const float radius = reader.readFloat("radius");
+        surface = std::unique_ptr<Surface>(new Sphere(radius, reader.readVector3("center")));
+    }
+    else if (type == TRIANGLE)
+    {
+        const Math::Vector3 vertex1 = reader.readVector3("vertex1");
+        const Math::Vector3 vertex2 = reader.readVector3("vertex2");
+        Triangle * triangle = new Triangle(vertex1, vertex2, reader.readVector3("vertex3"));
+        surface = std::unique_ptr<Surface>(triangle);
+        size_t coordinateCount;
+        std::shared_ptr<const float> textureCoordinates = reader.readFloatArray("textureCoordinates", coordinateCount);
+        if (coordinateCount == 6) { triangle->setTextureCoordinates(textureCoordinates.get()); }
+        else { reader.fail(); }
+    }
+    else if (type == GROUP_SURFACE)
+    {
+        GroupSurface * groupSurface = new GroupSurface();
+        surface = std::unique_ptr<Surface>(groupSurface);
+        reader.beginList("surfaces");
+        while (reader.nextInList())
+        {
+            std::unique_ptr<Surface> child = Surface::deserialize(reader);
+            if (child != NULL) { groupSurface->addSurface(std::move(child)); }
+        }
+    }
+    else if (type == MESH_SURFACE)
+    {
+        size_t positionCount, indexCount;
+        std::shared_ptr<const float> positions = reader.readFloatArray("positions", positionCount);
+        std::shared_ptr<const uint32_t> indices = reader.readUint32Array("indices", indexCount);
+
+        // the arrays are used in place, so this is the only pass over them. an index past the vertices would read
+        // outside of the positions
+        const size_t vertexCount = positionCount / 3;
+        bool valid = reader.isOk() && positionCount % 3 == 0 && indexCount % 3 == 0;
+        for (size_t k = 0; k < indexCount && valid; k++)
+        {
+            valid = indices.get()[k] < vertexCount;
+        }
+        if (valid) { surface = std::unique_ptr<Surface>(new MeshSurface(positions, vertexCount, indices, indexCount / 3)); }
+    }
+    else if (type == LOD_SURFACE)
+    {
+        const float pixelError = reader.readFloat("pixelError");
+        const float hysteresis = reader.readFloat("hysteresis");
+        const uint32_t minTriangleCount = reader.readUint32("minTriangleCount");
+        std::unique_ptr<Surface> mesh = reader.isOk() ? Surface::deserialize(reader) : NULL;
+        if (dynamic_cast<MeshSurface *>(mesh.get()) != NULL && pixelError > 0 && hysteresis >= 0 && hysteresis < 1)
+        {
+            std::unique_ptr<MeshSurface> levelMesh(static_cast<MeshSurface *>(mesh.release()));
+            surface = std::unique_ptr<Surface>(new LodSurface(std::move(levelMesh), pixelError, hysteresis, minTriangleCount));
+        }
+    }
+
+    if (surface == NULL) { reader.fail(); }
+    else { surface->deserializeMaterial(reader); }
+    if (!reader.isOk()) { return NULL; }
+    return surface;
+}
+
+void Surface::serializeMaterial(Serialization::Writer & writer) const
+{
+    // a list of at most one shader, so that a surface without one needs no placeholder in the text format
+    writer.beginList("material", this->shader == NULL ? 0 : 1);
+    if (this->shader != NULL) { this->shader->serialize(writer); }
+    writer.endList();
+}
+
+void Surface::deserializeMaterial(Serialization::Reader & reader)
+{
+    reader.beginList("material");
+    if (!reader.nextInList()) { return; }
+    this->shader = Shader::deserialize(reader);
+    if (reader.nextInList()) { reader.fail(); }
 }
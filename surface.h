@@ -5,16 +5,20 @@
 #include "shader.h"
 #include "util.h"
 #include "hittable.h"
+#include "serialization.h"
+#include "meshBvh.h"
 #include <memory>
 #include <vector>
 
+class Camera;
+
 class Surface : public Renderable
 {
 public:
     void setMaterial(std::unique_ptr<Shader> shader);
 
     virtual Util::Color computeColor(
-        const std::vector<std::unique_ptr<LightSource>> & lightSources,
+        const RenderContext & context,
         Math::Ray viewRay,
         std::shared_ptr<Renderable> surface,
         std::shared_ptr<Util::HitRecord> hitRecord
@@ -23,7 +27,30 @@ public:
     virtual bool hit(Math::Ray ray, float t0, float t1, std::shared_ptr<Util::HitRecord> & hitRecord) const = 0;
     virtual Math::Box boundingBox() const = 0;
 
+    // the shader computeColor would use for a hit already found by hit(). NULL when nothing shades the hit
+    virtual const Shader * resolveShader(const Util::HitRecord & hitRecord) const;
+    // adds the bounds of every surface a MirrorShader shades, for aiming photons at. groupShader is the shader of the
+    // enclosing group, which shades a surface that has none
+    virtual void collectMirrorBounds(const Shader * groupShader, std::vector<Math::Box> & bounds) const;
+
+    // builds whatever speeds up hit() and is not built yet, reusing hierarchies cached in cacheDirectory when it is not
+    // empty. not safe to call while the surface is being hit
+    virtual void buildAccelerationStructures(std::string const& cacheDirectory);
+    // recomputes bounds cached from the surfaces inside, after one of them was moved or reshaped
+    virtual void updateBounds();
+    // picks the levels of detail the camera sees, adding the bounds of every surface whose geometry changed. not safe
+    // to call while the surface is being hit
+    virtual void selectLevelOfDetail(const Camera & camera, std::vector<Math::Box> & changedBounds);
+
+    // writes the surface with its shader and, for groups, every surface in it
+    virtual void serialize(Serialization::Writer & writer) const = 0;
+    static std::unique_ptr<Surface> deserialize(Serialization::Reader & reader); // NULL if the reader does not hold a surface
+
     std::unique_ptr<Shader> shader = NULL;
+
+protected:
+    void serializeMaterial(Serialization::Writer & writer) const;
+    void deserializeMaterial(Serialization::Reader & reader);
 };
 
 class Sphere: public Surface
@@ -41,9 +68,12 @@ public:
 
     bool hit(Math::Ray ray, float t0, float t1, std::shared_ptr<Util::HitRecord> & hitRecord) const;
     Math::Box boundingBox() const;
+    void serialize(Serialization::Writer & writer) const;
 private:
     float radius;
     Math::Vector3 center;
+
+    void computeTextureCoordinates(Util::HitRecord & hitRecord) const;
 };
 
 class Triangle: public Surface
@@ -60,11 +90,16 @@ public:
     Math::Vector3 getUnitNormal() const;
 
     void setVertices(Math::Vector3 vertex1, Math::Vector3 vertex2, Math::Vector3 vertex3);
+    // u, v pairs for the vertices in the order getVertices returns them. they start as 0, 0 and 1, 0 and 0, 1
+    void getTextureCoordinates(float textureCoordinates[6]) const;
+    void setTextureCoordinates(const float textureCoordinates[6]);
 
     bool hit(Math::Ray ray, float t0, float t1, std::shared_ptr<Util::HitRecord> & hitRecord) const;
     Math::Box boundingBox() const;
+    void serialize(Serialization::Writer & writer) const;
 private:
     Math::Vector3 vertex1, vertex2, vertex3;
+    float textureCoordinates[6] = { 0, 0, 1, 0, 0, 1 };
 };
 
 class GroupSurface: public Surface
@@ -74,13 +109,96 @@ public:
 
     void addSurface(std::unique_ptr<Surface> surface);
     
-    Util::Color computeColor(const std::vector<std::unique_ptr<LightSource>> &lightSources, Math::Ray viewRay, std::shared_ptr<Renderable> surface, std::shared_ptr<Util::HitRecord> hitRecord) const;
-    
+    Util::Color computeColor(const RenderContext &context, Math::Ray viewRay, std::shared_ptr<Renderable> surface, std::shared_ptr<Util::HitRecord> hitRecord) const;
+    const Shader * resolveShader(const Util::HitRecord & hitRecord) const;
+    void collectMirrorBounds(const Shader * groupShader, std::vector<Math::Box> & bounds) const;
+    void buildAccelerationStructures(std::string const& cacheDirectory);
+    void updateBounds();
+    void selectLevelOfDetail(const Camera & camera, std::vector<Math::Box> & changedBounds);
+
     bool hit(Math::Ray ray, float t0, float t1, std::shared_ptr<Util::HitRecord> & hitRecord) const;
+    bool hitAny(Math::Ray ray, float t0, float t1) const;
     Math::Box boundingBox() const;
+    void serialize(Serialization::Writer & writer) const;
 private:
     std::vector<std::unique_ptr<Surface>> surfaces;
-    Math::Vector3 minBound, maxBound;
+    Math::Box bounds; // union of the bounding boxes of every surface in the group
+};
+
+// triangles sharing one array of vertex positions, three floats per vertex, and one array of vertex indices, three per
+// counterclockwise triangle. the arrays are shared rather than owned so a mesh read from a mapped file can use it in place
+class MeshSurface: public Surface
+{
+public:
+    MeshSurface(std::vector<Math::Vector3> const& vertices, std::vector<uint32_t> const& indices);
+    MeshSurface(std::shared_ptr<const float> positions, size_t vertexCount, std::shared_ptr<const uint32_t> indices, size_t triangleCount);
+
+    size_t getVertexCount() const;
+    size_t getTriangleCount() const;
+    Math::Vector3 getVertex(size_t vertexIndex) const;
+    void getTriangle(size_t triangleIndex, Math::Vector3 & vertex1, Math::Vector3 & vertex2, Math::Vector3 & vertex3) const;
+    const float * getPositions() const;
+    const uint32_t * getIndices() const;
+    const MeshBvh * getBvh() const; // NULL until buildAccelerationStructures, before which hit() tests every triangle
+
+    // builds the bvh, or maps it from the cache when it was built for the same geometry before
+    void buildAccelerationStructures(std::string const& cacheDirectory);
+
+    // hitObjectIndex is set to the index of the triangle that was hit
+    bool hit(Math::Ray ray, float t0, float t1, std::shared_ptr<Util::HitRecord> & hitRecord) const;
+    bool hitAny(Math::Ray ray, float t0, float t1) const; // walks the bvh in any order and stops at the first triangle hit
+    Math::Box boundingBox() const;
+    void serialize(Serialization::Writer & writer) const;
+private:
+    std::shared_ptr<const float> positions;
+    size_t vertexCount;
+    std::shared_ptr<const uint32_t> indices;
+    size_t triangleCount;
+    Math::Box bounds;
+    std::shared_ptr<const MeshBvh> bvh;
+};
+
+// a mesh that is traced at a coarser level of detail the smaller it looks. buildAccelerationStructures simplifies the
+// mesh with a MeshSimplifier to half its triangles again and again, down to minTriangleCount, and selectLevelOfDetail
+// picks the coarsest level whose error stays under pixelError pixels at the point of the mesh closest to the camera.
+// a finer level is taken as soon as the error goes over that, but a coarser one only once its error is under
+// 1 - hysteresis times it, so that a camera moving back and forth at one distance does not switch levels every frame.
+// the same level answers every ray of a frame, shadow and reflected rays included, so that a ray leaving the surface
+// cannot hit another level of it
+class LodSurface: public Surface
+{
+public:
+    LodSurface(std::unique_ptr<MeshSurface> mesh, float pixelError = 0.5, float hysteresis = 0.25, size_t minTriangleCount = 64);
+
+    float getPixelError() const;
+    float getHysteresis() const;
+    size_t getMinTriangleCount() const;
+    size_t getLevelCount() const; // 1 until buildAccelerationStructures
+    const MeshSurface & getLevel(size_t level) const; // level 0 is the mesh as given
+    float getLevelError(size_t level) const; // how far the level strays from the mesh at worst, in its units
+    size_t getSelectedLevel() const;
+
+    void setPixelError(float pixelError);
+    void setHysteresis(float hysteresis);
+    void selectLevel(size_t level);
+
+    // simplifies the mesh once and builds the bvh of every level
+    void buildAccelerationStructures(std::string const& cacheDirectory);
+    void selectLevelOfDetail(const Camera & camera, std::vector<Math::Box> & changedBounds);
+
+    bool hit(Math::Ray ray, float t0, float t1, std::shared_ptr<Util::HitRecord> & hitRecord) const;
+    bool hitAny(Math::Ray ray, float t0, float t1) const;
+    Math::Box boundingBox() const; // of every level, so that switching levels moves no bounds
+    void serialize(Serialization::Writer & writer) const; // the mesh as given, the levels being built again
+private:
+    std::vector<std::unique_ptr<MeshSurface>> levels;
+    std::vector<float> levelErrors;
+    size_t selectedLevel = 0;
+    float pixelError;
+    float hysteresis;
+    size_t minTriangleCount;
+    bool levelsBuilt = false;
+    Math::Box bounds;
 };
 
 
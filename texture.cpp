@@ -0,0 +1,293 @@
+#include "texture.h"
+#include "serialization.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    const char MAGIC[8] = { 'G', 'E', 'T', 'E', 'X', '\0', '\0', '\0' };
+    const uint32_t VERSION = 1;
+    const size_t HEADER_SIZE = 32;
+    const int MAX_TILE_SIZE = 4096;
+    const int BYTES_PER_TEXEL = 3;
+
+    // the width and height of every level, from the full image down to a single texel
+    void computeLevelSizes(int width, int height, std::vector<std::pair<int, int>> & sizes)
+    {
+        sizes.clear();
+        sizes.push_back({ width, height });
+        while (width > 1 || height > 1)
+        {
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+            sizes.push_back({ width, height });
+        }
+    }
+
+    // the texel x, y of a level with the coordinates clamped to it, three bytes per texel
+    const uint8_t * clampedTexel(std::vector<uint8_t> const& texels, int width, int height, int x, int y)
+    {
+        x = std::min(std::max(x, 0), width - 1);
+        y = std::min(std::max(y, 0), height - 1);
+        return &texels[BYTES_PER_TEXEL * ((size_t) y * width + x)];
+    }
+
+    int wrap(int x, int size)
+    {
+        x %= size;
+        return x < 0 ? x + size : x;
+    }
+}
+
+Texture::Texture(std::string const& filename, std::shared_ptr<TileCache> cache)
+{
+    this->filename = filename;
+    this->cache = cache;
+    this->textureId = cache->registerTexture();
+    this->file = open(filename.c_str(), O_RDONLY);
+    if (this->file < 0) { return; }
+
+    char header[HEADER_SIZE];
+    struct stat status;
+    if (pread(this->file, header, HEADER_SIZE, 0) != (ssize_t) HEADER_SIZE || fstat(this->file, &status) != 0 || std::memcmp(header, MAGIC, sizeof(MAGIC)) != 0)
+    {
+        close(this->file);
+        this->file = -1;
+        return;
+    }
+    Serialization::BinaryReader reader(header, HEADER_SIZE);
+    reader.readBytes(sizeof(MAGIC));
+    const uint32_t version = reader.readUint32("version");
+    const uint32_t width = reader.readUint32("width");
+    const uint32_t height = reader.readUint32("height");
+    const uint32_t tileSize = reader.readUint32("tileSize");
+    const uint32_t levelCount = reader.readUint32("levelCount");
+
+    // the sampling trusts the header, so it has to describe a file as long as this one
+    std::vector<std::pair<int, int>> sizes;
+    const bool sane = reader.isOk() && version == VERSION && width > 0 && height > 0 && width < (1 << 24) && height < (1 << 24) && tileSize > 0 && tileSize <= MAX_TILE_SIZE;
+    if (sane) { computeLevelSizes(width, height, sizes); }
+    uint64_t offset = HEADER_SIZE;
+    for (size_t level = 0; sane && level < sizes.size(); level++)
+    {
+        const int tilesX = (sizes[level].first + tileSize - 1) / tileSize;
+        const int tilesY = (sizes[level].second + tileSize - 1) / tileSize;
+        this->levels.push_back({ sizes[level].first, sizes[level].second, tilesX, tilesY, offset });
+        offset += (uint64_t) tilesX * tilesY * tileSize * tileSize * BYTES_PER_TEXEL;
+    }
+    if (!sane || levelCount != sizes.size() || (uint64_t) status.st_size < offset)
+    {
+        this->levels.clear();
+        close(this->file);
+        this->file = -1;
+        return;
+    }
+    this->tileSize = tileSize;
+}
+
+Texture::~Texture()
+{
+    if (this->file >= 0) { close(this->file); }
+}
+
+bool Texture::isOk() const
+{
+    return this->file >= 0;
+}
+
+std::string Texture::getFilename() const
+{
+    return this->filename;
+}
+
+std::shared_ptr<TileCache> Texture::getCache() const
+{
+    return this->cache;
+}
+
+int Texture::getWidth() const
+{
+    return this->levels.empty() ? 0 : this->levels[0].width;
+}
+
+int Texture::getHeight() const
+{
+    return this->levels.empty() ? 0 : this->levels[0].height;
+}
+
+int Texture::getLevelCount() const
+{
+    return this->levels.size();
+}
+
+int Texture::getTileSize() const
+{
+    return this->tileSize;
+}
+
+void Texture::sample(float u, float v, float footprint, float color[3]) const
+{
+    color[0] = color[1] = color[2] = 0;
+    if (this->levels.empty()) { return; }
+
+    const float texels = footprint * std::max(this->getWidth(), this->getHeight());
+    const float levelOfDetail = std::min(texels > 1 ? std::log2(texels) : 0.0f, (float) this->levels.size() - 1);
+    const int level = (int) levelOfDetail;
+    const float blend = levelOfDetail - level;
+    this->sampleBilinear(level, u, v, color);
+    if (blend <= 0) { return; }
+
+    float coarser[3];
+    this->sampleBilinear(level + 1, u, v, coarser);
+    for (int channel = 0; channel < 3; channel++) { color[channel] += blend * (coarser[channel] - color[channel]); }
+}
+
+Util::Color Texture::sample(float u, float v, float footprint) const
+{
+    float color[3];
+    this->sample(u, v, footprint, color);
+    return {
+        (uint8_t) std::min(255, (int) std::lround(color[0])),
+        (uint8_t) std::min(255, (int) std::lround(color[1])),
+        (uint8_t) std::min(255, (int) std::lround(color[2]))
+    };
+}
+
+Util::Color Texture::getTexel(int level, int x, int y) const
+{
+    const int tileSize = this->tileSize;
+    std::shared_ptr<const TileCache::Tile> tile = this->cache->getTile(this->textureId, level, x / tileSize, y / tileSize, *this);
+    if (tile == NULL) { return { 0, 0, 0 }; }
+    const uint8_t * texel = &(*tile)[BYTES_PER_TEXEL * ((y % tileSize) * tileSize + x % tileSize)];
+    return { texel[0], texel[1], texel[2] };
+}
+
+bool Texture::readTile(int level, uint32_t tileX, uint32_t tileY, TileCache::Tile & tile) const
+{
+    if (this->file < 0 || level < 0 || level >= (int) this->levels.size()) { return false; }
+    const Level & levelInfo = this->levels[level];
+    if ((int) tileX >= levelInfo.tilesX || (int) tileY >= levelInfo.tilesY) { return false; }
+
+    const size_t tileBytes = (size_t) this->tileSize * this->tileSize * BYTES_PER_TEXEL;
+    tile.resize(tileBytes);
+    const uint64_t offset = levelInfo.offset + ((uint64_t) tileY * levelInfo.tilesX + tileX) * tileBytes;
+    size_t done = 0;
+    while (done < tileBytes)
+    {
+        const ssize_t count = pread(this->file, (char *) tile.data() + done, tileBytes - done, offset + done);
+        if (count <= 0) { return false; }
+        done += count;
+    }
+    return true;
+}
+
+// the four texels around u, v, weighted by how close each is. the tile of the last texel is kept, since the four
+// mostly share one and each lookup in the cache takes the lock of a shard
+void Texture::sampleBilinear(int level, float u, float v, float color[3]) const
+{
+    const Level & levelInfo = this->levels[level];
+    const float x = (u - std::floor(u)) * levelInfo.width - 0.5f;
+    const float y = (v - std::floor(v)) * levelInfo.height - 0.5f;
+    const int x0 = (int) std::floor(x), y0 = (int) std::floor(y);
+    const float fractionX = x - x0, fractionY = y - y0;
+
+    const int tileSize = this->tileSize;
+    std::shared_ptr<const TileCache::Tile> tile;
+    int tileX = -1, tileY = -1;
+    color[0] = color[1] = color[2] = 0;
+    for (int corner = 0; corner < 4; corner++)
+    {
+        const int texelX = wrap(x0 + (corner & 1), levelInfo.width);
+        const int texelY = wrap(y0 + (corner >> 1), levelInfo.height);
+        const float weight = ((corner & 1) ? fractionX : 1 - fractionX) * ((corner >> 1) ? fractionY : 1 - fractionY);
+        if (texelX / tileSize != tileX || texelY / tileSize != tileY || tile == NULL)
+        {
+            tileX = texelX / tileSize;
+            tileY = texelY / tileSize;
+            tile = this->cache->getTile(this->textureId, level, tileX, tileY, *this);
+            if (tile == NULL) { continue; }
+        }
+        const uint8_t * texel = &(*tile)[BYTES_PER_TEXEL * ((texelY % tileSize) * tileSize + texelX % tileSize)];
+        color[0] += weight * texel[0];
+        color[1] += weight * texel[1];
+        color[2] += weight * texel[2];
+    }
+}
+
+bool Texture::write(std::string const& filename, int width, int height, std::vector<Util::Color> const& texels, int tileSize)
+{
+    if (width <= 0 || height <= 0 || tileSize <= 0 || tileSize > MAX_TILE_SIZE || texels.size() != (size_t) width * height) { return false; }
+    std::vector<std::pair<int, int>> sizes;
+    computeLevelSizes(width, height, sizes);
+
+    Serialization::BinaryWriter writer;
+    writer.writeBytes(MAGIC, sizeof(MAGIC));
+    writer.writeUint32("version", VERSION);
+    writer.writeUint32("width", width);
+    writer.writeUint32("height", height);
+    writer.writeUint32("tileSize", tileSize);
+    writer.writeUint32("levelCount", sizes.size());
+    writer.writeUint32("reserved", 0);
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    file.write(writer.getBuffer().data(), writer.getBuffer().size());
+
+    std::vector<uint8_t> level(BYTES_PER_TEXEL * texels.size());
+    for (size_t t = 0; t < texels.size(); t++)
+    {
+        level[BYTES_PER_TEXEL * t] = texels[t].red;
+        level[BYTES_PER_TEXEL * t + 1] = texels[t].green;
+        level[BYTES_PER_TEXEL * t + 2] = texels[t].blue;
+    }
+    std::vector<uint8_t> tile((size_t) tileSize * tileSize * BYTES_PER_TEXEL);
+    for (size_t l = 0; l < sizes.size() && file; l++)
+    {
+        const int levelWidth = sizes[l].first, levelHeight = sizes[l].second;
+        if (l > 0)
+        {
+            // odd sizes leave a last row or column that is averaged into the one next to it by clamping
+            const int parentWidth = sizes[l - 1].first, parentHeight = sizes[l - 1].second;
+            std::vector<uint8_t> parent;
+            parent.swap(level);
+            level.resize((size_t) BYTES_PER_TEXEL * levelWidth * levelHeight);
+            for (int y = 0; y < levelHeight; y++)
+            {
+                for (int x = 0; x < levelWidth; x++)
+                {
+                    for (int channel = 0; channel < BYTES_PER_TEXEL; channel++)
+                    {
+                        const int sum = clampedTexel(parent, parentWidth, parentHeight, 2 * x, 2 * y)[channel]
+                            + clampedTexel(parent, parentWidth, parentHeight, 2 * x + 1, 2 * y)[channel]
+                            + clampedTexel(parent, parentWidth, parentHeight, 2 * x, 2 * y + 1)[channel]
+                            + clampedTexel(parent, parentWidth, parentHeight, 2 * x + 1, 2 * y + 1)[channel];
+                        level[BYTES_PER_TEXEL * ((size_t) y * levelWidth + x) + channel] = (uint8_t) ((sum + 2) / 4);
+                    }
+                }
+            }
+        }
+
+        // the tiles over the edge of the level repeat its last row and column
+        const int tilesX = (levelWidth + tileSize - 1) / tileSize, tilesY = (levelHeight + tileSize - 1) / tileSize;
+        for (int tileY = 0; tileY < tilesY; tileY++)
+        {
+            for (int tileX = 0; tileX < tilesX; tileX++)
+            {
+                for (int y = 0; y < tileSize; y++)
+                {
+                    for (int x = 0; x < tileSize; x++)
+                    {
+                        const uint8_t * texel = clampedTexel(level, levelWidth, levelHeight, tileX * tileSize + x, tileY * tileSize + y);
+                        std::memcpy(&tile[BYTES_PER_TEXEL * ((size_t) y * tileSize + x)], texel, BYTES_PER_TEXEL);
+                    }
+                }
+                file.write((const char *) tile.data(), tile.size());
+            }
+        }
+    }
+    file.close();
+    return (bool) file;
+}
@@ -0,0 +1,63 @@
+#ifndef TEXTURE_HEADER
+#define TEXTURE_HEADER
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "util.h"
+#include "tileCache.h"
+
+// an image file made for sampling at any scale from textures bigger than memory. it holds every mip level, each half
+// the size of the one before down to a single texel, cut into square tiles of rgb bytes that lie in the file row by
+// row. a texture keeps only the file open and reads a tile through its TileCache the first time a ray lands on it
+class Texture : public TileCache::Source
+{
+public:
+    // opens filename and reads its tiles through cache. isOk() is false when the file is missing or not a texture
+    Texture(std::string const& filename, std::shared_ptr<TileCache> cache);
+    ~Texture();
+    Texture(Texture const&) = delete;
+    Texture & operator=(Texture const&) = delete;
+
+    bool isOk() const;
+    std::string getFilename() const;
+    std::shared_ptr<TileCache> getCache() const;
+    int getWidth() const;
+    int getHeight() const;
+    int getLevelCount() const;
+    int getTileSize() const;
+
+    // the color around u, v, which repeat over [0, 1) with v = 0 at the top row, averaged over footprint, the width
+    // of what a ray covers there in the same units. the footprint picks the two levels whose texels come closest to
+    // it, and the bilinear samples of both are blended by how close each comes
+    void sample(float u, float v, float footprint, float color[3]) const;
+    Util::Color sample(float u, float v, float footprint) const;
+    // a texel of a level, black when its tile cannot be read
+    Util::Color getTexel(int level, int x, int y) const;
+
+    bool readTile(int level, uint32_t tileX, uint32_t tileY, TileCache::Tile & tile) const;
+
+    // writes width by height texels, the top row first, as a texture file of tileSize by tileSize tiles. every level
+    // averages squares of four texels of the one before. false when the file cannot be written
+    static bool write(std::string const& filename, int width, int height, std::vector<Util::Color> const& texels, int tileSize = 64);
+
+private:
+    struct Level
+    {
+        int width, height;
+        int tilesX, tilesY;
+        uint64_t offset; // where the first tile of the level starts in the file
+    };
+
+    void sampleBilinear(int level, float u, float v, float color[3]) const;
+
+    std::string filename;
+    std::shared_ptr<TileCache> cache;
+    uint32_t textureId = 0;
+    int file = -1;
+    int tileSize = 0;
+    std::vector<Level> levels;
+};
+
+#endif
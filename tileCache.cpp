@@ -0,0 +1,129 @@
+#include "tileCache.h"
+#include <algorithm>
+
+namespace
+{
+    const size_t SHARED_CAPACITY = (size_t) 256 << 20;
+
+    // the finalizer of splitmix64, so that the neighbouring tiles one ray footprint touches land in different shards
+    uint64_t mixKey(uint64_t key)
+    {
+        key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+        return key ^ (key >> 31);
+    }
+}
+
+bool TileCache::Key::operator==(Key const& other) const
+{
+    return this->textureId == other.textureId && this->level == other.level && this->tileX == other.tileX && this->tileY == other.tileY;
+}
+
+size_t TileCache::KeyHash::operator()(Key const& key) const
+{
+    return mixKey((((uint64_t) key.textureId << 32) | (uint32_t) key.level) ^ mixKey(((uint64_t) key.tileY << 32) | key.tileX));
+}
+
+TileCache::TileCache(size_t capacityBytes, int shardCount)
+    : shardCapacity(0), nextTextureId(0)
+{
+    shardCount = std::max(1, shardCount);
+    for (int s = 0; s < shardCount; s++) { this->shards.push_back(std::unique_ptr<Shard>(new Shard())); }
+    this->shardCapacity = capacityBytes / shardCount;
+}
+
+size_t TileCache::getCapacity() const
+{
+    return this->shardCapacity * this->shards.size();
+}
+
+void TileCache::setCapacity(size_t capacityBytes)
+{
+    this->shardCapacity = capacityBytes / this->shards.size();
+    for (auto & shard : this->shards)
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        this->evict(*shard, this->shardCapacity);
+    }
+}
+
+TileCache::Statistics TileCache::getStatistics() const
+{
+    Statistics statistics;
+    for (auto & shard : this->shards)
+    {
+        statistics.hitCount += shard->hitCount;
+        statistics.missCount += shard->missCount;
+        statistics.evictionCount += shard->evictionCount;
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        statistics.residentBytes += shard->bytes;
+    }
+    return statistics;
+}
+
+uint32_t TileCache::registerTexture()
+{
+    return this->nextTextureId++;
+}
+
+std::shared_ptr<const TileCache::Tile> TileCache::getTile(uint32_t textureId, int level, uint32_t tileX, uint32_t tileY, Source const& source)
+{
+    const Key key = { textureId, level, tileX, tileY };
+    Shard & shard = *this->shards[KeyHash()(key) % this->shards.size()];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.index.find(key);
+        if (found != shard.index.end())
+        {
+            shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+            shard.hitCount++;
+            return found->second->tile;
+        }
+    }
+
+    // the file is read without the lock, so that a slow read does not hold up the hits of the other threads
+    shard.missCount++;
+    std::shared_ptr<Tile> tile(new Tile());
+    if (!source.readTile(level, tileX, tileY, *tile)) { return NULL; }
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.index.find(key);
+    if (found != shard.index.end()) { return found->second->tile; } // another thread read it in the meantime
+    shard.entries.push_front({ key, tile });
+    shard.index[key] = shard.entries.begin();
+    shard.bytes += tile->size();
+    this->evict(shard, this->shardCapacity);
+    return tile;
+}
+
+void TileCache::clear()
+{
+    for (auto & shard : this->shards)
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->entries.clear();
+        shard->index.clear();
+        shard->bytes = 0;
+        shard->hitCount = 0;
+        shard->missCount = 0;
+        shard->evictionCount = 0;
+    }
+}
+
+std::shared_ptr<TileCache> TileCache::getShared()
+{
+    static std::shared_ptr<TileCache> cache(new TileCache(SHARED_CAPACITY));
+    return cache;
+}
+
+void TileCache::evict(Shard & shard, size_t capacityBytes)
+{
+    while (shard.bytes > capacityBytes && !shard.entries.empty())
+    {
+        const Entry & entry = shard.entries.back();
+        shard.bytes -= entry.tile->size();
+        shard.index.erase(entry.key);
+        shard.entries.pop_back();
+        shard.evictionCount++;
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef TILE_CACHE_HEADER
+#define TILE_CACHE_HEADER
+
+#include <stdint.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// the tiles of texture files that were read last, up to a fixed number of bytes, so that textures much bigger than
+// memory can be sampled by reading only the tiles the rays land on. the tiles are spread over shards by a hash of
+// their key, each with its own lock and least recently used list, so threads sampling different tiles seldom wait on
+// each other and none waits on a global lock. a tile is handed out as a shared pointer, which keeps it alive for its
+// user after it is evicted
+class TileCache
+{
+public:
+    typedef std::vector<uint8_t> Tile;
+
+    // where the tiles come from on a miss, which is a texture file
+    class Source
+    {
+    public:
+        virtual ~Source() {}
+        // fills tile with the tile at level and tileX, tileY. false when it cannot be read
+        virtual bool readTile(int level, uint32_t tileX, uint32_t tileY, Tile & tile) const = 0;
+    };
+
+    struct Statistics
+    {
+        long hitCount = 0;
+        long missCount = 0; // lookups that had to read their tile, including the reads that failed
+        long evictionCount = 0;
+        size_t residentBytes = 0; // the bytes of the tiles in the cache now
+    };
+
+    // capacityBytes is shared evenly between the shards
+    TileCache(size_t capacityBytes, int shardCount = 16);
+
+    size_t getCapacity() const;
+    // evicts tiles until the cache fits the new capacity
+    void setCapacity(size_t capacityBytes);
+    Statistics getStatistics() const;
+
+    // a number that no other texture using the cache has, for the keys of its tiles
+    uint32_t registerTexture();
+    // the tile of texture textureId at level and tileX, tileY, from the cache or read from source when it is not there.
+    // NULL when the read fails, which is not cached. two threads missing the same tile at once may both read it
+    std::shared_ptr<const Tile> getTile(uint32_t textureId, int level, uint32_t tileX, uint32_t tileY, Source const& source);
+
+    void clear();
+
+    // the cache that textures read from scene files share, 256 mb unless set otherwise
+    static std::shared_ptr<TileCache> getShared();
+
+private:
+    // every field in full, so that no two tiles share a key however many textures and tiles there are
+    struct Key
+    {
+        uint32_t textureId;
+        int level;
+        uint32_t tileX, tileY;
+
+        bool operator==(Key const& other) const;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(Key const& key) const;
+    };
+
+    struct Entry
+    {
+        Key key;
+        std::shared_ptr<const Tile> tile;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::list<Entry> entries; // the most recently used first
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+        size_t bytes = 0;
+        std::atomic<long> hitCount, missCount, evictionCount;
+
+        Shard() : hitCount(0), missCount(0), evictionCount(0) {}
+    };
+
+    void evict(Shard & shard, size_t capacityBytes); // with the lock of shard held
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<size_t> shardCapacity;
+    std::atomic<uint32_t> nextTextureId;
+};
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef TILING_HEADER
+#define TILING_HEADER
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace Util
+{
+    // the pixels in [x0, x1) x [y0, y1)
+    struct PixelRect
+    {
+        int x0, y0, x1, y1;
+
+        int width() const { return this->x1 - this->x0; }
+        int height() const { return this->y1 - this->y0; }
+        int pixelCount() const { return this->width() * this->height(); }
+        bool isEmpty() const { return this->x1 <= this->x0 || this->y1 <= this->y0; }
+        bool contains(int x, int y) const { return x >= this->x0 && x < this->x1 && y >= this->y0 && y < this->y1; }
+    };
+
+    // the pixels in both a and b, empty when they do not overlap
+    inline PixelRect intersect(PixelRect const& a, PixelRect const& b)
+    {
+        return { std::max(a.x0, b.x0), std::max(a.y0, b.y0), std::min(a.x1, b.x1), std::min(a.y1, b.y1) };
+    }
+
+    // the pixels of rect outside cut, as at most four rectangles
+    inline std::vector<PixelRect> subtract(PixelRect const& rect, PixelRect const& cut)
+    {
+        const PixelRect overlap = intersect(rect, cut);
+        if (overlap.isEmpty()) { return { rect }; }
+
+        std::vector<PixelRect> pieces;
+        if (rect.y0 < overlap.y0) { pieces.push_back({ rect.x0, rect.y0, rect.x1, overlap.y0 }); }
+        if (overlap.y1 < rect.y1) { pieces.push_back({ rect.x0, overlap.y1, rect.x1, rect.y1 }); }
+        if (rect.x0 < overlap.x0) { pieces.push_back({ rect.x0, overlap.y0, overlap.x0, overlap.y1 }); }
+        if (overlap.x1 < rect.x1) { pieces.push_back({ overlap.x1, overlap.y0, rect.x1, overlap.y1 }); }
+        return pieces;
+    }
+
+    enum class TileOrder
+    {
+        RowMajor, // left to right, bottom to top
+        Morton, // z-order curve over the tile grid
+        Hilbert // hilbert curve over the tile grid. unlike morton every step goes to a neighbouring tile
+    };
+
+    // interleaves the bits of x and y, x taking the even bits
+    inline uint32_t mortonIndex(uint32_t x, uint32_t y)
+    {
+        auto spread = [](uint32_t a)
+        {
+            a &= 0x0000ffff;
+            a = (a | (a << 8)) & 0x00ff00ff;
+            a = (a | (a << 4)) & 0x0f0f0f0f;
+            a = (a | (a << 2)) & 0x33333333;
+            a = (a | (a << 1)) & 0x55555555;
+            return a;
+        };
+        return spread(x) | (spread(y) << 1);
+    }
+
+    // inverse of mortonIndex
+    inline void mortonPoint(uint32_t index, uint32_t & x, uint32_t & y)
+    {
+        auto compact = [](uint32_t a)
+        {
+            a &= 0x55555555;
+            a = (a | (a >> 1)) & 0x33333333;
+            a = (a | (a >> 2)) & 0x0f0f0f0f;
+            a = (a | (a >> 4)) & 0x00ff00ff;
+            a = (a | (a >> 8)) & 0x0000ffff;
+            return a;
+        };
+        x = compact(index);
+        y = compact(index >> 1);
+    }
+
+    // distance of (x, y) along the hilbert curve filling a size x size grid, size being a power of two
+    inline uint32_t hilbertIndex(uint32_t size, uint32_t x, uint32_t y)
+    {
+        uint32_t index = 0;
+        for (uint32_t s = size / 2; s > 0; s /= 2)
+        {
+            const uint32_t rx = (x & s) > 0;
+            const uint32_t ry = (y & s) > 0;
+            index += s * s * ((3 * rx) ^ ry);
+            if (ry == 0)
+            {
+                if (rx == 1)
+                {
+                    x = s - 1 - x;
+                    y = s - 1 - y;
+                }
+                std::swap(x, y);
+            }
+        }
+        return index;
+    }
+
+    // splits region into tiles of at most tileSize x tileSize pixels, listed in the given order
+    inline std::vector<PixelRect> computeTiles(PixelRect const& region, int tileSize, TileOrder order)
+    {
+        tileSize = std::max(1, tileSize);
+        const int tileCountX = (region.width() + tileSize - 1) / tileSize;
+        const int tileCountY = (region.height() + tileSize - 1) / tileSize;
+        uint32_t gridSize = 1; // power of two side of the square the curves are laid over
+        while ((int) gridSize < std::max(tileCountX, tileCountY)) { gridSize *= 2; }
+
+        std::vector<std::pair<uint64_t, PixelRect>> keyedTiles;
+        for (int ty = 0; ty < tileCountY; ty++)
+        {
+            for (int tx = 0; tx < tileCountX; tx++)
+            {
+                uint64_t key = (uint64_t) ty * tileCountX + tx;
+                if (order == TileOrder::Morton) { key = mortonIndex(tx, ty); }
+                else if (order == TileOrder::Hilbert) { key = hilbertIndex(gridSize, tx, ty); }
+
+                const PixelRect tile = {
+                    region.x0 + tx * tileSize,
+                    region.y0 + ty * tileSize,
+                    std::min(region.x0 + (tx + 1) * tileSize, region.x1),
+                    std::min(region.y0 + (ty + 1) * tileSize, region.y1)
+                };
+                keyedTiles.push_back({ key, tile });
+            }
+        }
+        std::sort(keyedTiles.begin(), keyedTiles.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+
+        std::vector<PixelRect> tiles;
+        for (auto & keyedTile : keyedTiles) { tiles.push_back(keyedTile.second); }
+        return tiles;
+    }
+
+    // splits a whole resolutionX x resolutionY frame
+    inline std::vector<PixelRect> computeTiles(int resolutionX, int resolutionY, int tileSize, TileOrder order)
+    {
+        return computeTiles({ 0, 0, resolutionX, resolutionY }, tileSize, order);
+    }
+
+    // calls body(i, j) for every pixel of rect, following the z-order curve from its bottom left corner
+    template <typename Body>
+    void forEachPixelInZOrder(PixelRect const& rect, Body body)
+    {
+        uint32_t side = 1;
+        while ((int) side < std::max(rect.width(), rect.height())) { side *= 2; }
+
+        uint32_t dx, dy;
+        for (uint32_t index = 0; index < side * side; index++)
+        {
+            mortonPoint(index, dx, dy);
+            if ((int) dx >= rect.width() || (int) dy >= rect.height()) { continue; }
+            body(rect.x0 + (int) dx, rect.y0 + (int) dy);
+        }
+    }
+};
+
+#endif
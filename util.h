@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include "math.h"
 
+class Renderable;
+
 namespace Util
 {
     struct Color
@@ -18,6 +20,10 @@ namespace Util
         Math::Vector3 unitNormal;
         Math::Vector3 intersectionPoint;
         int hitObjectIndex = -1;
+        const Renderable * hitSurface = NULL; // the innermost surface that was hit, never a group
+        float curvature = 0; // how fast the normal turns per distance along the surface, 1 / radius on a sphere
+        float textureU = 0, textureV = 0; // where the hit lies on the texture of the surface, see Texture::sample
+        float textureScale = 0; // how fast textureU and textureV change per distance along the surface
     };
 };
 
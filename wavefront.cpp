@@ -0,0 +1,294 @@
+#include "wavefront.h"
+#include "parallel.h"
+#include "occlusionCache.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    // a path ray that hit something, waiting to be shaded
+    struct PathHit
+    {
+        const Shader * shader;
+        Wavefront::PathRay pathRay;
+        Util::HitRecord hitRecord;
+    };
+
+    // which octant a direction points into. reflection rays are sorted by it so that neighbours in the queue travel
+    // through the same parts of the scene
+    int directionOctant(Math::Vector3 const& direction)
+    {
+        return (direction.getX() < 0 ? 1 : 0) | (direction.getY() < 0 ? 2 : 0) | (direction.getZ() < 0 ? 4 : 0);
+    }
+}
+
+WavefrontRenderer::WavefrontRenderer()
+{
+    this->threadCount = Util::defaultThreadCount();
+}
+
+WavefrontRenderer::WavefrontRenderer(int threadCount)
+{
+    this->setThreadCount(threadCount);
+}
+
+int WavefrontRenderer::getThreadCount() const
+{
+    return this->threadCount;
+}
+
+int WavefrontRenderer::getBatchSize() const
+{
+    return this->batchSize;
+}
+
+int WavefrontRenderer::getMaxDepth() const
+{
+    return this->maxDepth;
+}
+
+int WavefrontRenderer::getTileSize() const
+{
+    return this->tileSize;
+}
+
+Util::TileOrder WavefrontRenderer::getTileOrder() const
+{
+    return this->tileOrder;
+}
+
+int WavefrontRenderer::getWaveSize() const
+{
+    return this->waveSize;
+}
+
+void WavefrontRenderer::setThreadCount(int threadCount)
+{
+    this->threadCount = std::max(1, threadCount);
+}
+
+void WavefrontRenderer::setBatchSize(int batchSize)
+{
+    this->batchSize = std::max(1, batchSize);
+}
+
+void WavefrontRenderer::setMaxDepth(int maxDepth)
+{
+    this->maxDepth = maxDepth;
+}
+
+void WavefrontRenderer::setTileSize(int tileSize)
+{
+    this->tileSize = std::max(1, tileSize);
+}
+
+void WavefrontRenderer::setTileOrder(Util::TileOrder tileOrder)
+{
+    this->tileOrder = tileOrder;
+}
+
+void WavefrontRenderer::setWaveSize(int waveSize)
+{
+    this->waveSize = std::max(1, waveSize);
+}
+
+void WavefrontRenderer::render(const Camera & camera, std::shared_ptr<Surface> surface, const RenderContext & context, std::vector<Util::Color> & colors, std::vector<bool> & hits) const
+{
+    this->render(camera, surface, context, { 0, 0, camera.getResolutionX(), camera.getResolutionY() }, colors, hits);
+}
+
+void WavefrontRenderer::render(const Camera & camera, std::shared_ptr<Surface> surface, const RenderContext & context, Util::PixelRect const& region, std::vector<Util::Color> & colors, std::vector<bool> & hits) const
+{
+    const int pixelCount = region.pixelCount();
+    std::vector<float> radiance(3 * pixelCount, 0);
+    hits.assign(pixelCount, false);
+
+    const std::vector<Util::PixelRect> tiles = Util::computeTiles(region, this->tileSize, this->tileOrder);
+    std::vector<size_t> firstPathRays(tiles.size() + 1, 0);
+    for (size_t t = 0; t < tiles.size(); t++)
+    {
+        firstPathRays[t + 1] = firstPathRays[t] + tiles[t].pixelCount();
+    }
+
+    // every thread shades and tests shadow rays with its own context so that it can own its occlusion cache
+    std::vector<OcclusionCache> threadOcclusionCaches(this->threadCount);
+    std::vector<ShadowRayStatistics> threadShadowRayStatistics(this->threadCount);
+    std::vector<RenderContext> threadContexts(this->threadCount, context);
+    for (int t = 0; t < this->threadCount; t++)
+    {
+        if (context.occlusionCache != NULL) { threadContexts[t].occlusionCache = &threadOcclusionCaches[t]; }
+        if (context.shadowRayStatistics != NULL) { threadContexts[t].shadowRayStatistics = &threadShadowRayStatistics[t]; }
+    }
+
+    // the queues are kept from one wave and bounce to the next, so after the first wave they allocate nothing
+    std::vector<Wavefront::PathRay> pathRays;
+    std::vector<std::vector<PathHit>> threadHits(this->threadCount);
+    std::vector<Wavefront::RayQueues> threadQueues(this->threadCount);
+    std::vector<PathHit> pathHits;
+    std::vector<uint32_t> shadingOrder;
+    std::vector<Wavefront::ShadowRay> shadowRays;
+
+    auto addContributions = [&](std::vector<Wavefront::Contribution> const& newContributions)
+    {
+        for (auto & contribution : newContributions)
+        {
+            radiance[3 * contribution.pixelIndex] += contribution.red;
+            radiance[3 * contribution.pixelIndex + 1] += contribution.green;
+            radiance[3 * contribution.pixelIndex + 2] += contribution.blue;
+        }
+    };
+
+    for (size_t firstTile = 0, lastTile; firstTile < tiles.size(); firstTile = lastTile)
+    {
+        // a wave is the run of whole tiles that fits in waveSize pixels, or a single tile bigger than that
+        lastTile = firstTile + 1;
+        while (lastTile < tiles.size() && firstPathRays[lastTile + 1] - firstPathRays[firstTile] <= (size_t) this->waveSize) { lastTile++; }
+
+        // primary stage: one view ray per pixel, queued tile by tile and in z-order inside each tile so that
+        // neighbouring rays in the queue also travel through neighbouring parts of the scene
+        pathRays.resize(firstPathRays[lastTile] - firstPathRays[firstTile]);
+        Util::parallelFor(lastTile - firstTile, 1, this->threadCount, [&](size_t begin, size_t end, int)
+        {
+            std::vector<Math::Ray> tileRays;
+            for (size_t t = firstTile + begin; t < firstTile + end; t++)
+            {
+                const Util::PixelRect & tile = tiles[t];
+                tileRays.resize(tile.pixelCount());
+                camera.computeViewingRays(tile.x0, tile.y0, tile.x1, tile.y1, tileRays.data());
+                size_t p = firstPathRays[t] - firstPathRays[firstTile];
+                Util::forEachPixelInZOrder(tile, [&](int i, int j)
+                {
+                    pathRays[p] = Wavefront::PathRay();
+                    pathRays[p].ray = tileRays[(j - tile.y0) * tile.width() + (i - tile.x0)];
+                    pathRays[p].pixelIndex = (j - region.y0) * region.width() + (i - region.x0);
+                    pathRays[p].differential = context.rayDifferential;
+                    p++;
+                });
+            }
+        });
+
+        while (!pathRays.empty())
+        {
+            // intersection stage
+            for (auto & queues : threadQueues) { queues.clear(); }
+            for (auto & pathHitsOfThread : threadHits) { pathHitsOfThread.clear(); }
+            Util::parallelFor(pathRays.size(), this->batchSize, this->threadCount, [&](size_t begin, size_t end, int threadIndex)
+            {
+                std::shared_ptr<Util::HitRecord> hitRecord(new Util::HitRecord);
+                for (size_t k = begin; k < end; k++)
+                {
+                    const Wavefront::PathRay & pathRay = pathRays[k];
+                    *hitRecord = Util::HitRecord();
+                    if (!surface->hit(pathRay.ray, 0, std::numeric_limits<float>::max(), hitRecord))
+                    {
+                        if (pathRay.depth > 0)
+                        {
+                            threadQueues[threadIndex].contributions.push_back({
+                                pathRay.pixelIndex,
+                                pathRay.weight * pathRay.missColor.red,
+                                pathRay.weight * pathRay.missColor.green,
+                                pathRay.weight * pathRay.missColor.blue
+                            });
+                        }
+                        continue;
+                    }
+                    threadHits[threadIndex].push_back({ surface->resolveShader(*hitRecord), pathRay, *hitRecord });
+                }
+            });
+
+            pathHits.clear();
+            for (int t = 0; t < this->threadCount; t++)
+            {
+                pathHits.insert(pathHits.end(), threadHits[t].begin(), threadHits[t].end());
+                addContributions(threadQueues[t].contributions);
+            }
+            for (auto & pathHit : pathHits)
+            {
+                if (pathHit.pathRay.depth == 0) { hits[pathHit.pathRay.pixelIndex] = true; }
+            }
+
+            // shading stage. sorting by shader keeps each thread inside one shader for long runs of hits. the hits are
+            // large, so their indices are sorted instead of the hits
+            shadingOrder.resize(pathHits.size());
+            for (size_t k = 0; k < pathHits.size(); k++) { shadingOrder[k] = k; }
+            std::stable_sort(shadingOrder.begin(), shadingOrder.end(), [&](uint32_t lhs, uint32_t rhs) { return pathHits[lhs].shader < pathHits[rhs].shader; });
+            for (auto & queues : threadQueues) { queues.clear(); }
+            Util::parallelFor(pathHits.size(), this->batchSize, this->threadCount, [&](size_t begin, size_t end, int threadIndex)
+            {
+                for (size_t k = begin; k < end; k++)
+                {
+                    const PathHit & pathHit = pathHits[shadingOrder[k]];
+                    if (pathHit.shader == NULL) { continue; } // an unshaded hit displays black
+                    // key the random numbers of the shader by the frame pixel, as the recursive path does
+                    const int regionPixelIndex = pathHit.pathRay.pixelIndex;
+                    threadContexts[threadIndex].pixelIndex = (region.y0 + regionPixelIndex / region.width()) * camera.getResolutionX() + region.x0 + regionPixelIndex % region.width();
+                    threadContexts[threadIndex].bounce = pathHit.pathRay.depth;
+                    threadContexts[threadIndex].rayDifferential = pathHit.pathRay.differential;
+                    pathHit.shader->emitRays(threadContexts[threadIndex], surface, pathHit.pathRay, pathHit.hitRecord, threadQueues[threadIndex]);
+                }
+            });
+
+            shadowRays.clear();
+            pathRays.clear();
+            for (int t = 0; t < this->threadCount; t++)
+            {
+                shadowRays.insert(shadowRays.end(), threadQueues[t].shadowRays.begin(), threadQueues[t].shadowRays.end());
+                pathRays.insert(pathRays.end(), threadQueues[t].pathRays.begin(), threadQueues[t].pathRays.end());
+                addContributions(threadQueues[t].contributions);
+            }
+
+            // shadow stage. rays toward the same light are kept together since they tend to hit the same occluders
+            std::stable_sort(shadowRays.begin(), shadowRays.end(), [](Wavefront::ShadowRay const& lhs, Wavefront::ShadowRay const& rhs) { return lhs.lightIndex < rhs.lightIndex; });
+            for (auto & queues : threadQueues) { queues.clear(); }
+            Util::parallelFor(shadowRays.size(), this->batchSize, this->threadCount, [&](size_t begin, size_t end, int threadIndex)
+            {
+                for (size_t k = begin; k < end; k++)
+                {
+                    const Wavefront::ShadowRay & shadowRay = shadowRays[k];
+                    if (threadContexts[threadIndex].isOccluded(shadowRay.lightIndex, *surface, shadowRay.ray, shadowRay.t0, shadowRay.t1)) { continue; }
+                    threadQueues[threadIndex].contributions.push_back({ shadowRay.pixelIndex, shadowRay.red, shadowRay.green, shadowRay.blue });
+                }
+            });
+            for (int t = 0; t < this->threadCount; t++)
+            {
+                addContributions(threadQueues[t].contributions);
+            }
+
+            // the reflection rays emitted while shading become the next path queue
+            pathRays.erase(
+                std::remove_if(pathRays.begin(), pathRays.end(), [&](Wavefront::PathRay const& pathRay) { return pathRay.depth > this->maxDepth; }),
+                pathRays.end()
+            );
+            std::stable_sort(pathRays.begin(), pathRays.end(), [](Wavefront::PathRay const& lhs, Wavefront::PathRay const& rhs)
+            {
+                return directionOctant(lhs.ray.direction) < directionOctant(rhs.ray.direction);
+            });
+        }
+    }
+
+    if (context.occlusionCache != NULL)
+    {
+        for (auto & occlusionCache : threadOcclusionCaches)
+        {
+            context.occlusionCache->addStatistics(occlusionCache.getStatistics());
+        }
+    }
+    if (context.shadowRayStatistics != NULL)
+    {
+        for (auto & shadowRayStatistics : threadShadowRayStatistics)
+        {
+            context.shadowRayStatistics->add(shadowRayStatistics);
+        }
+    }
+
+    colors.resize(pixelCount);
+    for (int p = 0; p < pixelCount; p++)
+    {
+        colors[p] = {
+            (uint8_t) std::min(255, (int) std::floor(radiance[3 * p])),
+            (uint8_t) std::min(255, (int) std::floor(radiance[3 * p + 1])),
+            (uint8_t) std::min(255, (int) std::floor(radiance[3 * p + 2]))
+        };
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef WAVEFRONT_HEADER
+#define WAVEFRONT_HEADER
+
+#include <memory>
+#include <vector>
+#include "util.h"
+#include "camera.h"
+#include "surface.h"
+#include "renderContext.h"
+#include "rayQueue.h"
+#include "tiling.h"
+
+// renders a frame in stages instead of one pixel at a time. the view rays of a wave of tiles go into one queue, and
+// every stage (intersection, shading, shadow testing) runs over its whole queue in batches spread across threads.
+// reflection rays come back around as the next path queue, so deep reflections never grow the call stack. once a
+// wave has no rays left the next one is queued, so the queues stay a bounded size and are reused instead of holding
+// every ray of the frame at once
+class WavefrontRenderer
+{
+public:
+    WavefrontRenderer();
+    WavefrontRenderer(int threadCount);
+
+    int getThreadCount() const;
+    int getBatchSize() const;
+    int getMaxDepth() const;
+    int getTileSize() const;
+    Util::TileOrder getTileOrder() const;
+    int getWaveSize() const;
+
+    void setThreadCount(int threadCount);
+    void setBatchSize(int batchSize);
+    void setMaxDepth(int maxDepth); // reflection rays deeper than this are dropped
+    void setTileSize(int tileSize); // view rays are queued tile by tile, see Scene::setTileSize
+    void setTileOrder(Util::TileOrder tileOrder);
+    void setWaveSize(int waveSize); // the pixels whose view rays are queued together, rounded to whole tiles
+
+    // fills colors and hits in row major order with (0, 0) at the bottom left. hits is false where the view ray missed
+    void render(
+        const Camera & camera,
+        std::shared_ptr<Surface> surface,
+        const RenderContext & context,
+        std::vector<Util::Color> & colors,
+        std::vector<bool> & hits
+    ) const;
+    // renders only the pixels in region. colors and hits are laid out over region alone, row by row
+    void render(
+        const Camera & camera,
+        std::shared_ptr<Surface> surface,
+        const RenderContext & context,
+        Util::PixelRect const& region,
+        std::vector<Util::Color> & colors,
+        std::vector<bool> & hits
+    ) const;
+
+private:
+    int threadCount;
+    int batchSize = 4096;
+    int maxDepth = 16;
+    int tileSize = 32;
+    Util::TileOrder tileOrder = Util::TileOrder::Hilbert;
+    int waveSize = 1 << 16;
+};
+
+#endif